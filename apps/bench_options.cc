@@ -0,0 +1,114 @@
+#include "bench_options.hh"
+
+#include <iomanip>
+#include <iostream>
+#include <utility>
+
+using namespace std;
+
+//! Width of an option and its value in the usage message, after the indent
+static constexpr int OPTION_WIDTH = 18;
+
+BenchOptions::BenchOptions(const string &summary) : _summary(summary) {}
+
+void BenchOptions::add_option(const char letter,
+                              const string &value_name,
+                              const string &description,
+                              function<void(const char *value)> set) {
+    _options.push_back({letter, value_name, description, move(set)});
+}
+
+void BenchOptions::show_usage() const {
+    cerr << "Usage: " << _program << " [options]\n\n";
+    if (not _summary.empty()) {
+        cerr << _summary << " Options:\n\n";
+    }
+    const auto line = [](const string &option, const string &description) {
+        cerr << "   " << left << setw(OPTION_WIDTH) << option;
+        for (const char c : description) {
+            cerr << c;
+            if (c == '\n') {
+                cerr << string(3 + OPTION_WIDTH, ' ');
+            }
+        }
+        cerr << "\n";
+    };
+    for (const Option &option : _options) {
+        line(string("-") + option.letter + " <" + option.value_name + ">", option.description);
+    }
+    line("-f <format>", "Output format: text, csv or json (default text)");
+    line("-h", "Show this message");
+    cerr << "\n";
+}
+
+void BenchOptions::fail(const string &message) const {
+    cerr << "ERROR: " << message << "\n";
+    show_usage();
+    exit(EXIT_FAILURE);
+}
+
+//! \param[in] argc is the number of arguments, including the program's name
+//! \param[in] argv is the arguments, as passed to main()
+void BenchOptions::parse(const int argc, char **argv) {
+    if (argc <= 0) {
+        abort();  // For sticklers: don't try to access argv[0] if argc <= 0.
+    }
+    _program = argv[0];
+
+    for (int curr = 1; curr < argc; curr += 2) {
+        const string option = argv[curr];
+        if (option == "-h" or curr + 1 >= argc) {
+            show_usage();
+            exit(option == "-h" ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        const char *const value = argv[curr + 1];
+        if (option == "-f") {
+            _format = value;
+            continue;
+        }
+        bool found = false;
+        for (const Option &known : _options) {
+            if (option.size() == 2 and option[0] == '-' and option[1] == known.letter) {
+                known.set(value);
+                found = true;
+                break;
+            }
+        }
+        if (not found) {
+            fail("unrecognized option " + option);
+        }
+    }
+
+    if (_format != "text" and _format != "csv" and _format != "json") {
+        fail("bad option value");
+    }
+}
+
+void BenchOutput::record(const vector<Field> &fields) {
+    if (_format == "csv") {
+        if (_first) {
+            for (size_t i = 0; i < fields.size(); i++) {
+                cout << (i > 0 ? "," : "") << fields[i].name;
+            }
+            cout << "\n";
+        }
+        for (size_t i = 0; i < fields.size(); i++) {
+            cout << (i > 0 ? "," : "") << fields[i].value;
+        }
+        cout << "\n";
+    } else if (_format == "json") {
+        cout << (_first ? "[\n" : ",\n") << "  {";
+        for (size_t i = 0; i < fields.size(); i++) {
+            const char *const quote = fields[i].quoted ? "\"" : "";
+            cout << (i > 0 ? ", " : "") << '"' << fields[i].name << "\": " << quote << fields[i].value << quote;
+        }
+        cout << "}";
+    }
+    _first = false;
+}
+
+void BenchOutput::finish() {
+    if (_format == "json") {
+        cout << (_first ? "[]\n" : "\n]\n");
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef SPONGE_APPS_BENCH_OPTIONS_HH
+#define SPONGE_APPS_BENCH_OPTIONS_HH
+
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//! \brief The command line of a benchmark: `-<letter> <value>` options, plus `-f text|csv|json` and `-h`
+//! \details Each option sets a variable, which must outlive parse().
+class BenchOptions {
+  private:
+    struct Option {
+        char letter;                                 //!< Follows the `-`
+        std::string value_name;                      //!< What the value is, for the usage message
+        std::string description;                     //!< For the usage message; each `\n` starts an indented line
+        std::function<void(const char *value)> set;  //!< Stores the value
+    };
+
+    std::string _summary;            //!< What the benchmark does, for the usage message
+    std::vector<Option> _options{};  //!< The options, in the order they were added
+    std::string _program{};          //!< `argv[0]`, once parse() has been called
+    std::string _format{"text"};     //!< Set by `-f`
+
+    //! Add an option, with the function that stores its value
+    void add_option(const char letter,
+                    const std::string &value_name,
+                    const std::string &description,
+                    std::function<void(const char *value)> set);
+
+  public:
+    //! \param[in] summary says what the benchmark does, ahead of the options in the usage message
+    explicit BenchOptions(const std::string &summary = {});
+
+    //! Add an option that sets `target` (a number, or a std::string) to its value
+    template <typename T>
+    void add(const char letter, const std::string &value_name, const std::string &description, T &target) {
+        add_option(letter, value_name, description, [&target](const char *value) {
+            if constexpr (std::is_same_v<T, std::string>) {
+                target = value;
+            } else if constexpr (std::is_floating_point_v<T>) {
+                target = T(strtod(value, nullptr));
+            } else {
+                target = T(strtoull(value, nullptr, 0));
+            }
+        });
+    }
+
+    //! \brief Set the options' variables from the command line
+    //! \details Exits after printing the usage message, successfully for `-h`, and with an error for an
+    //! unrecognized option, a missing value or an unknown format.
+    void parse(const int argc, char **argv);
+
+    //! Print `message` and the usage message, and exit with an error (for an option value that doesn't make sense)
+    [[noreturn]] void fail(const std::string &message) const;
+
+    //! Print the usage message to stderr
+    void show_usage() const;
+
+    //! The output format chosen with `-f`: "text", "csv" or "json"
+    const std::string &format() const { return _format; }
+};
+
+//! \brief Prints a benchmark's results as CSV (after a header line) or as a JSON array, one record at a time
+//! \details In the text format nothing is printed, as each benchmark lays out its own text.
+class BenchOutput {
+  public:
+    //! A named value in a record
+    struct Field {
+        std::string name;   //!< Column of the CSV, or key in the JSON
+        std::string value;  //!< As printed
+        bool quoted;        //!< Whether JSON needs the value in quotes
+
+        //! A string value
+        Field(const std::string &n, const std::string &v) : name(n), value(v), quoted(true) {}
+
+        //! A numeric value, printed as std::ostream would
+        template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+        Field(const std::string &n, const T v) : name(n), value(), quoted(false) {
+            std::ostringstream out;
+            out << v;
+            value = out.str();
+        }
+    };
+
+  private:
+    std::string _format;  //!< "text", "csv" or "json"
+    bool _first{true};    //!< Whether no record has been printed yet
+
+  public:
+    //! \param[in] format is BenchOptions::format()
+    explicit BenchOutput(const std::string &format) : _format(format) {}
+
+    //! Whether the results are to be printed as text, by the benchmark itself
+    bool text() const { return _format == "text"; }
+
+    //! Print a record (every record must have the same fields, in the same order)
+    void record(const std::vector<Field> &fields);
+
+    //! End the output (closing the JSON array)
+    void finish();
+};
+
+#endif  // SPONGE_APPS_BENCH_OPTIONS_HH
@@ -1,86 +1,117 @@
 #include "bidirectional_stream_copy.hh"
 
-#include "byte_stream.hh"
+#include "buffer.hh"
 #include "eventloop.hh"
+#include "util.hh"
 
 #include <algorithm>
+#include <fcntl.h>
+#include <functional>
 #include <iostream>
+#include <optional>
 #include <unistd.h>
+#include <utility>
 
 using namespace std;
 
-void bidirectional_stream_copy(Socket &socket) {
-    constexpr size_t max_copy_length = 65536;
-    constexpr size_t buffer_size = 1048576;
+namespace {
+
+constexpr size_t max_copy_length = 65536;
+constexpr size_t buffer_size = 1048576;
+
+//! \brief Copies one direction of the stream, from `source` to `sink`, until `source` ends
+//! \details If both descriptors are spliceable(), the bytes move through a pipe with
+//! [splice(2)](\ref man2::splice) and never enter userspace. Otherwise each read is queued as a Buffer,
+//! and the queue is written out with [writev(2)](\ref man2::writev), so the bytes are copied out of the
+//! kernel once and not again.
+class OneWayCopy {
+  private:
+    FileDescriptor &_source;
+    FileDescriptor &_sink;
+    function<void()> _finish;                                //!< Ends the sink's stream, once everything is copied
+    optional<pair<FileDescriptor, FileDescriptor>> _pipe{};  //!< Read and write ends of the pipe, if splicing
+    size_t _capacity{buffer_size};                           //!< Most bytes held between source and sink
+    BufferList _queue{};                                     //!< Bytes read and not yet written, if not splicing
+    size_t _held{0};                                         //!< Bytes in the pipe or the queue
+    bool _ended{false};                                      //!< Has the source ended (or failed)?
+    bool _finished{false};                                   //!< Has _finish been called?
+
+    void read() {
+        if (_pipe) {
+            _held += _source.splice_to(_pipe->second, _capacity - _held);
+        } else {
+            string data = _source.read(min(max_copy_length, _capacity - _held));
+            _held += data.size();
+            _queue.append(BufferList{move(data)});
+        }
+        _ended = _source.eof();
+    }
 
+    void write() {
+        if (_held > 0) {
+            if (_pipe) {
+                _held -= _pipe->first.splice_to(_sink, _held);
+            } else {
+                const size_t written = _sink.write(_queue, false);
+                _queue.remove_prefix(written);
+                _held -= written;
+            }
+        }
+        if (_ended and _held == 0) {
+            _finish();
+            _finished = true;
+        }
+    }
+
+  public:
+    OneWayCopy(FileDescriptor &source, FileDescriptor &sink, function<void()> finish)
+        : _source(source), _sink(sink), _finish(move(finish)) {
+        if (not source.spliceable() or not sink.spliceable()) {
+            return;
+        }
+        int fds[2];
+        SystemCall("pipe2", ::pipe2(static_cast<int *>(fds), O_NONBLOCK | O_CLOEXEC));
+        _pipe.emplace(FileDescriptor{fds[0]}, FileDescriptor{fds[1]});
+        ::fcntl(fds[0], F_SETPIPE_SZ, buffer_size);  // best effort: more than pipe-max-size needs privileges
+        _capacity = SystemCall("fcntl", ::fcntl(fds[0], F_GETPIPE_SZ));
+    }
+
+    //! Add the rules that copy this direction to `eventloop`
+    void add_rules(EventLoop &eventloop) {
+        eventloop.add_rule(
+            _source,
+            Direction::In,
+            [&] { read(); },
+            [&] { return not _ended and _held < _capacity; },
+            [&] { _ended = true; });
+
+        eventloop.add_rule(
+            _sink,
+            Direction::Out,
+            [&] { write(); },
+            [&] { return _held > 0 or (_ended and not _finished); },
+            [&] { _ended = true; });
+    }
+};
+
+}  // namespace
+
+void bidirectional_stream_copy(Socket &socket) {
     EventLoop _eventloop{};
     FileDescriptor _input{STDIN_FILENO};
     FileDescriptor _output{STDOUT_FILENO};
-    ByteStream _outbound{buffer_size};
-    ByteStream _inbound{buffer_size};
-    bool _outbound_shutdown{false};
-    bool _inbound_shutdown{false};
 
     socket.set_blocking(false);
     _input.set_blocking(false);
     _output.set_blocking(false);
 
-    // rule 1: read from stdin into outbound byte stream
-    _eventloop.add_rule(
-        _input,
-        Direction::In,
-        [&] {
-            _outbound.write(_input.read(_outbound.remaining_capacity()));
-            if (_input.eof()) {
-                _outbound.end_input();
-            }
-        },
-        [&] { return (not _outbound.error()) and (_outbound.remaining_capacity() > 0) and (not _inbound.error()); },
-        [&] { _outbound.end_input(); });
-
-    // rule 2: read from outbound byte stream into socket
-    _eventloop.add_rule(socket,
-                        Direction::Out,
-                        [&] {
-                            const size_t bytes_to_write = min(max_copy_length, _outbound.buffer_size());
-                            const size_t bytes_written = socket.write(_outbound.peek_output(bytes_to_write), false);
-                            _outbound.pop_output(bytes_written);
-                            if (_outbound.eof()) {
-                                socket.shutdown(SHUT_WR);
-                                _outbound_shutdown = true;
-                            }
-                        },
-                        [&] { return (not _outbound.buffer_empty()) or (_outbound.eof() and not _outbound_shutdown); },
-                        [&] { _outbound.end_input(); });
-
-    // rule 3: read from socket into inbound byte stream
-    _eventloop.add_rule(
-        socket,
-        Direction::In,
-        [&] {
-            _inbound.write(socket.read(_inbound.remaining_capacity()));
-            if (socket.eof()) {
-                _inbound.end_input();
-            }
-        },
-        [&] { return (not _inbound.error()) and (_inbound.remaining_capacity() > 0) and (not _outbound.error()); },
-        [&] { _inbound.end_input(); });
-
-    // rule 4: read from inbound byte stream into stdout
-    _eventloop.add_rule(_output,
-                        Direction::Out,
-                        [&] {
-                            const size_t bytes_to_write = min(max_copy_length, _inbound.buffer_size());
-                            const size_t bytes_written = _output.write(_inbound.peek_output(bytes_to_write), false);
-                            _inbound.pop_output(bytes_written);
-
-                            if (_inbound.eof()) {
-                                _output.close();
-                                _inbound_shutdown = true;
-                            }
-                        },
-                        [&] { return (not _inbound.buffer_empty()) or (_inbound.eof() and not _inbound_shutdown); },
-                        [&] { _inbound.end_input(); });
+    // rules 1 and 2: from stdin to the socket, then shut down the socket's outbound direction
+    OneWayCopy outbound{_input, socket, [&] { socket.shutdown(SHUT_WR); }};
+    outbound.add_rules(_eventloop);
+
+    // rules 3 and 4: from the socket to stdout, then close stdout
+    OneWayCopy inbound{socket, _output, [&] { _output.close(); }};
+    inbound.add_rules(_eventloop);
 
     // loop until completion
     while (true) {
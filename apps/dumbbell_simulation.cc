@@ -0,0 +1,237 @@
+#include "simulated_nodes.hh"
+#include "simulator.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+//! The scenario to simulate, from the command line
+struct Options {
+    size_t flows = 100;              //!< Number of client/server pairs
+    size_t bytes = 100000;           //!< Bytes each client sends
+    uint64_t bottleneck_mbps = 100;  //!< Rate of the link between the routers
+    uint64_t access_mbps = 1000;     //!< Rate of the links between the hosts and the routers
+    uint64_t delay_ms = 10;          //!< One-way propagation delay of the link between the routers
+    size_t queue_bytes = 125000;     //!< Queue limit of every link
+    string queue = "droptail";       //!< Queueing discipline of every link: droptail or red
+    double loss = 0;                 //!< Probability that a packet is lost on the link between the routers
+    uint64_t seed = 1;               //!< Seed of the simulation's random decisions
+    uint64_t time_limit_s = 3600;    //!< Simulated seconds after which to give up
+};
+
+//! A client on the left of the dumbbell sending to a server on the right
+struct Flow {
+    TCPHostNode &client;
+    TCPHostNode &server;
+    Address server_address;            //!< The server's IP address and port
+    size_t unsent;                     //!< Bytes the client has yet to write
+    size_t received{0};                //!< Bytes the server has read
+    optional<uint64_t> finished_ns{};  //!< When the server read the end of the stream
+};
+
+//! Ethernet address number `n` of the left (`side` 1) or right (`side` 2) of the dumbbell
+static EthernetAddress ethernet_address(const uint8_t side, const uint32_t n) {
+    return {0x02, side, uint8_t(n >> 24), uint8_t(n >> 16), uint8_t(n >> 8), uint8_t(n)};
+}
+
+static void simulate(const Options &options) {
+    Simulator simulator{options.seed};
+    LinkConfig access;
+    access.bits_per_second = options.access_mbps * 1000000;
+    access.queue_limit = options.queue_bytes;
+    access.queue = options.queue == "red" ? LinkConfig::Queue::RED : LinkConfig::Queue::DropTail;
+    LinkConfig bottleneck = access;
+    bottleneck.bits_per_second = options.bottleneck_mbps * 1000000;
+    bottleneck.delay_ns = options.delay_ms * 1000000;
+    bottleneck.loss = options.loss;
+
+    // the interfaces log their addresses, and Router::add_route each route
+    auto *const log = cerr.rdbuf(nullptr);
+
+    // clients are 10.1.0.2 onwards, servers 10.2.0.2 onwards, and each router is .1 on every access link
+    const uint32_t clients = Address{"10.1.0.0"}.ipv4_numeric(), servers = Address{"10.2.0.0"}.ipv4_numeric();
+    auto &left = simulator.add<RouterNode>();
+    auto &right = simulator.add<RouterNode>();
+    left.add_interface(ethernet_address(1, 0), Address{"10.0.0.1"});
+    right.add_interface(ethernet_address(2, 0), Address{"10.0.0.2"});
+    left.add_route(servers, 16, Address{"10.0.0.2"}, 0);
+    right.add_route(clients, 16, Address{"10.0.0.1"}, 0);
+    const auto [left_to_right, right_to_left] = connect(simulator, left, 0, right, 0, bottleneck);
+
+    const TCPConfig config;
+    vector<Flow> flows;
+    for (uint32_t i = 1; i <= options.flows; i++) {
+        const Address client_ip = Address::from_ipv4_numeric(clients + i + 1);
+        const Address server_ip = Address::from_ipv4_numeric(servers + i + 1);
+        auto &client = simulator.add<TCPHostNode>(
+            config, ethernet_address(1, 2 * i), client_ip, Address::from_ipv4_numeric(clients + 1));
+        auto &server = simulator.add<TCPHostNode>(
+            config, ethernet_address(2, 2 * i), server_ip, Address::from_ipv4_numeric(servers + 1));
+        const size_t left_port =
+            left.add_interface(ethernet_address(1, 2 * i + 1), Address::from_ipv4_numeric(clients + 1));
+        const size_t right_port =
+            right.add_interface(ethernet_address(2, 2 * i + 1), Address::from_ipv4_numeric(servers + 1));
+        left.add_route(client_ip.ipv4_numeric(), 32, {}, left_port);
+        right.add_route(server_ip.ipv4_numeric(), 32, {}, right_port);
+        connect(simulator, client, 0, left, left_port, access);
+        connect(simulator, server, 0, right, right_port, access);
+        flows.push_back({client, server, {server_ip.ip(), 80}, options.bytes});
+    }
+    cerr.rdbuf(log);
+    cerr.clear();
+
+    const auto start = steady_clock::now();
+    for (auto &flow : flows) {
+        flow.server.listen(80);
+        flow.client.connect(10000, flow.server_address);
+    }
+
+    // the clients write what fits whenever there's room, and the servers read what arrives
+    size_t unfinished = flows.size();
+    for (auto &flow : flows) {
+        flow.client.set_application([&flow](TCPConnection &connection) {
+            const size_t size = min(flow.unsent, connection.remaining_outbound_capacity());
+            if (size > 0) {
+                flow.unsent -= connection.write(string(size, 'x'));
+                if (flow.unsent == 0) {
+                    connection.end_input_stream();
+                }
+            }
+        });
+        flow.server.set_application([&flow, &simulator, &unfinished](TCPConnection &connection) {
+            ByteStream &inbound = connection.inbound_stream();
+            flow.received += inbound.read(inbound.buffer_size()).size();
+            if (inbound.eof() and not flow.finished_ns) {
+                connection.end_input_stream();
+                flow.finished_ns = simulator.now_ns();
+                unfinished--;
+            }
+        });
+    }
+    const uint64_t time_limit_ns = options.time_limit_s * 1000000000;
+    simulator.run([&] { return unfinished == 0 or simulator.now_ns() >= time_limit_ns; });
+    const uint64_t finished_ns = simulator.now_ns();
+    const double wall_seconds = duration<double>(steady_clock::now() - start).count();
+    const uint64_t events_run = simulator.events_run();
+
+    // let the connections close
+    simulator.run([&] {
+        return all_of(flows.begin(), flows.end(), [](const Flow &flow) {
+            return not flow.client.connection().active() and not flow.server.connection().active();
+        });
+    });
+
+    vector<uint64_t> completion_ns;
+    uint64_t received = 0;
+    for (const auto &flow : flows) {
+        received += flow.received;
+        if (flow.finished_ns) {
+            completion_ns.push_back(*flow.finished_ns);
+        }
+    }
+    sort(completion_ns.begin(), completion_ns.end());
+    const double simulated_seconds = double(finished_ns) / 1e9;
+    const auto ms = [](const uint64_t ns) { return double(ns) / 1e6; };
+
+    cout << fixed << setprecision(3) << "flows completed:    " << completion_ns.size() << " of " << flows.size()
+         << "\nbytes received:     " << received << "\nsimulated time:     " << simulated_seconds << " s"
+         << "\nwall-clock time:    " << wall_seconds << " s (" << simulated_seconds / wall_seconds
+         << "x real time)\nevents run:         " << events_run << " ("
+         << double(events_run) / wall_seconds / 1e6 << " M/s)"
+         << "\ngoodput:            " << double(received) * 8 / simulated_seconds / 1e6 << " Mbit/s\n";
+    if (not completion_ns.empty()) {
+        cout << "completion time:    min " << ms(completion_ns.front()) << " ms, median "
+             << ms(completion_ns[completion_ns.size() / 2]) << " ms, max " << ms(completion_ns.back()) << " ms\n";
+    }
+    for (const auto &[name, link] : {pair{"left to right", &left_to_right}, pair{"right to left", &right_to_left}}) {
+        const LinkStats &stats = link->stats();
+        cout << "bottleneck " << name << ": " << stats.sent << " sent, " << stats.delivered << " delivered, "
+             << stats.queue_drops << " dropped by the queue, " << stats.lost << " lost\n";
+    }
+}
+
+static void show_usage(const char *argv0) {
+    cerr << "Usage: " << argv0 << " [options]\n\n"
+         << "Simulates TCP flows across a dumbbell: clients behind one router send to servers behind another,\n"
+         << "all sharing the link between the routers. Reports how the flows fared and how much faster than\n"
+         << "real time the simulation ran. Options:\n\n"
+         << "   -n <flows>        Number of client/server pairs (default 100)\n"
+         << "   -b <bytes>        Bytes each client sends (default 100000)\n"
+         << "   -r <Mbit/s>       Rate of the bottleneck link (default 100)\n"
+         << "   -a <Mbit/s>       Rate of the access links (default 1000)\n"
+         << "   -d <ms>           One-way delay of the bottleneck link (default 10)\n"
+         << "   -q <bytes>        Queue limit of every link (default 125000)\n"
+         << "   -Q <queue>        Queueing discipline: droptail or red (default droptail)\n"
+         << "   -l <rate>         Probability that the bottleneck loses a packet, from 0 to 1 (default 0)\n"
+         << "   -S <seed>         Seed of the simulation's random decisions (default 1)\n"
+         << "   -t <seconds>      Simulated time after which to give up (default 3600)\n"
+         << "   -h                Show this message\n\n";
+}
+
+static Options get_options(const int argc, char **argv) {
+    Options options;
+    for (int curr = 1; curr < argc; curr += 2) {
+        const string option = argv[curr];
+        if (option == "-h" or curr + 1 >= argc) {
+            show_usage(argv[0]);
+            exit(option == "-h" ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        const char *const value = argv[curr + 1];
+        if (option == "-n") {
+            options.flows = strtoul(value, nullptr, 0);
+        } else if (option == "-b") {
+            options.bytes = strtoull(value, nullptr, 0);
+        } else if (option == "-r") {
+            options.bottleneck_mbps = strtoull(value, nullptr, 0);
+        } else if (option == "-a") {
+            options.access_mbps = strtoull(value, nullptr, 0);
+        } else if (option == "-d") {
+            options.delay_ms = strtoull(value, nullptr, 0);
+        } else if (option == "-q") {
+            options.queue_bytes = strtoul(value, nullptr, 0);
+        } else if (option == "-Q") {
+            options.queue = value;
+        } else if (option == "-l") {
+            options.loss = strtod(value, nullptr);
+        } else if (option == "-S") {
+            options.seed = strtoull(value, nullptr, 0);
+        } else if (option == "-t") {
+            options.time_limit_s = strtoull(value, nullptr, 0);
+        } else {
+            cerr << "ERROR: unrecognized option " << option << "\n";
+            show_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (options.flows == 0 or options.flows > 65000 or options.bottleneck_mbps == 0 or options.access_mbps == 0 or
+        options.loss < 0 or options.loss >= 1 or (options.queue != "droptail" and options.queue != "red")) {
+        cerr << "ERROR: bad option value\n";
+        show_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    return options;
+}
+
+int main(int argc, char **argv) {
+    try {
+        if (argc <= 0) {
+            abort();  // For sticklers: don't try to access argv[0] if argc <= 0.
+        }
+
+        simulate(get_options(argc, argv));
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
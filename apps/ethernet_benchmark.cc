@@ -0,0 +1,93 @@
+#include "arp_message.hh"
+#include "network_interface.hh"
+#include "tcp_over_ip.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t frame_count = 1000000;
+constexpr size_t segment_payload_size = 1400;
+
+//! The transmit path of TCPOverIPv4OverEthernetAdapter::write, with /dev/null standing in for the TAP device
+//! (opening a TAP device needs privileges the benchmark shouldn't require)
+class EthernetWriter : public TCPOverIPv4Adapter {
+  private:
+    FileDescriptor _device;
+    NetworkInterface _interface;
+    Address _next_hop;
+
+  public:
+    EthernetWriter(FileDescriptor &&device,
+                   const EthernetAddress &eth_address,
+                   const Address &ip_address,
+                   const Address &next_hop)
+        : _device(move(device)), _interface(eth_address, ip_address), _next_hop(next_hop) {}
+
+    NetworkInterface &interface() { return _interface; }
+
+    void write(TCPSegment &seg) {
+        _interface.send_datagram(wrap_tcp_in_ip(seg), _next_hop);
+        while (not _interface.frames_out().empty()) {
+            _device.write(_interface.frames_out().front().serialize());
+            _interface.frames_out().pop();
+        }
+    }
+};
+
+int main() {
+    try {
+        const EthernetAddress local_eth = {0x02, 0, 0, 0, 0, 1};
+        const EthernetAddress router_eth = {0x02, 0, 0, 0, 0, 2};
+        const Address local_ip{"10.0.0.1", 0};
+        const Address router_ip{"10.0.0.2", 0};
+
+        EthernetWriter writer{FileDescriptor{SystemCall("open", open("/dev/null", O_WRONLY))},
+                              local_eth,
+                              local_ip,
+                              router_ip};
+        writer.config_mut().source = {"10.0.0.1", 1234};
+        writer.config_mut().destination = {"10.0.0.3", 80};
+
+        // resolve the next hop before timing, so every write takes the cache-hit path
+        ARPMessage arp;
+        arp.opcode = ARPMessage::OPCODE_REPLY;
+        arp.sender_ethernet_address = router_eth;
+        arp.sender_ip_address = router_ip.ipv4_numeric();
+        arp.target_ethernet_address = local_eth;
+        arp.target_ip_address = local_ip.ipv4_numeric();
+        EthernetFrame reply;
+        reply.header().type = EthernetHeader::TYPE_ARP;
+        reply.header().src = router_eth;
+        reply.header().dst = local_eth;
+        reply.payload() = arp.serialize();
+        writer.interface().recv_frame(reply);
+
+        TCPSegment seg;
+        seg.header().ack = true;
+        seg.payload() = Buffer{string(segment_payload_size, 'x')};
+
+        const auto first_time = high_resolution_clock::now();
+        for (size_t i = 0; i < frame_count; i++) {
+            seg.header().seqno = WrappingInt32(i * segment_payload_size);
+            writer.write(seg);
+        }
+        const auto final_time = high_resolution_clock::now();
+
+        const auto duration = duration_cast<nanoseconds>(final_time - first_time).count();
+        cout << fixed << setprecision(2);
+        cout << "Ethernet transmit path: " << frame_count * 1e3 / double(duration) << " Mframes/s ("
+             << double(duration) / frame_count << " ns/frame)\n";
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+#include "eventloop.hh"
+#include "socket.hh"
+#include "util.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t burst_size = 16;
+constexpr size_t rounds = 2000;
+
+//! Name of a backend, padded for the table
+static const char *backend_name(const EventLoop::Backend backend) {
+    switch (backend) {
+        case EventLoop::Backend::Poll:
+            return "poll    ";
+        case EventLoop::Backend::Epoll:
+            return "epoll   ";
+        case EventLoop::Backend::IoUring:
+            return "io_uring";
+    }
+    return "?";
+}
+
+//! Fan-in like `bouncer`: many mostly-idle UDP sockets in one loop, with a few of them ready at a time
+void fan_in(const EventLoop::Backend backend, const size_t socket_count) {
+    EventLoop loop{backend};
+    vector<UDPSocket> sockets(socket_count);
+    vector<Address> addresses;
+    addresses.reserve(socket_count);
+    size_t received = 0;
+
+    for (auto &sock : sockets) {
+        sock.bind(Address{"127.0.0.1", 0});
+        addresses.push_back(sock.local_address());
+        loop.add_rule(sock, Direction::In, [&] {
+            sock.recv();
+            received++;
+        });
+    }
+
+    UDPSocket sender;
+    auto rd = get_random_generator();
+    size_t waits = 0;
+
+    const auto first_time = high_resolution_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < burst_size; i++) {
+            sender.sendto(addresses[rd() % socket_count], "x");
+        }
+        const size_t goal = (round + 1) * burst_size;
+        while (received < goal) {
+            if (loop.wait_next_event(1000) != EventLoop::Result::Success) {
+                throw runtime_error("datagram lost in fan-in benchmark");
+            }
+            waits++;
+        }
+    }
+    const auto final_time = high_resolution_clock::now();
+
+    const auto duration = duration_cast<nanoseconds>(final_time - first_time).count();
+    cout << fixed << setprecision(2);
+    cout << backend_name(backend) << " backend, " << setw(6) << socket_count
+         << " sockets: " << setw(10) << received * 1e9 / double(duration) << " datagrams/s, " << setw(10)
+         << double(duration) / 1000 / double(waits) << " us/wait\n";
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        if (argc <= 0) {
+            abort();  // For sticklers: don't try to access argv[0] if argc <= 0.
+        }
+
+        if (argc > 2) {
+            cerr << "Usage: " << argv[0] << " [max_sockets]\n";
+            return EXIT_FAILURE;
+        }
+
+        const size_t max_sockets = argc == 2 ? stoul(argv[1]) : 16000;
+        for (size_t socket_count = 1000; socket_count <= max_sockets; socket_count *= 4) {
+            fan_in(EventLoop::Backend::Poll, socket_count);
+            fan_in(EventLoop::Backend::Epoll, socket_count);
+            fan_in(EventLoop::Backend::IoUring, socket_count);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -114,8 +114,9 @@ class NetworkInterfaceAdapter : public TCPOverIPv4Adapter {
         _interface.tick(ms_since_last_tick);
         send_pending();
     }
+    std::optional<size_t> time_until_next_deadline() const { return _interface.time_until_next_deadline(); }
     NetworkInterface &interface() { return _interface; }
-    queue<EthernetFrame> frames_out() { return _interface.frames_out(); }
+    RingQueue<EthernetFrame> frames_out() { return _interface.frames_out(); }
 
     operator FileDescriptor &() { return _data_socket_pair.first; }
     FileDescriptor &frame_fd() { return _data_socket_pair.second; }
@@ -188,6 +189,15 @@ void program_body(bool is_client, const string &bounce_host, const string &bounc
     TCPSocketLab7 sock =
         is_client ? TCPSocketLab7{{"192.168.0.50"}, {"192.168.0.1"}} : TCPSocketLab7{{"172.16.0.100"}, {"172.16.0.1"}};
 
+    /* the host and the router's host-side interface are wired together here, so neither needs ARP */
+    NetworkInterface &host_interface = sock.adapter().interface();
+    NetworkInterface &router_interface = router.interface(host_side);
+    host_interface.add_static_neighbor(router_interface.ip_address(), router_interface.ethernet_address());
+    router_interface.add_static_neighbor(host_interface.ip_address(), host_interface.ethernet_address());
+
+    /* tell the other router where we are before any traffic needs it */
+    router.interface(internet_side).announce();
+
     atomic<bool> exit_flag{};
 
     /* set up the network */
@@ -2,6 +2,8 @@
 #include "router.hh"
 #include "util.hh"
 
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 #include <list>
 #include <unordered_map>
@@ -191,10 +193,10 @@ class Network {
     }
 
     void deliver(const string &src_name,
-                 const queue<EthernetFrame> &src,
+                 const RingQueue<EthernetFrame> &src,
                  const string &dst_name,
                  AsyncNetworkInterface &dst) {
-        queue<EthernetFrame> to_send = src;
+        RingQueue<EthernetFrame> to_send = src;
         while (not to_send.empty()) {
             to_send.front().payload() = to_send.front().payload().concatenate();
             cerr << "Transferring frame from " << src_name << " to " << dst_name << ": " << summary(to_send.front())
@@ -257,6 +259,29 @@ class Network {
         }
     }
 
+    //! Have every interface announce itself with gratuitous ARP, so that no datagram waits for resolution
+    void announce() {
+        for (const auto id : {default_id, eth0_id, eth1_id, eth2_id, uun3_id, hs4_id, mit5_id}) {
+            _router.interface(id).announce();
+        }
+        for (auto &host : _hosts) {
+            host.second.interface().announce();
+        }
+        simulate_physical_connections();
+    }
+
+    //! Total number of datagrams, over all interfaces, that had to wait for ARP
+    uint64_t cold_misses() {
+        uint64_t ret = 0;
+        for (const auto id : {default_id, eth0_id, eth1_id, eth2_id, uun3_id, hs4_id, mit5_id}) {
+            ret += _router.interface(id).arp_stats().cold_misses;
+        }
+        for (auto &host : _hosts) {
+            ret += host.second.interface().arp_stats().cold_misses;
+        }
+        return ret;
+    }
+
     Host &host(const string &name) {
         auto it = _hosts.find(name);
         if (it == _hosts.end()) {
@@ -269,13 +294,18 @@ class Network {
     }
 };
 
-void network_simulator() {
+void network_simulator(const bool announce) {
     const string green = "\033[32;1m", normal = "\033[m";
 
     cerr << green << "Constructing network." << normal << "\n";
 
     Network network;
 
+    if (announce) {
+        cerr << green << "Sending gratuitous ARP announcements." << normal << "\n";
+        network.announce();
+    }
+
     cout << green << "\n\nTesting traffic between two ordinary hosts (applesauce to cherrypie)..." << normal << "\n\n";
     {
         auto dgram_sent = network.host("applesauce").send_to(network.host("cherrypie").address());
@@ -341,11 +371,21 @@ void network_simulator() {
     }
 
     cout << "\n\n\033[32;1mCongratulations! All datagrams were routed successfully.\033[m\n";
+    cout << "Datagrams that waited for ARP resolution: " << network.cold_misses() << "\n";
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     try {
-        network_simulator();
+        if (argc <= 0) {
+            abort();  // For sticklers: don't try to access argv[0] if argc <= 0.
+        }
+
+        if (argc > 2 or (argc == 2 and argv[1] != "announce"s)) {
+            cerr << "Usage: " << argv[0] << " [announce]\n";
+            return EXIT_FAILURE;
+        }
+
+        network_simulator(argc == 2);
     } catch (const exception &e) {
         cerr << "\n\n\n";
         cerr << "\033[31;1mError: " << e.what() << "\033[m\n";
@@ -0,0 +1,163 @@
+#include "packet_ring.hh"
+#include "socket.hh"
+#include "tun.hh"
+#include "util.hh"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <string>
+#include <string_view>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t frame_count = 200000;
+constexpr size_t frame_size = 1514;
+constexpr size_t flight_size = 64;   // frames sent together, like a window's worth of TCP segments
+constexpr size_t burst_size = 1024;  // frames sent before the receiver catches up, in the receive benchmark
+
+//! An Ethernet type for local experiments (IEEE 802), so that the kernel ignores the frames
+static const string EXPERIMENTAL_TYPE = "\x88\xb5";
+
+//! A full-sized broadcast test frame
+static string test_frame() {
+    string frame = string(6, '\xff') + string("\x02\x00\x00\x00\x00\x01", 6) + EXPERIMENTAL_TYPE;
+    frame.resize(frame_size, 'x');
+    return frame;
+}
+
+static void report(const string &what, const size_t frames, const steady_clock::time_point start) {
+    const double seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+    cout << fixed << setprecision(2) << what << ": " << setw(6) << double(frames) / seconds / 1e6 << " Mframes/s ("
+         << setw(7) << seconds * 1e9 / double(frames) << " ns/frame)\n";
+}
+
+//! Frames written to a TAP device, one write(2) each, as TCPOverIPv4OverEthernetAdapter does
+static void transmit_tap(const string &tap_name) {
+    TapFD tap{tap_name};
+    const string frame = test_frame();
+    const auto start = steady_clock::now();
+    for (size_t i = 0; i < frame_count; i++) {
+        tap.write(frame);
+    }
+    report("transmit, TAP device, write(2) per frame     ", frame_count, start);
+}
+
+//! Frames sent through a PacketRing a flight at a time, as TCPOverIPv4OverPacketRingAdapter does
+static void transmit_ring(const string &interface) {
+    PacketRing ring{interface};
+    const string frame = test_frame();
+    const auto start = steady_clock::now();
+    for (size_t i = 0; i < frame_count; i++) {
+        ring.send(frame);
+        if ((i + 1) % flight_size == 0) {
+            ring.flush();
+        }
+    }
+    ring.flush();
+    report("transmit, AF_PACKET ring, flush per flight   ", frame_count, start);
+}
+
+//! A plain AF_PACKET socket on `interface`, read one frame per read(2) like a TAP device
+static FileDescriptor plain_packet_socket(const string &interface) {
+    FileDescriptor fd{SystemCall("socket", ::socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL)))};
+    const int buffer_size = 16 * 1024 * 1024;
+    ::setsockopt(fd.fd_num(), SOL_SOCKET, SO_RCVBUFFORCE, &buffer_size, sizeof(buffer_size));  // best effort
+    sockaddr_ll link_address{};
+    link_address.sll_family = AF_PACKET;
+    link_address.sll_protocol = htons(ETH_P_ALL);
+    link_address.sll_ifindex = static_cast<int>(if_nametoindex(interface.c_str()));
+    SystemCall("bind", ::bind(fd.fd_num(), reinterpret_cast<const sockaddr *>(&link_address), sizeof(link_address)));
+    fd.set_blocking(false);
+    return fd;
+}
+
+//! Frames sent through a PacketRing on `interface` in bursts, and received on `peer`, the other end of a
+//! veth pair, either through a PacketRing or with a read(2) per frame
+static void receive(const string &interface, const string &peer, const bool ring) {
+    PacketRing sender{interface};
+    optional<PacketRing> ring_receiver;
+    optional<FileDescriptor> plain_receiver;
+    if (ring) {
+        ring_receiver.emplace(peer);
+    } else {
+        plain_receiver.emplace(plain_packet_socket(peer));
+    }
+    const int fd_num = ring ? ring_receiver->fd_num() : plain_receiver->fd_num();
+
+    const string frame = test_frame();
+    size_t received = 0;
+    string buffer;
+    const auto start = steady_clock::now();
+    for (size_t sent = 0; sent < frame_count;) {
+        for (size_t i = 0; i < burst_size; i++, sent++) {
+            sender.send(frame);
+        }
+        sender.flush();
+
+        // catch up, until no frame arrives for a while
+        while (received < sent) {
+            pollfd pfd{fd_num, POLLIN, 0};
+            if (SystemCall("poll", ::poll(&pfd, 1, 100)) == 0) {
+                break;
+            }
+            if (ring) {
+                while (const auto received_frame = ring_receiver->receive()) {
+                    received += received_frame->data.substr(12, 2) == EXPERIMENTAL_TYPE;
+                }
+            } else {
+                try {
+                    while (true) {
+                        plain_receiver->read(buffer, frame_size);
+                        received += string_view(buffer).substr(12, 2) == EXPERIMENTAL_TYPE;
+                    }
+                } catch (const unix_error &e) {
+                    if (e.code().value() != EAGAIN) {
+                        throw;
+                    }
+                }
+            }
+        }
+    }
+    report(ring ? "receive,  AF_PACKET ring, in place          " : "receive,  AF_PACKET socket, read(2) per frame",
+           received,
+           start);
+    if (received < frame_count) {
+        cout << "          (" << frame_count - received << " of " << frame_count << " frames lost)\n";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        if (argc <= 0) {
+            abort();  // For sticklers: don't try to access argv[0] if argc <= 0.
+        }
+
+        if (argc != 4) {
+            cerr << "Usage: " << argv[0] << " <tapdev> <veth> <veth-peer>\n\n"
+                 << "Compares sending frames to a TAP device with sending them through an AF_PACKET ring on one\n"
+                 << "end of a veth pair, and receiving them on the other end through a ring or one read(2) at a\n"
+                 << "time. All the interfaces must be up, e.g.\n\n"
+                 << "    ip tuntap add mode tap user `username` name tap10 && ip link set tap10 up\n"
+                 << "    ip link add veth0 type veth peer name veth1 && ip link set veth0 up && ip link set veth1 up\n";
+            return EXIT_FAILURE;
+        }
+
+        transmit_tap(argv[1]);
+        transmit_ring(argv[2]);
+        receive(argv[2], argv[3], false);
+        receive(argv[2], argv[3], true);
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+#include "parallel_simulator.hh"
+#include "simulated_nodes.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+//! The scenario to simulate, from the command line
+struct Options {
+    size_t sites = 20;            //!< Number of sites, each a router and its hosts
+    size_t hosts = 500;           //!< Hosts at each site, half of them clients and half servers
+    size_t partitions = 0;        //!< Number of partitions the sites are spread over (0: one per site)
+    size_t bytes = 4000;          //!< Bytes each client sends
+    uint64_t site_mbps = 1000;    //!< Rate of the links between sites
+    uint64_t access_mbps = 1000;  //!< Rate of the links between hosts and their site's router
+    uint64_t delay_ms = 5;        //!< One-way delay of the links between sites (the lookahead)
+    uint64_t seed = 1;            //!< Seed of the simulation's random decisions
+    vector<size_t> threads{};     //!< Numbers of threads to run the simulation on, one run each
+};
+
+//! What a run measured
+struct Results {
+    double wall_seconds = 0;    //!< Elapsed time of the run
+    uint64_t simulated_ns = 0;  //!< Simulated time when the last flow finished
+    uint64_t events = 0;        //!< Events run
+    uint64_t windows = 0;       //!< Windows run
+    size_t finished = 0;        //!< Flows whose server read the end of the stream
+    uint64_t digest = 0;        //!< Hash of when each flow finished, to compare runs by
+};
+
+//! A client at one site sending to a server at the next site round the ring
+struct Flow {
+    Simulator &server_partition;       //!< The partition of the server, whose clock says when the flow finished
+    size_t unsent;                     //!< Bytes the client has yet to write
+    optional<uint64_t> finished_ns{};  //!< When the server read the end of the stream
+};
+
+//! IP address of host `host` (or the router, host -1) on the access links of site `site`
+static Address host_address(const size_t site, const int host) {
+    return Address::from_ipv4_numeric((10u << 24) + (uint32_t(site) << 16) + uint32_t(host + 2));
+}
+
+//! IP address of site `site`'s end (`end` 1) or site `site + 1`'s end (`end` 2) of the link between them
+static Address ring_address(const size_t site, const int end) {
+    return Address::from_ipv4_numeric((172u << 24) + (16u << 16) + (uint32_t(site) << 8) + uint32_t(end));
+}
+
+//! Ethernet address number `n` of site `site`
+static EthernetAddress ethernet_address(const size_t site, const uint32_t n) {
+    return {0x02, uint8_t(site >> 8), uint8_t(site), uint8_t(n >> 16), uint8_t(n >> 8), uint8_t(n)};
+}
+
+static Results simulate(const Options &options, const size_t threads) {
+    const size_t partition_count = options.partitions ? options.partitions : options.sites;
+    LinkConfig site_link, access_link;
+    site_link.bits_per_second = options.site_mbps * 1000000;
+    site_link.delay_ns = options.delay_ms * 1000000;
+    access_link.bits_per_second = options.access_mbps * 1000000;
+    ParallelSimulator simulator{partition_count, site_link.delay_ns, options.seed, threads};
+
+    // the flows from each site's clients, by site then client
+    const size_t clients = options.hosts / 2;
+    vector<Flow> flows;
+    flows.reserve(options.sites * clients);
+    for (size_t site = 0; site < options.sites; site++) {
+        for (size_t i = 0; i < clients; i++) {
+            flows.push_back({simulator.partition((site + 1) % options.sites % partition_count), options.bytes});
+        }
+    }
+
+    // the interfaces log their addresses, and Router::add_route each route
+    auto *const log = cerr.rdbuf(nullptr);
+
+    // each site's router has the links to the next and previous sites round the ring as ports 0 and 1, then
+    // one to each host; even hosts are clients, of the odd host after them at the next site
+    const TCPConfig config;
+    vector<reference_wrapper<RouterNode>> routers;
+    vector<reference_wrapper<TCPHostNode>> hosts;
+    for (size_t site = 0; site < options.sites; site++) {
+        const size_t partition = site % partition_count;
+        const size_t next = (site + 1) % options.sites, previous = (site + options.sites - 1) % options.sites;
+        auto &router = simulator.partition(partition).add<RouterNode>();
+        router.add_interface(ethernet_address(site, 0), ring_address(site, 1));
+        router.add_interface(ethernet_address(site, 1), ring_address(previous, 2));
+        router.add_route(host_address(next, -1).ipv4_numeric(), 16, ring_address(site, 2), 0);
+        router.add_route(host_address(previous, -1).ipv4_numeric(), 16, ring_address(previous, 1), 1);
+        routers.push_back(router);
+
+        for (int host = 0; host < int(options.hosts); host++) {
+            auto &node = simulator.partition(partition).add<TCPHostNode>(
+                config, ethernet_address(site, 2 * host + 2), host_address(site, host), host_address(site, -1));
+            const size_t port = router.add_interface(ethernet_address(site, 2 * host + 3), host_address(site, -1));
+            router.add_route(host_address(site, host).ipv4_numeric(), 32, {}, port);
+            connect(simulator, partition, node, 0, partition, router, port, access_link);
+            hosts.push_back(node);
+
+            if (host % 2 == 0) {
+                Flow &flow = flows[site * clients + host / 2];
+                node.connect(10000, {host_address(next, host + 1).ip(), 80});
+                node.set_application([&flow](TCPConnection &connection) {
+                    const size_t size = min(flow.unsent, connection.remaining_outbound_capacity());
+                    if (size > 0) {
+                        flow.unsent -= connection.write(string(size, 'x'));
+                        if (flow.unsent == 0) {
+                            connection.end_input_stream();
+                        }
+                    }
+                });
+            } else {
+                Flow &flow = flows[previous * clients + host / 2];
+                node.listen(80);
+                node.set_application([&flow](TCPConnection &connection) {
+                    ByteStream &inbound = connection.inbound_stream();
+                    inbound.pop_output(inbound.buffer_size());
+                    if (inbound.eof() and not flow.finished_ns) {
+                        connection.end_input_stream();
+                        flow.finished_ns = flow.server_partition.now_ns();
+                    }
+                });
+            }
+        }
+    }
+    for (size_t site = 0; site < options.sites; site++) {
+        const size_t next = (site + 1) % options.sites;
+        connect(simulator,
+                site % partition_count,
+                routers[site].get(),
+                0,
+                next % partition_count,
+                routers[next].get(),
+                1,
+                site_link);
+    }
+    cerr.rdbuf(log);
+    cerr.clear();
+
+    Results results;
+    const auto start = steady_clock::now();
+    simulator.run([&] {
+        return all_of(flows.begin(), flows.end(), [](const Flow &flow) { return flow.finished_ns.has_value(); });
+    });
+    results.wall_seconds = duration<double>(steady_clock::now() - start).count();
+    results.events = simulator.events_run();
+    results.windows = simulator.windows();
+
+    // let the connections close
+    simulator.run([&] {
+        return none_of(hosts.begin(), hosts.end(), [](const TCPHostNode &host) { return host.connection().active(); });
+    });
+
+    // FNV-1a over the flows' finishing times
+    results.digest = 14695981039346656037u;
+    for (const auto &flow : flows) {
+        if (flow.finished_ns) {
+            results.finished++;
+            results.simulated_ns = max(results.simulated_ns, *flow.finished_ns);
+        }
+        const uint64_t finished_ns = flow.finished_ns.value_or(0);
+        for (size_t i = 0; i < 8; i++) {
+            results.digest = (results.digest ^ ((finished_ns >> (8 * i)) & 0xff)) * 1099511628211u;
+        }
+    }
+    return results;
+}
+
+static void show_usage(const char *argv0) {
+    cerr << "Usage: " << argv0 << " [options]\n\n"
+         << "Simulates sites joined in a ring, each a router and its hosts, with every client sending to a\n"
+         << "server at the next site. The sites are spread over the partitions of a ParallelSimulator, and\n"
+         << "the simulation is run once for each number of threads given, which must all give the same\n"
+         << "results. Options:\n\n"
+         << "   -s <sites>        Number of sites (default 20)\n"
+         << "   -H <hosts>        Hosts at each site, an even number (default 500)\n"
+         << "   -p <partitions>   Number of partitions (default 0, one per site)\n"
+         << "   -b <bytes>        Bytes each client sends (default 4000)\n"
+         << "   -r <Mbit/s>       Rate of the links between sites (default 1000)\n"
+         << "   -a <Mbit/s>       Rate of the access links (default 1000)\n"
+         << "   -d <ms>           Delay of the links between sites, the lookahead (default 5)\n"
+         << "   -S <seed>         Seed of the simulation's random decisions (default 1)\n"
+         << "   -j <threads,...>  Numbers of threads to run on (default 1 and every core)\n"
+         << "   -h                Show this message\n\n";
+}
+
+static Options get_options(const int argc, char **argv) {
+    Options options;
+    for (int curr = 1; curr < argc; curr += 2) {
+        const string option = argv[curr];
+        if (option == "-h" or curr + 1 >= argc) {
+            show_usage(argv[0]);
+            exit(option == "-h" ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        const char *const value = argv[curr + 1];
+        if (option == "-s") {
+            options.sites = strtoul(value, nullptr, 0);
+        } else if (option == "-H") {
+            options.hosts = strtoul(value, nullptr, 0);
+        } else if (option == "-p") {
+            options.partitions = strtoul(value, nullptr, 0);
+        } else if (option == "-b") {
+            options.bytes = strtoull(value, nullptr, 0);
+        } else if (option == "-r") {
+            options.site_mbps = strtoull(value, nullptr, 0);
+        } else if (option == "-a") {
+            options.access_mbps = strtoull(value, nullptr, 0);
+        } else if (option == "-d") {
+            options.delay_ms = strtoull(value, nullptr, 0);
+        } else if (option == "-S") {
+            options.seed = strtoull(value, nullptr, 0);
+        } else if (option == "-j") {
+            istringstream list{value};
+            for (string threads; getline(list, threads, ',');) {
+                options.threads.push_back(strtoul(threads.c_str(), nullptr, 0));
+            }
+        } else {
+            cerr << "ERROR: unrecognized option " << option << "\n";
+            show_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (options.threads.empty()) {
+        options.threads = {1};
+        if (thread::hardware_concurrency() > 1) {
+            options.threads.push_back(thread::hardware_concurrency());
+        }
+    }
+
+    if (options.sites < 2 or options.sites > 255 or options.hosts == 0 or options.hosts % 2 != 0 or
+        options.hosts > 65000 or options.site_mbps == 0 or options.access_mbps == 0 or options.delay_ms == 0 or
+        find(options.threads.begin(), options.threads.end(), 0) != options.threads.end()) {
+        cerr << "ERROR: bad option value\n";
+        show_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    return options;
+}
+
+int main(int argc, char **argv) {
+    try {
+        if (argc <= 0) {
+            abort();  // For sticklers: don't try to access argv[0] if argc <= 0.
+        }
+
+        const Options options = get_options(argc, argv);
+        cout << options.sites * options.hosts << " hosts at " << options.sites << " sites, "
+             << (options.partitions ? options.partitions : options.sites) << " partitions\n";
+        optional<Results> first{};
+        for (const size_t threads : options.threads) {
+            const Results results = simulate(options, threads);
+            if (not first) {
+                first = results;
+            }
+            cout << fixed << setprecision(3) << setw(3) << threads << " threads: " << results.finished
+                 << " flows finished at " << double(results.simulated_ns) / 1e9 << " s simulated, "
+                 << results.events << " events in " << results.windows << " windows, " << results.wall_seconds
+                 << " s (speedup " << setprecision(2) << first->wall_seconds / results.wall_seconds
+                 << "), digest " << hex << results.digest << dec << "\n";
+            if (results.digest != first->digest or results.events != first->events) {
+                throw runtime_error("the runs differ");
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,112 +1,340 @@
+#include "bench_options.hh"
 #include "tcp_connection.hh"
+#include "util.hh"
+#include "wrapping_integers.hh"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <iomanip>
 #include <iostream>
+#include <optional>
+#include <random>
 #include <string>
+#include <string_view>
+#include <sys/resource.h>
 
 using namespace std;
 using namespace std::chrono;
 
-constexpr size_t len = 100 * 1024 * 1024;
+//! The scenario to measure, from the command line
+struct Options {
+    size_t bytes = 100 * 1024 * 1024;  //!< Bytes each connection transfers
+    size_t connections = 1;            //!< Number of connections, run side by side
+    TCPConfig config{};                //!< Configuration of every TCPConnection
+    double loss = 0;                   //!< Probability that a segment is lost
+    double duplicate = 0;              //!< Probability that a segment is delivered twice
+    size_t reorder_depth = 0;          //!< How many earlier segments a segment may overtake
+    uint64_t rtt_ms = 0;               //!< Round-trip time of the simulated link
+    uint32_t seed = 1;                 //!< Seed of the random decisions of the link
+    string format = "text";            //!< Output format: text, csv or json
+};
 
-void move_segments(TCPConnection &x, TCPConnection &y, vector<TCPSegment> &segments, const bool reorder) {
-    while (not x.segments_out().empty()) {
-        segments.emplace_back(move(x.segments_out().front()));
-        x.segments_out().pop();
+//! What a run measured
+struct Results {
+    uint64_t bytes = 0;            //!< Bytes received, over all connections
+    uint64_t segments = 0;         //!< Segments sent, in both directions
+    uint64_t retransmissions = 0;  //!< Segments sent that only repeat sequence numbers sent before
+    double wall_seconds = 0;       //!< Elapsed time until every byte was received
+    double cpu_seconds = 0;        //!< CPU time (user and system) until every byte was received
+    uint64_t simulated_ms = 0;     //!< Time on the simulated clock until every byte was received
+};
+
+//! \brief One direction of a simulated link between two TCPConnections
+//! \details Each segment is lost, duplicated and delayed by half the RTT, then delivered in order, unless the
+//! link is reordering: then each delivery picks at random among the first `reorder_depth + 1` segments due.
+class Link {
+  private:
+    const Options &_options;
+    mt19937 &_random;
+    deque<pair<uint64_t, TCPSegment>> _in_flight{};  //!< Segments and their delivery times, in order sent
+    optional<WrappingInt32> _isn{};                  //!< Sequence number of the SYN sent over the link
+    uint64_t _next_seqno{0};                         //!< Absolute sequence number after the highest sent
+
+  public:
+    Link(const Options &options, mt19937 &random) : _options(options), _random(random) {}
+
+    //! Take the segments `from` has sent; returns `true` if there were any
+    bool send(TCPConnection &from, const uint64_t now, Results &results) {
+        bool sent = false;
+        for (; not from.segments_out().empty(); from.segments_out().pop(), sent = true) {
+            TCPSegment &segment = from.segments_out().front();
+            results.segments++;
+
+            if (segment.header().syn and not _isn) {
+                _isn = segment.header().seqno;
+            }
+            if (_isn and segment.length_in_sequence_space() > 0) {
+                const uint64_t end =
+                    unwrap(segment.header().seqno, *_isn, _next_seqno) + segment.length_in_sequence_space();
+                results.retransmissions += end <= _next_seqno;
+                _next_seqno = max(_next_seqno, end);
+            }
+
+            uniform_real_distribution<double> chance{0, 1};
+            if (_options.loss > 0 and chance(_random) < _options.loss) {
+                continue;
+            }
+            const uint64_t delivery_time = now + _options.rtt_ms / 2;
+            if (_options.duplicate > 0 and chance(_random) < _options.duplicate) {
+                _in_flight.emplace_back(delivery_time, segment);
+            }
+            _in_flight.emplace_back(delivery_time, move(segment));
+        }
+        return sent;
     }
-    if (reorder) {
-        for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
-            y.segment_received(move(*it));
+
+    //! Hand `to` the segments due by `now`; returns `true` if there were any
+    bool deliver(TCPConnection &to, const uint64_t now) {
+        size_t due = 0;
+        while (due < _in_flight.size() and _in_flight[due].first <= now) {
+            due++;
         }
-    } else {
-        for (auto it = segments.begin(); it != segments.end(); ++it) {
-            y.segment_received(move(*it));
+        const bool delivered = due > 0;
+        for (; due > 0; due--) {
+            size_t index = 0;
+            if (_options.reorder_depth > 0) {
+                index = uniform_int_distribution<size_t>{0, min(_options.reorder_depth, due - 1)}(_random);
+            }
+            const TCPSegment segment = move(_in_flight[index].second);
+            _in_flight.erase(_in_flight.begin() + index);
+            to.segment_received(segment);
         }
+        return delivered;
     }
-    segments.clear();
-}
-
-void main_loop(const bool reorder) {
-    TCPConfig config;
-    TCPConnection x{config}, y{config};
 
-    string string_to_send(len, 'x');
-    for (auto &ch : string_to_send) {
-        ch = rand();
+    //! When the next segment is due, if any is in flight
+    optional<uint64_t> next_delivery() const {
+        if (_in_flight.empty()) {
+            return {};
+        }
+        return _in_flight.front().first;
     }
+};
 
-    Buffer bytes_to_send{string(string_to_send)};
-    x.connect();
-    y.end_input_stream();
-
-    bool x_closed = false;
+//! A connection that sends `Options::bytes` bytes from `sender` to `receiver`, which sends nothing back
+struct Flow {
+    TCPConnection sender;
+    TCPConnection receiver;
+    Link forward;
+    Link backward;
+    size_t written{0};  //!< Bytes written into `sender`
+    size_t read{0};     //!< Bytes read from `receiver`, and checked
 
-    string string_received;
-    string_received.reserve(len);
+    Flow(const Options &options, mt19937 &random)
+        : sender{options.config}
+        , receiver{options.config}
+        , forward{options, random}
+        , backward{options, random} {
+        sender.connect();
+        if (options.bytes == 0) {
+            sender.end_input_stream();  // step() ends it after the last write, and there is none
+        }
+        receiver.end_input_stream();
+    }
 
-    const auto first_time = high_resolution_clock::now();
+    //! Move data and segments as far as possible without time passing; returns `true` if anything moved
+    bool step(const string_view data, const uint64_t now, Results &results) {
+        bool progress = false;
 
-    auto loop = [&] {
-        // write input into x
-        while (bytes_to_send.size() and x.remaining_outbound_capacity()) {
-            const auto want = min(x.remaining_outbound_capacity(), bytes_to_send.size());
-            const auto written = x.write(string(bytes_to_send.str().substr(0, want)));
-            if (want != written) {
-                throw runtime_error("want = " + to_string(want) + ", written = " + to_string(written));
+        while (written < data.size() and sender.remaining_outbound_capacity() > 0) {
+            const size_t want = min(sender.remaining_outbound_capacity(), data.size() - written);
+            const size_t wrote = sender.write(string(data.substr(written, want)));
+            if (wrote != want) {
+                throw runtime_error("want = " + to_string(want) + ", written = " + to_string(wrote));
+            }
+            written += wrote;
+            progress = true;
+            if (written == data.size()) {
+                sender.end_input_stream();
             }
-            bytes_to_send.remove_prefix(written);
         }
 
-        if (bytes_to_send.size() == 0 and not x_closed) {
-            x.end_input_stream();
-            x_closed = true;
+        progress |= forward.send(sender, now, results);
+        progress |= backward.send(receiver, now, results);
+        progress |= forward.deliver(receiver, now);
+        progress |= backward.deliver(sender, now);
+
+        const size_t available = receiver.inbound_stream().buffer_size();
+        if (available > 0) {
+            const string received = receiver.inbound_stream().read(available);
+            if (read + received.size() > data.size() or data.substr(read, received.size()) != received) {
+                throw runtime_error("bytes sent vs. received don't match at offset " + to_string(read));
+            }
+            read += received.size();
+            results.bytes += received.size();
+            progress = true;
         }
 
-        // exchange segments between x and y but in reverse order
-        vector<TCPSegment> segments;
-        move_segments(x, y, segments, reorder);
-        move_segments(y, x, segments, false);
+        return progress;
+    }
+
+    //! Has every byte arrived?
+    bool received(const size_t size) { return read == size and receiver.inbound_stream().eof(); }
 
-        // read output from y
-        const auto available_output = y.inbound_stream().buffer_size();
-        if (available_output > 0) {
-            string_received.append(y.inbound_stream().read(available_output));
+    //! Are both ends closed?
+    bool finished() const { return not sender.active() and not receiver.active(); }
+
+    //! When the next segment or timer is due, if ever
+    optional<uint64_t> next_event(const uint64_t now) const {
+        optional<uint64_t> next{};
+        const auto earliest = [&](const optional<uint64_t> time) {
+            if (time and (not next or *time < *next)) {
+                next = time;
+            }
+        };
+        earliest(forward.next_delivery());
+        earliest(backward.next_delivery());
+        for (const TCPConnection *connection : {&sender, &receiver}) {
+            if (const auto remaining = connection->time_until_next_deadline()) {
+                earliest(now + *remaining);
+            }
         }
+        return next;
+    }
+};
 
-        // time passes
-        x.tick(1000);
-        y.tick(1000);
-    };
+static double cpu_seconds() {
+    rusage usage{};
+    SystemCall("getrusage", ::getrusage(RUSAGE_SELF, &usage));
+    const auto seconds = [](const timeval &t) { return double(t.tv_sec) + double(t.tv_usec) / 1e6; };
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
 
-    while (not y.inbound_stream().eof()) {
-        loop();
+//! \brief Run every connection to completion on a simulated clock
+//! \details Segments and bytes move for as long as they can at one instant; when nothing can, the clock jumps
+//! to the next delivery or timer, so a run takes only the CPU time that TCP itself needs.
+static Results run(const Options &options) {
+    mt19937 random{options.seed};
+    string data(options.bytes, 0);
+    generate(data.begin(), data.end(), [&] { return static_cast<char>(random()); });
+
+    deque<Flow> flows;
+    for (size_t i = 0; i < options.connections; i++) {
+        flows.emplace_back(options, random);
     }
 
-    if (string_received != string_to_send) {
-        throw runtime_error("strings sent vs. received don't match");
+    Results results;
+    uint64_t now = 0;
+    const auto wall_start = steady_clock::now();
+    const double cpu_start = cpu_seconds();
+    bool all_received = false;
+
+    while (true) {
+        bool progress = false;
+        for (Flow &flow : flows) {
+            progress |= flow.step(data, now, results);
+        }
+
+        if (not all_received and
+            all_of(flows.begin(), flows.end(), [&](Flow &flow) { return flow.received(data.size()); })) {
+            all_received = true;
+            results.wall_seconds = duration_cast<duration<double>>(steady_clock::now() - wall_start).count();
+            results.cpu_seconds = cpu_seconds() - cpu_start;
+            results.simulated_ms = now;
+        }
+        if (all_of(flows.begin(), flows.end(), [](const Flow &flow) { return flow.finished(); })) {
+            break;
+        }
+        if (progress) {
+            continue;
+        }
+
+        // time passes
+        optional<uint64_t> next{};
+        for (const Flow &flow : flows) {
+            const auto event = flow.next_event(now);
+            if (event and (not next or *event < *next)) {
+                next = event;
+            }
+        }
+        if (not next) {
+            throw runtime_error("stalled with nothing left to happen");
+        }
+        const uint64_t elapsed = max<uint64_t>(*next, now + 1) - now;
+        for (Flow &flow : flows) {
+            flow.sender.tick(elapsed);
+            flow.receiver.tick(elapsed);
+        }
+        now += elapsed;
     }
 
-    const auto final_time = high_resolution_clock::now();
+    if (not all_received) {
+        throw runtime_error("a connection closed before its bytes arrived");
+    }
+    return results;
+}
 
-    const auto duration = duration_cast<nanoseconds>(final_time - first_time).count();
+static void print(const Options &options, const Results &results) {
+    const double gigabits_per_second = double(results.bytes) * 8 / results.wall_seconds / 1e9;
+    // with `-n 0` there are no bytes to divide by
+    const double segments_per_byte = results.bytes > 0 ? double(results.segments) / double(results.bytes) : 0;
+    const TCPConfig &config = options.config;
 
-    const auto gigabits_per_second = len * 8.0 / double(duration);
+    BenchOutput output{options.format};
+    if (not output.text()) {
+        output.record({{"bytes", options.bytes},
+                       {"connections", options.connections},
+                       {"recv_capacity", config.recv_capacity},
+                       {"send_capacity", config.send_capacity},
+                       {"loss", options.loss},
+                       {"duplicate", options.duplicate},
+                       {"reorder_depth", options.reorder_depth},
+                       {"rtt_ms", options.rtt_ms},
+                       {"seed", options.seed},
+                       {"gbit_per_s", gigabits_per_second},
+                       {"retransmissions", results.retransmissions},
+                       {"segments", results.segments},
+                       {"segments_per_byte", segments_per_byte},
+                       {"wall_s", results.wall_seconds},
+                       {"cpu_s", results.cpu_seconds},
+                       {"simulated_ms", results.simulated_ms}});
+        output.finish();
+    } else {
+        cout << fixed << setprecision(2) << "CPU-limited throughput: " << gigabits_per_second << " Gbit/s ("
+             << results.cpu_seconds << " s CPU), " << results.segments << " segments ("
+             << setprecision(5) << segments_per_byte << " per byte), " << results.retransmissions
+             << " retransmissions, " << results.simulated_ms << " ms simulated\n";
+    }
+}
 
-    cout << fixed << setprecision(2);
-    cout << "CPU-limited throughput" << (reorder ? " with reordering: " : "                : ") << gigabits_per_second
-         << " Gbit/s\n";
+static Options get_options(const int argc, char **argv) {
+    Options options;
+    const string capacity = to_string(TCPConfig::DEFAULT_CAPACITY);
+    BenchOptions command_line{
+        "Transfers bytes between pairs of TCPConnections over a simulated link, and reports the throughput\n"
+        "that the CPU allows."};
+    command_line.add('n', "bytes", "Bytes each connection transfers (default 104857600)", options.bytes);
+    command_line.add('c', "count", "Number of connections, run side by side (default 1)", options.connections);
+    command_line.add('w', "bytes", "Receive capacity (default " + capacity + ")", options.config.recv_capacity);
+    command_line.add('s', "bytes", "Send capacity (default " + capacity + ")", options.config.send_capacity);
+    command_line.add('t',
+                     "ms",
+                     "Retransmission timeout (default " + to_string(TCPConfig::TIMEOUT_DFLT) + ")",
+                     options.config.rt_timeout);
+    command_line.add('l', "rate", "Probability that a segment is lost, from 0 to 1 (default 0)", options.loss);
+    command_line.add(
+        'd', "rate", "Probability that a segment is delivered twice, from 0 to 1 (default 0)", options.duplicate);
+    command_line.add(
+        'r', "depth", "How many earlier segments a segment may overtake (default 0)", options.reorder_depth);
+    command_line.add('R', "ms", "Round-trip time of the link, on the simulated clock (default 0)", options.rtt_ms);
+    command_line.add('S', "seed", "Seed of the link's random decisions, and of the data (default 1)", options.seed);
+    command_line.parse(argc, argv);
 
-    while (x.active() or y.active()) {
-        loop();
+    if (options.connections == 0 or options.config.recv_capacity == 0 or options.config.send_capacity == 0 or
+        options.loss < 0 or options.loss >= 1 or options.duplicate < 0 or options.duplicate > 1) {
+        command_line.fail("bad option value");
     }
+    options.format = command_line.format();
+    return options;
 }
 
-int main() {
+int main(int argc, char **argv) {
     try {
-        main_loop(false);
-        main_loop(true);
+        const Options options = get_options(argc, argv);
+        print(options, run(options));
     } catch (const exception &e) {
         cerr << e.what() << "\n";
         return EXIT_FAILURE;
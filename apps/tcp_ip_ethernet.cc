@@ -33,6 +33,10 @@ static void show_usage(const char *argv0, const char *msg) {
 
          << "   -d <tapdev>     Connect to tap <tapdev>                         " << TAP_DFLT << "\n\n"
 
+         << "   -p <ifname>     Instead of a tap device, send and receive       (tap)\n"
+         << "                   frames on interface <ifname> through an\n"
+         << "                   AF_PACKET ring (e.g. one end of a veth pair).\n\n"
+
          << "   -h              Show this message.\n\n";
 
     if (msg != nullptr) {
@@ -48,10 +52,11 @@ static void check_argc(int argc, char **argv, int curr, const char *err) {
     }
 }
 
-static tuple<TCPConfig, FdAdapterConfig, Address, string> get_config(int argc, char **argv) {
+static tuple<TCPConfig, FdAdapterConfig, Address, string, bool> get_config(int argc, char **argv) {
     TCPConfig c_fsm{};
     FdAdapterConfig c_filt{};
     string tapdev = TAP_DFLT;
+    bool packet_ring = false;
 
     int curr = 1;
 
@@ -90,6 +95,12 @@ static tuple<TCPConfig, FdAdapterConfig, Address, string> get_config(int argc, c
             tapdev = argv[curr + 1];
             curr += 2;
 
+        } else if (strncmp("-p", argv[curr], 3) == 0) {
+            check_argc(argc, argv, curr, "ERROR: -p requires one argument.");
+            tapdev = argv[curr + 1];
+            packet_ring = true;
+            curr += 2;
+
         } else if (strncmp("-h", argv[curr], 3) == 0) {
             show_usage(argv[0], nullptr);
             exit(0);
@@ -106,7 +117,17 @@ static tuple<TCPConfig, FdAdapterConfig, Address, string> get_config(int argc, c
 
     Address next_hop{next_hop_address, "0"};
 
-    return make_tuple(c_fsm, c_filt, next_hop, tapdev);
+    return make_tuple(c_fsm, c_filt, next_hop, tapdev, packet_ring);
+}
+
+//! Connect a TCPSpongeSocket over `adapter`, and copy between it and stdin/stdout until both streams end
+template <typename AdapterT>
+static void run(AdapterT &&adapter, const TCPConfig &c_fsm, const FdAdapterConfig &c_filt) {
+    TCPSpongeSocket<AdapterT> tcp_socket(std::move(adapter));
+    tcp_socket.connect(c_fsm, c_filt);
+
+    bidirectional_stream_copy(tcp_socket);
+    tcp_socket.wait_until_closed();
 }
 
 int main(int argc, char **argv) {
@@ -124,15 +145,18 @@ int main(int argc, char **argv) {
         local_ethernet_address.at(0) |= 0x02;  // "10" in last two binary digits marks a private Ethernet address
         local_ethernet_address.at(0) &= 0xfe;
 
-        auto [c_fsm, c_filt, next_hop, tap_dev_name] = get_config(argc, argv);
-
-        TCPOverIPv4OverEthernetSpongeSocket tcp_socket(TCPOverIPv4OverEthernetAdapter(
-            TCPOverIPv4OverEthernetAdapter(TapFD(tap_dev_name), local_ethernet_address, c_filt.source, next_hop)));
-
-        tcp_socket.connect(c_fsm, c_filt);
+        auto [c_fsm, c_filt, next_hop, tap_dev_name, packet_ring] = get_config(argc, argv);
 
-        bidirectional_stream_copy(tcp_socket);
-        tcp_socket.wait_until_closed();
+        if (packet_ring) {
+            run(TCPOverIPv4OverPacketRingAdapter(
+                    PacketRing(tap_dev_name), local_ethernet_address, c_filt.source, next_hop),
+                c_fsm,
+                c_filt);
+        } else {
+            run(TCPOverIPv4OverEthernetAdapter(TapFD(tap_dev_name), local_ethernet_address, c_filt.source, next_hop),
+                c_fsm,
+                c_filt);
+        }
     } catch (const exception &e) {
         cerr << "Exception: " << e.what() << endl;
         return EXIT_FAILURE;
@@ -1,4 +1,5 @@
 #include "bidirectional_stream_copy.hh"
+#include "impairment.hh"
 #include "tcp_config.hh"
 #include "tcp_sponge_socket.hh"
 #include "tun.hh"
@@ -34,8 +35,16 @@ static void show_usage(const char *argv0, const char *msg) {
 
          << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n\n"
 
+         << "   -o              Use the tun's checksum and segmentation         (off)\n"
+         << "                   offloads, and send segments of up to 64 KiB\n\n"
+
          << "   -Lu <loss>      Set uplink loss to <rate> (float in 0..1)       (no loss)\n"
-         << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n\n"
+         << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n"
+         << "   -Iu <spec>      Impair the uplink as <spec> says, e.g.          (none)\n"
+         << "                   \"delay 40 10 loss 0.01 rate 1250000\" (see\n"
+         << "                   parse_impairment for the keywords)\n"
+         << "   -Id <spec>      Impair the downlink as <spec> says              (none)\n"
+         << "   -Is <seed>      Seed the impairments' random decisions          (random)\n\n"
 
          << "   -h              Show this message.\n\n";
 
@@ -52,13 +61,14 @@ static void check_argc(int argc, char **argv, int curr, const char *err) {
     }
 }
 
-static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char **argv) {
+static tuple<TCPConfig, FdAdapterConfig, bool, char *, bool> get_config(int argc, char **argv) {
     TCPConfig c_fsm{};
     FdAdapterConfig c_filt{};
     char *tundev = nullptr;
 
     int curr = 1;
     bool listen = false;
+    bool offload = false;
 
     string source_address = LOCAL_ADDRESS_DFLT;
     string source_port = to_string(uint16_t(random_device()()));
@@ -93,20 +103,34 @@ static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char
             tundev = argv[curr + 1];
             curr += 2;
 
+        } else if (strncmp("-o", argv[curr], 3) == 0) {
+            offload = true;
+            c_fsm.max_payload_size = TCPOverIPv4OverTunFdAdapter::MAX_OFFLOAD_PAYLOAD_SIZE;
+            curr += 1;
+
         } else if (strncmp("-Lu", argv[curr], 3) == 0) {
             check_argc(argc, argv, curr, "ERROR: -Lu requires one argument.");
-            float lossrate = strtof(argv[curr + 1], nullptr);
-            using LossRateUpT = decltype(c_filt.loss_rate_up);
-            c_filt.loss_rate_up =
-                static_cast<LossRateUpT>(static_cast<float>(numeric_limits<LossRateUpT>::max()) * lossrate);
+            c_filt.impairment_up.loss = strtod(argv[curr + 1], nullptr);
             curr += 2;
 
         } else if (strncmp("-Ld", argv[curr], 3) == 0) {
-            check_argc(argc, argv, curr, "ERROR: -Lu requires one argument.");
-            float lossrate = strtof(argv[curr + 1], nullptr);
-            using LossRateDnT = decltype(c_filt.loss_rate_dn);
-            c_filt.loss_rate_dn =
-                static_cast<LossRateDnT>(static_cast<float>(numeric_limits<LossRateDnT>::max()) * lossrate);
+            check_argc(argc, argv, curr, "ERROR: -Ld requires one argument.");
+            c_filt.impairment_dn.loss = strtod(argv[curr + 1], nullptr);
+            curr += 2;
+
+        } else if (strncmp("-Iu", argv[curr], 3) == 0) {
+            check_argc(argc, argv, curr, "ERROR: -Iu requires one argument.");
+            c_filt.impairment_up = parse_impairment(argv[curr + 1]);
+            curr += 2;
+
+        } else if (strncmp("-Id", argv[curr], 3) == 0) {
+            check_argc(argc, argv, curr, "ERROR: -Id requires one argument.");
+            c_filt.impairment_dn = parse_impairment(argv[curr + 1]);
+            curr += 2;
+
+        } else if (strncmp("-Is", argv[curr], 3) == 0) {
+            check_argc(argc, argv, curr, "ERROR: -Is requires one argument.");
+            c_filt.impairment_seed = strtoull(argv[curr + 1], nullptr, 0);
             curr += 2;
 
         } else if (strncmp("-h", argv[curr], 3) == 0) {
@@ -131,7 +155,7 @@ static tuple<TCPConfig, FdAdapterConfig, bool, char *> get_config(int argc, char
         c_filt.source = {source_address, source_port};
     }
 
-    return make_tuple(c_fsm, c_filt, listen, tundev);
+    return make_tuple(c_fsm, c_filt, listen, tundev, offload);
 }
 
 int main(int argc, char **argv) {
@@ -141,9 +165,9 @@ int main(int argc, char **argv) {
             return EXIT_FAILURE;
         }
 
-        auto [c_fsm, c_filt, listen, tun_dev_name] = get_config(argc, argv);
+        auto [c_fsm, c_filt, listen, tun_dev_name, offload] = get_config(argc, argv);
         LossyTCPOverIPv4SpongeSocket tcp_socket(LossyTCPOverIPv4OverTunFdAdapter(
-            TCPOverIPv4OverTunFdAdapter(TunFD(tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name))));
+            TCPOverIPv4OverTunFdAdapter(TunFD(tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name, false, offload))));
 
         if (listen) {
             tcp_socket.listen_and_accept(c_fsm, c_filt);
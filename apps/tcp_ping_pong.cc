@@ -0,0 +1,274 @@
+#include "bench_options.hh"
+#include "latency_histogram.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_sponge_socket.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+using Transport = TCPOverUDPSpongeSocket::Transport;
+
+//! The benchmark to run, from the command line
+struct Options {
+    size_t rounds = 5000;         //!< Number of requests
+    size_t request_size = 64;     //!< Bytes in each request
+    size_t response_size = 64;    //!< Bytes in each response
+    uint16_t delayed_ack_ms = 0;  //!< TCPConfig::delayed_ack_ms of both ends
+    string mode = "all";          //!< connection, socketpair, rings, inline, or all of them
+    string format = "text";       //!< Output format: text, csv or json
+};
+
+//! Read `size` bytes from the connection (fewer only at the end of the stream)
+static string receive(TCPOverUDPSpongeSocket &sock, const Transport transport, const size_t size) {
+    if (transport == Transport::Inline) {
+        ByteStream &inbound = sock.inbound_stream();
+        sock.run_until([&] { return inbound.buffer_size() >= size or inbound.eof(); });
+        return inbound.read(size);
+    }
+
+    string ret;
+    while (ret.size() < size and not sock.eof()) {
+        ret.append(sock.read(size - ret.size()));
+    }
+    return ret;
+}
+
+//! Write all of `data` to the connection
+static void transmit(TCPOverUDPSpongeSocket &sock, const Transport transport, const string &data) {
+    if (transport == Transport::Inline) {
+        sock.write_inline(data);
+    } else {
+        sock.write(data);
+    }
+}
+
+//! \brief Send requests from one TCPSpongeSocket to another over UDP on the loopback interface, each once the
+//! response to the previous one has arrived, and record the time from sending each request to receiving
+//! all of its response
+static LatencyHistogram ping_pong_sockets(const Options &options, const Transport transport) {
+    TCPConfig config;
+    config.rt_timeout = 100;  // so that closing doesn't linger long
+    config.delayed_ack_ms = options.delayed_ack_ms;
+
+    UDPSocket server_udp;
+    server_udp.bind(Address{"127.0.0.1", 0});
+    FdAdapterConfig server_config;
+    server_config.source = server_udp.local_address();
+    TCPOverUDPSpongeSocket server{TCPOverUDPSocketAdapter{move(server_udp)}, EventLoop::Backend::Poll, transport};
+
+    const string response(options.response_size, 'y');
+    thread server_thread([&] {
+        server.listen_and_accept(config, server_config);
+        while (true) {
+            const string request = receive(server, transport, options.request_size);
+            if (request.size() < options.request_size) {
+                break;
+            }
+            transmit(server, transport, response);
+        }
+        server.wait_until_closed();
+    });
+
+    FdAdapterConfig client_config;
+    client_config.destination = server_config.source;
+    TCPOverUDPSpongeSocket client{TCPOverUDPSocketAdapter{UDPSocket{}}, EventLoop::Backend::Poll, transport};
+    client.connect(config, client_config);
+
+    const string request(options.request_size, 'x');
+    LatencyHistogram latencies;
+    for (size_t i = 0; i < options.rounds; i++) {
+        const auto start = steady_clock::now();
+        transmit(client, transport, request);
+        if (receive(client, transport, options.response_size) != response) {
+            throw runtime_error("response doesn't match what was sent");
+        }
+        latencies.record(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+    }
+    client.wait_until_closed();
+    server_thread.join();
+
+    return latencies;
+}
+
+//! \brief Send requests between two TCPConnections in this thread, with segments handed straight from one
+//! to the other
+//! \details Time only passes on a simulated clock, when neither connection can make progress without a timer
+//! (a delayed ACK, say). A request's latency is the CPU time it took plus the simulated time it waited.
+static LatencyHistogram ping_pong_connections(const Options &options) {
+    TCPConfig config;
+    config.delayed_ack_ms = options.delayed_ack_ms;
+    TCPConnection client{config}, server{config};
+    client.connect();
+
+    const string request(options.request_size, 'x');
+    const string response(options.response_size, 'y');
+    string client_unsent, server_unsent;  // bytes not yet accepted by the connection
+    size_t server_received = 0;           // bytes of the current request received by the server
+    uint64_t now_ms = 0;
+
+    // do whatever can be done without time passing; returns whether anything happened
+    const auto step = [&] {
+        bool progress = false;
+        for (auto [connection, unsent] : {pair{&client, &client_unsent}, pair{&server, &server_unsent}}) {
+            if (not unsent->empty() and connection->remaining_outbound_capacity() > 0) {
+                unsent->erase(0, connection->write(*unsent));
+                progress = true;
+            }
+        }
+        for (auto [from, to] : {pair{&client, &server}, pair{&server, &client}}) {
+            for (; not from->segments_out().empty(); from->segments_out().pop()) {
+                to->segment_received(from->segments_out().front());
+                progress = true;
+            }
+        }
+
+        ByteStream &inbound = server.inbound_stream();
+        if (inbound.buffer_size() > 0) {
+            server_received += inbound.read(inbound.buffer_size()).size();
+            for (; server_received >= request.size(); server_received -= request.size()) {
+                server_unsent += response;
+            }
+            progress = true;
+        }
+        return progress;
+    };
+
+    // let time pass until the next timer of either connection
+    const auto wait = [&] {
+        optional<size_t> next{};
+        for (const TCPConnection *connection : {&client, &server}) {
+            const auto remaining = connection->time_until_next_deadline();
+            if (remaining and (not next or *remaining < *next)) {
+                next = remaining;
+            }
+        }
+        if (not next) {
+            throw runtime_error("stalled with nothing left to happen");
+        }
+        const size_t elapsed = max<size_t>(*next, 1);
+        client.tick(elapsed);
+        server.tick(elapsed);
+        now_ms += elapsed;
+    };
+
+    LatencyHistogram latencies;
+    for (size_t i = 0; i < options.rounds; i++) {
+        const auto start = steady_clock::now();
+        const uint64_t start_ms = now_ms;
+        client_unsent += request;
+
+        string received;
+        ByteStream &inbound = client.inbound_stream();
+        while (received.size() < response.size()) {
+            if (not step()) {
+                wait();
+            }
+            received += inbound.read(min(inbound.buffer_size(), response.size() - received.size()));
+        }
+        if (received != response) {
+            throw runtime_error("response doesn't match what was sent");
+        }
+
+        const auto cpu_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        latencies.record(cpu_ns + (now_ms - start_ms) * 1000000);
+    }
+
+    // close both ends, the server once it has seen the client's FIN
+    client.end_input_stream();
+    bool server_closed = false;
+    while (client.active() or server.active()) {
+        if (not server_closed and server.inbound_stream().eof()) {
+            server.end_input_stream();
+            server_closed = true;
+        }
+        if (not step()) {
+            wait();
+        }
+    }
+
+    return latencies;
+}
+
+static void print(const Options &options, const string &mode, const LatencyHistogram &latencies, BenchOutput &output) {
+    const auto us = [](const uint64_t ns) { return double(ns) / 1000; };
+    if (not output.text()) {
+        output.record({{"mode", mode},
+                       {"rounds", options.rounds},
+                       {"request_size", options.request_size},
+                       {"response_size", options.response_size},
+                       {"delayed_ack_ms", options.delayed_ack_ms},
+                       {"mean_us", latencies.mean() / 1000},
+                       {"p50_us", us(latencies.percentile(50))},
+                       {"p90_us", us(latencies.percentile(90))},
+                       {"p99_us", us(latencies.percentile(99))},
+                       {"p99_9_us", us(latencies.percentile(99.9))},
+                       {"max_us", us(latencies.max())}});
+    } else {
+        cout << fixed << setprecision(1) << left << setw(11) << mode << right << ": round trip p50 " << setw(7)
+             << us(latencies.percentile(50)) << " us, p99 " << setw(7) << us(latencies.percentile(99))
+             << " us, p99.9 " << setw(8) << us(latencies.percentile(99.9)) << " us, max " << setw(8)
+             << us(latencies.max()) << " us\n";
+    }
+}
+
+static Options get_options(const int argc, char **argv) {
+    Options options;
+    BenchOptions command_line{
+        "Sends requests over a TCP connection, each once the response to the previous one has arrived, and\n"
+        "reports the distribution of the round-trip times."};
+    command_line.add('n', "rounds", "Number of requests (default 5000)", options.rounds);
+    command_line.add('q', "bytes", "Size of each request (default 64)", options.request_size);
+    command_line.add('p', "bytes", "Size of each response (default 64)", options.response_size);
+    command_line.add(
+        'a', "ms", "Delayed ACK timeout of both ends (default 0, no delayed ACKs)", options.delayed_ack_ms);
+    command_line.add('m',
+                     "mode",
+                     "Where the connections run (default all):\n"
+                     "  connection  two TCPConnections in one thread, on a simulated clock\n"
+                     "  socketpair  TCPSpongeSockets over UDP, each with its own thread\n"
+                     "  rings       the same, with the owner's data passed through rings\n"
+                     "  inline      TCPSpongeSockets run to completion by the owner's thread",
+                     options.mode);
+    command_line.parse(argc, argv);
+
+    const vector<string> modes{"connection", "socketpair", "rings", "inline", "all"};
+    if (options.rounds == 0 or options.request_size == 0 or options.response_size == 0 or
+        find(modes.begin(), modes.end(), options.mode) == modes.end()) {
+        command_line.fail("bad option value");
+    }
+    options.format = command_line.format();
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        const Options options = get_options(argc, argv);
+        BenchOutput output{options.format};
+        const auto run = [&](const string &mode, const auto &benchmark) {
+            if (options.mode == mode or options.mode == "all") {
+                print(options, mode, benchmark(), output);
+            }
+        };
+        run("connection", [&] { return ping_pong_connections(options); });
+        run("socketpair", [&] { return ping_pong_sockets(options, Transport::SocketPair); });
+        run("rings", [&] { return ping_pong_sockets(options, Transport::Rings); });
+        run("inline", [&] { return ping_pong_sockets(options, Transport::Inline); });
+        output.finish();
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#include "sharded_tcp_stack.hh"
+#include "tcp_config.hh"
+#include "tcp_stack.hh"
+#include "tun.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+constexpr const char *TUN_DFLT = "tun144";
+
+static void show_usage(const char *argv0) {
+    cerr << "Usage: " << argv0 << " [-d <tundev>] [-n <shards>] <port>\n\n"
+         << "Echoes back whatever arrives on every TCP connection to <port>, with the connections spread\n"
+         << "over <shards> threads (default: one per core), each reading its own queue of a multi-queue\n"
+         << "TUN device (default " << TUN_DFLT << ", which must have been created with `multi_queue`).\n";
+}
+
+//! Send back what a connection has received, until the peer has finished
+static bool echo(const size_t, TCPStack &stack, const TCPStack::ConnectionId id) {
+    ByteStream &inbound = stack.inbound_stream(id);
+    const size_t len = min(inbound.buffer_size(), stack.connection(id).remaining_outbound_capacity());
+    if (len > 0) {
+        stack.write(id, inbound.read(len));
+    }
+    return not((inbound.eof() and inbound.buffer_empty()) or inbound.error());
+}
+
+static void program_body(const char *tun_name, const size_t shards, const uint16_t port) {
+    TunTapQueues tun{tun_name, true, shards};
+    vector<FileDescriptor> queues;
+    for (size_t i = 0; i < shards; i++) {
+        queues.push_back(tun.queue(i).duplicate());
+    }
+
+    ShardedTCPStack stack{move(queues), echo};
+    stack.listen(port, TCPConfig{}, 128);
+    stack.start();
+
+    cerr << "Echoing connections to port " << port << " on " << tun_name << " with " << shards << " shards...\n";
+    while (true) {
+        this_thread::sleep_for(chrono::seconds(10));
+        for (size_t i = 0; i < shards; i++) {
+            const ShardedTCPStack::Stats stats = stack.stats(i);
+            cerr << "shard " << i << ": " << stats.received << " datagrams received, " << stats.steered
+                 << " passed to other shards\n";
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    try {
+        const char *tun_name = TUN_DFLT;
+        size_t shards = max(1U, thread::hardware_concurrency());
+        int curr = 1;
+        for (; curr + 1 < argc; curr += 2) {
+            if (strcmp(argv[curr], "-d") == 0) {
+                tun_name = argv[curr + 1];
+            } else if (strcmp(argv[curr], "-n") == 0) {
+                shards = strtoul(argv[curr + 1], nullptr, 0);
+            } else {
+                break;
+            }
+        }
+        if (curr + 1 != argc or shards == 0) {
+            show_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        program_body(tun_name, shards, uint16_t(strtoul(argv[curr], nullptr, 0)));
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+#include "eventloop.hh"
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+#include "tcp_config.hh"
+#include "tcp_stack.hh"
+#include "tun.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_set>
+
+using namespace std;
+
+constexpr const char *TUN_DFLT = "tun144";
+
+static void show_usage(const char *argv0) {
+    cerr << "Usage: " << argv0 << " [-d <tundev>] [-b <backlog>] <port>\n\n"
+         << "Echoes back whatever arrives on every TCP connection to <port>, for any number of\n"
+         << "connections at once, using one TCPStack on one TUN device (default " << TUN_DFLT << ").\n";
+}
+
+//! Send back what a connection has received, and close it once the peer has finished
+static void echo(TCPStack &stack, unordered_set<TCPStack::ConnectionId> &accepted, const TCPStack::ConnectionId id) {
+    ByteStream &inbound = stack.inbound_stream(id);
+    const size_t len = min(inbound.buffer_size(), stack.connection(id).remaining_outbound_capacity());
+    if (len > 0) {
+        stack.write(id, inbound.read(len));
+    }
+    if ((inbound.eof() and inbound.buffer_empty()) or inbound.error()) {
+        accepted.erase(id);
+        stack.close(id);
+    }
+}
+
+static void program_body(const char *tun_name, const uint16_t port, const size_t backlog) {
+    TunFD tun{tun_name};
+    EventLoop loop{EventLoop::Backend::Epoll};
+    TCPStack stack{65536};
+    unordered_set<TCPStack::ConnectionId> accepted;
+
+    stack.listen(port, TCPConfig{}, backlog);
+
+    uint64_t last_tick_ms = timestamp_ms();
+    const auto tick = [&] {
+        const uint64_t now = timestamp_ms();
+        stack.tick(now - last_tick_ms);
+        last_tick_ms = now;
+    };
+
+    loop.add_rule(tun, Direction::In, [&] {
+        tick();
+        InternetDatagram dgram;
+        if (dgram.parse(tun.read()) != ParseResult::NoError) {
+            return;
+        }
+        const optional<TCPStack::ConnectionId> id = stack.datagram_received(dgram);
+        while (const auto new_id = stack.accept(port)) {
+            accepted.insert(new_id.value());
+            echo(stack, accepted, new_id.value());
+        }
+        if (id.has_value() and accepted.count(id.value()) != 0) {
+            echo(stack, accepted, id.value());
+        }
+    });
+
+    loop.add_rule(
+        tun,
+        Direction::Out,
+        [&] {
+            for (; not stack.datagrams_out().empty(); stack.datagrams_out().pop()) {
+                tun.write(stack.datagrams_out().front().serialize());
+            }
+        },
+        [&] { return not stack.datagrams_out().empty(); });
+
+    cerr << "Echoing connections to port " << port << " on " << tun_name << "...\n";
+    while (true) {
+        const optional<size_t> deadline = stack.time_until_next_deadline();
+        if (loop.wait_next_event(deadline.has_value() ? int(deadline.value()) : -1) == EventLoop::Result::Exit) {
+            break;
+        }
+        tick();
+    }
+}
+
+int main(int argc, char **argv) {
+    try {
+        const char *tun_name = TUN_DFLT;
+        size_t backlog = 128;
+        int curr = 1;
+        for (; curr + 1 < argc; curr += 2) {
+            if (strcmp(argv[curr], "-d") == 0) {
+                tun_name = argv[curr + 1];
+            } else if (strcmp(argv[curr], "-b") == 0) {
+                backlog = strtoul(argv[curr + 1], nullptr, 0);
+            } else {
+                break;
+            }
+        }
+        if (curr + 1 != argc) {
+            show_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        program_body(tun_name, uint16_t(strtoul(argv[curr], nullptr, 0)), backlog);
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,11 +1,11 @@
 #include "bidirectional_stream_copy.hh"
+#include "impairment.hh"
 #include "tcp_config.hh"
 #include "tcp_sponge_socket.hh"
 
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <limits>
 #include <random>
 #include <string>
 #include <tuple>
@@ -29,7 +29,19 @@ static void show_usage(const char *argv0, const char *msg) {
          << "   -t <tmout>      Set rt_timeout to tmout                         " << TCPConfig::TIMEOUT_DFLT << "\n\n"
 
          << "   -Lu <loss>      Set uplink loss to <rate> (float in 0..1)       (no loss)\n"
-         << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n\n"
+         << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n"
+         << "   -Iu <spec>      Impair the uplink as <spec> says, e.g.          (none)\n"
+         << "                   \"delay 40 10 loss 0.01 rate 1250000\" (see\n"
+         << "                   parse_impairment for the keywords)\n"
+         << "   -Id <spec>      Impair the downlink as <spec> says              (none)\n"
+         << "   -Is <seed>      Seed the impairments' random decisions          (random)\n\n"
+
+         << "   -u              Do datagram and socket I/O through io_uring.    (poll)\n\n"
+
+         << "   -g              Batch segments with UDP GSO and GRO.            (one datagram per syscall)\n\n"
+
+         << "   -r              Pass data to and from the TCP thread through    (socket pair)\n"
+         << "                   shared-memory rings.\n\n"
 
          << "   -h              Show this message and quit.\n\n";
 
@@ -46,12 +58,18 @@ static void check_argc(int argc, char **argv, int curr, const char *err) {
     }
 }
 
-static tuple<TCPConfig, FdAdapterConfig, bool> get_config(int argc, char **argv) {
+using Transport = LossyTCPOverUDPSpongeSocket::Transport;
+
+static tuple<TCPConfig, FdAdapterConfig, bool, EventLoop::Backend, Transport, bool> get_config(int argc,
+                                                                                               char **argv) {
     TCPConfig c_fsm{};
     FdAdapterConfig c_filt{};
 
     int curr = 1;
     bool listen = false;
+    EventLoop::Backend backend = EventLoop::Backend::Poll;
+    Transport transport = Transport::SocketPair;
+    bool segmentation_offload = false;
 
     while (argc - curr > 2) {
         if (strncmp("-l", argv[curr], 3) == 0) {
@@ -70,20 +88,41 @@ static tuple<TCPConfig, FdAdapterConfig, bool> get_config(int argc, char **argv)
 
         } else if (strncmp("-Lu", argv[curr], 3) == 0) {
             check_argc(argc, argv, curr, "ERROR: -Lu requires one argument.");
-            float lossrate = strtof(argv[curr + 1], nullptr);
-            using LossRateUpT = decltype(c_filt.loss_rate_up);
-            c_filt.loss_rate_up =
-                static_cast<LossRateUpT>(static_cast<float>(numeric_limits<LossRateUpT>::max()) * lossrate);
+            c_filt.impairment_up.loss = strtod(argv[curr + 1], nullptr);
             curr += 2;
 
         } else if (strncmp("-Ld", argv[curr], 3) == 0) {
-            check_argc(argc, argv, curr, "ERROR: -Lu requires one argument.");
-            float lossrate = strtof(argv[curr + 1], nullptr);
-            using LossRateDnT = decltype(c_filt.loss_rate_dn);
-            c_filt.loss_rate_dn =
-                static_cast<LossRateDnT>(static_cast<float>(numeric_limits<LossRateDnT>::max()) * lossrate);
+            check_argc(argc, argv, curr, "ERROR: -Ld requires one argument.");
+            c_filt.impairment_dn.loss = strtod(argv[curr + 1], nullptr);
+            curr += 2;
+
+        } else if (strncmp("-Iu", argv[curr], 3) == 0) {
+            check_argc(argc, argv, curr, "ERROR: -Iu requires one argument.");
+            c_filt.impairment_up = parse_impairment(argv[curr + 1]);
+            curr += 2;
+
+        } else if (strncmp("-Id", argv[curr], 3) == 0) {
+            check_argc(argc, argv, curr, "ERROR: -Id requires one argument.");
+            c_filt.impairment_dn = parse_impairment(argv[curr + 1]);
+            curr += 2;
+
+        } else if (strncmp("-Is", argv[curr], 3) == 0) {
+            check_argc(argc, argv, curr, "ERROR: -Is requires one argument.");
+            c_filt.impairment_seed = strtoull(argv[curr + 1], nullptr, 0);
             curr += 2;
 
+        } else if (strncmp("-u", argv[curr], 3) == 0) {
+            backend = EventLoop::Backend::IoUring;
+            curr += 1;
+
+        } else if (strncmp("-g", argv[curr], 3) == 0) {
+            segmentation_offload = true;
+            curr += 1;
+
+        } else if (strncmp("-r", argv[curr], 3) == 0) {
+            transport = Transport::Rings;
+            curr += 1;
+
         } else if (strncmp("-h", argv[curr], 3) == 0) {
             show_usage(argv[0], nullptr);
             exit(0);
@@ -94,13 +133,19 @@ static tuple<TCPConfig, FdAdapterConfig, bool> get_config(int argc, char **argv)
         }
     }
 
+    // io_uring receives don't report the size of GRO-coalesced datagrams
+    if (segmentation_offload and backend == EventLoop::Backend::IoUring) {
+        show_usage(argv[0], "ERROR: -g can't be combined with -u.");
+        exit(1);
+    }
+
     if (listen) {
         c_filt.source = {"0", argv[argc - 1]};
     } else {
         c_filt.destination = {argv[argc - 2], argv[argc - 1]};
     }
 
-    return make_tuple(c_fsm, c_filt, listen);
+    return make_tuple(c_fsm, c_filt, listen, backend, transport, segmentation_offload);
 }
 
 int main(int argc, char **argv) {
@@ -111,14 +156,17 @@ int main(int argc, char **argv) {
         }
 
         // handle configuration and UDP setup from cmdline arguments
-        auto [c_fsm, c_filt, listen] = get_config(argc, argv);
+        auto [c_fsm, c_filt, listen, backend, transport, segmentation_offload] = get_config(argc, argv);
 
         // build a TCP FSM on top of the UDP socket
         UDPSocket udp_sock;
         if (listen) {
             udp_sock.bind(c_filt.source);
         }
-        LossyTCPOverUDPSpongeSocket tcp_socket(LossyTCPOverUDPSocketAdapter(TCPOverUDPSocketAdapter(move(udp_sock))));
+        LossyTCPOverUDPSpongeSocket tcp_socket(
+            LossyTCPOverUDPSocketAdapter(TCPOverUDPSocketAdapter(move(udp_sock), segmentation_offload)),
+            backend,
+            transport);
         if (listen) {
             tcp_socket.listen_and_accept(c_fsm, c_filt);
         } else {
@@ -0,0 +1,186 @@
+#include "address.hh"
+#include "ipv4_datagram.hh"
+#include "socket.hh"
+#include "tcp_segment.hh"
+#include "tun.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <linux/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr const char *TUN_DFLT = "tun144";
+constexpr size_t datagrams_per_thread = 50000;
+constexpr size_t flows_per_thread = 16;
+constexpr uint8_t PROTO_UDP = 17;
+
+static void show_usage(const char *argv0) {
+    cerr << "Usage: " << argv0 << " [-d <tundev>] [-n <max_queues>] <address>\n\n"
+         << "Measures packets per second through 1, 2, 4, ... <max_queues> (default 4) queues of a multi-queue\n"
+         << "TUN device (default " << TUN_DFLT << ", created with `multi_queue`), with one thread per queue.\n"
+         << "<address> must be routed through the device, and not be one of the host's own.\n";
+}
+
+//! The host's own IPv4 address on a device
+static Address device_address(const string &devname) {
+    FileDescriptor sock{SystemCall("socket", ::socket(AF_INET, SOCK_DGRAM, 0))};
+    struct ifreq req {};
+    strncpy(static_cast<char *>(req.ifr_name), devname.data(), IFNAMSIZ - 1);
+    SystemCall("ioctl", ioctl(sock.fd_num(), SIOCGIFADDR, static_cast<void *>(&req)));
+    return Address{&req.ifr_addr, sizeof(sockaddr_in)};
+}
+
+//! Attach the first `count` queues, and detach the rest
+static void use_queues(TunTapQueues &tun, const size_t count) {
+    for (size_t i = 0; i < tun.size(); i++) {
+        if (i < count) {
+            tun.attach(i);
+        } else {
+            tun.detach(i);
+        }
+    }
+}
+
+//! Print a line of results
+static void report(const char *direction, const size_t queues, const size_t packets, const nanoseconds duration) {
+    cout << fixed << setprecision(0) << direction << ", " << setw(2) << queues << " queues: " << setw(9)
+         << double(packets) * 1e9 / double(duration.count()) << " packets/s\n";
+}
+
+//! \brief The kernel sends UDP datagrams out of the device, from one sending thread per queue, and each
+//! queue is read by its own thread
+static void kernel_to_queues(TunTapQueues &tun, const size_t queues, const Address &remote) {
+    use_queues(tun, queues);
+
+    atomic<bool> sending{true};
+    atomic<size_t> received{0};
+    vector<thread> readers;
+    for (size_t i = 0; i < queues; i++) {
+        readers.emplace_back([&, queue = tun.queue(i).duplicate()]() mutable {
+            string buffer;
+            size_t mine = 0;
+            pollfd pfd{queue.fd_num(), POLLIN, 0};
+            // keep reading until the senders are done and the queue has been quiet for a while
+            while (SystemCall("poll", ::poll(&pfd, 1, 100)) > 0 or sending) {
+                if (pfd.revents & POLLIN) {
+                    queue.read(buffer, 65536);
+                    mine += buffer.size() > 9 and uint8_t(buffer[9]) == PROTO_UDP;
+                }
+            }
+            received += mine;
+        });
+    }
+
+    const auto start = steady_clock::now();
+    vector<thread> senders;
+    for (size_t i = 0; i < queues; i++) {
+        senders.emplace_back([&, i] {
+            UDPSocket sock;
+            const string payload(64, 'x');
+            for (size_t n = 0; n < datagrams_per_thread; n++) {
+                const auto port = uint16_t(10000 + i * flows_per_thread + n % flows_per_thread);
+                sock.sendto(Address{remote.ip(), port}, payload);
+            }
+        });
+    }
+    for (auto &sender : senders) {
+        sender.join();
+    }
+    const auto sent = steady_clock::now();
+    sending = false;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+
+    report("kernel -> queues", queues, received, sent - start);
+    const size_t total = queues * datagrams_per_thread;
+    if (received < total) {
+        cout << "    (" << total - received << " of " << total << " datagrams dropped by the device)\n";
+    }
+}
+
+//! Each queue's thread writes TCP segments into the kernel, from its own set of flows
+static void queues_to_kernel(TunTapQueues &tun, const size_t queues, const Address &remote, const Address &local) {
+    use_queues(tun, queues);
+
+    vector<vector<string>> datagrams(queues);
+    for (size_t i = 0; i < queues; i++) {
+        for (size_t flow = 0; flow < flows_per_thread; flow++) {
+            TCPSegment seg;
+            seg.header().sport = uint16_t(10000 + i * flows_per_thread + flow);
+            seg.header().dport = 9;  // nothing listens there; the kernel answers with a RST
+            seg.header().ack = true;
+            InternetDatagram dgram;
+            dgram.header().src = remote.ipv4_numeric();
+            dgram.header().dst = local.ipv4_numeric();
+            dgram.header().len = dgram.header().hlen * 4 + seg.header().doff * 4;
+            dgram.payload() = seg.serialize(dgram.header().pseudo_cksum());
+            datagrams[i].push_back(dgram.serialize().concatenate());
+        }
+    }
+
+    const auto start = steady_clock::now();
+    vector<thread> writers;
+    for (size_t i = 0; i < queues; i++) {
+        writers.emplace_back([&, i, queue = tun.queue(i).duplicate()]() mutable {
+            for (size_t n = 0; n < datagrams_per_thread; n++) {
+                queue.write(datagrams[i][n % flows_per_thread]);
+            }
+        });
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    report("queues -> kernel", queues, queues * datagrams_per_thread, steady_clock::now() - start);
+}
+
+int main(int argc, char **argv) {
+    try {
+        const char *tun_name = TUN_DFLT;
+        size_t max_queues = 4;
+        int curr = 1;
+        for (; curr + 1 < argc; curr += 2) {
+            if (strcmp(argv[curr], "-d") == 0) {
+                tun_name = argv[curr + 1];
+            } else if (strcmp(argv[curr], "-n") == 0) {
+                max_queues = strtoul(argv[curr + 1], nullptr, 0);
+            } else {
+                break;
+            }
+        }
+        if (curr + 1 != argc or max_queues == 0) {
+            show_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        const Address remote{argv[curr]};
+        const Address local = device_address(tun_name);
+        TunTapQueues tun{tun_name, true, max_queues};
+        for (size_t queues = 1; queues <= max_queues; queues *= 2) {
+            kernel_to_queues(tun, queues, remote);
+        }
+        for (size_t queues = 1; queues <= max_queues; queues *= 2) {
+            queues_to_kernel(tun, queues, remote, local);
+        }
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+#include "bench.hh"
+
+#include "bench_options.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+//! The command-line options of run()
+struct Options {
+    string filter{};           //!< Only run benchmarks whose names contain this
+    double min_time_ms = 100;  //!< Shortest duration of a timed run
+    size_t repetitions = 5;    //!< Number of timed runs, of which the median is reported
+};
+
+//! Time `iterations` operations, in nanoseconds
+static double time_ns(const BenchmarkSuite::Body &body, const size_t iterations) {
+    const auto start = steady_clock::now();
+    body(iterations);
+    return double(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+}
+
+void BenchmarkSuite::add(const string &name, const size_t bytes_per_op, Body body) {
+    _benchmarks.push_back({name, bytes_per_op, move(body)});
+}
+
+void BenchmarkSuite::add_report(function<void()> report) { _reports.push_back(move(report)); }
+
+//! \details Options: `-b <substring>` selects benchmarks by name, `-m <ms>` sets the shortest timed run,
+//! `-r <count>` the number of timed runs, and `-f text|csv|json` the output format.
+int BenchmarkSuite::run(const int argc, char **argv) const {
+    Options options;
+    BenchOptions command_line;
+    command_line.add('b', "substring", "Only run the benchmarks whose names contain <substring>", options.filter);
+    command_line.add('m', "ms", "Shortest duration of each timed run (default 100)", options.min_time_ms);
+    command_line.add(
+        'r', "count", "Number of timed runs, of which the median is reported (default 5)", options.repetitions);
+    command_line.parse(argc, argv);
+    if (options.repetitions == 0) {
+        command_line.fail("bad option value");
+    }
+    const double min_time_ns = options.min_time_ms * 1e6;
+    BenchOutput output{command_line.format()};
+
+    try {
+        for (const auto &report : _reports) {
+            report();
+        }
+
+        for (const Benchmark &benchmark : _benchmarks) {
+            if (benchmark.name.find(options.filter) == string::npos) {
+                continue;
+            }
+
+            // calibrate: grow the number of iterations until a run lasts the minimum time
+            size_t iterations = 1;
+            for (double elapsed = time_ns(benchmark.body, iterations); elapsed < min_time_ns;) {
+                const double factor = elapsed > 0 ? min(100.0, max(2.0, 1.2 * min_time_ns / elapsed)) : 100.0;
+                iterations = static_cast<size_t>(double(iterations) * factor);
+                elapsed = time_ns(benchmark.body, iterations);
+            }
+
+            vector<double> ns_per_op;
+            for (size_t i = 0; i < options.repetitions; i++) {
+                ns_per_op.push_back(time_ns(benchmark.body, iterations) / double(iterations));
+            }
+            sort(ns_per_op.begin(), ns_per_op.end());
+            const double median = ns_per_op[ns_per_op.size() / 2];
+            const double megabytes_per_second = double(benchmark.bytes_per_op) / median * 1e3;
+
+            if (not output.text()) {
+                output.record({{"name", benchmark.name},
+                               {"ns_per_op", median},
+                               {"mb_per_s", megabytes_per_second},
+                               {"iterations", iterations},
+                               {"repetitions", options.repetitions}});
+            } else {
+                cout << left << setw(48) << benchmark.name << right << fixed << setprecision(1) << setw(12) << median
+                     << " ns/op";
+                if (benchmark.bytes_per_op > 0) {
+                    cout << setw(10) << megabytes_per_second << " MB/s";
+                }
+                cout << endl;
+            }
+        }
+        output.finish();
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
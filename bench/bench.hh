@@ -0,0 +1,49 @@
+#ifndef SPONGE_BENCH_BENCH_HH
+#define SPONGE_BENCH_BENCH_HH
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+//! \brief A set of microbenchmarks, each timing one operation of a component in isolation
+//! \details A benchmark is a function that performs its operation `iterations` times. run() calibrates the
+//! number of iterations until one run lasts at least the minimum time, then times several runs and reports
+//! the median time per operation, so that results can be compared across commits. Setup done inside the
+//! function is timed too, so it should be cheap next to the operations (or done once, outside).
+class BenchmarkSuite {
+  public:
+    //! Function that performs the benchmarked operation `iterations` times
+    using Body = std::function<void(const size_t iterations)>;
+
+  private:
+    struct Benchmark {
+        std::string name;     //!< Name, like `component/operation/parameter`
+        size_t bytes_per_op;  //!< Bytes each operation processes (0 if throughput makes no sense)
+        Body body;            //!< The operation
+    };
+
+    std::vector<Benchmark> _benchmarks{};
+    std::vector<std::function<void()>> _reports{};  //!< Called by run() before the benchmarks
+
+  public:
+    //! Add a benchmark
+    void add(const std::string &name, const size_t bytes_per_op, Body body);
+
+    //! \brief Add a report, which run() calls once the command line has been parsed, before the benchmarks
+    //! \details For figures that aren't timings (e.g. memory use); a report should print them to stderr, so
+    //! that the CSV and JSON output stays parseable.
+    void add_report(std::function<void()> report);
+
+    //! \brief Run the benchmarks selected on the command line, and print the results
+    //! \returns the exit status for main()
+    int run(const int argc, char **argv) const;
+};
+
+//! Keep the compiler from optimizing away the computation of `value`
+template <typename T>
+inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#endif  // SPONGE_BENCH_BENCH_HH
@@ -0,0 +1,33 @@
+#include "bench.hh"
+#include "byte_stream.hh"
+
+#include <string>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    BenchmarkSuite suite;
+
+    for (const size_t chunk : {1, 64, 1000, 4096, 65536}) {
+        const string data(chunk, 'x');
+
+        suite.add("byte_stream/write_read/" + to_string(chunk), chunk, [data](const size_t iterations) {
+            ByteStream stream{65536};
+            for (size_t i = 0; i < iterations; i++) {
+                stream.write(data);
+                do_not_optimize(stream.read(data.size()));
+            }
+        });
+
+        suite.add("byte_stream/write_peek_pop/" + to_string(chunk), chunk, [data](const size_t iterations) {
+            ByteStream stream{65536};
+            for (size_t i = 0; i < iterations; i++) {
+                stream.write(data);
+                do_not_optimize(stream.peek_output(data.size()));
+                stream.pop_output(data.size());
+            }
+        });
+    }
+
+    return suite.run(argc, argv);
+}
@@ -0,0 +1,33 @@
+#include "bench.hh"
+#include "util.hh"
+
+#include <numeric>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    BenchmarkSuite suite;
+
+    // an odd size, and an odd offset, catch the byte-at-a-time paths
+    for (const size_t size : {20, 1499, 1500, 65536}) {
+        for (const size_t offset : {0, 1}) {
+            string data(size + offset, 0);
+            iota(data.begin(), data.end(), 0);
+
+            suite.add("checksum/add/" + to_string(size) + (offset ? "/unaligned" : ""),
+                      size,
+                      [data, offset](const size_t iterations) {
+                          const string_view view = string_view(data).substr(offset);
+                          for (size_t i = 0; i < iterations; i++) {
+                              InternetChecksum checksum;
+                              checksum.add(view);
+                              do_not_optimize(checksum.value());
+                          }
+                      });
+        }
+    }
+
+    return suite.run(argc, argv);
+}
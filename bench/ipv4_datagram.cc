@@ -0,0 +1,40 @@
+#include "address.hh"
+#include "bench.hh"
+#include "buffer.hh"
+#include "ipv4_datagram.hh"
+
+#include <string>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    BenchmarkSuite suite;
+
+    for (const size_t payload_size : {40, 1020}) {
+        IPv4Datagram datagram;
+        datagram.header().src = Address{"10.0.0.1"}.ipv4_numeric();
+        datagram.header().dst = Address{"10.0.0.2"}.ipv4_numeric();
+        datagram.payload() = Buffer{string(payload_size, 'x')};
+        datagram.header().len = datagram.header().hlen * 4 + payload_size;
+        const Buffer serialized{datagram.serialize().concatenate()};
+        const size_t size = serialized.size();
+
+        suite.add("ipv4_datagram/serialize/" + to_string(size), size, [datagram](const size_t iterations) {
+            for (size_t i = 0; i < iterations; i++) {
+                do_not_optimize(datagram.serialize());
+            }
+        });
+
+        suite.add("ipv4_datagram/parse/" + to_string(size), size, [serialized](const size_t iterations) {
+            for (size_t i = 0; i < iterations; i++) {
+                IPv4Datagram parsed;
+                if (parsed.parse(serialized) != ParseResult::NoError) {
+                    throw runtime_error("ipv4_datagram/parse: bad datagram");
+                }
+                do_not_optimize(parsed);
+            }
+        });
+    }
+
+    return suite.run(argc, argv);
+}
@@ -0,0 +1,58 @@
+#include "address.hh"
+#include "bench.hh"
+#include "buffer.hh"
+#include "ethernet_frame.hh"
+#include "ipv4_datagram.hh"
+#include "network_interface.hh"
+
+#include <memory>
+#include <string>
+
+using namespace std;
+
+static const EthernetAddress local_ethernet_address{0x02, 0, 0, 0, 0, 1};
+static const EthernetAddress neighbor_ethernet_address{0x02, 0, 0, 0, 0, 2};
+static const Address local_address{"10.0.0.1"};
+static const Address neighbor_address{"10.0.0.2"};
+
+static InternetDatagram make_datagram(const Address &src, const Address &dst) {
+    InternetDatagram datagram;
+    datagram.header().src = src.ipv4_numeric();
+    datagram.header().dst = dst.ipv4_numeric();
+    datagram.payload() = Buffer{string(1000, 'x')};
+    datagram.header().len = datagram.header().hlen * 4 + datagram.payload().size();
+    return datagram;
+}
+
+int main(int argc, char **argv) {
+    BenchmarkSuite suite;
+
+    const InternetDatagram outbound = make_datagram(local_address, neighbor_address);
+    const size_t size = outbound.header().len;
+
+    // (the constructor logs the interface's addresses, so the interface is made once)
+    auto interface = make_shared<NetworkInterface>(local_ethernet_address, local_address);
+    interface->add_static_neighbor(neighbor_address, neighbor_ethernet_address);
+
+    suite.add("network_interface/send_datagram", size, [interface, outbound](const size_t iterations) {
+        for (size_t i = 0; i < iterations; i++) {
+            interface->send_datagram(outbound, neighbor_address);
+            do_not_optimize(interface->frames_out().front());
+            interface->frames_out().pop();
+        }
+    });
+
+    EthernetFrame inbound;
+    inbound.header().src = neighbor_ethernet_address;
+    inbound.header().dst = local_ethernet_address;
+    inbound.header().type = EthernetHeader::TYPE_IPv4;
+    inbound.payload() = Buffer{make_datagram(neighbor_address, local_address).serialize().concatenate()};
+
+    suite.add("network_interface/recv_frame", size, [interface, inbound](const size_t iterations) {
+        for (size_t i = 0; i < iterations; i++) {
+            do_not_optimize(interface->recv_frame(inbound));
+        }
+    });
+
+    return suite.run(argc, argv);
+}
@@ -0,0 +1,86 @@
+#include "address.hh"
+#include "bench.hh"
+#include "buffer.hh"
+#include "ethernet_frame.hh"
+#include "ipv4_datagram.hh"
+#include "router.hh"
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+constexpr size_t egress_interfaces = 3;
+
+static EthernetAddress ethernet_address(const uint8_t n) { return {0x02, 0, 0, 0, 1, n}; }
+
+//! \brief A router with one ingress interface, `egress_interfaces` more, and `route_count` random routes
+//! (plus a default route) to next hops on them
+static shared_ptr<Router> make_router(const size_t route_count) {
+    // the interfaces log their addresses, and Router::add_route each route
+    auto *const log = cerr.rdbuf(nullptr);
+
+    auto router_ptr = make_shared<Router>();
+    Router &router = *router_ptr;
+    router.add_interface({ethernet_address(0), Address{"10.0.0.1"}});
+    for (uint8_t i = 1; i <= egress_interfaces; i++) {
+        const size_t index = router.add_interface({ethernet_address(i), Address{"10.0." + to_string(i) + ".1"}});
+        router.interface(index).add_static_neighbor(Address{"10.0." + to_string(i) + ".2"}, ethernet_address(i + 10));
+    }
+
+    mt19937 random{1};
+    router.add_route(0, 0, Address{"10.0.1.2"}, 1);
+    for (size_t i = 0; i < route_count; i++) {
+        const uint8_t prefix_length = 8 + random() % 17;
+        const size_t interface = 1 + random() % egress_interfaces;
+        router.add_route(static_cast<uint32_t>(random()) & ~(~uint32_t{0} >> prefix_length),
+                         prefix_length,
+                         Address{"10.0." + to_string(interface) + ".2"},
+                         interface);
+    }
+    cerr.rdbuf(log);
+    cerr.clear();
+
+    return router_ptr;
+}
+
+int main(int argc, char **argv) {
+    BenchmarkSuite suite;
+
+    // frames for the ingress interface, to random destinations
+    mt19937 random{2};
+    vector<EthernetFrame> frames(256);
+    for (auto &frame : frames) {
+        InternetDatagram datagram;
+        datagram.header().src = Address{"10.0.0.2"}.ipv4_numeric();
+        datagram.header().dst = static_cast<uint32_t>(random());
+        datagram.payload() = Buffer{string(1000, 'x')};
+        datagram.header().len = datagram.header().hlen * 4 + datagram.payload().size();
+
+        frame.header().src = ethernet_address(10);
+        frame.header().dst = ethernet_address(0);
+        frame.header().type = EthernetHeader::TYPE_IPv4;
+        frame.payload() = Buffer{datagram.serialize().concatenate()};
+    }
+
+    for (const size_t route_count : {8, 1000}) {
+        auto router = make_router(route_count);
+        suite.add("router/route/" + to_string(route_count), 0, [router, frames](const size_t iterations) {
+            for (size_t i = 0; i < iterations; i++) {
+                router->interface(0).recv_frame(frames[i % frames.size()]);
+                router->route();
+                for (size_t j = 1; j <= egress_interfaces; j++) {
+                    auto &frames_out = router->interface(j).frames_out();
+                    for (; not frames_out.empty(); frames_out.pop()) {
+                        do_not_optimize(frames_out.front());
+                    }
+                }
+            }
+        });
+    }
+
+    return suite.run(argc, argv);
+}
@@ -0,0 +1,64 @@
+#include "bench.hh"
+#include "stream_reassembler.hh"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+constexpr size_t segment_size = 1000;
+constexpr size_t window = 64 * segment_size;  //!< Bytes reassembled by each operation
+
+//! \brief The substrings of one window, in the order they are pushed
+//! \details Each is a pair of an offset in the window and a length.
+static vector<pair<size_t, size_t>> pattern(const string &name) {
+    vector<pair<size_t, size_t>> substrings;
+    for (size_t offset = 0; offset < window; offset += segment_size) {
+        substrings.emplace_back(offset, segment_size);
+    }
+
+    mt19937 random{1};
+    if (name == "reverse") {
+        reverse(substrings.begin(), substrings.end());
+    } else if (name == "random") {
+        shuffle(substrings.begin(), substrings.end(), random);
+    } else if (name == "overlap") {
+        // each substring also covers half of the next one, in random order
+        for (auto &substring : substrings) {
+            substring.second = min(segment_size * 3 / 2, window - substring.first);
+        }
+        shuffle(substrings.begin(), substrings.end(), random);
+    }
+    return substrings;
+}
+
+int main(int argc, char **argv) {
+    BenchmarkSuite suite;
+
+    string data(window, 0);
+    iota(data.begin(), data.end(), 0);
+
+    for (const string name : {"in_order", "reverse", "random", "overlap"}) {
+        vector<string> pieces;
+        vector<size_t> offsets;
+        for (const auto &[offset, length] : pattern(name)) {
+            pieces.push_back(data.substr(offset, length));
+            offsets.push_back(offset);
+        }
+
+        suite.add("stream_reassembler/" + name, window, [pieces, offsets](const size_t iterations) {
+            StreamReassembler reassembler{window};
+            for (size_t i = 0; i < iterations; i++) {
+                for (size_t j = 0; j < pieces.size(); j++) {
+                    reassembler.push_substring(pieces[j], i * window + offsets[j], false);
+                }
+                do_not_optimize(reassembler.stream_out().read(window));
+            }
+        });
+    }
+
+    return suite.run(argc, argv);
+}
@@ -0,0 +1,43 @@
+#include "bench.hh"
+#include "buffer.hh"
+#include "tcp_segment.hh"
+
+#include <string>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    BenchmarkSuite suite;
+
+    for (const size_t payload_size : {0, 1000}) {
+        TCPSegment segment;
+        segment.header().sport = 1234;
+        segment.header().dport = 5678;
+        segment.header().seqno = WrappingInt32{0x12345678};
+        segment.header().ackno = WrappingInt32{0x9abcdef0};
+        segment.header().ack = true;
+        segment.header().win = 64000;
+        segment.payload() = Buffer{string(payload_size, 'x')};
+        const uint32_t pseudo_checksum = 0x1234;
+        const Buffer serialized{segment.serialize(pseudo_checksum).concatenate()};
+        const size_t size = serialized.size();
+
+        suite.add("tcp_segment/serialize/" + to_string(payload_size), size, [segment](const size_t iterations) {
+            for (size_t i = 0; i < iterations; i++) {
+                do_not_optimize(segment.serialize(pseudo_checksum));
+            }
+        });
+
+        suite.add("tcp_segment/parse/" + to_string(payload_size), size, [serialized](const size_t iterations) {
+            for (size_t i = 0; i < iterations; i++) {
+                TCPSegment parsed;
+                if (parsed.parse(serialized, pseudo_checksum) != ParseResult::NoError) {
+                    throw runtime_error("tcp_segment/parse: bad segment");
+                }
+                do_not_optimize(parsed);
+            }
+        });
+    }
+
+    return suite.run(argc, argv);
+}
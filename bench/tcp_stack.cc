@@ -0,0 +1,104 @@
+#include "bench.hh"
+#include "tcp_stack.hh"
+
+#include <iostream>
+#include <malloc.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//! SYNs in a burst, each from its own client port
+constexpr size_t burst = 10000;
+
+//! IPv4 datagrams carrying the SYNs of a burst to port 80, parsed as if off the wire
+static vector<InternetDatagram> make_syns() {
+    const uint32_t client = Address{"10.0.0.2"}.ipv4_numeric(), server = Address{"10.0.0.1"}.ipv4_numeric();
+    vector<InternetDatagram> syns;
+    for (size_t i = 0; i < burst; i++) {
+        TCPSegment syn;
+        syn.header().sport = 10000 + i;
+        syn.header().dport = 80;
+        syn.header().syn = true;
+        syn.header().seqno = WrappingInt32{uint32_t(i)};
+
+        InternetDatagram dgram;
+        dgram.header().src = client;
+        dgram.header().dst = server;
+        dgram.header().len = dgram.header().hlen * 4 + syn.header().doff * 4;
+        dgram.payload() = syn.serialize(dgram.header().pseudo_cksum());
+        syns.emplace_back();
+        if (syns.back().parse(Buffer{dgram.serialize().concatenate()}) != ParseResult::NoError) {
+            throw runtime_error("make_syns: bad SYN");
+        }
+    }
+    return syns;
+}
+
+//! Bytes allocated on the heap
+static size_t heap() {
+    const struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+//! Heap bytes a listener keeps per SYN of a burst, with `syn_backlog` half-open connections before SYN cookies
+static double bytes_per_syn(const vector<InternetDatagram> &syns, const size_t syn_backlog) {
+    TCPStack server{1};
+    server.listen(80, TCPConfig{}, burst, syn_backlog);
+    const size_t before = heap();
+    for (const auto &syn : syns) {
+        server.datagram_received(syn);
+    }
+    return double(heap() - before) / burst;
+}
+
+//! Heap bytes of a TCPConnection with the default TCPConfig
+static double bytes_per_connection() {
+    vector<TCPConnection> connections;
+    connections.reserve(burst / 10);
+    const size_t before = heap();
+    for (size_t i = 0; i < burst / 10; i++) {
+        connections.emplace_back(TCPConfig{});
+    }
+    const double ret = double(heap() - before) / connections.size();
+    TCPSegment rst;
+    rst.header().rst = true;
+    for (auto &connection : connections) {
+        connection.segment_received(rst);
+    }
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    BenchmarkSuite suite;
+    const auto syns = make_syns();
+
+    // a listener taking SYNs into its SYN backlog, or answering them with SYN cookies, with a fresh listener
+    // for each burst
+    for (const auto &[name, syn_backlog] : {pair<string, size_t>{"half_open", burst}, {"cookie", 0}}) {
+        suite.add("tcp_stack/syn/" + name, 0, [&syns, syn_backlog = syn_backlog](const size_t iterations) {
+            unique_ptr<TCPStack> server{};
+            for (size_t i = 0; i < iterations; i++) {
+                if (i % burst == 0) {
+                    server = make_unique<TCPStack>();
+                    server->listen(80, TCPConfig{}, burst, syn_backlog);
+                }
+                server->datagram_received(syns[i % burst]);
+                for (; not server->datagrams_out().empty(); server->datagrams_out().pop()) {
+                    do_not_optimize(server->datagrams_out().front());
+                }
+            }
+        });
+    }
+
+    suite.add_report([&syns] {
+        cerr << "Memory per half-open connection: " << bytes_per_syn(syns, burst)
+             << " bytes (with SYN cookies: " << bytes_per_syn(syns, 0)
+             << "; a TCPConnection with the default TCPConfig: " << bytes_per_connection() << ")\n";
+    });
+
+    return suite.run(argc, argv);
+}
@@ -0,0 +1,40 @@
+#include "bench.hh"
+#include "wrapping_integers.hh"
+
+#include <random>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    BenchmarkSuite suite;
+
+    // absolute sequence numbers spread over several wraps, and checkpoints close to them
+    mt19937_64 random{1};
+    const WrappingInt32 isn{static_cast<uint32_t>(random())};
+    vector<uint64_t> absolute(4096);
+    vector<uint64_t> checkpoints(absolute.size());
+    for (size_t i = 0; i < absolute.size(); i++) {
+        absolute[i] = random() % (uint64_t{1} << 36);
+        checkpoints[i] = absolute[i] + random() % 65536 - 32768;
+    }
+    vector<WrappingInt32> wrapped;
+    for (const uint64_t n : absolute) {
+        wrapped.push_back(wrap(n, isn));
+    }
+
+    suite.add("wrapping_integers/wrap", 0, [=](const size_t iterations) {
+        for (size_t i = 0; i < iterations; i++) {
+            do_not_optimize(wrap(absolute[i % absolute.size()], isn));
+        }
+    });
+
+    suite.add("wrapping_integers/unwrap", 0, [=](const size_t iterations) {
+        for (size_t i = 0; i < iterations; i++) {
+            const size_t j = i % wrapped.size();
+            do_not_optimize(unwrap(wrapped[j], isn, checkpoints[j]));
+        }
+    });
+
+    return suite.run(argc, argv);
+}
@@ -21,6 +21,7 @@ add_test(NAME t_send_window          COMMAND send_window)
 add_test(NAME t_send_ack             COMMAND send_ack)
 add_test(NAME t_send_close           COMMAND send_close)
 add_test(NAME t_send_extra           COMMAND send_extra)
+add_test(NAME t_send_deadline        COMMAND send_deadline)
 
 add_test(NAME t_strm_reassem_single      COMMAND fsm_stream_reassembler_single)
 add_test(NAME t_strm_reassem_seq         COMMAND fsm_stream_reassembler_seq)
@@ -40,6 +41,23 @@ add_test(NAME t_byte_stream_many_writes  COMMAND byte_stream_many_writes)
 add_test(NAME t_webget               COMMAND "${PROJECT_SOURCE_DIR}/tests/webget_t.sh")
 
 add_test(NAME arp_network_interface    COMMAND net_interface)
+add_test(NAME t_timer_wheel          COMMAND timer_wheel)
+add_test(NAME t_tcp_timers           COMMAND tcp_timers)
+add_test(NAME t_tcp_backpressure     COMMAND tcp_backpressure)
+add_test(NAME t_tcp_stack            COMMAND tcp_stack)
+add_test(NAME t_byte_ring            COMMAND byte_ring)
+add_test(NAME t_sharded_tcp_stack    COMMAND sharded_tcp_stack)
+add_test(NAME t_tcp_offload          COMMAND tcp_offload)
+add_test(NAME t_datagram_offload     COMMAND datagram_offload)
+add_test(NAME t_packet_ring          COMMAND packet_ring)
+add_test(NAME t_ring_queue           COMMAND ring_queue)
+add_test(NAME t_eventloop            COMMAND eventloop)
+add_test(NAME t_latency_histogram    COMMAND latency_histogram)
+add_test(NAME t_simulator            COMMAND simulator)
+add_test(NAME t_parallel_simulator   COMMAND parallel_simulator)
+add_test(NAME t_impairment           COMMAND impairment)
+add_test(NAME t_tcp_sponge_socket    COMMAND tcp_sponge_socket)
+add_test(NAME t_tun_queues           COMMAND tun_queues)
 
 add_test(NAME router_test    COMMAND network_simulator)
 
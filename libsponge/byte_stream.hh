@@ -11,7 +11,7 @@
 class ByteStream {
   private:
     // Your code here -- add private members as necessary.
-    const size_t capacity;
+    size_t capacity;
     std::vector<char> buffer;
     size_t front, rear;
     size_t read_count, write_count;
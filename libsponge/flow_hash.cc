@@ -0,0 +1,66 @@
+#include "flow_hash.hh"
+
+#include <stdexcept>
+
+using namespace std;
+
+const RSSKey DEFAULT_RSS_KEY = {0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3,
+                                0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3,
+                                0x80, 0x30, 0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa};
+
+uint32_t toeplitz_hash(const string_view input, const RSSKey &key) {
+    if (input.size() + sizeof(uint32_t) > key.size()) {
+        throw runtime_error("toeplitz_hash: input longer than the key allows");
+    }
+
+    uint32_t result = 0;
+    // the 32 bits of the key starting at the current bit, in `window`, with the next 8 bits of the key after it
+    uint64_t window = (uint64_t(key[0]) << 32) | (uint64_t(key[1]) << 24) | (uint64_t(key[2]) << 16) |
+                      (uint64_t(key[3]) << 8) | key[4];
+    for (size_t i = 0; i < input.size(); i++) {
+        const uint8_t byte = input[i];
+        for (int bit = 7; bit >= 0; bit--) {
+            if (byte & (1 << bit)) {
+                result ^= uint32_t(window >> (bit + 1));
+            }
+        }
+        window = (window << 8) | key[i + 5 < key.size() ? i + 5 : 0];
+    }
+    return result;
+}
+
+uint32_t flow_hash(const uint32_t source_address,
+                   const uint32_t destination_address,
+                   const uint16_t source_port,
+                   const uint16_t destination_port,
+                   const RSSKey &key) {
+    const uint8_t input[12] = {uint8_t(source_address >> 24),
+                               uint8_t(source_address >> 16),
+                               uint8_t(source_address >> 8),
+                               uint8_t(source_address),
+                               uint8_t(destination_address >> 24),
+                               uint8_t(destination_address >> 16),
+                               uint8_t(destination_address >> 8),
+                               uint8_t(destination_address),
+                               uint8_t(source_port >> 8),
+                               uint8_t(source_port),
+                               uint8_t(destination_port >> 8),
+                               uint8_t(destination_port)};
+    return toeplitz_hash({reinterpret_cast<const char *>(input), sizeof(input)}, key);
+}
+
+optional<uint32_t> flow_hash(const string_view datagram, const RSSKey &key) {
+    constexpr uint8_t PROTO_TCP = 6;
+    if (datagram.size() < 20 or (uint8_t(datagram[0]) >> 4) != 4 or uint8_t(datagram[9]) != PROTO_TCP) {
+        return {};
+    }
+    const size_t header_length = (uint8_t(datagram[0]) & 0xf) * 4;
+    if (header_length < 20 or datagram.size() < header_length + 4) {
+        return {};
+    }
+    // the addresses and ports are already in the order flow_hash() hashes them, in network byte order
+    char input[12];
+    datagram.copy(input, 8, 12);
+    datagram.copy(input + 8, 4, header_length);
+    return toeplitz_hash({input, sizeof(input)}, key);
+}
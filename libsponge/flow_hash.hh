@@ -0,0 +1,34 @@
+#ifndef SPONGE_LIBSPONGE_FLOW_HASH_HH
+#define SPONGE_LIBSPONGE_FLOW_HASH_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+//! A secret key for toeplitz_hash()
+using RSSKey = std::array<uint8_t, 40>;
+
+//! The key of the examples in Microsoft's Receive Side Scaling specification, which many NICs use by default
+extern const RSSKey DEFAULT_RSS_KEY;
+
+//! \brief The Toeplitz hash of `input`, as NICs compute it for Receive Side Scaling
+//! \details Each set bit of the input, from the most significant bit of its first byte on, XORs into the
+//! result the 32 bits of the key that start at the same bit position. `input` can be at most 36 bytes.
+uint32_t toeplitz_hash(const std::string_view input, const RSSKey &key = DEFAULT_RSS_KEY);
+
+//! \brief The RSS hash of a TCP/IPv4 flow, as seen in the segments that arrive from `source`
+//! \details Addresses and ports are in host byte order; they are hashed in network byte order, source
+//! address first, then the destination address, source port and destination port.
+uint32_t flow_hash(const uint32_t source_address,
+                   const uint32_t destination_address,
+                   const uint16_t source_port,
+                   const uint16_t destination_port,
+                   const RSSKey &key = DEFAULT_RSS_KEY);
+
+//! \brief flow_hash() of the TCP segment in a serialized IPv4 datagram, read straight from its bytes
+//! \returns an empty optional if the datagram is too short, isn't IPv4, or doesn't carry TCP
+std::optional<uint32_t> flow_hash(const std::string_view datagram, const RSSKey &key = DEFAULT_RSS_KEY);
+
+#endif  // SPONGE_LIBSPONGE_FLOW_HASH_HH
@@ -0,0 +1,85 @@
+#include "neighbor_table.hh"
+
+#include <utility>
+
+using namespace std;
+
+//! \details Fibonacci hashing: multiply by 2^32 / golden ratio and keep the high bits,
+//! which spreads out the consecutive addresses typical of a subnet.
+size_t NeighborTable::home(const uint32_t ip_address) const {
+    const uint64_t mixed = uint64_t(ip_address) * 0x9E3779B97F4A7C15ull;
+    return (mixed >> 32) & (_slots.size() - 1);
+}
+
+size_t NeighborTable::probe(const uint32_t ip_address) const {
+    const size_t mask = _slots.size() - 1;
+    size_t i = home(ip_address);
+    while (_slots[i].occupied and _slots[i].entry.ip_address != ip_address) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void NeighborTable::grow() {
+    vector<Slot> old(_slots.size() * 2);
+    swap(old, _slots);
+    for (auto &slot : old) {
+        if (slot.occupied) {
+            Slot &dest = _slots[probe(slot.entry.ip_address)];
+            dest.occupied = true;
+            dest.entry = move(slot.entry);
+        }
+    }
+}
+
+NeighborTable::Entry *NeighborTable::find(const uint32_t ip_address) {
+    Slot &slot = _slots[probe(ip_address)];
+    return slot.occupied ? &slot.entry : nullptr;
+}
+
+const NeighborTable::Entry *NeighborTable::find(const uint32_t ip_address) const {
+    const Slot &slot = _slots[probe(ip_address)];
+    return slot.occupied ? &slot.entry : nullptr;
+}
+
+NeighborTable::Entry &NeighborTable::insert(const uint32_t ip_address) {
+    size_t i = probe(ip_address);
+    if (_slots[i].occupied) {
+        return _slots[i].entry;
+    }
+    if (2 * (_size + 1) > _slots.size()) {
+        grow();
+        i = probe(ip_address);
+    }
+    _slots[i].occupied = true;
+    _slots[i].entry = Entry{};
+    _slots[i].entry.ip_address = ip_address;
+    _size++;
+    return _slots[i].entry;
+}
+
+bool NeighborTable::erase(const uint32_t ip_address) {
+    const size_t mask = _slots.size() - 1;
+    size_t hole = probe(ip_address);
+    if (not _slots[hole].occupied) {
+        return false;
+    }
+    _slots[hole].occupied = false;
+    _size--;
+
+    // backward-shift deletion: pull later members of the probe run into the hole,
+    // unless doing so would move an entry in front of its home bucket
+    for (size_t i = (hole + 1) & mask; _slots[i].occupied; i = (i + 1) & mask) {
+        const size_t h = home(_slots[i].entry.ip_address);
+        const bool home_in_gap = (hole <= i) ? (hole < h and h <= i) : (hole < h or h <= i);
+        if (home_in_gap) {
+            continue;
+        }
+        _slots[hole].occupied = true;
+        _slots[hole].entry = move(_slots[i].entry);
+        _slots[i].occupied = false;
+        hole = i;
+    }
+    _slots[hole].entry = Entry{};
+    return true;
+}
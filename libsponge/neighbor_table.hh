@@ -0,0 +1,96 @@
+#ifndef SPONGE_LIBSPONGE_NEIGHBOR_TABLE_HH
+#define SPONGE_LIBSPONGE_NEIGHBOR_TABLE_HH
+
+#include "buffer.hh"
+#include "ethernet_header.hh"
+#include "ipv4_datagram.hh"
+#include "timer_wheel.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+//! \brief The ARP cache of a NetworkInterface: an open-addressed hash table of neighbors keyed by IPv4 address
+class NeighborTable {
+  public:
+    //! Resolution state of a neighbor
+    enum class State : uint8_t {
+        INCOMPLETE,  //!< An ARP request has been sent and no reply has arrived yet
+        REACHABLE,   //!< The Ethernet address was learned recently and may be used
+        STALE,       //!< The Ethernet address is out of date and must be resolved again before use
+        PERMANENT    //!< The Ethernet address was configured statically; it never expires and isn't relearned
+    };
+
+    //! One neighbor
+    struct Entry {
+        uint32_t ip_address{};                  //!< IPv4 address of the neighbor (the key)
+        State state{State::INCOMPLETE};         //!< Resolution state
+        EthernetAddress ethernet_address{};     //!< Last known Ethernet address (meaningless while INCOMPLETE)
+        uint64_t updated_ms{};                  //!< Time of the last state change
+        TimerWheel<uint32_t>::TimerId timer{};  //!< Timer that ends the current state
+
+        //! Header of IPv4 frames to `ethernet_address`, copied into every frame sent to this neighbor
+        EthernetHeader frame_header{};
+
+        //! Serialization of `frame_header`, shared by every frame sent to this neighbor
+        Buffer serialized_frame_header{};
+
+        //! Datagrams waiting for this neighbor to be resolved, oldest first
+        std::deque<InternetDatagram> pending{};
+
+        //! `true` if frames may be sent to `ethernet_address`
+        bool resolved() const { return state == State::REACHABLE or state == State::PERMANENT; }
+    };
+
+  private:
+    //! A bucket of the table
+    struct Slot {
+        bool occupied{false};
+        Entry entry{};
+    };
+
+    std::vector<Slot> _slots;  //!< Buckets; the size is always a power of two
+    size_t _size{0};           //!< Number of occupied buckets
+
+    //! Index of the bucket where probing for `ip_address` starts
+    size_t home(const uint32_t ip_address) const;
+
+    //! Index of the bucket holding `ip_address`, or of the empty bucket where it would go
+    size_t probe(const uint32_t ip_address) const;
+
+    //! Double the number of buckets and reinsert every entry
+    void grow();
+
+  public:
+    //! Construct an empty table
+    NeighborTable() : _slots(16) {}
+
+    //! \name Lookup and modification
+    //! \note insert() and erase() move entries, so they invalidate pointers returned by find()
+    //!@{
+
+    //! \returns the entry for `ip_address`, or `nullptr` if there is none
+    Entry *find(const uint32_t ip_address);
+
+    //! \returns the entry for `ip_address`, or `nullptr` if there is none
+    const Entry *find(const uint32_t ip_address) const;
+
+    //! \returns the entry for `ip_address`, creating an INCOMPLETE entry if there is none
+    Entry &insert(const uint32_t ip_address);
+
+    //! \brief Remove the entry for `ip_address`
+    //! \returns `true` if there was an entry to remove
+    bool erase(const uint32_t ip_address);
+    //!@}
+
+    //! Number of neighbors in the table
+    size_t size() const { return _size; }
+};
+
+//! \class NeighborTable
+//! Collisions are resolved by linear probing, and erase() shifts later entries of the probe sequence
+//! back instead of leaving tombstones, so lookups never have to skip over deleted buckets. The table
+//! doubles in size whenever it would become more than half full.
+
+#endif  // SPONGE_LIBSPONGE_NEIGHBOR_TABLE_HH
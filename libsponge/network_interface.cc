@@ -3,7 +3,7 @@
 #include "arp_message.hh"
 #include "ethernet_frame.hh"
 
-#include <iostream>
+#include <algorithm>
 
 // Dummy implementation of a network interface
 // Translates from {IP datagram, next hop address} to link-layer frame, and from link-layer frame to IP datagram
@@ -21,10 +21,7 @@ using namespace std;
 //! \param[in] ethernet_address Ethernet (what ARP calls "hardware") address of the interface
 //! \param[in] ip_address IP (what ARP calls "protocol") address of the interface
 NetworkInterface::NetworkInterface(const EthernetAddress &ethernet_address, const Address &ip_address)
-    : _ethernet_address(ethernet_address), _ip_address(ip_address) {
-    cerr << "DEBUG: Network interface has Ethernet address " << to_string(_ethernet_address) << " and IP address "
-         << ip_address.ip() << "\n";
-}
+    : _ethernet_address(ethernet_address), _ip_address(ip_address) {}
 
 //send an arp message within an ethernet frame
 void NetworkInterface::send_arp(const uint16_t &opcode, const uint32_t &target_ip, const EthernetAddress &target_eth={0,0,0,0,0,0})
@@ -54,89 +51,121 @@ void NetworkInterface::send_arp(const uint16_t &opcode, const uint32_t &target_i
 void NetworkInterface::send_datagram(const InternetDatagram &dgram, const Address &next_hop) {
     // convert IP address of next hop to raw 32-bit representation (used in ARP header)
     const uint32_t next_hop_ip = next_hop.ipv4_numeric();
-    if(_cached_mappings.find(next_hop_ip)!=_cached_mappings.end())//Found in cache
-    {
-        EthernetFrame new_frame;
-        new_frame.header().type=EthernetHeader::TYPE_IPv4;
-        new_frame.header().src=_ethernet_address;
-        new_frame.header().dst=_cached_mappings[next_hop_ip];
-        new_frame.payload()=dgram.serialize();
-        _frames_out.push(new_frame);
+    const NeighborTable::Entry *neighbor = _neighbors.find(next_hop_ip);
+    if (neighbor and neighbor->resolved()) {
+        _frames_out.emplace(neighbor->frame_header, neighbor->serialized_frame_header, dgram.serialize());
         return;
     }
-    else//Not found in cache, may need to send an arp request
-    {
-        bool found=false;
-        //Check if this arp request have been sent recently
-        for(auto& it:_arp_send_timer)
-        {
-            //this ip have recently been sent
-            if(it.first==next_hop_ip)
-            {
-                found=true;
-                if(it.second>5000)//It have been at least 5sec since last sent
-                {
-                    //store the dgram into queue, resend arp request
-                    it.second=0;
-                    _datagrams_waiting.push_back({dgram, next_hop});
-                    //resend an arp request after this loop
-                    break;
-                }
-                else//store the dgram into queue, wait for arp reply
-                {
-                    _datagrams_waiting.push_back({dgram, next_hop});
-                    //return and wait for reply
-                    return;
-                }
-            }
-        }
-        //if not found, add dgram into the queue and add the ip into timer list
-        if(!found)
-        {
-            _arp_send_timer.push_back({next_hop_ip, 0});
-            _datagrams_waiting.push_back({dgram, next_hop});
-        }
-        //Send an arp request
-        send_arp(ARPMessage::OPCODE_REQUEST, next_hop_ip);
-        
+
+    // a request sent within the last five seconds is still outstanding; don't flood the link
+    const bool request_outstanding = neighbor and neighbor->state == NeighborTable::State::INCOMPLETE;
+
+    // hold the datagram until the next hop's Ethernet address is known
+    _arp_stats.cold_misses++;
+    NeighborTable::Entry &entry = _neighbors.insert(next_hop_ip);
+    if (entry.pending.size() >= MAX_PENDING_PER_NEIGHBOR) {
+        entry.pending.pop_front();
+        _arp_stats.pending_drops++;
+    }
+    entry.pending.push_back(dgram);
+
+    if (request_outstanding) {
         return;
     }
 
+    set_state(entry, NeighborTable::State::INCOMPLETE, ARP_REQUEST_TIMEOUT_MS);
+    send_arp(ARPMessage::OPCODE_REQUEST, next_hop_ip);
+}
 
+void NetworkInterface::set_frame_header(NeighborTable::Entry &entry, const EthernetAddress &dst) const {
+    entry.frame_header.type = EthernetHeader::TYPE_IPv4;
+    entry.frame_header.src = _ethernet_address;
+    entry.frame_header.dst = dst;
+    entry.serialized_frame_header = Buffer{entry.frame_header.serialize()};
 }
 
-//Update mapping entries and entry timer, remove invalid term of send timer
-void NetworkInterface::update_mappings(const uint32_t &new_ip, const EthernetAddress &new_eth)
-{
-    //Refresh mapping and mapping timer
-    bool found=false;
-    _cached_mappings[new_ip]=new_eth;
-    for(auto& it:_arp_mapping_timer)
-    {
-        if(it.first==new_ip)
-        {
-            it.second=0;
-            found=true;
-        }
+void NetworkInterface::set_state(NeighborTable::Entry &entry,
+                                 const NeighborTable::State state,
+                                 const uint64_t lifetime_ms) {
+    _neighbor_timers.cancel(entry.timer);
+    entry.state = state;
+    entry.updated_ms = _now_ms;
+    // a state lasts until its lifetime has been exceeded, and the wheel fires once the clock reaches the expiry
+    entry.timer = _neighbor_timers.schedule(_now_ms + lifetime_ms + 1, entry.ip_address);
+}
+
+//! \details An unanswered request just expires, dropping the datagrams that were waiting for it
+//! (a later datagram will send a new one), a reachable mapping goes stale, and a stale mapping is forgotten.
+void NetworkInterface::neighbor_timer_expired(const uint32_t ip_address) {
+    NeighborTable::Entry *entry = _neighbors.find(ip_address);
+    if (not entry) {
+        return;
     }
-    if(!found)
-    {
-        _arp_mapping_timer.push_back({new_ip, 0});
+    entry->timer = TimerWheel<uint32_t>::NO_TIMER;
+    if (entry->state == NeighborTable::State::REACHABLE) {
+        set_state(*entry, NeighborTable::State::STALE, ARP_STALE_MS);
+    } else {
+        _arp_stats.unresolved_drops += entry->pending.size();
+        _neighbors.erase(ip_address);
     }
-    //Remove send timer for that ip
-    auto it=_arp_send_timer.begin();
-    while(it!=_arp_send_timer.end())
-    {
-        if(it->first==new_ip)
-        {
-            auto previous=it++;
-            _arp_send_timer.erase(previous);
-        }
-        else
-            it++;
+}
+
+void NetworkInterface::send_pending_datagrams(const uint32_t ip_address) {
+    NeighborTable::Entry *entry = _neighbors.find(ip_address);
+    if (not entry or not entry->resolved()) {
+        return;
+    }
+    for (const auto &dgram : entry->pending) {
+        _frames_out.emplace(entry->frame_header, entry->serialized_frame_header, dgram.serialize());
     }
+    entry->pending.clear();
 }
 
+//! Learn (or refresh) the Ethernet address of a neighbor
+void NetworkInterface::update_mappings(const uint32_t &new_ip, const EthernetAddress &new_eth) {
+    const NeighborTable::Entry *known = _neighbors.find(new_ip);
+    if (new_ip == _ip_address.ipv4_numeric() or (known and known->state == NeighborTable::State::PERMANENT)) {
+        return;
+    }
+    if (known and known->state == NeighborTable::State::INCOMPLETE) {
+        const uint64_t elapsed = _now_ms - known->updated_ms;
+        _arp_stats.resolutions++;
+        _arp_stats.resolution_ms_total += elapsed;
+        _arp_stats.resolution_ms_max = max(_arp_stats.resolution_ms_max, elapsed);
+    }
+    NeighborTable::Entry &entry = _neighbors.insert(new_ip);
+    if (entry.serialized_frame_header.size() == 0 or entry.ethernet_address != new_eth) {
+        set_frame_header(entry, new_eth);
+    }
+    entry.ethernet_address = new_eth;
+    set_state(entry, NeighborTable::State::REACHABLE, ARP_REACHABLE_MS);
+}
+
+void NetworkInterface::add_static_neighbor(const Address &ip_address, const EthernetAddress &ethernet_address) {
+    const uint32_t ip = ip_address.ipv4_numeric();
+    NeighborTable::Entry &entry = _neighbors.insert(ip);
+    _neighbor_timers.cancel(entry.timer);
+    entry.timer = TimerWheel<uint32_t>::NO_TIMER;
+    entry.state = NeighborTable::State::PERMANENT;
+    entry.updated_ms = _now_ms;
+    entry.ethernet_address = ethernet_address;
+    set_frame_header(entry, ethernet_address);
+    send_pending_datagrams(ip);
+}
+
+bool NetworkInterface::remove_static_neighbor(const Address &ip_address) {
+    const uint32_t ip = ip_address.ipv4_numeric();
+    const NeighborTable::Entry *entry = _neighbors.find(ip);
+    if (not entry or entry->state != NeighborTable::State::PERMANENT) {
+        return false;
+    }
+    return _neighbors.erase(ip);
+}
+
+//! \details The announcement is an ARP request whose sender and target IP addresses are both ours
+//! ([RFC 5227](https://tools.ietf.org/html/rfc5227), section 3), so nobody replies to it.
+void NetworkInterface::announce() { send_arp(ARPMessage::OPCODE_REQUEST, _ip_address.ipv4_numeric()); }
+
 //! \param[in] frame the incoming Ethernet frame
 optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &frame) {
     if(frame.header().dst!=_ethernet_address&&frame.header().dst!=ETHERNET_BROADCAST)
@@ -165,51 +194,24 @@ optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &fra
                 if(new_message.target_ip_address==_ip_address.ipv4_numeric())
                     send_arp(ARPMessage::OPCODE_REPLY, new_message.sender_ip_address, new_message.sender_ethernet_address);
             }
-            //check datagrams in queue, if the mapping of their next hop addr is now availiable then send them
-            auto it=_datagrams_waiting.begin();
-            while(it!=_datagrams_waiting.end())
-            {
-                if(_cached_mappings.find(it->second.ipv4_numeric())!=_cached_mappings.end())
-                {
-                    auto previous=it++;
-                    send_datagram(previous->first, previous->second);
-                    _datagrams_waiting.erase(previous);
-                }
-                else
-                {
-                    it++;
-                }
-            }
+            //the sender's mapping is now known, so send whatever was waiting for it
+            send_pending_datagrams(new_message.sender_ip_address);
         }  
     }
     return {};
 }
 
-//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
-void NetworkInterface::tick(const size_t ms_since_last_tick) { 
-    //Increment timer
-    for(auto& it:_arp_send_timer)
-    {
-        it.second+=ms_since_last_tick;
-    }
-    for(auto& it:_arp_mapping_timer)
-    {
-        it.second+=ms_since_last_tick;
-    }
-    //Check expired entries and remove it from cache
-    auto it=_arp_mapping_timer.begin();
-    while(it!=_arp_mapping_timer.end())
-    {
-        //mapping entries timeout is 30sec
-        if(it->second>30000)
-        {
-            auto previous=it++;
-            //remove relevant entry from mapping cache and entry timer
-            _cached_mappings.erase(previous->first);
-            _arp_mapping_timer.erase(previous);
-        }
-        else
-            it++;
+optional<size_t> NetworkInterface::time_until_next_deadline() const {
+    const optional<uint64_t> expiry = _neighbor_timers.next_expiry();
+    if (not expiry.has_value()) {
+        return {};
     }
-    return;
- }
+    // a timer fires at the first tick that moves the clock past its expiry
+    return max(expiry.value(), _now_ms + 1) - _now_ms;
+}
+
+//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
+void NetworkInterface::tick(const size_t ms_since_last_tick) {
+    _now_ms += ms_since_last_tick;
+    _neighbor_timers.advance(_now_ms, [&](const uint32_t ip_address) { neighbor_timer_expired(ip_address); });
+}
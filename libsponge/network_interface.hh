@@ -2,13 +2,14 @@
 #define SPONGE_LIBSPONGE_NETWORK_INTERFACE_HH
 
 #include "ethernet_frame.hh"
+#include "neighbor_table.hh"
+#include "ring_queue.hh"
 #include "tcp_over_ip.hh"
+#include "timer_wheel.hh"
 #include "tun.hh"
 
+#include <cstdint>
 #include <optional>
-#include <queue>
-#include <unordered_map>
-#include <list>
 
 //! \brief A "network interface" that connects IP (the internet layer, or network layer)
 //! with Ethernet (the network access layer, or link layer).
@@ -32,6 +33,17 @@
 //! request or reply, the network interface processes the frame
 //! and learns or replies as necessary.
 class NetworkInterface {
+  public:
+    //! Counters describing address resolution on this interface
+    struct ARPStats {
+        uint64_t cold_misses{0};          //!< Datagrams that had to wait for their next hop to be resolved
+        uint64_t pending_drops{0};        //!< Waiting datagrams dropped because a neighbor's queue was full
+        uint64_t unresolved_drops{0};     //!< Waiting datagrams dropped because no ARP reply arrived in time
+        uint64_t resolutions{0};          //!< Outstanding ARP requests that were answered
+        uint64_t resolution_ms_total{0};  //!< Sum of the time from request to reply over all resolutions
+        uint64_t resolution_ms_max{0};    //!< Longest time from request to reply
+    };
+
   private:
     //! Ethernet (known as hardware, network-access-layer, or link-layer) address of the interface
     EthernetAddress _ethernet_address;
@@ -40,14 +52,47 @@ class NetworkInterface {
     Address _ip_address;
 
     //! outbound queue of Ethernet frames that the NetworkInterface wants sent
-    std::queue<EthernetFrame> _frames_out{};
+    RingQueue<EthernetFrame> _frames_out{};
+
+    //! \name Lifetimes of the neighbor states, each of which ends once it has been exceeded (at 5001 ms, say)
+    //!@{
+
+    //! How long an unanswered ARP request suppresses new requests for the same address
+    static constexpr uint64_t ARP_REQUEST_TIMEOUT_MS = 5000;
+
+    //! How long a learned mapping may be used before it goes stale
+    static constexpr uint64_t ARP_REACHABLE_MS = 30000;
+
+    //! How long a stale mapping is kept before its entry is removed
+    static constexpr uint64_t ARP_STALE_MS = 60000;
+    //!@}
+
+    //! Most datagrams held for one unresolved neighbor; beyond this, the oldest is dropped
+    static constexpr size_t MAX_PENDING_PER_NEIGHBOR = 64;
+
+    //! Milliseconds elapsed since construction (the sum of all tick() arguments)
+    uint64_t _now_ms{0};
+
+    //! ARP cache: one entry per neighbor, in any resolution state
+    NeighborTable _neighbors{};
+
+    //! Expiry timers of the entries in _neighbors, keyed by IPv4 address
+    TimerWheel<uint32_t> _neighbor_timers{};
 
-    std::list<std::pair<InternetDatagram, Address>> _datagrams_waiting{};
+    //! Move a neighbor into `state`, (re)arming its timer to fire `lifetime_ms` from now
+    void set_state(NeighborTable::Entry &entry, const NeighborTable::State state, const uint64_t lifetime_ms);
 
-    std::unordered_map<uint32_t, EthernetAddress> _cached_mappings{};
+    //! Called when the timer of a neighbor entry fires
+    void neighbor_timer_expired(const uint32_t ip_address);
 
-    std::list<std::pair<uint32_t, size_t>> _arp_send_timer{};
-    std::list<std::pair<uint32_t, size_t>> _arp_mapping_timer{};
+    //! Compute, once, the header of IPv4 frames from this interface to the neighbor at `dst`
+    void set_frame_header(NeighborTable::Entry &entry, const EthernetAddress &dst) const;
+
+    //! Send, in order, the datagrams that were waiting for a neighbor that is now reachable
+    void send_pending_datagrams(const uint32_t ip_address);
+
+    //! Counters reported by arp_stats()
+    ARPStats _arp_stats{};
 
     void update_mappings(const uint32_t &new_ip, const EthernetAddress &new_eth);
     void send_arp(const uint16_t &opcode,const uint32_t &target_ip, const EthernetAddress &target_eth);
@@ -56,7 +101,8 @@ class NetworkInterface {
     NetworkInterface(const EthernetAddress &ethernet_address, const Address &ip_address);
 
     //! \brief Access queue of Ethernet frames awaiting transmission
-    std::queue<EthernetFrame> &frames_out() { return _frames_out; }
+    //! \note Frames are dropped (like a full transmit ring on a real NIC) if the owner stops draining the queue.
+    RingQueue<EthernetFrame> &frames_out() { return _frames_out; }
 
     //! \brief Sends an IPv4 datagram, encapsulated in an Ethernet frame (if it knows the Ethernet destination address).
 
@@ -73,6 +119,36 @@ class NetworkInterface {
 
     //! \brief Called periodically when time elapses
     void tick(const size_t ms_since_last_tick);
+
+    //! \brief Milliseconds of tick() time until the next neighbor entry expires
+    //! \returns an empty optional if there are no entries that expire
+    std::optional<size_t> time_until_next_deadline() const;
+
+    //! \name Neighbor configuration
+    //!@{
+
+    //! \brief Add (or replace) a permanent mapping, so datagrams to `ip_address` never wait for ARP
+    //! \details Datagrams already waiting for `ip_address` are sent immediately. Static entries don't
+    //! expire and aren't overwritten by ARP traffic.
+    void add_static_neighbor(const Address &ip_address, const EthernetAddress &ethernet_address);
+
+    //! \brief Remove a mapping added by add_static_neighbor()
+    //! \returns `true` if there was a static entry for `ip_address`
+    bool remove_static_neighbor(const Address &ip_address);
+
+    //! \brief Broadcast a gratuitous ARP announcement of this interface's addresses
+    //! \details Neighbors learn (or, after a failover, update) the mapping without waiting to resolve it.
+    void announce();
+    //!@}
+
+    //! \brief Ethernet address of the interface
+    const EthernetAddress &ethernet_address() const { return _ethernet_address; }
+
+    //! \brief IP address of the interface
+    const Address &ip_address() const { return _ip_address; }
+
+    //! \brief Counters describing address resolution
+    const ARPStats &arp_stats() const { return _arp_stats; }
 };
 
 #endif  // SPONGE_LIBSPONGE_NETWORK_INTERFACE_HH
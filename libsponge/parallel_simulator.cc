@@ -0,0 +1,164 @@
+#include "parallel_simulator.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+//! \brief Where the threads wait for each other between windows
+//! \details The last thread to arrive runs the completion (with the others still waiting), then releases them.
+class WindowBarrier {
+  private:
+    mutex _mutex{};
+    condition_variable _released{};
+    size_t _threads;
+    size_t _waiting{0};
+    uint64_t _generation{0};
+
+  public:
+    explicit WindowBarrier(const size_t threads) : _threads(threads) {}
+
+    void arrive_and_wait(const function<void()> &completion) {
+        unique_lock<mutex> lock{_mutex};
+        const uint64_t generation = _generation;
+        if (++_waiting == _threads) {
+            completion();
+            _waiting = 0;
+            _generation++;
+            _released.notify_all();
+        } else {
+            _released.wait(lock, [&] { return _generation != generation; });
+        }
+    }
+};
+
+}  // namespace
+
+ParallelSimulator::ParallelSimulator(const size_t partitions,
+                                     const uint64_t lookahead_ns,
+                                     const uint64_t seed,
+                                     const size_t threads)
+    : _lookahead_ns(lookahead_ns), _threads(max<size_t>(1, min(threads, partitions))) {
+    if (partitions == 0 or lookahead_ns == 0) {
+        throw invalid_argument("ParallelSimulator: needs a partition and a lookahead");
+    }
+    for (size_t i = 0; i < partitions; i++) {
+        // spread the partitions' seeds out, so that neighbouring seeds don't give related runs
+        _partitions.push_back(make_unique<Partition>(seed + i * 0x9e3779b97f4a7c15, partitions));
+    }
+}
+
+void ParallelSimulator::post(const size_t from, const size_t to, const uint64_t time_ns, Simulator::Action &&action) {
+    _partitions[from]->outboxes[to].push_back({time_ns, move(action)});
+}
+
+//! \details The messages join each partition's events in order of the partition that sent them, then of
+//! sending, which doesn't depend on how the partitions were spread over threads.
+void ParallelSimulator::deliver_messages() {
+    for (const auto &from : _partitions) {
+        for (size_t to = 0; to < _partitions.size(); to++) {
+            for (auto &message : from->outboxes[to]) {
+                _partitions[to]->simulator.schedule_at(message.time_ns, move(message.action));
+            }
+            from->outboxes[to].clear();
+        }
+    }
+}
+
+bool ParallelSimulator::run_windows(const function<bool()> &done, const uint64_t limit_ns) {
+    uint64_t window_end_ns = 0;  // last time in the window
+    bool stop = false, finished = false;
+    exception_ptr error{};
+    mutex error_mutex{};
+
+    // between windows: gather what crossed partitions, and choose the next window
+    const auto between_windows = [&] {
+        deliver_messages();
+        if (error or done()) {
+            finished = not error;
+            stop = true;
+            return;
+        }
+        optional<uint64_t> next_ns{};
+        for (const auto &partition : _partitions) {
+            const auto partition_next_ns = partition->simulator.next_event_ns();
+            if (partition_next_ns and (not next_ns or *partition_next_ns < *next_ns)) {
+                next_ns = partition_next_ns;
+            }
+        }
+        if (not next_ns or *next_ns > limit_ns) {
+            stop = true;
+            return;
+        }
+        window_end_ns = min(*next_ns + (_lookahead_ns - 1), limit_ns);
+        _windows++;
+    };
+
+    // thread `t` runs every `_threads`th partition through the window
+    const auto run_window = [&](const size_t t) {
+        try {
+            for (size_t i = t; i < _partitions.size(); i += _threads) {
+                _partitions[i]->simulator.run_until(window_end_ns);
+            }
+        } catch (...) {
+            lock_guard<mutex> lock{error_mutex};
+            if (not error) {
+                error = current_exception();
+            }
+        }
+    };
+
+    WindowBarrier barrier{_threads};
+    const auto work = [&](const size_t t) {
+        while (true) {
+            barrier.arrive_and_wait([&] {
+                _now_ns = max(_now_ns, window_end_ns);
+                between_windows();
+            });
+            if (stop) {
+                return;
+            }
+            run_window(t);
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t t = 1; t < _threads; t++) {
+        workers.emplace_back(work, t);
+    }
+    work(0);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    return finished;
+}
+
+bool ParallelSimulator::run(const function<bool()> &done) {
+    return run_windows(done, numeric_limits<uint64_t>::max());
+}
+
+void ParallelSimulator::run_until(const uint64_t time_ns) {
+    run_windows([] { return false; }, time_ns);
+    for (const auto &partition : _partitions) {
+        partition->simulator.run_until(time_ns);
+    }
+    _now_ns = max(_now_ns, time_ns);
+}
+
+uint64_t ParallelSimulator::events_run() const {
+    uint64_t ret = 0;
+    for (const auto &partition : _partitions) {
+        ret += partition->simulator.events_run();
+    }
+    return ret;
+}
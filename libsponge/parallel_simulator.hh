@@ -0,0 +1,129 @@
+#ifndef SPONGE_LIBSPONGE_PARALLEL_SIMULATOR_HH
+#define SPONGE_LIBSPONGE_PARALLEL_SIMULATOR_HH
+
+#include "simulator.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//! \brief A simulation split into partitions, each a Simulator of its own, run side by side on worker threads
+//! \details Objects in different partitions only meet over links made by add_link(), whose delay is at least
+//! the simulator's lookahead. So the partitions can run in windows as long as the lookahead: nothing that
+//! happens in one partition during a window can affect another before the window ends. Between windows, the
+//! packets that crossed partitions join their receivers' events, always in the same order.
+//!
+//! Each partition draws its random decisions from a generator seeded by the simulator's seed and the
+//! partition's index, and the windows depend only on the events, so a run gives the same results with any
+//! number of threads, one included.
+class ParallelSimulator {
+  private:
+    //! An event scheduled by one partition for another, waiting for the end of the window
+    struct Message {
+        uint64_t time_ns;          //!< When it runs
+        Simulator::Action action;  //!< What it does
+    };
+
+    //! One Simulator, and what its objects have sent to other partitions in the current window
+    struct Partition {
+        Simulator simulator;                         //!< The partition's events and objects
+        std::vector<std::vector<Message>> outboxes;  //!< Messages to each partition, in the order sent
+
+        Partition(const uint64_t seed, const size_t partition_count) : simulator(seed), outboxes(partition_count) {}
+    };
+
+    std::vector<std::unique_ptr<Partition>> _partitions{};  //!< The partitions, by index
+    uint64_t _lookahead_ns;                                 //!< Least delay of a link between partitions
+    size_t _threads;                                        //!< Number of threads that run the partitions
+    uint64_t _now_ns{0};                                    //!< Time up to which every partition has run
+    uint64_t _windows{0};                                   //!< Number of windows run
+
+    //! Schedule an event on partition `to`, from partition `from`'s thread, at the end of the window
+    void post(const size_t from, const size_t to, const uint64_t time_ns, Simulator::Action &&action);
+
+    //! Hand the messages in every outbox to their partitions
+    void deliver_messages();
+
+    //! Run windows until `done()` or no events are left, none beyond time `limit_ns`
+    bool run_windows(const std::function<bool()> &done, const uint64_t limit_ns);
+
+  public:
+    //! \param[in] partitions is the number of partitions
+    //! \param[in] lookahead_ns is the least delay of any link between partitions (and the length of a window)
+    //! \param[in] seed determines every random decision of the simulation
+    //! \param[in] threads is the number of threads to run the partitions on (at most one per partition)
+    ParallelSimulator(const size_t partitions, const uint64_t lookahead_ns, const uint64_t seed, const size_t threads);
+
+    //! Partition `i`, to add objects to (as with Simulator::add) and schedule events on
+    Simulator &partition(const size_t i) { return _partitions.at(i)->simulator; }
+
+    //! Number of partitions
+    size_t partitions() const { return _partitions.size(); }
+
+    //! \brief Construct a link from partition `from` to partition `to`, owned by partition `from`
+    //! \throws std::invalid_argument if the partitions differ and the link's delay is less than the lookahead
+    template <typename T>
+    Link<T> &add_link(const size_t from,
+                      const size_t to,
+                      const LinkConfig &config,
+                      typename Link<T>::Receiver receiver) {
+        if (from == to) {
+            return partition(from).add<Link<T>>(config, std::move(receiver));
+        }
+        if (config.delay_ns < _lookahead_ns or to >= _partitions.size()) {
+            throw std::invalid_argument("ParallelSimulator: link between partitions is faster than the lookahead");
+        }
+        return partition(from).add<Link<T>>(
+            config, std::move(receiver), [this, from, to](const uint64_t time_ns, Simulator::Action &&arrival) {
+                post(from, to, time_ns, std::move(arrival));
+            });
+    }
+
+    //! \brief Run until `done()` is true or no events are left
+    //! \details `done()` is only asked between windows, when no partition is running.
+    //! \returns `done()`
+    bool run(const std::function<bool()> &done);
+
+    //! Run the events up to and including time `time_ns`
+    void run_until(const uint64_t time_ns);
+
+    //! Time up to which every partition has run
+    uint64_t now_ns() const { return _now_ns; }
+
+    //! Number of events run so far, in all partitions
+    uint64_t events_run() const;
+
+    //! Number of windows run so far
+    uint64_t windows() const { return _windows; }
+};
+
+//! \brief Connect port `a_port` of node `a`, in partition `a_partition`, and port `b_port` of node `b`, in
+//! partition `b_partition`, with a pair of links, one each way
+//! \returns the links from `a` to `b` and from `b` to `a`
+template <typename A, typename B>
+std::pair<Link<typename A::Packet> &, Link<typename A::Packet> &> connect(ParallelSimulator &simulator,
+                                                                          const size_t a_partition,
+                                                                          A &a,
+                                                                          const size_t a_port,
+                                                                          const size_t b_partition,
+                                                                          B &b,
+                                                                          const size_t b_port,
+                                                                          const LinkConfig &config) {
+    using Packet = typename A::Packet;
+    static_assert(std::is_same_v<Packet, typename B::Packet>, "connect: the nodes send different packets");
+
+    auto &a_to_b = simulator.add_link<Packet>(
+        a_partition, b_partition, config, [&b, b_port](Packet &&p) { b.receive(b_port, std::move(p)); });
+    auto &b_to_a = simulator.add_link<Packet>(
+        b_partition, a_partition, config, [&a, a_port](Packet &&p) { a.receive(a_port, std::move(p)); });
+    a.set_output(a_port, [&a_to_b](Packet &&p) { a_to_b.send(std::move(p)); });
+    b.set_output(b_port, [&b_to_a](Packet &&p) { b_to_a.send(std::move(p)); });
+    return {a_to_b, b_to_a};
+}
+
+#endif  // SPONGE_LIBSPONGE_PARALLEL_SIMULATOR_HH
@@ -4,7 +4,6 @@
 #include "network_interface.hh"
 
 #include <optional>
-#include <queue>
 
 //! \brief A wrapper for NetworkInterface that makes the host-side
 //! interface asynchronous: instead of returning received datagrams
@@ -12,7 +11,7 @@
 //! later retrieval. Otherwise, behaves identically to the underlying
 //! implementation of NetworkInterface.
 class AsyncNetworkInterface : public NetworkInterface {
-    std::queue<InternetDatagram> _datagrams_out{};
+    RingQueue<InternetDatagram> _datagrams_out{};
 
   public:
     using NetworkInterface::NetworkInterface;
@@ -35,7 +34,7 @@ class AsyncNetworkInterface : public NetworkInterface {
     };
 
     //! Access queue of Internet datagrams that have been received
-    std::queue<InternetDatagram> &datagrams_out() { return _datagrams_out; }
+    RingQueue<InternetDatagram> &datagrams_out() { return _datagrams_out; }
 };
 
 //! \brief A router that has multiple network interfaces and
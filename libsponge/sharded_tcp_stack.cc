@@ -0,0 +1,236 @@
+#include "sharded_tcp_stack.hh"
+
+#include "eventloop.hh"
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+#include "util.hh"
+
+#include <iostream>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+//! Make an [eventfd(2)](\ref man2::eventfd) readable
+static void notify(const FileDescriptor &event) {
+    const uint64_t one = 1;
+    SystemCall("write", static_cast<int>(::write(event.fd_num(), &one, sizeof(one))));
+}
+
+ShardedTCPStack::Shard::Shard(const size_t i, FileDescriptor &&q, const size_t datagrams_out_capacity)
+    : index(i)
+    , queue(move(q))
+    , inbox_event(SystemCall("eventfd", ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)))
+    , stack(datagrams_out_capacity) {
+    receive_buffer.reserve(MAX_DATAGRAM_SIZE);
+}
+
+ShardedTCPStack::ShardedTCPStack(vector<FileDescriptor> &&queues,
+                                 Handler handler,
+                                 const bool pin_threads,
+                                 const RSSKey &key,
+                                 const size_t datagrams_out_capacity)
+    : _handler(move(handler)), _key(key), _pin_threads(pin_threads) {
+    if (queues.empty()) {
+        throw runtime_error("ShardedTCPStack: needs at least one queue");
+    }
+    for (size_t i = 0; i < queues.size(); i++) {
+        _shards.push_back(make_unique<Shard>(i, move(queues[i]), datagrams_out_capacity));
+    }
+    for (size_t i = 0; i < INDIRECTION_TABLE_SIZE; i++) {
+        _indirection[i] = uint16_t(i % _shards.size());
+    }
+}
+
+ShardedTCPStack::~ShardedTCPStack() {
+    try {
+        stop();
+    } catch (const exception &e) {
+        cerr << "Exception stopping ShardedTCPStack: " << e.what() << endl;
+    }
+}
+
+void ShardedTCPStack::listen(const uint16_t port,
+                             const TCPConfig &config,
+                             const size_t backlog,
+                             const size_t syn_backlog) {
+    if (_started) {
+        throw runtime_error("ShardedTCPStack: listen() after start()");
+    }
+    for (auto &shard : _shards) {
+        shard->stack.listen(port, config, backlog, syn_backlog);
+    }
+    _listening.push_back(port);
+}
+
+void ShardedTCPStack::set_indirection_table(const IndirectionTable &table) {
+    if (_started) {
+        throw runtime_error("ShardedTCPStack: set_indirection_table() after start()");
+    }
+    for (const uint16_t shard : table) {
+        if (shard >= _shards.size()) {
+            throw runtime_error("ShardedTCPStack: indirection table names shard " + to_string(shard) + " of " +
+                                to_string(_shards.size()));
+        }
+    }
+    _indirection = table;
+}
+
+void ShardedTCPStack::start() {
+    if (_started) {
+        throw runtime_error("ShardedTCPStack: already started");
+    }
+    _started = true;
+
+    const unsigned cores = max(1U, thread::hardware_concurrency());
+    for (auto &shard : _shards) {
+        shard->thread = thread([this, &shard = *shard] { run(shard); });
+        if (_pin_threads) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(shard->index % cores, &cpus);
+            const int err = pthread_setaffinity_np(shard->thread.native_handle(), sizeof(cpus), &cpus);
+            if (err != 0) {
+                throw unix_error("pthread_setaffinity_np", err);
+            }
+        }
+    }
+}
+
+void ShardedTCPStack::stop() {
+    _stopping = true;
+    for (auto &shard : _shards) {
+        if (shard->thread.joinable()) {
+            notify(shard->inbox_event);
+            shard->thread.join();
+        }
+    }
+}
+
+ShardedTCPStack::Stats ShardedTCPStack::stats(const size_t shard) const {
+    const Shard &s = *_shards.at(shard);
+    return {s.received.load(memory_order_relaxed),
+            s.steered.load(memory_order_relaxed),
+            s.serving.load(memory_order_relaxed)};
+}
+
+void ShardedTCPStack::run(Shard &shard) {
+    try {
+        EventLoop loop{EventLoop::Backend::Epoll};
+        string event_count;
+
+        uint64_t last_tick_ms = timestamp_ms();
+        const auto tick = [&] {
+            const uint64_t now = timestamp_ms();
+            shard.stack.tick(now - last_tick_ms, [&](const TCPStack::ConnectionId id) {
+                if (shard.accepted.count(id) != 0) {
+                    shard.timer_fired.push_back(id);
+                }
+            });
+            last_tick_ms = now;
+            // served once the tick is over, as the handler may close the connection
+            for (const TCPStack::ConnectionId id : shard.timer_fired) {
+                if (shard.accepted.count(id) != 0) {
+                    serve(shard, id);
+                }
+            }
+            shard.timer_fired.clear();
+        };
+
+        loop.add_rule(shard.queue, Direction::In, [&] {
+            tick();
+            shard.queue.read(shard.receive_buffer, MAX_DATAGRAM_SIZE);
+            dispatch(shard, shard.receive_buffer);
+        });
+
+        loop.add_rule(shard.inbox_event, Direction::In, [&] {
+            tick();
+            shard.inbox_event.read(event_count, sizeof(uint64_t));
+            vector<string> steered;
+            {
+                lock_guard<mutex> lock(shard.inbox_mutex);
+                steered.swap(shard.inbox);
+            }
+            for (const string &datagram : steered) {
+                deliver(shard, datagram);
+            }
+        });
+
+        loop.add_rule(
+            shard.queue,
+            Direction::Out,
+            [&] {
+                RingQueue<InternetDatagram> &out = shard.stack.datagrams_out();
+                for (; not out.empty(); out.pop()) {
+                    shard.queue.write(out.front().serialize());
+                }
+            },
+            [&] { return not shard.stack.datagrams_out().empty(); });
+
+        while (not _stopping) {
+            const optional<size_t> deadline = shard.stack.time_until_next_deadline();
+            if (loop.wait_next_event(deadline.has_value() ? int(deadline.value()) : -1) == EventLoop::Result::Exit) {
+                break;
+            }
+            tick();
+        }
+    } catch (const exception &e) {
+        cerr << "Exception in shard " << shard.index << ": " << e.what() << endl;
+    }
+}
+
+void ShardedTCPStack::dispatch(Shard &shard, const string_view datagram) {
+    // datagrams that aren't TCP over IPv4 go to the shard that read them, which drops them
+    const optional<uint32_t> hash = flow_hash(datagram, _key);
+    const size_t owner = hash.has_value() ? shard_for(hash.value()) : shard.index;
+    if (owner == shard.index) {
+        deliver(shard, datagram);
+        return;
+    }
+
+    Shard &other = *_shards[owner];
+    shard.steered.fetch_add(1, memory_order_relaxed);
+    bool was_empty = false;
+    {
+        lock_guard<mutex> lock(other.inbox_mutex);
+        was_empty = other.inbox.empty();
+        other.inbox.emplace_back(datagram);
+    }
+    if (was_empty) {
+        notify(other.inbox_event);
+    }
+}
+
+void ShardedTCPStack::deliver(Shard &shard, const string_view datagram) {
+    InternetDatagram dgram;
+    if (dgram.parse(Buffer{string(datagram)}) != ParseResult::NoError) {
+        return;
+    }
+    shard.received.fetch_add(1, memory_order_relaxed);
+
+    const optional<TCPStack::ConnectionId> id = shard.stack.datagram_received(dgram);
+    for (const uint16_t port : _listening) {
+        while (const auto new_id = shard.stack.accept(port)) {
+            shard.accepted.insert(new_id.value());
+            shard.serving.fetch_add(1, memory_order_relaxed);
+            serve(shard, new_id.value());
+        }
+    }
+    if (id.has_value() and shard.accepted.count(id.value()) != 0) {
+        serve(shard, id.value());
+    }
+}
+
+void ShardedTCPStack::serve(Shard &shard, const TCPStack::ConnectionId id) {
+    const bool done = not _handler(shard.index, shard.stack, id);
+    // a connection that is no longer active only stays in the stack until it is closed
+    if (done or not shard.stack.connection(id).active()) {
+        shard.accepted.erase(id);
+        shard.serving.fetch_sub(1, memory_order_relaxed);
+        shard.stack.close(id);
+    }
+}
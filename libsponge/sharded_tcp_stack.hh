@@ -0,0 +1,160 @@
+#ifndef SPONGE_LIBSPONGE_SHARDED_TCP_STACK_HH
+#define SPONGE_LIBSPONGE_SHARDED_TCP_STACK_HH
+
+#include "file_descriptor.hh"
+#include "flow_hash.hh"
+#include "tcp_config.hh"
+#include "tcp_stack.hh"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+//! \brief TCPStack%s on several threads, each serving the connections that one share of the flows belongs to
+class ShardedTCPStack {
+  public:
+    //! \brief Called by a shard's thread when one of its accepted connections may have something to do
+    //! \details Called once when the connection is accepted, and again whenever a segment arrives for it or
+    //! one of its timers fires. Once the connection is no longer active (the peer reset it, say), the shard
+    //! close()s it after this call whatever it returns. Handlers for different shards run concurrently, but
+    //! each only ever sees its own shard's stack.
+    //! \returns `false` once done with the connection, which the shard then close()s
+    using Handler = std::function<bool(const size_t shard, TCPStack &stack, const TCPStack::ConnectionId id)>;
+
+    //! Entries in the indirection table that maps a flow_hash() to a shard, as in a NIC
+    static constexpr size_t INDIRECTION_TABLE_SIZE = 128;
+
+    //! Shard of each flow_hash() modulo INDIRECTION_TABLE_SIZE
+    using IndirectionTable = std::array<uint16_t, INDIRECTION_TABLE_SIZE>;
+
+    //! Most bytes read from a queue at once (the largest IPv4 datagram)
+    static constexpr size_t MAX_DATAGRAM_SIZE = 65535;
+
+    //! Counters kept by each shard
+    struct Stats {
+        uint64_t received{0};  //!< Datagrams given to the shard's TCPStack
+        uint64_t steered{0};   //!< Datagrams read from the shard's queue that belonged to another shard
+        uint64_t serving{0};   //!< Accepted connections that the shard hasn't close()d yet
+    };
+
+  private:
+    //! One thread, with its own TCPStack, queue and receive buffer
+    struct Shard {
+        size_t index;                                           //!< Position among the shards
+        FileDescriptor queue;                                   //!< Carries the shard's IPv4 datagrams, both ways
+        FileDescriptor inbox_event;                             //!< Readable while `inbox` has datagrams
+        TCPStack stack;                                         //!< Connections of the flows that hash to the shard
+        std::string receive_buffer{};                           //!< Reused for every read from `queue`
+        std::unordered_set<TCPStack::ConnectionId> accepted{};  //!< Connections the handler is serving
+        std::vector<TCPStack::ConnectionId> timer_fired{};      //!< Connections acted on by the last tick
+        std::mutex inbox_mutex{};                               //!< Protects `inbox`
+        std::vector<std::string> inbox{};                       //!< Datagrams steered here by other shards
+        std::atomic<uint64_t> received{0};                      //!< See Stats::received
+        std::atomic<uint64_t> steered{0};                       //!< See Stats::steered
+        std::atomic<uint64_t> serving{0};                       //!< See Stats::serving
+        std::thread thread{};                                   //!< Runs ShardedTCPStack::run()
+
+        //! Construct a shard that reads and writes `q`
+        Shard(const size_t i, FileDescriptor &&q, const size_t datagrams_out_capacity);
+    };
+
+    std::vector<std::unique_ptr<Shard>> _shards{};  //!< The shards, by index
+    std::vector<uint16_t> _listening{};             //!< Ports passed to listen()
+    Handler _handler;                               //!< Serves the accepted connections
+    RSSKey _key;                                    //!< Key of the flow_hash()
+    IndirectionTable _indirection{};                //!< Maps a flow_hash() to the shard that serves it
+    bool _pin_threads;                              //!< Whether start() pins each thread to a core
+    bool _started{false};                           //!< Whether start() has been called
+    std::atomic<bool> _stopping{false};             //!< Set by stop() to end the threads
+
+    //! Body of a shard's thread
+    void run(Shard &shard);
+
+    //! Give a datagram that arrived on one of the shards' queues to the shard that owns its flow
+    void dispatch(Shard &shard, const std::string_view datagram);
+
+    //! Hand a datagram to a shard's own TCPStack, and call the handler for the connections it concerns
+    void deliver(Shard &shard, const std::string_view datagram);
+
+    //! Call the handler for a connection, closing it if the handler or the connection is done
+    void serve(Shard &shard, const TCPStack::ConnectionId id);
+
+  public:
+    //! \brief Construct one shard per queue
+    //! \param[in] queues carry IPv4 datagrams: for instance the queues of a multi-queue TUN device, or one
+    //!            datagram socket per shard. Each shard replies on the queue it reads from.
+    //! \param[in] handler serves the accepted connections
+    //! \param[in] pin_threads pins shard `i`'s thread to core `i` (modulo the number of cores)
+    ShardedTCPStack(std::vector<FileDescriptor> &&queues,
+                    Handler handler,
+                    const bool pin_threads = true,
+                    const RSSKey &key = DEFAULT_RSS_KEY,
+                    const size_t datagrams_out_capacity = RingQueue<InternetDatagram>::DEFAULT_CAPACITY);
+
+    //! Stops the threads, if running
+    ~ShardedTCPStack();
+
+    //! \brief Accept connections to `port` on every shard
+    //! \note Must be called before start().
+    void listen(const uint16_t port,
+                const TCPConfig &config,
+                const size_t backlog,
+                const size_t syn_backlog = TCPStack::DEFAULT_SYN_BACKLOG);
+
+    //! Start the shards' threads
+    void start();
+
+    //! Stop the shards' threads, and wait for them to finish
+    void stop();
+
+    //! Number of shards
+    size_t shards() const { return _shards.size(); }
+
+    //! \brief Replace the indirection table, which starts out spreading its entries round-robin over the shards
+    //! \details To have a NIC steer each datagram straight to the queue of its shard, program the NIC with the
+    //! same table (and key).
+    //! \note Must be called before start().
+    void set_indirection_table(const IndirectionTable &table);
+
+    //! The indirection table that maps a flow_hash() to a shard
+    const IndirectionTable &indirection_table() const { return _indirection; }
+
+    //! The shard that serves the flow with this flow_hash()
+    size_t shard_for(const uint32_t hash) const { return _indirection[hash % INDIRECTION_TABLE_SIZE]; }
+
+    //! The counters of a shard (read while the threads run, so only approximately up to date)
+    Stats stats(const size_t shard) const;
+
+    //! \name
+    //! A ShardedTCPStack cannot be copied or moved, since its threads refer to it
+    //!@{
+    ShardedTCPStack(const ShardedTCPStack &other) = delete;
+    ShardedTCPStack &operator=(const ShardedTCPStack &other) = delete;
+    ShardedTCPStack(ShardedTCPStack &&other) = delete;
+    ShardedTCPStack &operator=(ShardedTCPStack &&other) = delete;
+    //!@}
+};
+
+//! \class ShardedTCPStack
+//! One TCPStack serves any number of connections, but on one thread. A ShardedTCPStack runs one TCPStack
+//! per queue, each on its own thread (pinned to its own core, by default) with its own connection table,
+//! timers and receive buffer, so that the shards share no state on the path of a segment.
+//!
+//! Every segment of a connection must reach the same shard. As a NIC does for Receive Side Scaling, each
+//! datagram is assigned to a shard by the Toeplitz hash of its addresses and ports (see flow_hash()),
+//! through an indirection table (see set_indirection_table()). A multi-queue NIC or TUN device that steers by
+//! the same hash and table delivers each datagram straight to the queue of the shard that owns it; otherwise
+//! the shard that read the datagram passes it on to the owner's inbox, which costs a copy and a wakeup, and
+//! is counted in Stats::steered. Either way, every shard replies on its own queue.
+//!
+//! A ShardedTCPStack only accepts connections; it doesn't open any.
+
+#endif  // SPONGE_LIBSPONGE_SHARDED_TCP_STACK_HH
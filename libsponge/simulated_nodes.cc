@@ -0,0 +1,221 @@
+#include "simulated_nodes.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+//! The earlier of two deadlines, either of which may be missing
+static optional<size_t> earliest(const optional<size_t> a, const optional<size_t> b) {
+    if (a and b) {
+        return min(*a, *b);
+    }
+    return a ? a : b;
+}
+
+//! Throw unless `port` is 0, the only port of a node with one
+static void check_single_port(const size_t port) {
+    if (port != 0) {
+        throw out_of_range("node has only port 0");
+    }
+}
+
+//! Join the frame's payload into one buffer, as a trip over a wire would, for NetworkInterface::recv_frame to parse
+static EthernetFrame &as_received(EthernetFrame &frame) {
+    frame.payload() = frame.payload().concatenate();
+    return frame;
+}
+
+void SimulatedNode::update(const function<void()> &action) {
+    const uint64_t now_ms = _simulator.now_ms();
+    if (now_ms > _ticked_ms) {
+        tick(now_ms - _ticked_ms);
+        _ticked_ms = now_ms;
+    }
+    action();
+    flush();
+    schedule_wake_up();
+}
+
+//! \details A wake-up that is due later than the one already scheduled isn't scheduled: the earlier one
+//! will reschedule it. A wake-up event that is no longer the one due next does nothing when it runs.
+void SimulatedNode::schedule_wake_up() {
+    const auto remaining_ms = time_until_next_deadline();
+    if (not remaining_ms) {
+        return;
+    }
+    const uint64_t wake_ns = (_ticked_ms + max<uint64_t>(*remaining_ms, 1)) * 1000000;
+    if (_wake_ns and *_wake_ns <= wake_ns and *_wake_ns >= _simulator.now_ns()) {
+        return;
+    }
+    _wake_ns = wake_ns;
+    _simulator.schedule_at(wake_ns, [this, wake_ns] {
+        if (_wake_ns == wake_ns) {
+            _wake_ns.reset();
+            update([] {});
+        }
+    });
+}
+
+optional<size_t> ConnectionNode::time_until_next_deadline() { return _connection.time_until_next_deadline(); }
+
+void ConnectionNode::flush() {
+    if (_application) {
+        _application(_connection);
+    }
+    for (auto &segments = _connection.segments_out(); not segments.empty(); segments.pop()) {
+        if (_output) {
+            _output(move(segments.front()));
+        }
+    }
+}
+
+void ConnectionNode::set_output(const size_t port, function<void(TCPSegment &&)> output) {
+    check_single_port(port);
+    _output = move(output);
+}
+
+void ConnectionNode::receive(const size_t port, TCPSegment &&segment) {
+    check_single_port(port);
+    update([&] { _connection.segment_received(segment); });
+}
+
+InterfaceNode::InterfaceNode(Simulator &simulator,
+                             const EthernetAddress &ethernet_address,
+                             const Address &ip_address,
+                             function<void(InternetDatagram &&)> on_datagram)
+    : SimulatedNode(simulator), _interface(ethernet_address, ip_address), _on_datagram(move(on_datagram)) {}
+
+optional<size_t> InterfaceNode::time_until_next_deadline() { return _interface.time_until_next_deadline(); }
+
+void InterfaceNode::flush() {
+    for (auto &frames = _interface.frames_out(); not frames.empty(); frames.pop()) {
+        if (_output) {
+            _output(move(frames.front()));
+        }
+    }
+}
+
+void InterfaceNode::set_output(const size_t port, function<void(EthernetFrame &&)> output) {
+    check_single_port(port);
+    _output = move(output);
+}
+
+void InterfaceNode::receive(const size_t port, EthernetFrame &&frame) {
+    check_single_port(port);
+    update([&] {
+        if (auto datagram = _interface.recv_frame(as_received(frame))) {
+            _on_datagram(move(*datagram));
+        }
+    });
+}
+
+void InterfaceNode::send_datagram(const InternetDatagram &datagram, const Address &next_hop) {
+    update([&] { _interface.send_datagram(datagram, next_hop); });
+}
+
+TCPHostNode::TCPHostNode(Simulator &simulator,
+                         const TCPConfig &config,
+                         const EthernetAddress &ethernet_address,
+                         const Address &ip_address,
+                         const Address &next_hop)
+    : SimulatedNode(simulator), _connection(config), _interface(ethernet_address, ip_address), _next_hop(next_hop) {
+    _adapter.config_mut().source = ip_address;
+}
+
+void TCPHostNode::tick(const size_t ms) {
+    _connection.tick(ms);
+    _interface.tick(ms);
+}
+
+optional<size_t> TCPHostNode::time_until_next_deadline() {
+    return earliest(_connection.time_until_next_deadline(), _interface.time_until_next_deadline());
+}
+
+void TCPHostNode::flush() {
+    if (_application) {
+        _application(_connection);
+    }
+    for (auto &segments = _connection.segments_out(); not segments.empty(); segments.pop()) {
+        _interface.send_datagram(_adapter.wrap_tcp_in_ip(segments.front()), _next_hop);
+    }
+    for (auto &frames = _interface.frames_out(); not frames.empty(); frames.pop()) {
+        if (_output) {
+            _output(move(frames.front()));
+        }
+    }
+}
+
+void TCPHostNode::set_output(const size_t port, function<void(EthernetFrame &&)> output) {
+    check_single_port(port);
+    _output = move(output);
+}
+
+void TCPHostNode::receive(const size_t port, EthernetFrame &&frame) {
+    check_single_port(port);
+    update([&] {
+        if (const auto datagram = _interface.recv_frame(as_received(frame))) {
+            if (const auto segment = _adapter.unwrap_tcp_in_ip(*datagram)) {
+                _connection.segment_received(*segment);
+            }
+        }
+    });
+}
+
+void TCPHostNode::connect(const uint16_t local_port, const Address &destination) {
+    _adapter.config_mut().source = {_adapter.config().source.ip(), local_port};
+    _adapter.config_mut().destination = destination;
+    update([&] { _connection.connect(); });
+}
+
+void TCPHostNode::listen(const uint16_t local_port) {
+    _adapter.config_mut().source = {_adapter.config().source.ip(), local_port};
+    _adapter.set_listening(true);
+}
+
+size_t RouterNode::add_interface(const EthernetAddress &ethernet_address, const Address &ip_address) {
+    _outputs.emplace_back();
+    return _router.add_interface(AsyncNetworkInterface{ethernet_address, ip_address});
+}
+
+void RouterNode::add_route(const uint32_t route_prefix,
+                           const uint8_t prefix_length,
+                           const optional<Address> next_hop,
+                           const size_t interface_num) {
+    _router.add_route(route_prefix, prefix_length, next_hop, interface_num);
+}
+
+void RouterNode::tick(const size_t ms) {
+    for (size_t i = 0; i < _outputs.size(); i++) {
+        _router.interface(i).tick(ms);
+    }
+}
+
+optional<size_t> RouterNode::time_until_next_deadline() {
+    optional<size_t> ret{};
+    for (size_t i = 0; i < _outputs.size(); i++) {
+        ret = earliest(ret, _router.interface(i).time_until_next_deadline());
+    }
+    return ret;
+}
+
+void RouterNode::flush() {
+    for (size_t i = 0; i < _outputs.size(); i++) {
+        for (auto &frames = _router.interface(i).frames_out(); not frames.empty(); frames.pop()) {
+            if (_outputs[i]) {
+                _outputs[i](move(frames.front()));
+            }
+        }
+    }
+}
+
+void RouterNode::set_output(const size_t port, function<void(EthernetFrame &&)> output) {
+    _outputs.at(port) = move(output);
+}
+
+void RouterNode::receive(const size_t port, EthernetFrame &&frame) {
+    update([&] {
+        _router.interface(port).recv_frame(as_received(frame));
+        _router.route();
+    });
+}
@@ -0,0 +1,214 @@
+#ifndef SPONGE_LIBSPONGE_SIMULATED_NODES_HH
+#define SPONGE_LIBSPONGE_SIMULATED_NODES_HH
+
+#include "network_interface.hh"
+#include "router.hh"
+#include "simulator.hh"
+#include "tcp_connection.hh"
+#include "tcp_over_ip.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+//! \brief Something in a simulation that has timers and sends packets: the base of the node classes below
+//! \details A node keeps its object's tick() time in step with the Simulator lazily: update() first ticks the
+//! object by the milliseconds that have passed, then acts, then hands whatever the object sent to its links,
+//! and finally schedules a wake-up for the object's next timer. So an idle node costs nothing, and thousands
+//! of them don't need ticking every millisecond.
+class SimulatedNode : public SimulatedObject {
+  private:
+    Simulator &_simulator;
+    uint64_t _ticked_ms;                 //!< Simulator::now_ms() when the object was last ticked
+    std::optional<uint64_t> _wake_ns{};  //!< Time of the wake-up event that is due next, if any
+
+    //! Schedule a wake-up for the object's next timer, unless an earlier one is already due
+    void schedule_wake_up();
+
+  protected:
+    //! Pass `ms` milliseconds of the object's time
+    virtual void tick(const size_t ms) = 0;
+
+    //! Milliseconds of tick() time until the object's next timer, if any
+    virtual std::optional<size_t> time_until_next_deadline() = 0;
+
+    //! Hand what the object has sent to the links
+    virtual void flush() = 0;
+
+    //! Catch up with the simulator's clock, run `action`, flush(), and schedule the next wake-up
+    void update(const std::function<void()> &action);
+
+    Simulator &simulator() { return _simulator; }
+
+  public:
+    explicit SimulatedNode(Simulator &simulator) : _simulator(simulator), _ticked_ms(simulator.now_ms()) {}
+};
+
+//! \brief A TCPConnection that exchanges TCPSegment%s directly with its peer, over a Link<TCPSegment>
+class ConnectionNode : public SimulatedNode {
+  public:
+    using Packet = TCPSegment;  //!< What the node sends and receives
+
+  private:
+    TCPConnection _connection;
+    std::function<void(TCPSegment &&)> _output{};
+    std::function<void(TCPConnection &)> _application{};
+
+    void tick(const size_t ms) override { _connection.tick(ms); }
+    std::optional<size_t> time_until_next_deadline() override;
+    void flush() override;
+
+  public:
+    ConnectionNode(Simulator &simulator, const TCPConfig &config) : SimulatedNode(simulator), _connection(config) {}
+
+    //! Send what the connection sends to `output` (a Link's send(), usually)
+    void set_output(const size_t port, std::function<void(TCPSegment &&)> output);
+
+    //! Deliver a segment to the connection
+    void receive(const size_t port, TCPSegment &&segment);
+
+    //! Do something with the connection (connect(), write(), read its inbound_stream()...)
+    void act(const std::function<void(TCPConnection &)> &action) {
+        update([&] { action(_connection); });
+    }
+
+    //! \brief Run `application` whenever something happens to the connection (a segment or a timer), to write
+    //! and read it
+    void set_application(std::function<void(TCPConnection &)> application) {
+        update([&] { _application = std::move(application); });
+    }
+
+    //! The connection, to inspect
+    const TCPConnection &connection() const { return _connection; }
+};
+
+//! \brief A NetworkInterface on a Link<EthernetFrame>, whose owner sends and receives Internet datagrams
+class InterfaceNode : public SimulatedNode {
+  public:
+    using Packet = EthernetFrame;  //!< What the node sends and receives
+
+  private:
+    NetworkInterface _interface;
+    std::function<void(EthernetFrame &&)> _output{};
+    std::function<void(InternetDatagram &&)> _on_datagram;
+
+    void tick(const size_t ms) override { _interface.tick(ms); }
+    std::optional<size_t> time_until_next_deadline() override;
+    void flush() override;
+
+  public:
+    //! \param[in] on_datagram is called with each datagram the interface receives
+    InterfaceNode(Simulator &simulator,
+                  const EthernetAddress &ethernet_address,
+                  const Address &ip_address,
+                  std::function<void(InternetDatagram &&)> on_datagram);
+
+    void set_output(const size_t port, std::function<void(EthernetFrame &&)> output);
+    void receive(const size_t port, EthernetFrame &&frame);
+
+    //! Send a datagram to `next_hop`
+    void send_datagram(const InternetDatagram &datagram, const Address &next_hop);
+
+    //! Do something else with the interface (add_static_neighbor(), announce()...)
+    void act(const std::function<void(NetworkInterface &)> &action) {
+        update([&] { action(_interface); });
+    }
+};
+
+//! \brief A TCPConnection on a host with one NetworkInterface, which sends its segments in IPv4 datagrams
+//! over a Link<EthernetFrame> (to a RouterNode, say)
+class TCPHostNode : public SimulatedNode {
+  public:
+    using Packet = EthernetFrame;  //!< What the node sends and receives
+
+  private:
+    TCPConnection _connection;
+    NetworkInterface _interface;
+    TCPOverIPv4Adapter _adapter{};
+    Address _next_hop;
+    std::function<void(EthernetFrame &&)> _output{};
+    std::function<void(TCPConnection &)> _application{};
+
+    void tick(const size_t ms) override;
+    std::optional<size_t> time_until_next_deadline() override;
+    void flush() override;
+
+  public:
+    //! \param[in] next_hop is where the host sends every datagram (its router, or its peer on the same link)
+    TCPHostNode(Simulator &simulator,
+                const TCPConfig &config,
+                const EthernetAddress &ethernet_address,
+                const Address &ip_address,
+                const Address &next_hop);
+
+    void set_output(const size_t port, std::function<void(EthernetFrame &&)> output);
+    void receive(const size_t port, EthernetFrame &&frame);
+
+    //! Connect from `local_port` to `destination` (an address and port)
+    void connect(const uint16_t local_port, const Address &destination);
+
+    //! Accept a connection on `local_port`
+    void listen(const uint16_t local_port);
+
+    //! Do something with the connection (write(), read its inbound_stream()...)
+    void act(const std::function<void(TCPConnection &)> &action) {
+        update([&] { action(_connection); });
+    }
+
+    //! \brief Run `application` whenever something happens to the connection (a segment or a timer), to write
+    //! and read it
+    void set_application(std::function<void(TCPConnection &)> application) {
+        update([&] { _application = std::move(application); });
+    }
+
+    //! The connection, to inspect
+    const TCPConnection &connection() const { return _connection; }
+};
+
+//! \brief A Router whose interfaces are ports of the node, each on a Link<EthernetFrame>
+class RouterNode : public SimulatedNode {
+  public:
+    using Packet = EthernetFrame;  //!< What the node sends and receives
+
+  private:
+    Router _router{};
+    std::vector<std::function<void(EthernetFrame &&)>> _outputs{};  //!< Where each interface sends frames
+
+    void tick(const size_t ms) override;
+    std::optional<size_t> time_until_next_deadline() override;
+    void flush() override;
+
+  public:
+    explicit RouterNode(Simulator &simulator) : SimulatedNode(simulator) {}
+
+    //! Add an interface, which is port number (the returned index) of the node
+    size_t add_interface(const EthernetAddress &ethernet_address, const Address &ip_address);
+
+    //! Add a route (see Router::add_route)
+    void add_route(const uint32_t route_prefix,
+                   const uint8_t prefix_length,
+                   const std::optional<Address> next_hop,
+                   const size_t interface_num);
+
+    void set_output(const size_t port, std::function<void(EthernetFrame &&)> output);
+    void receive(const size_t port, EthernetFrame &&frame);
+};
+
+//! \brief Connect port `a_port` of node `a` and port `b_port` of node `b` with a pair of links, one each way
+//! \returns the links from `a` to `b` and from `b` to `a`
+template <typename A, typename B>
+std::pair<Link<typename A::Packet> &, Link<typename A::Packet> &> connect(
+    Simulator &simulator, A &a, const size_t a_port, B &b, const size_t b_port, const LinkConfig &config) {
+    using Packet = typename A::Packet;
+    static_assert(std::is_same_v<Packet, typename B::Packet>, "connect: the nodes send different packets");
+
+    auto &a_to_b = simulator.add<Link<Packet>>(config, [&b, b_port](Packet &&p) { b.receive(b_port, std::move(p)); });
+    auto &b_to_a = simulator.add<Link<Packet>>(config, [&a, a_port](Packet &&p) { a.receive(a_port, std::move(p)); });
+    a.set_output(a_port, [&a_to_b](Packet &&p) { a_to_b.send(std::move(p)); });
+    b.set_output(b_port, [&b_to_a](Packet &&p) { b_to_a.send(std::move(p)); });
+    return {a_to_b, b_to_a};
+}
+
+#endif  // SPONGE_LIBSPONGE_SIMULATED_NODES_HH
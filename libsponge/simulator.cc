@@ -0,0 +1,55 @@
+#include "simulator.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+void Simulator::schedule_at(const uint64_t time_ns, Action action) {
+    if (time_ns < _now_ns) {
+        throw runtime_error("Simulator: can't schedule an event in the past");
+    }
+    _events.push_back({time_ns, _scheduled++, move(action)});
+    push_heap(_events.begin(), _events.end(), Later{});
+}
+
+bool Simulator::run_once() {
+    if (_events.empty()) {
+        return false;
+    }
+    pop_heap(_events.begin(), _events.end(), Later{});
+    Event event = move(_events.back());
+    _events.pop_back();
+
+    _now_ns = event.time_ns;
+    _events_run++;
+    event.action();
+    return true;
+}
+
+bool Simulator::run(const function<bool()> &done) {
+    while (not done()) {
+        if (not run_once()) {
+            return done();
+        }
+    }
+    return true;
+}
+
+void Simulator::run_until(const uint64_t time_ns) {
+    while (not _events.empty() and _events.front().time_ns <= time_ns) {
+        run_once();
+    }
+    _now_ns = max(_now_ns, time_ns);
+}
+
+optional<uint64_t> Simulator::next_event_ns() const {
+    if (_events.empty()) {
+        return {};
+    }
+    return _events.front().time_ns;
+}
+
+size_t wire_size(const TCPSegment &segment) { return segment.header().doff * 4 + segment.payload().size(); }
+
+size_t wire_size(const EthernetFrame &frame) { return EthernetHeader::LENGTH + frame.payload().size(); }
@@ -0,0 +1,251 @@
+#ifndef SPONGE_LIBSPONGE_SIMULATOR_HH
+#define SPONGE_LIBSPONGE_SIMULATOR_HH
+
+#include "ethernet_frame.hh"
+#include "tcp_segment.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+//! Anything a Simulator owns: a link, or a node that links connect
+class SimulatedObject {
+  public:
+    SimulatedObject() = default;
+    SimulatedObject(const SimulatedObject &other) = delete;
+    SimulatedObject &operator=(const SimulatedObject &other) = delete;
+    virtual ~SimulatedObject() = default;
+};
+
+//! \brief A deterministic discrete-event simulator: a virtual clock, the events scheduled on it, and a
+//! seeded random generator
+//! \details Events run in order of time, and events scheduled for the same time in the order they were
+//! scheduled, so a run depends only on what is simulated and the seed. The clock counts nanoseconds and jumps
+//! from one event to the next, so it runs as fast as the simulated objects allow, not in real time.
+class Simulator {
+  public:
+    //! Something to do at a scheduled time
+    using Action = std::function<void()>;
+
+  private:
+    //! A scheduled Action
+    struct Event {
+        uint64_t time_ns;   //!< When the event runs
+        uint64_t sequence;  //!< Order among the events for the same time
+        Action action;      //!< What it does
+    };
+
+    //! Orders the heap of events so that the earliest is on top
+    struct Later {
+        bool operator()(const Event &a, const Event &b) const {
+            return a.time_ns > b.time_ns or (a.time_ns == b.time_ns and a.sequence > b.sequence);
+        }
+    };
+
+    std::vector<Event> _events{};  //!< Heap of scheduled events
+    uint64_t _now_ns{0};           //!< Virtual time
+    uint64_t _scheduled{0};        //!< Number of events ever scheduled
+    uint64_t _events_run{0};       //!< Number of events run
+    std::mt19937_64 _random;       //!< Source of every random decision in the simulation
+
+    std::vector<std::unique_ptr<SimulatedObject>> _objects{};  //!< Links and nodes, owned by the simulator
+
+  public:
+    //! Construct a simulator whose random decisions all derive from `seed`
+    explicit Simulator(const uint64_t seed = 1) : _random(seed) {}
+
+    //! \brief Construct an object owned by the simulator, as `T(*this, args...)`
+    //! \returns a reference that stays valid for the simulator's lifetime
+    template <typename T, typename... Args>
+    T &add(Args &&... args) {
+        auto object = std::make_unique<T>(*this, std::forward<Args>(args)...);
+        T &ret = *object;
+        _objects.push_back(std::move(object));
+        return ret;
+    }
+
+    //! Run `action` `delay_ns` nanoseconds from now
+    void schedule(const uint64_t delay_ns, Action action) { schedule_at(_now_ns + delay_ns, std::move(action)); }
+
+    //! Run `action` at time `time_ns` (which must not be in the past)
+    void schedule_at(const uint64_t time_ns, Action action);
+
+    //! Run the next event; returns `false` if there is none
+    bool run_once();
+
+    //! \brief Run events until `done()` is true or none are left
+    //! \returns `done()`
+    bool run(const std::function<bool()> &done);
+
+    //! Run the events up to and including time `time_ns`, then set the clock to it
+    void run_until(const uint64_t time_ns);
+
+    //! Time of the next event, if any
+    std::optional<uint64_t> next_event_ns() const;
+
+    //! \name Virtual time
+    //!@{
+    uint64_t now_ns() const { return _now_ns; }
+    uint64_t now_ms() const { return _now_ns / 1000000; }
+    //!@}
+
+    //! Number of events run so far
+    uint64_t events_run() const { return _events_run; }
+
+    //! Number of events waiting to run
+    size_t events_pending() const { return _events.size(); }
+
+    //! The random generator, for every random decision of the simulated objects
+    std::mt19937_64 &random() { return _random; }
+
+    //! `true` with probability `p`
+    bool chance(const double p) { return p > 0 and std::uniform_real_distribution<double>{0, 1}(_random) < p; }
+};
+
+//! How a Link behaves
+struct LinkConfig {
+    //! What a full (or filling) queue does with a new packet
+    enum class Queue {
+        DropTail,  //!< Drop it if it doesn't fit
+        RED        //!< Random Early Detection: drop it with a probability that grows with the average queue
+    };
+
+    uint64_t bits_per_second = 0;  //!< Rate at which packets are transmitted (0: infinitely fast)
+    uint64_t delay_ns = 0;         //!< Propagation delay
+    size_t queue_limit = 0;        //!< Most bytes waiting or being transmitted (0: no limit)
+    Queue queue = Queue::DropTail;  //!< Queueing discipline
+
+    //! \name RED parameters (with Queue::RED and a queue_limit)
+    //!@{
+    double red_min = 0.25;     //!< Average queue, as a fraction of queue_limit, above which drops begin
+    double red_max = 0.75;     //!< Average queue, as a fraction of queue_limit, above which everything drops
+    double red_max_p = 0.1;    //!< Drop probability as the average queue reaches red_max
+    double red_weight = 0.02;  //!< Weight of the current queue in the moving average
+    //!@}
+
+    double loss = 0;                //!< Probability that a transmitted packet is lost
+    double reorder = 0;             //!< Probability that a packet is held back by `reorder_delay_ns`
+    uint64_t reorder_delay_ns = 0;  //!< Extra delay of a reordered packet, which later packets may overtake
+};
+
+//! What a Link has done
+struct LinkStats {
+    uint64_t sent{0};             //!< Packets handed to the link
+    uint64_t delivered{0};        //!< Packets delivered at the far end
+    uint64_t bytes_delivered{0};  //!< Bytes in the packets delivered
+    uint64_t queue_drops{0};      //!< Packets dropped by the queue (drop-tail or RED)
+    uint64_t lost{0};             //!< Packets transmitted but lost
+};
+
+//! \name Bytes a packet takes on a link
+//!@{
+size_t wire_size(const TCPSegment &segment);  //!< TCP header and payload
+size_t wire_size(const EthernetFrame &frame);  //!< Ethernet header and payload
+//!@}
+
+//! \brief A one-way link that carries packets of type `T` (TCPSegment or EthernetFrame) between two nodes
+//! \details A packet sent into the link waits in its queue, is transmitted at `bits_per_second`, then arrives
+//! `delay_ns` later (more if it is reordered) unless it is lost. The receiver is called from a Simulator
+//! event at the time of arrival.
+template <typename T>
+class Link : public SimulatedObject {
+  public:
+    //! Called with each packet that arrives
+    using Receiver = std::function<void(T &&packet)>;
+
+    //! Schedules the event of a packet's arrival, on the receiver's Simulator if that isn't the sender's
+    using Scheduler = std::function<void(const uint64_t time_ns, Simulator::Action &&arrival)>;
+
+  private:
+    Simulator &_simulator;
+    LinkConfig _config;
+    Receiver _receiver;
+    Scheduler _scheduler;
+    std::deque<std::pair<uint64_t, size_t>> _queue{};  //!< Departure time and size of packets not yet sent on
+    size_t _queued_bytes{0};                           //!< Bytes in _queue
+    uint64_t _busy_until_ns{0};                        //!< When the transmitter finishes the last packet
+    double _average_queue{0};                          //!< Moving average of _queued_bytes, for RED
+    LinkStats _stats{};
+
+    //! Should a packet of `size` bytes be dropped by the queue?
+    bool queue_drops(const size_t size) {
+        if (_config.queue_limit == 0) {
+            return false;
+        }
+        if (_queued_bytes + size > _config.queue_limit) {
+            return true;
+        }
+        if (_config.queue != LinkConfig::Queue::RED) {
+            return false;
+        }
+        _average_queue += _config.red_weight * (double(_queued_bytes) - _average_queue);
+        const double min = _config.red_min * double(_config.queue_limit);
+        const double max = _config.red_max * double(_config.queue_limit);
+        if (_average_queue < min) {
+            return false;
+        }
+        if (_average_queue >= max) {
+            return true;
+        }
+        return _simulator.chance(_config.red_max_p * (_average_queue - min) / (max - min));
+    }
+
+  public:
+    //! \brief Construct a link that hands each arriving packet to `receiver`
+    //! \param[in] scheduler schedules arrivals (by default, on `simulator`)
+    Link(Simulator &simulator, const LinkConfig &config, Receiver receiver, Scheduler scheduler = {})
+        : _simulator(simulator), _config(config), _receiver(std::move(receiver)), _scheduler(std::move(scheduler)) {}
+
+    //! Put a packet into the link
+    void send(T &&packet) {
+        _stats.sent++;
+        const uint64_t now = _simulator.now_ns();
+        for (; not _queue.empty() and _queue.front().first <= now; _queue.pop_front()) {
+            _queued_bytes -= _queue.front().second;
+        }
+
+        const size_t size = wire_size(packet);
+        if (queue_drops(size)) {
+            _stats.queue_drops++;
+            return;
+        }
+
+        const uint64_t transmission_ns =
+            _config.bits_per_second ? (uint64_t(size) * 8 * 1000000000 + _config.bits_per_second - 1) /
+                                          _config.bits_per_second
+                                    : 0;
+        _busy_until_ns = std::max(_busy_until_ns, now) + transmission_ns;
+        _queue.emplace_back(_busy_until_ns, size);
+        _queued_bytes += size;
+
+        if (_simulator.chance(_config.loss)) {
+            _stats.lost++;
+            return;
+        }
+        uint64_t arrival = _busy_until_ns + _config.delay_ns;
+        if (_simulator.chance(_config.reorder)) {
+            arrival += _config.reorder_delay_ns;
+        }
+        Simulator::Action arrive = [this, size, packet = std::move(packet)]() mutable {
+            _stats.delivered++;
+            _stats.bytes_delivered += size;
+            _receiver(std::move(packet));
+        };
+        if (_scheduler) {
+            _scheduler(arrival, std::move(arrive));
+        } else {
+            _simulator.schedule_at(arrival, std::move(arrive));
+        }
+    }
+
+    const LinkConfig &config() const { return _config; }
+    const LinkStats &stats() const { return _stats; }
+};
+
+#endif  // SPONGE_LIBSPONGE_SIMULATOR_HH
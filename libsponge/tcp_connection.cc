@@ -17,19 +17,22 @@ size_t TCPConnection::unassembled_bytes() const {
     return _receiver.unassembled_bytes(); 
 }
 
-size_t TCPConnection::time_since_last_segment_received() const { return _timer_since_last_received; }
+size_t TCPConnection::time_since_last_segment_received() const { return _timers->now()-_last_segment_received_ms; }
 
 void TCPConnection::abort_connection()
 {
     _sender.stream_in().set_error();
     _receiver.stream_out().set_error();
     _is_active=false;
+    _linger_timer.stop();
+    _delayed_ack_timer.stop();
+    _keepalive_timer.stop();
 }
 
-//pop and send a segment from the sender's queue
+//pop and send a segment from the sender's queue, unless the owner hasn't made room for it yet
 void TCPConnection::send_a_segment_with_ack()
 {
-    if(_sender.segments_out().empty())
+    if(_sender.segments_out().empty()||_segments_out.full())
         return;
     TCPSegment& seg_to_send=_sender.segments_out().front();
     if(_receiver.ackno().has_value())
@@ -38,20 +41,30 @@ void TCPConnection::send_a_segment_with_ack()
         seg_to_send.header().ackno=_receiver.ackno().value();
     }
     seg_to_send.header().win=_receiver.window_size();
-    _segments_out.push(seg_to_send);
+    _segments_out.push(move(seg_to_send));
     _sender.segments_out().pop();
+    //whatever ACK was being held back has just gone out
+    _delayed_ack_timer.stop();
+}
+
+//send the sender's segments, in order, for as long as there is room for them
+void TCPConnection::send_segments()
+{
+    while(!_sender.segments_out().empty()&&!_segments_out.full())
+        send_a_segment_with_ack();
 }
 
 void TCPConnection::segment_received(const TCPSegment &seg) { 
     //std::cout<<"Segment received!"<<std::endl;
     if(!_is_active)
         return;
-    _timer_since_last_received=0;
+    _last_segment_received_ms=_timers->now();
     if(seg.header().rst)
     {
         abort_connection();
         return;
     }
+    const optional<WrappingInt32> ackno_before=_receiver.ackno();
     if(!_receiver.stream_out().input_ended())
         _receiver.segment_received(seg);
     if(_receiver.stream_out().input_ended()&&(_sender.next_seqno_absolute()<_sender.stream_in().bytes_written()+2))
@@ -68,21 +81,35 @@ void TCPConnection::segment_received(const TCPSegment &seg) {
 
     if(!_sender.segments_out().empty())
     {
-        do
-        {
-            send_a_segment_with_ack();
-        } while (!_sender.segments_out().empty());
+        send_segments();
     }
     else if(seg.length_in_sequence_space()>0||
     (_receiver.ackno().has_value()&&(seg.length_in_sequence_space()==0)
     &&seg.header().seqno==_receiver.ackno().value()-1))
     {
-        _sender.send_empty_segment();
-        send_a_segment_with_ack();
+        //Hold back the ACK of plain in-order data, but never of two segments in a row
+        const bool in_order_data=!seg.header().syn&&!seg.header().fin&&seg.payload().size()>0
+            &&_receiver.ackno().has_value()&&_receiver.ackno()!=ackno_before;
+        if(_cfg.delayed_ack_ms>0&&in_order_data&&!_delayed_ack_timer.running())
+            _delayed_ack_timer.start(_cfg.delayed_ack_ms);
+        else
+        {
+            _sender.send_empty_segment();
+            send_segments();
+        }
     }
 
-    
-
+    if(!_is_active)
+        return;
+    //Linger (again) from now on, or end at the next tick if there is no need to
+    if(both_streams_finished())
+        _linger_timer.start(_linger_after_streams_finish ? 10*_cfg.rt_timeout : 0);
+    if(_cfg.keepalive_ms>0&&_receiver.ackno().has_value())
+    {
+        _keepalive_probes=0;
+        _keepalive_timer.start(_cfg.keepalive_ms);
+    }
+    send_segments();
 }
 
 void TCPConnection::send_a_rst_segment()
@@ -90,10 +117,12 @@ void TCPConnection::send_a_rst_segment()
     _sender.fill_window();
     if(_sender.segments_out().empty())
         _sender.send_empty_segment();
-    TCPSegment& seg_to_send=_sender.segments_out().front();
-    seg_to_send.header().rst=true;
-    _segments_out.push(seg_to_send);
-    _sender.segments_out().pop();
+    //the RST is the last segment the connection sends; it waits like any other if there is no room for it
+    TCPSegment rst=move(_sender.segments_out().front());
+    rst.header().rst=true;
+    _sender.segments_out()=queue<TCPSegment>{};
+    _sender.segments_out().push(move(rst));
+    send_a_segment_with_ack();
 }
 
 bool TCPConnection::active() const { return _is_active; }
@@ -102,59 +131,139 @@ size_t TCPConnection::write(const string &data) {
     size_t num_data=_sender.stream_in().write(data);
     _sender.fill_window();
     
-    while (!_sender.segments_out().empty())
-    {
-        send_a_segment_with_ack();
-    } 
+    send_segments();
     return num_data;
 }
 
 //! \param[in] ms_since_last_tick number of milliseconds since the last call to this method
 void TCPConnection::tick(const size_t ms_since_last_tick) { 
+    //The owner of a shared TCPTimers advances it and calls timer_expired() itself
+    if(_own_timers)
+        _own_timers->advance(ms_since_last_tick, [&](uint64_t, TCPTimers::Kind kind) { timer_expired(kind); });
+    send_segments();
+}
+
+void TCPConnection::timer_expired(const TCPTimers::Kind kind) {
     if(!_is_active)
         return;
-    _timer_since_last_received+=ms_since_last_tick;
-    _sender.tick(ms_since_last_tick);
-    if(_sender.consecutive_retransmissions()>TCPConfig::MAX_RETX_ATTEMPTS)
+    switch(kind)
+    {
+    case TCPTimers::Kind::Retransmission:
+        _sender.timer_expired(kind);
+        if(_sender.consecutive_retransmissions()>TCPConfig::MAX_RETX_ATTEMPTS)
+        {
+            send_a_rst_segment();
+            abort_connection();
+        }
+        else
+            send_segments();
+        break;
+    case TCPTimers::Kind::Linger:
+        if(both_streams_finished())
+            _is_active=false;
+        break;
+    case TCPTimers::Kind::DelayedAck:
+        _sender.send_empty_segment();
+        send_segments();
+        break;
+    case TCPTimers::Kind::Keepalive:
+        send_keepalive();
+        break;
+    }
+}
+
+void TCPConnection::send_keepalive()
+{
+    if(_keepalive_probes>=TCPConfig::MAX_KEEPALIVE_PROBES)
     {
         send_a_rst_segment();
         abort_connection();
         return;
     }
-    else
-        send_a_segment_with_ack();
-    
-
-    if(_receiver.stream_out().input_ended()&&_receiver.unassembled_bytes()==0
-    &&_sender.stream_in().eof()&&(_sender.next_seqno_absolute()==_sender.stream_in().bytes_written()+2)
-    &&_sender.bytes_in_flight()==0)
+    //The retransmission timer already watches a connection with data in flight
+    if(_sender.bytes_in_flight()>0)
     {
-        if(!_linger_after_streams_finish||_timer_since_last_received>=10*_cfg.rt_timeout)
-            _is_active=false;
+        _keepalive_timer.start(_cfg.keepalive_ms);
+        return;
     }
+    //A probe carries the last seqno the peer has already acknowledged, so it must ACK it again
+    _sender.send_empty_segment();
+    _sender.segments_out().back().header().seqno=_sender.next_seqno()-1;
+    send_segments();
+    _keepalive_probes++;
+    _keepalive_timer.start(_cfg.rt_timeout);
+}
 
+bool TCPConnection::both_streams_finished() const
+{
+    return _receiver.stream_out().input_ended()&&_receiver.unassembled_bytes()==0
+    &&_sender.stream_in().eof()&&(_sender.next_seqno_absolute()==_sender.stream_in().bytes_written()+2)
+    &&_sender.bytes_in_flight()==0;
+}
 
+optional<size_t> TCPConnection::time_until_next_deadline() const {
+    if(!_is_active)
+        return {};
+    optional<size_t> deadline=_sender.time_until_next_deadline();
+    for(const TCPTimers::Timer *timer : {&_linger_timer, &_delayed_ack_timer, &_keepalive_timer})
+    {
+        if(timer->running()&&(!deadline.has_value()||timer->time_remaining()<deadline.value()))
+            deadline=timer->time_remaining();
+    }
+    return deadline;
 }
 
 void TCPConnection::end_input_stream() {
     //cout<<"Ending outbound stream!"<<endl;
     _sender.stream_in().end_input();
     _sender.fill_window();
-    while (!_sender.segments_out().empty())
-    {
-        send_a_segment_with_ack();
-    } 
+    send_segments();
 }
 
 void TCPConnection::connect() {
     if(_sender.next_seqno_absolute()==0)
     {
         _sender.fill_window();
-        send_a_segment_with_ack();
+        send_segments();
     }
 
 }
 
+//the new connection's queue must refill from its own sender, and the moved-from one must not send a RST
+TCPConnection::TCPConnection(TCPConnection &&other)
+    : _cfg(other._cfg), _own_timers(move(other._own_timers)), _timers(other._timers),
+      _timer_owner(other._timer_owner), _receiver(move(other._receiver)), _sender(move(other._sender)),
+      _linger_timer(move(other._linger_timer)), _delayed_ack_timer(move(other._delayed_ack_timer)),
+      _keepalive_timer(move(other._keepalive_timer)), _last_segment_received_ms(other._last_segment_received_ms),
+      _keepalive_probes(other._keepalive_probes), _segments_out(move(other._segments_out)),
+      _linger_after_streams_finish(other._linger_after_streams_finish), _is_active(other._is_active) {
+    _segments_out.set_on_room([this] { send_segments(); });
+    other._is_active=false;
+}
+
+//the timers are replaced before the TCPTimers they may be kept in, which the old ones must leave first
+TCPConnection &TCPConnection::operator=(TCPConnection &&other) {
+    if(this==&other)
+        return *this;
+    _linger_timer=move(other._linger_timer);
+    _delayed_ack_timer=move(other._delayed_ack_timer);
+    _keepalive_timer=move(other._keepalive_timer);
+    _sender=move(other._sender);
+    _own_timers=move(other._own_timers);
+    _timers=other._timers;
+    _timer_owner=other._timer_owner;
+    _cfg=other._cfg;
+    _receiver=move(other._receiver);
+    _last_segment_received_ms=other._last_segment_received_ms;
+    _keepalive_probes=other._keepalive_probes;
+    _segments_out=move(other._segments_out);
+    _segments_out.set_on_room([this] { send_segments(); });
+    _linger_after_streams_finish=other._linger_after_streams_finish;
+    _is_active=other._is_active;
+    other._is_active=false;
+    return *this;
+}
+
 TCPConnection::~TCPConnection() {
     try {
         if (active()) {
@@ -1,35 +1,74 @@
 #ifndef SPONGE_LIBSPONGE_TCP_FACTORED_HH
 #define SPONGE_LIBSPONGE_TCP_FACTORED_HH
 
+#include "ring_queue.hh"
 #include "tcp_config.hh"
 #include "tcp_receiver.hh"
 #include "tcp_sender.hh"
 #include "tcp_state.hh"
+#include "tcp_timers.hh"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
 
 //! \brief A complete endpoint of a TCP connection
 class TCPConnection {
   private:
     TCPConfig _cfg;
+
+    //! timers of a connection that wasn't given a TCPTimers to share
+    std::unique_ptr<TCPTimers> _own_timers;
+
+    //! where the connection's timers are kept (_own_timers, or a shared one)
+    TCPTimers *_timers;
+
+    //! identifies the connection to the caller of TCPTimers::advance
+    uint64_t _timer_owner;
+
     TCPReceiver _receiver{_cfg.recv_capacity};
-    TCPSender _sender{_cfg.send_capacity, _cfg.rt_timeout, _cfg.fixed_isn};
+    TCPSender _sender{
+        _cfg.send_capacity, _cfg.rt_timeout, _cfg.fixed_isn, _timers, _timer_owner, _cfg.max_payload_size};
+
+    //! fires when the connection is done lingering after both streams have finished
+    TCPTimers::Timer _linger_timer{*_timers, _timer_owner, TCPTimers::Kind::Linger};
+
+    //! fires when an acknowledgment that is being held back must be sent
+    TCPTimers::Timer _delayed_ack_timer{*_timers, _timer_owner, TCPTimers::Kind::DelayedAck};
+
+    //! fires when the connection has been idle long enough to send a keepalive probe
+    TCPTimers::Timer _keepalive_timer{*_timers, _timer_owner, TCPTimers::Kind::Keepalive};
+
+    //! TCPTimers::now() when the last segment was received
+    uint64_t _last_segment_received_ms{_timers->now()};
+
+    //! keepalive probes sent since the last segment was received
+    unsigned _keepalive_probes{0};
 
     //! outbound queue of segments that the TCPConnection wants sent
-    std::queue<TCPSegment> _segments_out{};
+    RingQueue<TCPSegment> _segments_out{};
 
     //! Should the TCPConnection stay active (and keep ACKing)
     //! for 10 * _cfg.rt_timeout milliseconds after both streams have ended,
     //! in case the remote TCPConnection doesn't know we've received its whole stream?
     bool _linger_after_streams_finish{true};
 
-    uint16_t _timer_since_last_received{0};
-
     bool _is_active{true};
 
     void abort_connection();
 
     void send_a_segment_with_ack();
 
+    //! Move the sender's segments to _segments_out until it is full
+    void send_segments();
+
     void send_a_rst_segment();
+
+    //! Probe an idle peer, or give up on it
+    void send_keepalive();
+
+    //! Have both streams ended, with everything we sent acknowledged?
+    bool both_streams_finished() const;
   public:
     //! \name "Input" interface for the writer
     //!@{
@@ -53,6 +92,7 @@ class TCPConnection {
 
     //! \brief The inbound byte stream received from the peer
     ByteStream &inbound_stream() { return _receiver.stream_out(); }
+    const ByteStream &inbound_stream() const { return _receiver.stream_out(); }
     //!@}
 
     //! \name Accessors used for testing
@@ -74,14 +114,25 @@ class TCPConnection {
     //! Called when a new segment has been received from the network
     void segment_received(const TCPSegment &seg);
 
-    //! Called periodically when time elapses
+    //! \brief Called periodically when time elapses
+    //! \note Does nothing if the connection's timers are kept in a TCPTimers that was passed to the
+    //! constructor; the owner of that TCPTimers advances it and calls timer_expired() instead.
     void tick(const size_t ms_since_last_tick);
 
+    //! Called when one of the connection's timers has expired
+    void timer_expired(const TCPTimers::Kind kind);
+
+    //! \brief Milliseconds of tick() time until tick() next has something to do (retransmit, or stop lingering)
+    //! \returns an empty optional if nothing will happen until a segment arrives or more data is written
+    std::optional<size_t> time_until_next_deadline() const;
+
     //! \brief TCPSegments that the TCPConnection has enqueued for transmission.
     //! \note The owner or operating system will dequeue these and
     //! put each one into the payload of a lower-layer datagram (usually Internet datagrams (IP),
     //! but could also be user datagrams (UDP) or any other kind).
-    std::queue<TCPSegment> &segments_out() { return _segments_out; }
+    //! If the owner lets the queue fill up, further segments wait in the TCPSender until there is room, and
+    //! are moved in as soon as the owner pops one.
+    RingQueue<TCPSegment> &segments_out() { return _segments_out; }
 
     //! \brief Is the connection still alive in any way?
     //! \returns `true` if either stream is still running or if the TCPConnection is lingering
@@ -90,7 +141,16 @@ class TCPConnection {
     //!@}
 
     //! Construct a new connection from a configuration
-    explicit TCPConnection(const TCPConfig &cfg) : _cfg{cfg} {}
+    explicit TCPConnection(const TCPConfig &cfg)
+        : _cfg{cfg}, _own_timers(std::make_unique<TCPTimers>()), _timers(_own_timers.get()), _timer_owner(0) {
+        _segments_out.set_on_room([this] { send_segments(); });
+    }
+
+    //! Construct a new connection whose timers are kept in `timers`, as timers of `owner`
+    TCPConnection(const TCPConfig &cfg, TCPTimers &timers, const uint64_t owner)
+        : _cfg{cfg}, _own_timers(nullptr), _timers(&timers), _timer_owner(owner) {
+        _segments_out.set_on_room([this] { send_segments(); });
+    }
 
     //! \name construction and destruction
     //! moving is allowed; copying is disallowed; default construction not possible
@@ -98,8 +158,8 @@ class TCPConnection {
     //!@{
     ~TCPConnection();  //!< destructor sends a RST if the connection is still open
     TCPConnection() = delete;
-    TCPConnection(TCPConnection &&other) = default;
-    TCPConnection &operator=(TCPConnection &&other) = default;
+    TCPConnection(TCPConnection &&other);
+    TCPConnection &operator=(TCPConnection &&other);
     TCPConnection(const TCPConnection &other) = delete;
     TCPConnection &operator=(const TCPConnection &other) = delete;
     //!@}
@@ -11,14 +11,14 @@ using namespace std;
 ParseResult EthernetFrame::parse(const Buffer buffer) {
     NetParser p{buffer};
     _header.parse(p);
+    _serialized_header = Buffer{};
     _payload = p.buffer();
 
     return p.get_error();
 }
 
 BufferList EthernetFrame::serialize() const {
-    BufferList ret;
-    ret.append(_header.serialize());
+    BufferList ret = _serialized_header.size() ? BufferList{_serialized_header} : BufferList{_header.serialize()};
     ret.append(_payload);
     return ret;
 }
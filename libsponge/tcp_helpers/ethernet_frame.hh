@@ -4,13 +4,23 @@
 #include "buffer.hh"
 #include "ethernet_header.hh"
 
+#include <utility>
+
 //! \brief Ethernet frame
 class EthernetFrame {
   private:
     EthernetHeader _header{};
+    Buffer _serialized_header{};  //!< Cached serialization of _header, or empty if there is none
     BufferList _payload{};
 
   public:
+    EthernetFrame() = default;
+
+    //! \brief Construct from a header whose serialization has already been computed
+    //! \note `serialized_header` must be the result of `header.serialize()`; it is shared, not copied.
+    EthernetFrame(const EthernetHeader &header, const Buffer &serialized_header, BufferList payload)
+        : _header(header), _serialized_header(serialized_header), _payload(std::move(payload)) {}
+
     //! \brief Parse the frame from a string
     ParseResult parse(const Buffer buffer);
 
@@ -20,7 +30,10 @@ class EthernetFrame {
     //! \name Accessors
     //!@{
     const EthernetHeader &header() const { return _header; }
-    EthernetHeader &header() { return _header; }
+    EthernetHeader &header() {
+        _serialized_header = Buffer{};  // the caller may modify the header
+        return _header;
+    }
 
     const BufferList &payload() const { return _payload; }
     BufferList &payload() { return _payload; }
@@ -6,6 +6,13 @@
 
 using namespace std;
 
+TCPOverUDPSocketAdapter::TCPOverUDPSocketAdapter(UDPSocket &&sock, const bool segmentation_offload)
+    : _sock(move(sock)), _segmentation_offload(segmentation_offload) {
+    if (_segmentation_offload) {
+        _sock.set_gro();
+    }
+}
+
 //! \details This function first attempts to parse a TCP segment from the next UDP
 //! payload recv()d from the socket.
 //!
@@ -17,40 +24,97 @@ using namespace std;
 //! and the TCP segment read from the wire includes a SYN, this function clears the
 //! `_listen` flag and calls calls connect() on the underlying UDP socket, with
 //! the result that future outgoing segments go to the sender of the SYN segment.
+//!
+//! A payload that GRO has coalesced from several datagrams is sliced into one segment per
+//! datagram without copying; the first is returned, and the rest by the following calls
+//! (see read_pending()).
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
 optional<TCPSegment> TCPOverUDPSocketAdapter::read() {
-    auto datagram = _sock.recv();
+    if (_received.empty()) {
+        auto datagram = _sock.recv();
 
-    // is it for us?
-    if (not listening() and (datagram.source_address != config().destination)) {
-        return {};
-    }
+        // is it for us?
+        if (not listening() and (datagram.source_address != config().destination)) {
+            return {};
+        }
 
-    // is the payload a valid TCP segment?
-    TCPSegment seg;
-    if (ParseResult::NoError != seg.parse(move(datagram.payload), 0)) {
-        return {};
-    }
+        const Buffer payload{move(datagram.payload)};
+        const size_t segment_size = datagram.segment_size > 0 ? datagram.segment_size : payload.size();
+        for (size_t offset = 0; offset < payload.size(); offset += segment_size) {
+            Buffer piece = payload;
+            piece.remove_prefix(offset);
+            piece.remove_suffix(payload.size() - min(payload.size(), offset + segment_size));
+
+            // is the payload a valid TCP segment?
+            TCPSegment seg;
+            if (ParseResult::NoError != seg.parse(piece, 0)) {
+                continue;
+            }
 
-    // should we target this source in all future replies?
-    if (listening()) {
-        if (seg.header().syn and not seg.header().rst) {
-            config_mutable().destination = datagram.source_address;
-            set_listening(false);
-        } else {
+            // should we target this source in all future replies?
+            if (listening()) {
+                if (seg.header().syn and not seg.header().rst) {
+                    config_mutable().destination = datagram.source_address;
+                    set_listening(false);
+                } else {
+                    continue;
+                }
+            }
+
+            _received.push(move(seg));
+        }
+
+        if (_received.empty()) {
             return {};
         }
     }
 
+    TCPSegment seg = move(_received.front());
+    _received.pop();
     return seg;
 }
 
 //! Serialize a TCP segment and send it as the payload of a UDP datagram.
 //! \param[in] seg is the TCP segment to write
+//! \details With segmentation offload, the datagram joins the batch for the next flush() instead. A batch
+//! holds segments of one size, except that the last may be shorter (as UDP_SEGMENT requires), so a
+//! segment that can't join the batch sends it first.
 void TCPOverUDPSocketAdapter::write(TCPSegment &seg) {
     seg.header().sport = config().source.port();
     seg.header().dport = config().destination.port();
-    _sock.sendto(config().destination, seg.serialize(0));
+    if (not _segmentation_offload) {
+        _sock.sendto(config().destination, seg.serialize(0));
+        return;
+    }
+
+    const BufferList datagram = seg.serialize(0);
+    const size_t size = datagram.size();
+    if (_batch_count > 0 and (_batch_closed or size > _batch_segment_size or _batch_count == MAX_BATCH_SEGMENTS or
+                              _batch.size() + size > MAX_BATCH_SIZE)) {
+        flush();
+    }
+    if (_batch_count == 0) {
+        _batch_segment_size = size;
+    }
+    _batch_closed = size < _batch_segment_size;
+    _batch.append(datagram);
+    _batch_count++;
+}
+
+void TCPOverUDPSocketAdapter::flush() {
+    if (_batch_count == 0) {
+        return;
+    }
+
+    const BufferList batch = move(_batch);
+    const size_t count = _batch_count;
+    _batch = {};
+    _batch_count = 0;
+    if (count == 1) {
+        _sock.sendto(config().destination, batch);
+    } else {
+        _sock.sendto_segmented(config().destination, batch, _batch_segment_size);
+    }
 }
 
 //! Specialize LossyFdAdapter to TCPOverUDPSocketAdapter
@@ -9,6 +9,7 @@
 #include "tcp_segment.hh"
 
 #include <optional>
+#include <queue>
 #include <utility>
 
 //! \brief Basic functionality for file descriptor adaptors
@@ -40,23 +41,57 @@ class FdAdapterBase {
 
     //! Called periodically when time elapses
     void tick(const size_t) {}
+
+    //! Milliseconds of tick() time until tick() next has something to do (never, for most adapters)
+    std::optional<size_t> time_until_next_deadline() const { return {}; }
+
+    //! Send whatever write() has held back to send together (nothing, for most adapters)
+    void flush() {}
+
+    //! Whether read() has segments to return without reading from the file descriptor (never, for most adapters)
+    bool read_pending() const { return false; }
 };
 
 //! \brief A FD adaptor that reads and writes TCP segments in UDP payloads
+//! \details With segmentation offload, write() collects a flight of equal-sized segments and flush() sends
+//! them with one [UDP_SEGMENT](\ref man7::udp) sendmsg, and the socket receives with
+//! [UDP_GRO](\ref man7::udp), so that one recv() can bring in a whole flight, which read() then hands out
+//! one segment at a time.
 class TCPOverUDPSocketAdapter : public FdAdapterBase {
+  public:
+    //! Most segments one flush() sends at once (the kernel's limit is UDP_MAX_SEGMENTS, 64 before Linux 5.5)
+    static constexpr size_t MAX_BATCH_SEGMENTS = 64;
+
+    //! Most bytes one flush() sends at once (the largest UDP payload)
+    static constexpr size_t MAX_BATCH_SIZE = 65535 - 20 - 8;
+
   private:
     UDPSocket _sock;
+    bool _segmentation_offload;          //!< Send with UDP_SEGMENT and receive with UDP_GRO?
+    BufferList _batch{};                 //!< Serialized segments held back by write(), back to back
+    size_t _batch_count{0};              //!< Number of segments in _batch
+    size_t _batch_segment_size{0};       //!< Size of each segment in _batch, except perhaps the last
+    bool _batch_closed{false};           //!< Was the last segment in _batch shorter, so that none may follow it?
+    std::queue<TCPSegment> _received{};  //!< Segments received in a coalesced datagram and not yet read()
 
   public:
     //! Construct from a UDPSocket sliced into a FileDescriptor
-    explicit TCPOverUDPSocketAdapter(UDPSocket &&sock) : _sock(std::move(sock)) {}
+    //! \param[in] sock is the UDP socket to send and receive on
+    //! \param[in] segmentation_offload says whether to batch segments with UDP GSO and GRO (see above)
+    explicit TCPOverUDPSocketAdapter(UDPSocket &&sock, const bool segmentation_offload = false);
 
     //! Attempts to read and return a TCP segment related to the current connection from a UDP payload
     std::optional<TCPSegment> read();
 
-    //! Writes a TCP segment into a UDP payload
+    //! Writes a TCP segment into a UDP payload (held back until flush() with segmentation offload)
     void write(TCPSegment &seg);
 
+    //! Sends the segments that write() has held back
+    void flush();
+
+    //! Whether read() has segments from a coalesced datagram left to return
+    bool read_pending() const { return not _received.empty(); }
+
     //! Access the underlying UDP socket
     operator UDPSocket &() { return _sock; }
 
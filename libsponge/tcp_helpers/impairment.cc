@@ -0,0 +1,176 @@
+#include "impairment.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+Impairment::Impairment(const ImpairmentConfig &config, const uint64_t seed)
+    : _config(config), _random(seed), _tokens(max<double>(config.rate_burst, 1)) {}
+
+bool Impairment::chance(const double p) { return p > 0 and uniform_real_distribution<double>{0, 1}(_random) < p; }
+
+size_t Impairment::size(const TCPSegment &segment) {
+    return segment.header().doff * 4 + segment.payload().size();
+}
+
+void Impairment::push(const TCPSegment &segment) {
+    _stats.pushed++;
+
+    // Gilbert-Elliott: move between the states, then lose the segment with the state's probability
+    if (_config.burst_start > 0) {
+        _in_burst = _in_burst ? not chance(_config.burst_end) : chance(_config.burst_start);
+    }
+    if (chance(_in_burst ? _config.burst_loss : _config.loss)) {
+        _stats.lost++;
+        return;
+    }
+
+    const bool duplicate = chance(_config.duplicate);
+    _stats.duplicated += duplicate;
+    for (int copy = 0; copy <= int(duplicate); copy++) {
+        int64_t delay_ms = _config.delay_ms;
+        if (_config.jitter_ms > 0) {
+            const int64_t jitter_ms = _config.jitter_ms;
+            delay_ms = max<int64_t>(0, delay_ms + uniform_int_distribution<int64_t>{-jitter_ms, jitter_ms}(_random));
+        }
+        if (chance(_config.reorder)) {
+            _stats.reordered++;
+            delay_ms = 0;
+        }
+        _held.push_back({_now_ms + delay_ms, _pushed++, segment});
+        push_heap(_held.begin(), _held.end(), Later{});
+    }
+}
+
+void Impairment::release() {
+    while (not _held.empty() and _held.front().release_ms <= _now_ms) {
+        pop_heap(_held.begin(), _held.end(), Later{});
+        TCPSegment segment = move(_held.back().segment);
+        _held.pop_back();
+
+        const size_t bytes = size(segment);
+        if (_config.rate_limit != 0 and _rate_queue_bytes + bytes > _config.rate_limit) {
+            _stats.rate_drops++;
+            continue;
+        }
+        _rate_queue_bytes += bytes;
+        _rate_queue.push_back(move(segment));
+    }
+}
+
+optional<TCPSegment> Impairment::pop() {
+    release();
+    if (_rate_queue.empty() or (_config.rate != 0 and _tokens <= 0)) {
+        return {};
+    }
+
+    TCPSegment ret = move(_rate_queue.front());
+    _rate_queue.pop_front();
+    const size_t bytes = size(ret);
+    _rate_queue_bytes -= bytes;
+    if (_config.rate != 0) {
+        _tokens -= bytes;
+    }
+    _stats.popped++;
+    return ret;
+}
+
+bool Impairment::ready() const {
+    return (not _held.empty() and _held.front().release_ms <= _now_ms) or
+           (not _rate_queue.empty() and (_config.rate == 0 or _tokens > 0));
+}
+
+void Impairment::tick(const size_t ms) {
+    _now_ms += ms;
+    if (_config.rate != 0) {
+        _tokens = min(_tokens + double(_config.rate) * ms / 1000, max<double>(_config.rate_burst, 1));
+    }
+}
+
+optional<size_t> Impairment::time_until_next_deadline() const {
+    optional<size_t> ret{};
+    if (not _held.empty()) {
+        ret = _held.front().release_ms > _now_ms ? _held.front().release_ms - _now_ms : 0;
+    }
+    if (not _rate_queue.empty()) {
+        // the bucket lets the next segment through once it has any tokens
+        const size_t wait_ms =
+            (_config.rate == 0 or _tokens > 0) ? 0 : size_t(floor(-_tokens * 1000 / double(_config.rate))) + 1;
+        ret = min(ret.value_or(wait_ms), wait_ms);
+    }
+    return ret;
+}
+
+ImpairmentConfig parse_impairment(const string &description) {
+    ImpairmentConfig ret;
+    istringstream words{description};
+
+    // read the next word as a number (or leave `value` alone if it's optional and missing)
+    const auto number = [&](const string &keyword, double &value, const bool optional = false) {
+        const auto position = words.tellg();
+        string word;
+        if (not(words >> word)) {
+            if (optional) {
+                return false;
+            }
+            throw runtime_error("impairment: \"" + keyword + "\" needs a value");
+        }
+        size_t parsed = 0;
+        try {
+            value = stod(word, &parsed);
+        } catch (const logic_error &) {
+            parsed = 0;
+        }
+        if (parsed != word.size() or value < 0) {
+            if (optional) {
+                words.seekg(position);
+                return false;
+            }
+            throw runtime_error("impairment: bad value \"" + word + "\" for \"" + keyword + "\"");
+        }
+        return true;
+    };
+    const auto probability = [&](const string &keyword, double &p, const bool optional = false) {
+        const bool present = number(keyword, p, optional);
+        if (p > 1) {
+            throw runtime_error("impairment: \"" + keyword + "\" needs a probability from 0 to 1");
+        }
+        return present;
+    };
+
+    for (string keyword; words >> keyword;) {
+        double value = 0;
+        if (keyword == "loss") {
+            probability(keyword, ret.loss);
+        } else if (keyword == "burst") {
+            probability(keyword, ret.burst_start);
+            probability(keyword, ret.burst_end);
+            probability(keyword, ret.burst_loss, true);
+        } else if (keyword == "duplicate") {
+            probability(keyword, ret.duplicate);
+        } else if (keyword == "delay") {
+            number(keyword, value);
+            ret.delay_ms = uint32_t(value);
+            if (number(keyword, value, true)) {
+                ret.jitter_ms = uint32_t(value);
+            }
+        } else if (keyword == "reorder") {
+            probability(keyword, ret.reorder);
+        } else if (keyword == "rate") {
+            number(keyword, value);
+            ret.rate = uint64_t(value);
+            if (number(keyword, value, true)) {
+                ret.rate_burst = size_t(value);
+                if (number(keyword, value, true)) {
+                    ret.rate_limit = size_t(value);
+                }
+            }
+        } else {
+            throw runtime_error("impairment: unknown keyword \"" + keyword + "\"");
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,106 @@
+#ifndef SPONGE_LIBSPONGE_IMPAIRMENT_HH
+#define SPONGE_LIBSPONGE_IMPAIRMENT_HH
+
+#include "tcp_config.hh"
+#include "tcp_segment.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+//! \brief A netem-like stage that impairs the segments going one way through a LossyFdAdapter
+//! \details A segment pushed in may be lost (see ImpairmentConfig) or duplicated, then is held back for the
+//! delay and jitter (so segments with more jitter are overtaken), and finally waits for a token bucket to let
+//! it through at the configured rate, dropped if the bucket's queue is full. pop() returns the segments that
+//! have made it through; time passes with tick().
+//!
+//! Every random decision is made by push(), from a generator seeded at construction, so the same segments
+//! pushed with the same seed are impaired the same way.
+class Impairment {
+  public:
+    //! What the stage has done
+    struct Stats {
+        uint64_t pushed{0};      //!< Segments pushed in
+        uint64_t lost{0};        //!< Segments lost (in or out of bursts)
+        uint64_t duplicated{0};  //!< Segments sent twice
+        uint64_t reordered{0};   //!< Segments that skipped the delay
+        uint64_t rate_drops{0};  //!< Segments dropped because the token bucket's queue was full
+        uint64_t popped{0};      //!< Segments that made it through
+    };
+
+  private:
+    //! A segment held back until `release_ms`
+    struct Held {
+        uint64_t release_ms;  //!< When the delay ends
+        uint64_t sequence;    //!< Order among segments released at the same time
+        TCPSegment segment;   //!< The segment
+    };
+
+    //! Orders the heap of held segments so that the first to be released is on top
+    struct Later {
+        bool operator()(const Held &a, const Held &b) const {
+            return a.release_ms > b.release_ms or (a.release_ms == b.release_ms and a.sequence > b.sequence);
+        }
+    };
+
+    ImpairmentConfig _config;
+    std::mt19937_64 _random;
+    bool _in_burst{false};                 //!< Gilbert-Elliott state
+    uint64_t _now_ms{0};                   //!< Time passed in tick()s
+    uint64_t _pushed{0};                   //!< Segments pushed so far, to order the held segments
+    std::vector<Held> _held{};             //!< Heap of segments in their delay
+    std::deque<TCPSegment> _rate_queue{};  //!< Segments waiting for the token bucket
+    size_t _rate_queue_bytes{0};           //!< Bytes in _rate_queue
+    double _tokens;                        //!< Bytes the token bucket lets through (may be negative)
+    Stats _stats{};
+
+    //! `true` with probability `p`
+    bool chance(const double p);
+
+    //! Move the segments whose delay has ended to the token bucket's queue
+    void release();
+
+    //! Bytes of a segment that count against the rate
+    static size_t size(const TCPSegment &segment);
+
+  public:
+    //! Construct a stage that impairs segments as `config` says, with random decisions derived from `seed`
+    Impairment(const ImpairmentConfig &config, const uint64_t seed);
+
+    //! Impair a segment
+    void push(const TCPSegment &segment);
+
+    //! Take the next segment that has made it through, if any
+    std::optional<TCPSegment> pop();
+
+    //! Whether pop() may have a segment to return now
+    bool ready() const;
+
+    //! Pass `ms` milliseconds
+    void tick(const size_t ms);
+
+    //! Milliseconds of tick() time until a held segment is due, if any is held
+    std::optional<size_t> time_until_next_deadline() const;
+
+    const Stats &stats() const { return _stats; }
+};
+
+//! \brief Parse a netem-like description of an impairment, such as "delay 40 10 loss 0.01 rate 1250000"
+//! \details The description is a list of any of
+//!
+//! - `loss <p>`
+//! - `burst <start> <end> [<loss>]` (Gilbert-Elliott burst loss)
+//! - `duplicate <p>`
+//! - `delay <ms> [<jitter ms>]`
+//! - `reorder <p>`
+//! - `rate <bytes per second> [<burst bytes> [<queue limit bytes>]]`
+//!
+//! with probabilities from 0 to 1.
+//! \throws std::runtime_error if the description is malformed
+ImpairmentConfig parse_impairment(const std::string &description);
+
+#endif  // SPONGE_LIBSPONGE_IMPAIRMENT_HH
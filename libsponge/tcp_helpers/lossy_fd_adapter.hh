@@ -2,31 +2,50 @@
 #define SPONGE_LIBSPONGE_LOSSY_FD_ADAPTER_HH
 
 #include "file_descriptor.hh"
+#include "impairment.hh"
 #include "tcp_config.hh"
 #include "tcp_segment.hh"
 #include "util.hh"
 
 #include <optional>
-#include <random>
 #include <utility>
 
-//! An adapter class that adds random dropping behavior to an FD adapter
+//! \brief An adapter class that impairs the segments an FD adapter reads and writes, as netem would
+//! \details Each direction goes through an Impairment, set up from config().impairment_dn and impairment_up
+//! when the first segment passes (so after TCPSpongeSocket has configured the adapter). Held-back uplink
+//! segments are written by tick(); held-back downlink segments are returned by read() once due, and make
+//! read_pending() true.
 template <typename AdapterT>
 class LossyFdAdapter {
   private:
-    //! Fast RNG used by _should_drop()
-    std::mt19937 _rand{get_random_generator()};
-
     //! The underlying FD adapter
     AdapterT _adapter;
 
-    //! \brief Determine whether or not to drop a given read or write
-    //! \param[in] uplink is `true` to use the uplink loss probability, else use the downlink loss probability
-    //! \returns `true` if the segment should be dropped
-    bool _should_drop(bool uplink) {
-        const auto &cfg = _adapter.config();
-        const uint16_t loss = uplink ? cfg.loss_rate_up : cfg.loss_rate_dn;
-        return loss != 0 && uint16_t(_rand()) < loss;
+    std::optional<Impairment> _down{};  //!< Impairs the segments read
+    std::optional<Impairment> _up{};    //!< Impairs the segments written
+
+    //! The Impairment of one direction, set up the first time it's needed
+    Impairment &_impairment(const bool uplink) {
+        std::optional<Impairment> &impairment = uplink ? _up : _down;
+        if (not impairment) {
+            const auto &cfg = _adapter.config();
+            // each direction gets its own stream of random decisions, derived from the seed if there is one
+            const uint64_t seed = cfg.impairment_seed ? *cfg.impairment_seed : get_random_generator()();
+            impairment.emplace(uplink ? cfg.impairment_up : cfg.impairment_dn, seed * 2 + uplink);
+        }
+        return *impairment;
+    }
+
+    //! Write the uplink segments that have made it through the impairment
+    void _write_released() {
+        bool wrote = false;
+        while (auto seg = _impairment(true).pop()) {
+            _adapter.write(*seg);
+            wrote = true;
+        }
+        if (wrote) {
+            _adapter.flush();
+        }
     }
 
   public:
@@ -36,24 +55,56 @@ class LossyFdAdapter {
     //! Construct from a FileDescriptor appropriate to the AdapterT constructor
     explicit LossyFdAdapter(AdapterT &&adapter) : _adapter(std::move(adapter)) {}
 
-    //! \brief Read from the underlying AdapterT instance, potentially dropping the read datagram
-    //! \returns std::optional<TCPSegment> that is empty if the segment was dropped or if
+    //! \brief Read a segment that has made it through the downlink impairment
+    //! \details Returns a held-back segment that is due, if there is one, without reading from the underlying
+    //! AdapterT; otherwise reads a segment and impairs it. So to read a readable file descriptor, first call
+    //! read() until read_pending() is `false`.
+    //! \returns std::optional<TCPSegment> that is empty if no segment has made it through (yet), or if
     //!          the underlying AdapterT returned an empty value
     std::optional<TCPSegment> read() {
-        auto ret = _adapter.read();
-        if (_should_drop(false)) {
-            return {};
+        Impairment &down = _impairment(false);
+        if (not down.ready()) {
+            if (auto seg = _adapter.read()) {
+                down.push(*seg);
+            }
         }
-        return ret;
+        return down.pop();
     }
 
-    //! \brief Write to the underlying AdapterT instance, potentially dropping the datagram to be written
-    //! \param[in] seg is the packet to either write or drop
+    //! \brief Write a segment through the uplink impairment, which may drop, duplicate or hold it back
+    //! \param[in] seg is the packet to impair and write
     void write(TCPSegment &seg) {
-        if (_should_drop(true)) {
-            return;
+        _impairment(true).push(seg);
+        _write_released();
+    }
+
+    //! Pass time in the underlying AdapterT and both impairments, writing the uplink segments now due
+    void tick(const size_t ms_since_last_tick) {
+        _adapter.tick(ms_since_last_tick);
+        _impairment(false).tick(ms_since_last_tick);
+        _impairment(true).tick(ms_since_last_tick);
+        _write_released();
+    }
+
+    //! Milliseconds until the underlying AdapterT or either impairment next has something to do
+    std::optional<size_t> time_until_next_deadline() const {
+        std::optional<size_t> ret = _adapter.time_until_next_deadline();
+        for (const auto &impairment : {&_down, &_up}) {
+            const auto deadline = *impairment ? (*impairment)->time_until_next_deadline() : std::nullopt;
+            if (deadline and (not ret or *deadline < *ret)) {
+                ret = deadline;
+            }
         }
-        return _adapter.write(seg);
+        return ret;
+    }
+
+    //! Whether read() has segments to return without the file descriptor being readable
+    bool read_pending() const { return _adapter.read_pending() or (_down and _down->ready()); }
+
+    //! What each direction's impairment has done (nothing until a segment passes)
+    std::optional<Impairment::Stats> stats(const bool uplink) const {
+        const std::optional<Impairment> &impairment = uplink ? _up : _down;
+        return impairment ? impairment->stats() : std::optional<Impairment::Stats>{};
     }
 
     //! \name
@@ -63,9 +114,7 @@ class LossyFdAdapter {
     void set_listening(const bool l) { _adapter.set_listening(l); }      //!< FdAdapterBase::set_listening passthrough
     const FdAdapterConfig &config() const { return _adapter.config(); }  //!< FdAdapterBase::config passthrough
     FdAdapterConfig &config_mut() { return _adapter.config_mut(); }      //!< FdAdapterBase::config_mut passthrough
-    void tick(const size_t ms_since_last_tick) {
-        _adapter.tick(ms_since_last_tick);
-    }  //!< FdAdapterBase::tick passthrough
+    void flush() { _adapter.flush(); }                                   //!< FdAdapterBase::flush passthrough
     //!@}
 };
 
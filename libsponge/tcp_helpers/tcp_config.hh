@@ -11,15 +11,47 @@
 //! Config for TCP sender and receiver
 class TCPConfig {
   public:
-    static constexpr size_t DEFAULT_CAPACITY = 64000;  //!< Default capacity
-    static constexpr size_t MAX_PAYLOAD_SIZE = 1000;   //!< Conservative max payload size for real Internet
-    static constexpr uint16_t TIMEOUT_DFLT = 1000;     //!< Default re-transmit timeout is 1 second
-    static constexpr unsigned MAX_RETX_ATTEMPTS = 8;   //!< Maximum re-transmit attempts before giving up
+    static constexpr size_t DEFAULT_CAPACITY = 64000;    //!< Default capacity
+    static constexpr size_t MAX_PAYLOAD_SIZE = 1000;     //!< Conservative max payload size for real Internet
+    static constexpr uint16_t TIMEOUT_DFLT = 1000;       //!< Default re-transmit timeout is 1 second
+    static constexpr unsigned MAX_RETX_ATTEMPTS = 8;     //!< Maximum re-transmit attempts before giving up
+    static constexpr unsigned MAX_KEEPALIVE_PROBES = 9;  //!< Unanswered keepalive probes before giving up
 
     uint16_t rt_timeout = TIMEOUT_DFLT;       //!< Initial value of the retransmission timeout, in milliseconds
     size_t recv_capacity = DEFAULT_CAPACITY;  //!< Receive capacity, in bytes
     size_t send_capacity = DEFAULT_CAPACITY;  //!< Sender capacity, in bytes
     std::optional<WrappingInt32> fixed_isn{};
+
+    //! Longest time the ACK of in-order data may be held back, in milliseconds (0: acknowledge at once)
+    uint16_t delayed_ack_ms = 0;
+
+    //! Idle time after which a connection is probed, then probed every `rt_timeout` ms (0: no keepalives)
+    uint32_t keepalive_ms = 0;
+
+    //! \brief Largest payload the sender puts in one segment
+    //! \details Only a device that segments for us (see TunTapFD's `vnet_hdr`) can take more than MAX_PAYLOAD_SIZE.
+    size_t max_payload_size = MAX_PAYLOAD_SIZE;
+};
+
+//! \brief What a LossyFdAdapter does to the segments going one way (see Impairment)
+//! \details Probabilities are from 0 to 1. A segment is lost with probability `loss`, or `burst_loss` during
+//! a burst: the Gilbert-Elliott model, where each segment starts a burst with probability `burst_start` and
+//! ends one with probability `burst_end`.
+class ImpairmentConfig {
+  public:
+    double loss = 0;         //!< Probability that a segment is lost outside bursts
+    double burst_start = 0;  //!< Probability that a burst of loss starts at a segment (0: no bursts)
+    double burst_end = 1;    //!< Probability that a burst of loss ends at a segment
+    double burst_loss = 1;   //!< Probability that a segment is lost during a burst
+    double duplicate = 0;    //!< Probability that a segment is sent twice
+
+    uint32_t delay_ms = 0;   //!< Time each segment is held back
+    uint32_t jitter_ms = 0;  //!< Most that the delay varies, either way, from one segment to the next
+    double reorder = 0;      //!< Probability that a segment skips the delay, overtaking those held back
+
+    uint64_t rate = 0;      //!< Bytes per second that a token bucket lets through (0: no limit)
+    size_t rate_burst = 0;  //!< Bytes the token bucket lets through at once, beyond the rate
+    size_t rate_limit = 0;  //!< Most bytes that may wait for the token bucket (0: no limit)
 };
 
 //! Config for classes derived from FdAdapter
@@ -28,8 +60,11 @@ class FdAdapterConfig {
     Address source{"0", 0};       //!< Source address and port
     Address destination{"0", 0};  //!< Destination address and port
 
-    uint16_t loss_rate_dn = 0;  //!< Downlink loss rate (for LossyFdAdapter)
-    uint16_t loss_rate_up = 0;  //!< Uplink loss rate (for LossyFdAdapter)
+    ImpairmentConfig impairment_dn{};  //!< Downlink impairment (for LossyFdAdapter)
+    ImpairmentConfig impairment_up{};  //!< Uplink impairment (for LossyFdAdapter)
+
+    //! Seed of the LossyFdAdapter's random decisions (none: a different run every time)
+    std::optional<uint64_t> impairment_seed{};
 };
 
 #endif  // SPONGE_LIBSPONGE_TCP_CONFIG_HH
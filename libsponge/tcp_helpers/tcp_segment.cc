@@ -9,11 +9,16 @@ using namespace std;
 
 //! \param[in] buffer string/Buffer to be parsed
 //! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
-ParseResult TCPSegment::parse(const Buffer buffer, const uint32_t datagram_layer_checksum) {
-    InternetChecksum check(datagram_layer_checksum);
-    check.add(buffer);
-    if (check.value()) {
-        return ParseResult::BadChecksum;
+//! \param[in] verify_checksum is whether to check the segment's checksum
+ParseResult TCPSegment::parse(const Buffer buffer,
+                              const uint32_t datagram_layer_checksum,
+                              const bool verify_checksum) {
+    if (verify_checksum) {
+        InternetChecksum check(datagram_layer_checksum);
+        check.add(buffer);
+        if (check.value()) {
+            return ParseResult::BadChecksum;
+        }
     }
 
     NetParser p{buffer};
@@ -43,3 +48,18 @@ BufferList TCPSegment::serialize(const uint32_t datagram_layer_checksum) const {
 
     return ret;
 }
+
+//! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
+//! \details The checksum field holds the one's complement sum of the pseudo-header, not inverted, as
+//! Linux expects of a packet marked `CHECKSUM_PARTIAL`: summing the rest of the segment into it, and
+//! inverting the result, gives the checksum.
+BufferList TCPSegment::serialize_partial_checksum(const uint32_t datagram_layer_checksum) const {
+    TCPHeader header_out = _header;
+    header_out.cksum = static_cast<uint16_t>(~InternetChecksum(datagram_layer_checksum).value());
+
+    BufferList ret;
+    ret.append(header_out.serialize());
+    ret.append(_payload);
+
+    return ret;
+}
@@ -14,11 +14,18 @@ class TCPSegment {
 
   public:
     //! \brief Parse the segment from a string
-    ParseResult parse(const Buffer buffer, const uint32_t datagram_layer_checksum = 0);
+    //! \param[in] verify_checksum is `false` for a segment whose checksum a device has checked, or will fill in
+    ParseResult parse(const Buffer buffer,
+                      const uint32_t datagram_layer_checksum = 0,
+                      const bool verify_checksum = true);
 
     //! \brief Serialize the segment to a string
     BufferList serialize(const uint32_t datagram_layer_checksum = 0) const;
 
+    //! \brief Serialize the segment with only the pseudo-header's part of the checksum in its checksum field,
+    //! for a device with checksum offload to complete over the rest of the segment
+    BufferList serialize_partial_checksum(const uint32_t datagram_layer_checksum) const;
+
     //! \name Accessors
     //!@{
     const TCPHeader &header() const { return _header; }
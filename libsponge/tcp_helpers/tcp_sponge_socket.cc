@@ -1,58 +1,172 @@
 #include "tcp_sponge_socket.hh"
 
+#include "byte_ring.hh"
 #include "network_interface.hh"
 #include "parser.hh"
 #include "tun.hh"
 #include "util.hh"
 
 #include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <utility>
 
 using namespace std;
 
-static constexpr size_t TCP_TICK_MS = 10;
-
 //! \param[in] condition is a function returning true if loop should continue
+//! \details Between events the loop sleeps until the next deadline of the TCPConnection or the adapter,
+//! and doesn't wake up at all while neither has a timer running.
 template <typename AdaptT>
 void TCPSpongeSocket<AdaptT>::_tcp_loop(const function<bool()> &condition) {
-    auto base_time = timestamp_ms();
     while (condition()) {
-        auto ret = _eventloop.wait_next_event(TCP_TICK_MS);
+        _schedule_tick();
+        auto ret = _eventloop.wait_next_event(-1);
         if (ret == EventLoop::Result::Exit or _abort) {
             break;
         }
+    }
+}
+
+//! \details Called before anything that could start a timer, so that every timer counts from when it starts.
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_tick() {
+    const uint64_t now = timestamp_ms();
+    if (_tcp.value().active()) {
+        _tcp.value().tick(now - _last_tick_ms);
+        _datagram_adapter.tick(now - _last_tick_ms);
+    }
+    _last_tick_ms = now;
+}
 
-        if (_tcp.value().active()) {
-            const auto next_time = timestamp_ms();
-            _tcp.value().tick(next_time - base_time);
-            _datagram_adapter.tick(next_time - base_time);
-            base_time = next_time;
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_schedule_tick() {
+    optional<size_t> deadline{};
+    if (_tcp.value().active()) {
+        deadline = _tcp.value().time_until_next_deadline();
+        const optional<size_t> adapter_deadline = _datagram_adapter.time_until_next_deadline();
+        if (adapter_deadline.has_value() and (not deadline.has_value() or adapter_deadline < deadline)) {
+            deadline = adapter_deadline;
         }
     }
+
+    const uint64_t due = _last_tick_ms + deadline.value_or(0);
+    if (deadline.has_value() and _tick_timer != EventLoop::NO_TIMER and due == _tick_due_ms) {
+        return;
+    }
+    _eventloop.cancel_timer(_tick_timer);
+    _tick_timer = EventLoop::NO_TIMER;
+    if (deadline.has_value()) {
+        const uint64_t now = timestamp_ms();
+        _tick_due_ms = due;
+        _tick_timer = _eventloop.add_timer(due > now ? due - now : 0, [&] {
+            _tick_timer = EventLoop::NO_TIMER;
+            _tick();
+            _receive_pending();
+        });
+    }
 }
 
-//! \param[in] data_socket_pair is a pair of connected AF_UNIX SOCK_STREAM sockets
+//! \details Segments left over from a coalesced datagram, or held back by a LossyFdAdapter until a tick, don't
+//! make the adapter's file descriptor readable.
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_receive_pending() {
+    while (_tcp->active() and _datagram_adapter.read_pending()) {
+        auto seg = _datagram_adapter.read();
+        if (seg) {
+            _tcp->segment_received(move(seg.value()));
+        }
+    }
+    // with rings there's nothing to poll until a ring fills up (see rule 3)
+    if (_inbound_room.has_value() and _inbound_pending()) {
+        _deliver_inbound();
+    }
+}
+
+//! \param[in] data_socket_pair is a pair of connected AF_UNIX SOCK_STREAM sockets, or a ring_pair()
 //! \param[in] datagram_interface is the interface for reading and writing datagrams
+//! \param[in] backend is the EventLoop::Backend of the TCPConnection thread's event loop
+//! \param[in] transport is how bytes get between the owner and the TCPConnection
 template <typename AdaptT>
 TCPSpongeSocket<AdaptT>::TCPSpongeSocket(pair<FileDescriptor, FileDescriptor> data_socket_pair,
-                                         AdaptT &&datagram_interface)
+                                         AdaptT &&datagram_interface,
+                                         const EventLoop::Backend backend,
+                                         const Transport transport)
     : LocalStreamSocket(move(data_socket_pair.first))
+    , _transport(transport)
     , _thread_data(move(data_socket_pair.second))
-    , _datagram_adapter(move(datagram_interface)) {
+    , _datagram_adapter(move(datagram_interface))
+    , _eventloop(backend)
+    , _abort_notifier(SystemCall("eventfd", ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {
     _thread_data.set_blocking(false);
+    if (_thread_data.rings()) {
+        _inbound_room.emplace(_thread_data.rings()->out->writable_event().duplicate());
+    }
+}
+
+template <typename AdaptT>
+bool TCPSpongeSocket<AdaptT>::_inbound_pending() {
+    const ByteStream &inbound = _tcp->inbound_stream();
+    return (not inbound.buffer_empty()) or ((inbound.eof() or inbound.error()) and not _inbound_shutdown);
+}
+
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_deliver_inbound() {
+    ByteStream &inbound = _tcp->inbound_stream();
+    // Write from the inbound_stream into
+    // the pipe, handling the possibility of a partial
+    // write (i.e., only pop what was actually written).
+    const size_t amount_to_write = min(size_t(65536), inbound.buffer_size());
+    const std::string buffer = inbound.peek_output(amount_to_write);
+    size_t bytes_written = 0;
+    if (_inbound_room.has_value()) {
+        // pushed to directly, as writing to a full ring would block
+        try {
+            bytes_written = _thread_data.rings()->out->push(buffer);
+        } catch (const unix_error &) {
+            bytes_written = buffer.size();  // the owner has shut the socket down for reading: drop it
+        }
+    } else {
+        bytes_written = _thread_data.write(move(buffer), false);
+    }
+    inbound.pop_output(bytes_written);
+
+    if (inbound.eof() or inbound.error()) {
+        _thread_data.shutdown(SHUT_WR);
+        _inbound_shutdown = true;
+
+        // debugging output:
+        cerr << "DEBUG: Inbound stream from " << _datagram_adapter.config().destination.to_string() << " finished "
+             << (inbound.error() ? "with an error/reset.\n" : "cleanly.\n");
+        if (_tcp.value().state() == TCPState::State::TIME_WAIT) {
+            cerr << "DEBUG: Waiting for lingering segments (e.g. retransmissions of FIN) from peer...\n";
+        }
+    }
+}
+
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_send_segments() {
+    while (not _tcp->segments_out().empty()) {
+        _datagram_adapter.write(_tcp->segments_out().front());
+        _tcp->segments_out().pop();
+    }
+    _datagram_adapter.flush();
 }
 
 template <typename AdaptT>
 void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
     _tcp.emplace(config);
+    _last_tick_ms = timestamp_ms();
 
     // Set up the event loop
 
@@ -71,15 +185,22 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
     //
     // 4) Outbound segment generated by TCP (needs to be
     //    given to underlying datagram socket)
+    //
+    // Timers (retransmission, linger, ARP) are handled by a timer
+    // in the event loop, set for the earliest deadline (see _schedule_tick).
 
     // rule 1: read from filtered packet stream and dump into TCPConnection
     _eventloop.add_rule(_datagram_adapter,
                         Direction::In,
                         [&] {
+                            _tick();
+                            // the segments already pending come first, so that read() takes from the fd
+                            _receive_pending();
                             auto seg = _datagram_adapter.read();
                             if (seg) {
                                 _tcp->segment_received(move(seg.value()));
                             }
+                            _receive_pending();
 
                             // debugging output:
                             if (_thread_data.eof() and _tcp.value().bytes_in_flight() == 0 and not _fully_acked) {
@@ -91,11 +212,21 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
                         },
                         [&] { return _tcp->active(); });
 
+    // rule 4: read outbound segments from TCPConnection and send as datagrams
+    _eventloop.add_rule(
+        _datagram_adapter, Direction::Out, [&] { _send_segments(); }, [&] { return not _tcp->segments_out().empty(); });
+
+    // with Transport::Inline the owner reads and writes the streams itself, and there is no thread to abort
+    if (_transport == Transport::Inline) {
+        return;
+    }
+
     // rule 2: read from pipe into outbound buffer
     _eventloop.add_rule(
         _thread_data,
         Direction::In,
         [&] {
+            _tick();
             const auto data = _thread_data.read(_tcp->remaining_outbound_capacity());
             const auto len = data.size();
             const auto amount_written = _tcp->write(move(data));
@@ -119,47 +250,27 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
             _outbound_shutdown = true;
         });
 
-    // rule 3: read from inbound buffer into pipe
-    _eventloop.add_rule(
-        _thread_data,
-        Direction::Out,
-        [&] {
-            ByteStream &inbound = _tcp->inbound_stream();
-            // Write from the inbound_stream into
-            // the pipe, handling the possibility of a partial
-            // write (i.e., only pop what was actually written).
-            const size_t amount_to_write = min(size_t(65536), inbound.buffer_size());
-            const std::string buffer = inbound.peek_output(amount_to_write);
-            const auto bytes_written = _thread_data.write(move(buffer), false);
-            inbound.pop_output(bytes_written);
-
-            if (inbound.eof() or inbound.error()) {
-                _thread_data.shutdown(SHUT_WR);
-                _inbound_shutdown = true;
-
-                // debugging output:
-                cerr << "DEBUG: Inbound stream from " << _datagram_adapter.config().destination.to_string()
-                     << " finished " << (inbound.error() ? "with an error/reset.\n" : "cleanly.\n");
-                if (_tcp.value().state() == TCPState::State::TIME_WAIT) {
-                    cerr << "DEBUG: Waiting for lingering segments (e.g. retransmissions of FIN) from peer...\n";
-                }
-            }
-        },
-        [&] {
-            return (not _tcp->inbound_stream().buffer_empty()) or
-                   ((_tcp->inbound_stream().eof() or _tcp->inbound_stream().error()) and not _inbound_shutdown);
-        });
+    // rule 3: read from inbound buffer into pipe (or, with rings, resume once the owner has made room)
+    if (_inbound_room.has_value()) {
+        _eventloop.add_rule(
+            _inbound_room.value(),
+            Direction::In,
+            [&] {
+                _inbound_room->read(sizeof(uint64_t));
+                _deliver_inbound();
+            },
+            [&] { return _inbound_pending(); });
+    } else {
+        _eventloop.add_rule(
+            _thread_data, Direction::Out, [&] { _deliver_inbound(); }, [&] { return _inbound_pending(); });
+    }
 
-    // rule 4: read outbound segments from TCPConnection and send as datagrams
-    _eventloop.add_rule(_datagram_adapter,
-                        Direction::Out,
-                        [&] {
-                            while (not _tcp->segments_out().empty()) {
-                                _datagram_adapter.write(_tcp->segments_out().front());
-                                _tcp->segments_out().pop();
-                            }
-                        },
-                        [&] { return not _tcp->segments_out().empty(); });
+    // wakes the TCPConnection thread when the owner sets _abort; stays until the inbound stream is delivered
+    _eventloop.add_rule(
+        _abort_notifier,
+        Direction::In,
+        [&] { _abort_notifier.read(sizeof(uint64_t)); },
+        [&] { return _tcp->active() or not _inbound_shutdown; });
 }
 
 //! \brief Call [socketpair](\ref man2::socketpair) and return connected Unix-domain sockets of specified type
@@ -172,17 +283,31 @@ static inline pair<FileDescriptor, FileDescriptor> socket_pair_helper(const int
 }
 
 //! \param[in] datagram_interface is the underlying interface (e.g. to UDP, IP, or Ethernet)
+//! \param[in] backend is the EventLoop::Backend of the TCPConnection thread's event loop
+//! \param[in] transport is how bytes get between the owner and the TCPConnection
+//! \details With Transport::Inline a socket pair is still made, so that the TCPSpongeSocket is a socket,
+//! but nothing is sent over it.
 template <typename AdaptT>
-TCPSpongeSocket<AdaptT>::TCPSpongeSocket(AdaptT &&datagram_interface)
-    : TCPSpongeSocket(socket_pair_helper(SOCK_STREAM), move(datagram_interface)) {}
+TCPSpongeSocket<AdaptT>::TCPSpongeSocket(AdaptT &&datagram_interface,
+                                         const EventLoop::Backend backend,
+                                         const Transport transport)
+    : TCPSpongeSocket(transport == Transport::Rings ? ring_pair() : socket_pair_helper(SOCK_STREAM),
+                      move(datagram_interface),
+                      backend,
+                      transport) {}
 
 template <typename AdaptT>
 TCPSpongeSocket<AdaptT>::~TCPSpongeSocket() {
     try {
+        if (_transport == Transport::Inline and _tcp.has_value() and _tcp->active()) {
+            cerr << "Warning: unclean shutdown of TCPSpongeSocket\n";
+        }
         if (_tcp_thread.joinable()) {
             cerr << "Warning: unclean shutdown of TCPSpongeSocket\n";
             // force the other side to exit
             _abort.store(true);
+            const uint64_t wake = 1;
+            SystemCall("write", static_cast<int>(::write(_abort_notifier.fd_num(), &wake, sizeof(wake))));
             _tcp_thread.join();
         }
     } catch (const exception &e) {
@@ -190,8 +315,25 @@ TCPSpongeSocket<AdaptT>::~TCPSpongeSocket() {
     }
 }
 
+//! \details With Transport::Inline, ends the outbound stream, and runs the connection until it is done,
+//! discarding whatever else arrives (as shutting down the socket for reading would).
 template <typename AdaptT>
 void TCPSpongeSocket<AdaptT>::wait_until_closed() {
+    if (_transport == Transport::Inline) {
+        if (_tcp.has_value()) {
+            end_input_stream();
+            cerr << "DEBUG: Waiting for clean shutdown... ";
+            _tcp_loop([&] {
+                ByteStream &inbound = _tcp->inbound_stream();
+                inbound.pop_output(inbound.buffer_size());
+                _send_segments();
+                return _tcp->active();
+            });
+            cerr << "done.\n";
+        }
+        return;
+    }
+
     shutdown(SHUT_RDWR);
     if (_tcp_thread.joinable()) {
         cerr << "DEBUG: Waiting for clean shutdown... ";
@@ -225,7 +367,9 @@ void TCPSpongeSocket<AdaptT>::connect(const TCPConfig &c_tcp, const FdAdapterCon
     _tcp_loop([&] { return _tcp->state() == TCPState::State::SYN_SENT; });
     cerr << "Successfully connected to " << c_ad.destination.to_string() << ".\n";
 
-    _tcp_thread = thread(&TCPSpongeSocket::_tcp_main, this);
+    if (_transport != Transport::Inline) {
+        _tcp_thread = thread(&TCPSpongeSocket::_tcp_main, this);
+    }
 }
 
 //! \param[in] c_tcp is the TCPConfig for the TCPConnection
@@ -248,7 +392,9 @@ void TCPSpongeSocket<AdaptT>::listen_and_accept(const TCPConfig &c_tcp, const Fd
     });
     cerr << "New connection from " << _datagram_adapter.config().destination.to_string() << ".\n";
 
-    _tcp_thread = thread(&TCPSpongeSocket::_tcp_main, this);
+    if (_transport != Transport::Inline) {
+        _tcp_thread = thread(&TCPSpongeSocket::_tcp_main, this);
+    }
 }
 
 template <typename AdaptT>
@@ -270,6 +416,106 @@ void TCPSpongeSocket<AdaptT>::_tcp_main() {
     }
 }
 
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_check_inline(const char *method) const {
+    if (_transport != Transport::Inline or not _tcp.has_value()) {
+        throw runtime_error(string(method) + "() needs a connection made with Transport::Inline");
+    }
+}
+
+//! \param[in] timeout_ms is the longest to wait for an event; 0 handles only what is ready already
+template <typename AdaptT>
+bool TCPSpongeSocket<AdaptT>::poll_once(const int timeout_ms) {
+    _check_inline("poll_once");
+    _schedule_tick();
+    const auto ret = _eventloop.wait_next_event(timeout_ms);
+    // send what the connection queued in response at once, rather than at the next poll
+    _send_segments();
+    return ret != EventLoop::Result::Exit and _tcp->active();
+}
+
+//! \param[in] condition is checked before each wait for an event
+template <typename AdaptT>
+bool TCPSpongeSocket<AdaptT>::run_until(const function<bool()> &condition) {
+    _check_inline("run_until");
+    while (not condition()) {
+        if (not poll_once(-1)) {
+            return condition();
+        }
+    }
+    return true;
+}
+
+template <typename AdaptT>
+ByteStream &TCPSpongeSocket<AdaptT>::inbound_stream() {
+    _check_inline("inbound_stream");
+    return _tcp->inbound_stream();
+}
+
+//! \param[in] buffer is the data to write
+//! \param[in] write_all is whether to keep running the connection until all of `buffer` is written
+//! \returns the number of bytes written
+template <typename AdaptT>
+size_t TCPSpongeSocket<AdaptT>::write_inline(BufferViewList buffer, const bool write_all) {
+    _check_inline("write_inline");
+
+    size_t total_bytes_written = 0;
+    for (const iovec &chunk : buffer.as_iovecs()) {
+        string_view rest{static_cast<const char *>(chunk.iov_base), chunk.iov_len};
+        while (not rest.empty()) {
+            _tick();
+            const size_t bytes_written = _tcp->write(string(rest.substr(0, _tcp->remaining_outbound_capacity())));
+            _send_segments();
+            rest.remove_prefix(bytes_written);
+            total_bytes_written += bytes_written;
+            if (not rest.empty() and (not write_all or not poll_once(-1))) {
+                return total_bytes_written;
+            }
+        }
+    }
+    return total_bytes_written;
+}
+
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::end_input_stream() {
+    _check_inline("end_input_stream");
+    _tick();
+    _tcp->end_input_stream();
+    _send_segments();
+}
+
+template <typename AdaptT>
+EventLoop &TCPSpongeSocket<AdaptT>::eventloop() {
+    _check_inline("eventloop");
+    return _eventloop;
+}
+
+//! \param[in] limit is the maximum number of bytes to read
+template <typename AdaptT>
+string TCPSpongeSocket<AdaptT>::read(const size_t limit) {
+    string ret;
+    read(ret, limit);
+    return ret;
+}
+
+//! \param[out] str is the string to read into
+//! \param[in] limit is the maximum number of bytes to read
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::read(string &str, const size_t limit) {
+    if (_transport == Transport::Inline) {
+        throw runtime_error("read() on a TCPSpongeSocket with Transport::Inline; read inbound_stream() instead");
+    }
+    LocalStreamSocket::read(str, limit);
+}
+
+template <typename AdaptT>
+bool TCPSpongeSocket<AdaptT>::eof() const {
+    if (_transport == Transport::Inline) {
+        throw runtime_error("eof() on a TCPSpongeSocket with Transport::Inline; check inbound_stream() instead");
+    }
+    return LocalStreamSocket::eof();
+}
+
 //! Specialization of TCPSpongeSocket for TCPOverUDPSocketAdapter
 template class TCPSpongeSocket<TCPOverUDPSocketAdapter>;
 
@@ -279,12 +525,21 @@ template class TCPSpongeSocket<TCPOverIPv4OverTunFdAdapter>;
 //! Specialization of TCPSpongeSocket for TCPOverIPv4OverEthernetAdapter
 template class TCPSpongeSocket<TCPOverIPv4OverEthernetAdapter>;
 
+//! Specialization of TCPSpongeSocket for TCPOverIPv4OverPacketRingAdapter
+template class TCPSpongeSocket<TCPOverIPv4OverPacketRingAdapter>;
+
 //! Specialization of TCPSpongeSocket for LossyTCPOverUDPSocketAdapter
 template class TCPSpongeSocket<LossyTCPOverUDPSocketAdapter>;
 
 //! Specialization of TCPSpongeSocket for LossyTCPOverIPv4OverTunFdAdapter
 template class TCPSpongeSocket<LossyTCPOverIPv4OverTunFdAdapter>;
 
+//! Specialization of TCPSpongeSocket for LossyTCPOverIPv4OverEthernetAdapter
+template class TCPSpongeSocket<LossyTCPOverIPv4OverEthernetAdapter>;
+
+//! Specialization of TCPSpongeSocket for LossyTCPOverIPv4OverPacketRingAdapter
+template class TCPSpongeSocket<LossyTCPOverIPv4OverPacketRingAdapter>;
+
 CS144TCPSocket::CS144TCPSocket() : TCPOverIPv4SpongeSocket(TCPOverIPv4OverTunFdAdapter(TunFD("tun144"))) {}
 
 void CS144TCPSocket::connect(const Address &address) {
@@ -12,17 +12,33 @@
 
 #include <atomic>
 #include <cstdint>
+#include <limits>
 #include <optional>
+#include <string>
 #include <thread>
 #include <vector>
 
 //! Multithreaded wrapper around TCPConnection that approximates the Unix sockets API
 template <typename AdaptT>
 class TCPSpongeSocket : public LocalStreamSocket {
+  public:
+    //! How bytes get between the owner and the TCPConnection thread
+    enum class Transport {
+        SocketPair,  //!< Through the kernel, over a pair of `AF_UNIX` stream sockets
+        Rings,       //!< Through memory, over a ring_pair()
+        Inline       //!< Directly: there is no TCPConnection thread, and the owner runs the connection
+    };
+
   private:
+    //! How bytes get between the owner and the TCPConnection
+    Transport _transport;
+
     //! Stream socket for reads and writes between owner and TCP thread
     LocalStreamSocket _thread_data;
 
+    //! With Transport::Rings, signalled when the owner makes room in a full inbound ring
+    std::optional<FileDescriptor> _inbound_room{};
+
   protected:
     //! Adapter to underlying datagram socket (e.g., UDP or IP)
     AdaptT _datagram_adapter;
@@ -35,22 +51,52 @@ class TCPSpongeSocket : public LocalStreamSocket {
     std::optional<TCPConnection> _tcp{};
 
     //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes)
-    EventLoop _eventloop{};
+    EventLoop _eventloop;
+
+    //! Whether the inbound stream has bytes, or its end, still to be given to the owner
+    bool _inbound_pending();
+
+    //! Give the owner as much of the inbound stream as it has room for
+    void _deliver_inbound();
+
+    //! Give the adapter the segments that the TCPConnection has queued
+    void _send_segments();
+
+    //! Throw unless the socket uses Transport::Inline and has a connection
+    void _check_inline(const char *method) const;
 
     //! Process events while specified condition is true
     void _tcp_loop(const std::function<bool()> &condition);
 
+    //! Tell the TCPConnection and the adapter how much time has passed since they were last told
+    void _tick();
+
+    //! (Re)arm _tick_timer for the earliest deadline of the TCPConnection and the adapter
+    void _schedule_tick();
+
+    //! Give the TCPConnection the segments the adapter has ready without its file descriptor being readable
+    void _receive_pending();
+
+    uint64_t _last_tick_ms{0};                            //!< When _tick() last ran, in timestamp_ms() time
+    EventLoop::TimerId _tick_timer{EventLoop::NO_TIMER};  //!< Calls _tick() at the next deadline
+    uint64_t _tick_due_ms{0};                             //!< When _tick_timer fires, if it is pending
+
     //! Main loop of TCPConnection thread
     void _tcp_main();
 
     //! Handle to the TCPConnection thread; owner thread calls join() in the destructor
     std::thread _tcp_thread{};
 
-    //! Construct LocalStreamSocket fds from socket pair, initialize eventloop
-    TCPSpongeSocket(std::pair<FileDescriptor, FileDescriptor> data_socket_pair, AdaptT &&datagram_interface);
+    //! Construct LocalStreamSocket fds from socket pair (or ring pair), initialize eventloop
+    TCPSpongeSocket(std::pair<FileDescriptor, FileDescriptor> data_socket_pair,
+                    AdaptT &&datagram_interface,
+                    const EventLoop::Backend backend,
+                    const Transport transport);
 
     std::atomic_bool _abort{false};  //!< Flag used by the owner to force the TCPConnection thread to shut down
 
+    FileDescriptor _abort_notifier;  //!< [eventfd(2)](\ref man2::eventfd) that wakes the event loop to check _abort
+
     bool _inbound_shutdown{false};  //!< Has TCPSpongeSocket shut down the incoming data to the owner?
 
     bool _outbound_shutdown{false};  //!< Has the owner shut down the outbound data to the TCP connection?
@@ -58,8 +104,13 @@ class TCPSpongeSocket : public LocalStreamSocket {
     bool _fully_acked{false};  //!< Has the outbound data been fully acknowledged by the peer?
 
   public:
-    //! Construct from the interface that the TCPConnection thread will use to read and write datagrams
-    explicit TCPSpongeSocket(AdaptT &&datagram_interface);
+    //! \brief Construct from the interface that the TCPConnection thread will use to read and write datagrams
+    //! \param[in] backend is how the TCPConnection thread waits for (and, with EventLoop::Backend::IoUring,
+    //!            performs) I/O on the datagram interface and on the socket pair to the owner
+    //! \param[in] transport is how bytes get between the owner and the TCPConnection thread
+    explicit TCPSpongeSocket(AdaptT &&datagram_interface,
+                             const EventLoop::Backend backend = EventLoop::Backend::Poll,
+                             const Transport transport = Transport::SocketPair);
 
     //! Close socket, and wait for TCPConnection to finish
     //! \note Calling this function is only advisable if the socket has reached EOF,
@@ -75,6 +126,44 @@ class TCPSpongeSocket : public LocalStreamSocket {
     //! When a connected socket is destructed, it will send a RST
     ~TCPSpongeSocket();
 
+    //! \name Running the connection on the owner's thread
+    //! With Transport::Inline, connect() and listen_and_accept() start no thread; the owner makes the
+    //! connection progress by calling these methods (or wait_until_closed()), and reads and writes
+    //! its streams directly instead of through the socket.
+
+    //!@{
+
+    //! \brief Handle whatever events are ready, or the first one to arrive within `timeout_ms` (-1 for no limit)
+    //! \returns `false` once the connection is no longer active
+    bool poll_once(const int timeout_ms = 0);
+
+    //! \brief Handle events until `condition` returns `true`, or the connection is no longer active
+    //! \returns the last value of `condition`
+    bool run_until(const std::function<bool()> &condition);
+
+    //! The inbound stream of the connection, to read from directly
+    ByteStream &inbound_stream();
+
+    //! \brief Write to the connection's outbound stream, running the connection while it is full if `write_all`
+    //! \note Unlike FileDescriptor::write, which with Transport::Inline goes to a socket nobody reads
+    size_t write_inline(BufferViewList buffer, const bool write_all = true);
+
+    //! Shut down the outbound stream of the connection
+    void end_input_stream();
+
+    //! The event loop that runs the connection, to which the owner can add rules of its own
+    EventLoop &eventloop();
+    //!@}
+
+    //! \name
+    //! With Transport::Inline nothing ever arrives on the socket, so these throw rather than block forever
+
+    //!@{
+    std::string read(const size_t limit = std::numeric_limits<size_t>::max());
+    void read(std::string &str, const size_t limit = std::numeric_limits<size_t>::max());
+    bool eof() const;
+    //!@}
+
     //! \name
     //! This object cannot be safely moved or copied, since it is in use by two threads simultaneously
 
@@ -99,9 +188,12 @@ class TCPSpongeSocket : public LocalStreamSocket {
 using TCPOverUDPSpongeSocket = TCPSpongeSocket<TCPOverUDPSocketAdapter>;
 using TCPOverIPv4SpongeSocket = TCPSpongeSocket<TCPOverIPv4OverTunFdAdapter>;
 using TCPOverIPv4OverEthernetSpongeSocket = TCPSpongeSocket<TCPOverIPv4OverEthernetAdapter>;
+using TCPOverIPv4OverPacketRingSpongeSocket = TCPSpongeSocket<TCPOverIPv4OverPacketRingAdapter>;
 
 using LossyTCPOverUDPSpongeSocket = TCPSpongeSocket<LossyTCPOverUDPSocketAdapter>;
 using LossyTCPOverIPv4SpongeSocket = TCPSpongeSocket<LossyTCPOverIPv4OverTunFdAdapter>;
+using LossyTCPOverIPv4OverEthernetSpongeSocket = TCPSpongeSocket<LossyTCPOverIPv4OverEthernetAdapter>;
+using LossyTCPOverIPv4OverPacketRingSpongeSocket = TCPSpongeSocket<LossyTCPOverIPv4OverPacketRingAdapter>;
 
 //! \class TCPSpongeSocket
 //! This class involves the simultaneous operation of two threads.
@@ -122,6 +214,18 @@ using LossyTCPOverIPv4SpongeSocket = TCPSpongeSocket<LossyTCPOverIPv4OverTunFdAd
 //!   and [accept(2)](\ref man2::accept)
 //! - if TCPSpongeSocket is destructed while a TCP connection is open, the connection is
 //!   immediately terminated with a RST (call `wait_until_closed` to avoid this)
+//!
+//! By default the two threads pass bytes through a pair of Unix-domain sockets, which costs a copy
+//! into the kernel and one out of it, and a system call for each, in each direction. With
+//! Transport::Rings they share a pair of ByteRing%s instead: the owner's reads and writes copy
+//! straight to and from memory that the TCPConnection thread reads and writes, and an eventfd wakes
+//! the reader only when its ring goes from empty to non-empty. The socket can still be polled for
+//! Direction::In; it is always ready for Direction::Out, and a write blocks while the outbound ring is full.
+//!
+//! With Transport::Inline there is no second thread at all. Run-to-completion: the owner's own calls
+//! (poll_once(), run_until(), or rules it adds to eventloop()) read datagrams, run the TCPConnection,
+//! and send its segments, and the owner reads and writes the connection's byte streams directly. A
+//! request and its response then cost no thread wakeups or context switches.
 
 //! Helper class that makes a TCPOverIPv4SpongeSocket behave more like a (kernel) TCPSocket
 class CS144TCPSocket : public TCPOverIPv4SpongeSocket {
@@ -1,7 +1,61 @@
 #include "tuntap_adapter.hh"
 
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+
 using namespace std;
 
+//! \details With `vnet_hdr`, a segment that the kernel marks as needing a checksum (one from the host's own
+//! stack) or as already checked isn't checked again. It may be larger than the MTU, if the host's stack
+//! sent it that way or GRO coalesced it.
+optional<TCPSegment> TCPOverIPv4OverTunFdAdapter::read() {
+    Buffer packet{_tun.read()};
+    bool verify_checksum = true;
+    if (_tun.vnet_hdr()) {
+        VirtioNetHeader vnet{};
+        if (packet.size() < sizeof(vnet)) {
+            return {};
+        }
+        memcpy(&vnet, packet.str().data(), sizeof(vnet));
+        packet.remove_prefix(sizeof(vnet));
+        verify_checksum = (vnet.flags & (VirtioNetHeader::F_NEEDS_CSUM | VirtioNetHeader::F_DATA_VALID)) == 0;
+    }
+
+    InternetDatagram ip_dgram;
+    if (ip_dgram.parse(packet) != ParseResult::NoError) {
+        return {};
+    }
+    return unwrap_tcp_in_ip(ip_dgram, verify_checksum);
+}
+
+//! \details With `vnet_hdr`, the VirtioNetHeader asks the kernel to complete the TCP checksum, and, for a
+//! payload of more than TCPConfig::MAX_PAYLOAD_SIZE, to cut the segment into segments of that size if it
+//! has to (it needn't, to deliver the segment to the host's own stack).
+void TCPOverIPv4OverTunFdAdapter::write(TCPSegment &seg) {
+    if (not _tun.vnet_hdr()) {
+        _tun.write(wrap_tcp_in_ip(seg).serialize());
+        return;
+    }
+
+    const InternetDatagram ip_dgram = wrap_tcp_in_ip(seg, true);
+    const size_t ip_header_length = ip_dgram.header().hlen * 4;
+    VirtioNetHeader vnet{};
+    vnet.flags = VirtioNetHeader::F_NEEDS_CSUM;
+    vnet.csum_start = ip_header_length;
+    vnet.csum_offset = 16;  // offset of the checksum in the TCP header
+    if (seg.payload().size() > TCPConfig::MAX_PAYLOAD_SIZE) {
+        vnet.gso_type = VirtioNetHeader::GSO_TCPV4;
+        vnet.gso_size = TCPConfig::MAX_PAYLOAD_SIZE;
+        vnet.hdr_len = ip_header_length + seg.header().doff * 4;
+    }
+
+    BufferList packet{string(reinterpret_cast<const char *>(&vnet), sizeof(vnet))};
+    packet.append(ip_dgram.serialize());
+    _tun.write(packet);
+}
+
 //! \param[in] tap Raw network device that will be owned by the adapter
 //! \param[in] eth_address Ethernet address (local address) of the adapter
 //! \param[in] ip_address IP address (local address) of the adapter
@@ -48,12 +102,89 @@ void TCPOverIPv4OverEthernetAdapter::write(TCPSegment &seg) {
     send_pending();
 }
 
+//! \details Takes every queued frame in one burst. A TAP device delivers each write(2) as one frame,
+//! so the frames are still written individually.
 void TCPOverIPv4OverEthernetAdapter::send_pending() {
-    while (not _interface.frames_out().empty()) {
-        _tap.write(_interface.frames_out().front().serialize());
-        _interface.frames_out().pop();
+    _interface.frames_out().drain(back_inserter(_burst));
+    for (const auto &frame : _burst) {
+        _tap.write(frame.serialize());
     }
+    _burst.clear();
+}
+
+//! \param[in] ring Raw network socket that will be owned by the adapter
+//! \param[in] eth_address Ethernet address (local address) of the adapter
+//! \param[in] ip_address IP address (local address) of the adapter
+//! \param[in] next_hop IP address of the next hop (typically a router or default gateway)
+TCPOverIPv4OverPacketRingAdapter::TCPOverIPv4OverPacketRingAdapter(PacketRing &&ring,
+                                                                   const EthernetAddress &eth_address,
+                                                                   const Address &ip_address,
+                                                                   const Address &next_hop)
+    : _ring(move(ring)), _ethernet_address(eth_address), _interface(eth_address, ip_address), _next_hop(next_hop) {}
+
+//! \details A frame that the NetworkInterface would ignore anyway is dropped before it is copied out of the ring.
+//! The TCP checksum isn't checked again if the kernel has checked it, or if the segment comes from the host's
+//! own stack and the checksum was left to the (virtual) NIC.
+optional<TCPSegment> TCPOverIPv4OverPacketRingAdapter::read() {
+    const optional<PacketRing::Frame> received = _ring.receive();
+    if (not received.has_value() or received->data.size() < EthernetHeader::LENGTH) {
+        return {};
+    }
+    const string_view raw = received->data;
+
+    // look at the destination address and type in place
+    const bool for_us = memcmp(raw.data(), _ethernet_address.data(), _ethernet_address.size()) == 0 or
+                        memcmp(raw.data(), ETHERNET_BROADCAST.data(), ETHERNET_BROADCAST.size()) == 0;
+    const uint16_t type = uint16_t(uint8_t(raw.at(12)) << 8 | uint8_t(raw.at(13)));
+    if (not for_us or (type != EthernetHeader::TYPE_IPv4 and type != EthernetHeader::TYPE_ARP)) {
+        return {};
+    }
+
+    EthernetFrame frame;
+    if (frame.parse(string(raw)) != ParseResult::NoError) {
+        return {};
+    }
+
+    // Give the frame to the NetworkInterface. Get back an Internet datagram if frame was carrying one.
+    optional<InternetDatagram> ip_dgram = _interface.recv_frame(frame);
+
+    // The incoming frame may have caused the NetworkInterface to send a frame.
+    queue_pending();
+    _ring.flush();
+
+    // Try to interpret IPv4 datagram as TCP
+    if (ip_dgram) {
+        return unwrap_tcp_in_ip(ip_dgram.value(), received->verify_checksum);
+    }
+    return {};
+}
+
+//! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
+void TCPOverIPv4OverPacketRingAdapter::tick(const size_t ms_since_last_tick) {
+    _interface.tick(ms_since_last_tick);
+    queue_pending();
+    _ring.flush();
+}
+
+//! \param[in] seg the TCPSegment to send
+void TCPOverIPv4OverPacketRingAdapter::write(TCPSegment &seg) {
+    _interface.send_datagram(wrap_tcp_in_ip(seg), _next_hop);
+    queue_pending();
+}
+
+void TCPOverIPv4OverPacketRingAdapter::queue_pending() {
+    _interface.frames_out().drain(back_inserter(_burst));
+    for (const auto &frame : _burst) {
+        _ring.send(frame.serialize());
+    }
+    _burst.clear();
 }
 
 //! Specialize LossyFdAdapter to TCPOverIPv4OverTunFdAdapter
 template class LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>;
+
+//! Specialize LossyFdAdapter to TCPOverIPv4OverEthernetAdapter
+template class LossyFdAdapter<TCPOverIPv4OverEthernetAdapter>;
+
+//! Specialize LossyFdAdapter to TCPOverIPv4OverPacketRingAdapter
+template class LossyFdAdapter<TCPOverIPv4OverPacketRingAdapter>;
@@ -2,33 +2,38 @@
 #define SPONGE_LIBSPONGE_TUNFD_ADAPTER_HH
 
 #include "ethernet_header.hh"
+#include "ipv4_header.hh"
 #include "network_interface.hh"
+#include "packet_ring.hh"
+#include "tcp_header.hh"
 #include "tun.hh"
 
+#include <cstddef>
 #include <optional>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 //! \brief A FD adapter for IPv4 datagrams read from and written to a TUN device
+//! \details If the TunFD was opened with `vnet_hdr`, the adapter leaves TCP checksums to the kernel, and
+//! has it split segments of more than TCPConfig::MAX_PAYLOAD_SIZE; a TCPConfig::max_payload_size of up to
+//! MAX_OFFLOAD_PAYLOAD_SIZE then sends a whole window in one write(2).
 class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter {
   private:
     TunFD _tun;
 
   public:
+    //! Largest TCP payload that fits in one IPv4 datagram (without options)
+    static constexpr size_t MAX_OFFLOAD_PAYLOAD_SIZE = 65535 - IPv4Header::LENGTH - TCPHeader::LENGTH;
+
     //! Construct from a TunFD
     explicit TCPOverIPv4OverTunFdAdapter(TunFD &&tun) : _tun(std::move(tun)) {}
 
     //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
-    std::optional<TCPSegment> read() {
-        InternetDatagram ip_dgram;
-        if (ip_dgram.parse(_tun.read()) != ParseResult::NoError) {
-            return {};
-        }
-        return unwrap_tcp_in_ip(ip_dgram);
-    }
+    std::optional<TCPSegment> read();
 
     //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
-    void write(TCPSegment &seg) { _tun.write(wrap_tcp_in_ip(seg).serialize()); }
+    void write(TCPSegment &seg);
 
     //! Access the underlying TUN device
     operator TunFD &() { return _tun; }
@@ -49,6 +54,8 @@ class TCPOverIPv4OverEthernetAdapter : public TCPOverIPv4Adapter {
 
     Address _next_hop;  //!< IP address of the next hop
 
+    std::vector<EthernetFrame> _burst{};  //!< Frames taken from the interface by send_pending()
+
     void send_pending();  //!< Sends any pending Ethernet frames
 
   public:
@@ -66,6 +73,9 @@ class TCPOverIPv4OverEthernetAdapter : public TCPOverIPv4Adapter {
     //! Called periodically when time elapses
     void tick(const size_t ms_since_last_tick);
 
+    //! Milliseconds of tick() time until the NetworkInterface's next ARP timer expires
+    std::optional<size_t> time_until_next_deadline() const { return _interface.time_until_next_deadline(); }
+
     //! Access the underlying raw Ethernet connection
     operator TapFD &() { return _tap; }
 
@@ -73,4 +83,60 @@ class TCPOverIPv4OverEthernetAdapter : public TCPOverIPv4Adapter {
     operator const TapFD &() const { return _tap; }
 };
 
+//! \brief A FD adapter for IPv4 datagrams sent and received in Ethernet frames through a PacketRing
+//! \details Like TCPOverIPv4OverEthernetAdapter, except that frames are read in place from the ring (and only
+//! copied out if they are addressed to this interface and carry IPv4 or ARP), and that the frames for a
+//! flight of segments are transmitted together by flush().
+class TCPOverIPv4OverPacketRingAdapter : public TCPOverIPv4Adapter {
+  private:
+    PacketRing _ring;  //!< Raw Ethernet connection
+
+    EthernetAddress _ethernet_address;  //!< Ethernet address of the interface
+
+    NetworkInterface _interface;  //!< NIC abstraction
+
+    Address _next_hop;  //!< IP address of the next hop
+
+    std::vector<EthernetFrame> _burst{};  //!< Frames taken from the interface by queue_pending()
+
+    void queue_pending();  //!< Puts any pending Ethernet frames in the transmit ring
+
+  public:
+    //! Construct from a PacketRing
+    explicit TCPOverIPv4OverPacketRingAdapter(PacketRing &&ring,
+                                              const EthernetAddress &eth_address,
+                                              const Address &ip_address,
+                                              const Address &next_hop);
+
+    //! Attempts to read and parse an Ethernet frame containing an IPv4 datagram that contains a TCP segment
+    std::optional<TCPSegment> read();
+
+    //! Queues a TCP segment (in an IPv4 datagram, in an Ethernet frame) for the next flush()
+    void write(TCPSegment &seg);
+
+    //! Transmits the frames queued since the last flush()
+    void flush() { _ring.flush(); }
+
+    //! Whether the receive ring has more frames for read()
+    bool read_pending() const { return _ring.receive_pending(); }
+
+    //! Called periodically when time elapses
+    void tick(const size_t ms_since_last_tick);
+
+    //! Milliseconds of tick() time until the NetworkInterface's next ARP timer expires
+    std::optional<size_t> time_until_next_deadline() const { return _interface.time_until_next_deadline(); }
+
+    //! Access the underlying raw Ethernet connection
+    operator PacketRing &() { return _ring; }
+
+    //! Access the underlying raw Ethernet connection
+    operator const PacketRing &() const { return _ring; }
+};
+
+//! Typedef for TCPOverIPv4OverEthernetAdapter
+using LossyTCPOverIPv4OverEthernetAdapter = LossyFdAdapter<TCPOverIPv4OverEthernetAdapter>;
+
+//! Typedef for TCPOverIPv4OverPacketRingAdapter
+using LossyTCPOverIPv4OverPacketRingAdapter = LossyFdAdapter<TCPOverIPv4OverPacketRingAdapter>;
+
 #endif  // SPONGE_LIBSPONGE_TUNFD_ADAPTER_HH
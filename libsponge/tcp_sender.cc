@@ -11,12 +11,44 @@ using namespace std;
 //! \param[in] capacity the capacity of the outgoing byte stream
 //! \param[in] retx_timeout the initial amount of time to wait before retransmitting the oldest outstanding segment
 //! \param[in] fixed_isn the Initial Sequence Number to use, if set (otherwise uses a random ISN)
-TCPSender::TCPSender(const size_t capacity, const uint16_t retx_timeout, const std::optional<WrappingInt32> fixed_isn)
+//! \param[in] timers the TCPTimers that keeps the retransmission timer, if not the sender's own
+//! \param[in] owner identifies the sender (or its TCPConnection) to the caller of TCPTimers::advance
+TCPSender::TCPSender(const size_t capacity,
+                     const uint16_t retx_timeout,
+                     const std::optional<WrappingInt32> fixed_isn,
+                     TCPTimers *timers,
+                     const uint64_t owner,
+                     const size_t max_payload_size)
     : _isn(fixed_isn.value_or(WrappingInt32{random_device()()}))
     , _initial_retransmission_timeout{retx_timeout}
     , _curr_retransmission_timeout(retx_timeout)
     , _stream(capacity)
-    , _timer(retx_timeout) { }
+    , _own_timers(timers ? nullptr : make_unique<TCPTimers>())
+    , _timers(timers ? timers : _own_timers.get())
+    , _timer(*_timers, owner, TCPTimers::Kind::Retransmission)
+    , _max_payload_size(max_payload_size) { }
+
+//The retransmission timer is replaced before the TCPTimers it may be kept in, which the old one must leave first
+TCPSender &TCPSender::operator=(TCPSender &&other) {
+    if(this==&other)
+        return *this;
+    _timer=move(other._timer);
+    _own_timers=move(other._own_timers);
+    _timers=other._timers;
+    _isn=other._isn;
+    _segments_out=move(other._segments_out);
+    _initial_retransmission_timeout=other._initial_retransmission_timeout;
+    _curr_retransmission_timeout=other._curr_retransmission_timeout;
+    _stream=move(other._stream);
+    _next_seqno=other._next_seqno;
+    _receiver_win_size=other._receiver_win_size;
+    _sender_win_size=other._sender_win_size;
+    _sender_finished=other._sender_finished;
+    _segments_in_flight=move(other._segments_in_flight);
+    _num_consecutive_retrans=other._num_consecutive_retrans;
+    _max_payload_size=other._max_payload_size;
+    return *this;
+}
 
 uint64_t TCPSender::bytes_in_flight() const { 
     size_t count=0;
@@ -28,7 +60,7 @@ uint64_t TCPSender::bytes_in_flight() const {
 }
 
 //Send a non-empty segment(non-empty in sequence space)
-void TCPSender::send_a_segment(uint16_t window_size) {
+void TCPSender::send_a_segment(size_t window_size) {
     //std::cout<<"Sending a segment"<<std::endl;
     //If window_size is 0 or the sender finished sending, do nothing
     if(!window_size||_sender_finished)
@@ -71,24 +103,24 @@ void TCPSender::send_a_segment(uint16_t window_size) {
     _segments_out.push(new_seg);
     _segments_in_flight.push_back(new_seg);
     
-    if(!_timer.is_started())
-        _timer.restart(_curr_retransmission_timeout);
+    if(!_timer.running())
+        _timer.start(_curr_retransmission_timeout);
 }
 
 //Fill the sender window
 void TCPSender::fill_window() {
     //If the sender window is less than or equal to 1452 then send a segment directly
-    if(_sender_win_size<=TCPConfig::MAX_PAYLOAD_SIZE)
+    if(_sender_win_size<=_max_payload_size)
     {
         send_a_segment(_sender_win_size);
     }
     else //Split the sender window into several segments
     {
-        uint16_t remaining_win_size=_sender_win_size;
+        size_t remaining_win_size=_sender_win_size;
         //Try to send segments whose payload is as large as possible
-        while(remaining_win_size>TCPConfig::MAX_PAYLOAD_SIZE)
+        while(remaining_win_size>_max_payload_size)
         {
-            uint16_t segment_size=TCPConfig::MAX_PAYLOAD_SIZE;
+            size_t segment_size=_max_payload_size;
             if(_next_seqno==0)
                 segment_size+=1;
             send_a_segment(segment_size);
@@ -114,7 +146,7 @@ void TCPSender::update_window(const WrappingInt32 ackno, const uint16_t window_s
 void TCPSender::reset_retrans_parameters(bool timer_start)
 {
     _curr_retransmission_timeout=_initial_retransmission_timeout;
-    _timer.restart(_curr_retransmission_timeout);
+    _timer.start(_curr_retransmission_timeout);
     if(!timer_start)
         _timer.stop();
     _num_consecutive_retrans=0;
@@ -162,30 +194,38 @@ void TCPSender::ack_received(const WrappingInt32 ackno, const uint16_t window_si
 
 //! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
 void TCPSender::tick(const size_t ms_since_last_tick) { 
-    //Ignore if timer hasn't started
-    if(!_timer.is_started())
+    //A TCPConnection advances the timers it shares with us
+    if(!_own_timers)
+        return;
+    _own_timers->advance(ms_since_last_tick, [&](uint64_t, TCPTimers::Kind kind) { timer_expired(kind); });
+}
+
+//! \param[in] kind is always TCPTimers::Kind::Retransmission
+void TCPSender::timer_expired(const TCPTimers::Kind kind) {
+    if(kind!=TCPTimers::Kind::Retransmission||_segments_in_flight.empty())
         return;
-    _timer.tick(ms_since_last_tick);
-    //if timer expired
-    if(_timer.expired())
+    //Delete the acked segment from list
+    _segments_out.push(_segments_in_flight.front());
+    //If the receive window size is not zero, then do exponential backoff and increment the counter
+    //On the contrary, if the receive window IS ZERO
+    //this means the sender may be very eager to know when the receiver's window is free
+    //So don't use exp backoff and counter timeout to stop frequent retransmission
+    if(_receiver_win_size)
     {
-        //Delete the acked segment from list
-        _segments_out.push(_segments_in_flight.front());
-        //If the receive window size is not zero, then do exponential backoff and increment the counter
-        //On the contrary, if the receive window IS ZERO
-        //this means the sender may be very eager to know when the receiver's window is free
-        //So don't use exp backoff and counter timeout to stop frequent retransmission
-        if(_receiver_win_size)
-        {
-            _num_consecutive_retrans++;
-            _curr_retransmission_timeout*=2;
-        }
-        _timer.restart(_curr_retransmission_timeout);
+        _num_consecutive_retrans++;
+        _curr_retransmission_timeout*=2;
     }
+    _timer.start(_curr_retransmission_timeout);
 }
 
 unsigned int TCPSender::consecutive_retransmissions() const { return _num_consecutive_retrans; }
 
+optional<size_t> TCPSender::time_until_next_deadline() const {
+    if(!_timer.running())
+        return {};
+    return _timer.time_remaining();
+}
+
 void TCPSender::send_empty_segment() { 
     TCPSegment new_seg;
     new_seg.header().seqno=wrap(_next_seqno, _isn);
@@ -4,35 +4,16 @@
 #include "byte_stream.hh"
 #include "tcp_config.hh"
 #include "tcp_segment.hh"
+#include "tcp_timers.hh"
 #include "wrapping_integers.hh"
 
 #include <functional>
+#include <memory>
+#include <optional>
 #include <queue>
 #include <list>
 
 
-class TCPTimer
-{
-    uint64_t _time_elapsed{0};
-    uint64_t _rto;
-    bool _started{false};
-public:
-    explicit TCPTimer(uint64_t rto):_rto(rto){}
-    void stop() { _started=false; }
-    bool is_started() { return _started; };
-    void tick(const size_t ms_since_last_tick) {
-        if(_started)
-          _time_elapsed+=ms_since_last_tick;
-    }
-    bool expired() { return _time_elapsed>=_rto; }
-    void restart(uint64_t rto) {
-        _started=true;
-        _rto=rto;
-        _time_elapsed=0;
-    }
-};
-
-
 //! \brief The "sender" part of a TCP implementation.
 
 //! Accepts a ByteStream, divides it up into segments and sends the
@@ -62,24 +43,40 @@ class TCPSender {
 
     uint16_t _sender_win_size{1};
 
-    TCPTimer _timer;
-
     bool _sender_finished{false};
 
     std::deque<TCPSegment> _segments_in_flight{};
 
     unsigned short _num_consecutive_retrans{0};
 
-    void send_a_segment(uint16_t segment_size);
+    //! timers of a sender that isn't part of a TCPConnection
+    std::unique_ptr<TCPTimers> _own_timers;
+
+    //! where the retransmission timer is kept (_own_timers, or the TCPConnection's)
+    TCPTimers *_timers;
+
+    //! retransmission timer
+    TCPTimers::Timer _timer;
+
+    //! largest payload of a segment
+    size_t _max_payload_size;
+
+    void send_a_segment(size_t segment_size);
 
     void update_window(const WrappingInt32 ackno, const uint16_t window_size);
 
     void reset_retrans_parameters(bool timer_start);
   public:
     //! Initialize a TCPSender
+    //! \param timers, if given, keeps the retransmission timer (as a timer of `owner`); otherwise the
+    //!        sender keeps it in a TCPTimers of its own, advanced by tick()
+    //! \param max_payload_size is the largest payload to put in one segment (see TCPConfig::max_payload_size)
     TCPSender(const size_t capacity = TCPConfig::DEFAULT_CAPACITY,
               const uint16_t retx_timeout = TCPConfig::TIMEOUT_DFLT,
-              const std::optional<WrappingInt32> fixed_isn = {});
+              const std::optional<WrappingInt32> fixed_isn = {},
+              TCPTimers *timers = nullptr,
+              const uint64_t owner = 0,
+              const size_t max_payload_size = TCPConfig::MAX_PAYLOAD_SIZE);
 
     //! \name "Input" interface for the writer
     //!@{
@@ -100,7 +97,11 @@ class TCPSender {
     void fill_window();
 
     //! \brief Notifies the TCPSender of the passage of time
+    //! \note Does nothing if the sender's timer is kept in a TCPTimers that was passed to the constructor.
     void tick(const size_t ms_since_last_tick);
+
+    //! \brief The retransmission timer expired: retransmit the oldest outstanding segment
+    void timer_expired(const TCPTimers::Kind kind);
     //!@}
 
     //! \name Accessors
@@ -114,6 +115,10 @@ class TCPSender {
     //! \brief Number of consecutive retransmissions that have occurred in a row
     unsigned int consecutive_retransmissions() const;
 
+    //! \brief Milliseconds of tick() time until the retransmission timer expires
+    //! \returns an empty optional if the timer isn't running
+    std::optional<size_t> time_until_next_deadline() const;
+
     //! \brief TCPSegments that the TCPSender has enqueued for transmission.
     //! \note These must be dequeued and sent by the TCPConnection,
     //! which will need to fill in the fields that are set by the TCPReceiver
@@ -130,6 +135,16 @@ class TCPSender {
     //! \brief relative seqno for the next byte to be sent
     WrappingInt32 next_seqno() const { return wrap(_next_seqno, _isn); }
     //!@}
+
+    //! \name
+    //! A TCPSender can be moved, but not copied
+    //!@{
+    TCPSender(TCPSender &&other) = default;
+    TCPSender(const TCPSender &other) = delete;
+    TCPSender &operator=(const TCPSender &other) = delete;
+    TCPSender &operator=(TCPSender &&other);
+    ~TCPSender() = default;
+    //!@}
 };
 
 
@@ -0,0 +1,368 @@
+#include "tcp_stack.hh"
+
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "tcp_segment.hh"
+#include "tcp_state.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+using namespace std;
+
+size_t TCPStack::FourTupleHash::operator()(const FourTuple &t) const {
+    const uint64_t addresses = (uint64_t(t.local_address) << 32) | t.remote_address;
+    const uint64_t ports = (uint64_t(t.local_port) << 16) | t.remote_port;
+    return hash<uint64_t>{}(addresses ^ (ports * 0x9e3779b97f4a7c15ULL));
+}
+
+//! \param[in] datagrams_out_capacity is the capacity of datagrams_out()
+TCPStack::TCPStack(const size_t datagrams_out_capacity)
+    : _random(get_random_generator())
+    , _cookie_secret((uint64_t(_random()) << 32) | _random())
+    , _datagrams_out(datagrams_out_capacity) {}
+
+TCPStack::ConnectionMap::iterator TCPStack::add_connection(const FourTuple &tuple, const TCPConfig &config) {
+    const ConnectionId id = _next_id++;
+    const auto it =
+        _connections.emplace(piecewise_construct, forward_as_tuple(id), forward_as_tuple(tuple, config, _timers, id))
+            .first;
+    _demux.emplace(tuple, id);
+    return it;
+}
+
+TCPStack::Connection &TCPStack::lookup(const ConnectionId id) {
+    const auto it = _connections.find(id);
+    if (it == _connections.end()) {
+        throw out_of_range("TCPStack: no connection with id " + to_string(id));
+    }
+    return it->second;
+}
+
+//! \param[in] tuple addresses the datagram
+//! \param[in] seg is the segment, whose ports are filled in
+void TCPStack::send_segment(const FourTuple &tuple, TCPSegment &seg) {
+    seg.header().sport = tuple.local_port;
+    seg.header().dport = tuple.remote_port;
+
+    InternetDatagram dgram;
+    dgram.header().src = tuple.local_address;
+    dgram.header().dst = tuple.remote_address;
+    dgram.header().len = dgram.header().hlen * 4 + seg.header().doff * 4 + seg.payload().size();
+    dgram.payload() = seg.serialize(dgram.header().pseudo_cksum());
+    _datagrams_out.push(move(dgram));
+}
+
+//! \param[in] it is the connection, which may be erased
+void TCPStack::service(ConnectionMap::iterator it) {
+    Connection &conn = it->second;
+
+    for (auto &segments = conn.tcp.segments_out(); not segments.empty(); segments.pop()) {
+        send_segment(conn.tuple, segments.front());
+    }
+
+    if (conn.listener.has_value() and not conn.ready and conn.tcp.active() and
+        conn.tcp.state() != TCPState::State::SYN_RCVD) {
+        _listeners.at(conn.listener.value()).accept_queue.push_back(it->first);
+        conn.ready = true;
+    }
+
+    // nobody will ever look at a connection that is done and was closed (or never accepted)
+    if (not conn.tcp.active() and (conn.closed or conn.listener.has_value())) {
+        if (conn.listener.has_value()) {
+            _listeners.at(conn.listener.value()).pending--;
+        }
+        _demux.erase(conn.tuple);
+        _connections.erase(it);
+    }
+}
+
+//! \param[in] port is the TCP port to listen on
+//! \param[in] config is the configuration of the accepted connections
+//! \param[in] backlog is the most connections that may be pending at once
+//! \param[in] syn_backlog is the most half-open connections to keep at once
+void TCPStack::listen(const uint16_t port, const TCPConfig &config, const size_t backlog, const size_t syn_backlog) {
+    if (not _listeners.emplace(port, Listener{config, backlog, syn_backlog}).second) {
+        throw runtime_error("TCPStack::listen: already listening on port " + to_string(port));
+    }
+}
+
+optional<TCPStack::ConnectionId> TCPStack::accept(const uint16_t port) {
+    Listener &listener = _listeners.at(port);
+    while (not listener.accept_queue.empty()) {
+        const ConnectionId id = listener.accept_queue.front();
+        listener.accept_queue.pop_front();
+        // connections that died in the queue are already gone
+        const auto it = _connections.find(id);
+        if (it != _connections.end()) {
+            it->second.listener.reset();
+            listener.pending--;
+            return id;
+        }
+    }
+    return {};
+}
+
+//! \param[in] config is the configuration of the new connection
+//! \param[in] local is our address and port
+//! \param[in] remote is the peer's address and port
+TCPStack::ConnectionId TCPStack::connect(const TCPConfig &config, const Address &local, const Address &remote) {
+    const FourTuple tuple{local.ipv4_numeric(), remote.ipv4_numeric(), local.port(), remote.port()};
+    if (_demux.count(tuple) != 0) {
+        throw runtime_error("TCPStack::connect: a connection from " + local.to_string() + " to " +
+                            remote.to_string() + " already exists");
+    }
+    const auto it = add_connection(tuple, config);
+    const ConnectionId id = it->first;
+    it->second.tcp.connect();
+    service(it);
+    return id;
+}
+
+void TCPStack::close(const ConnectionId id) {
+    Connection &conn = lookup(id);
+    conn.closed = true;
+    // a connection that is already done (reset, say) has nothing more to send
+    if (conn.tcp.active()) {
+        conn.tcp.end_input_stream();
+    }
+    service(_connections.find(id));
+}
+
+size_t TCPStack::write(const ConnectionId id, const string &data) {
+    const size_t written = lookup(id).tcp.write(data);
+    service(_connections.find(id));
+    return written;
+}
+
+void TCPStack::end_input_stream(const ConnectionId id) {
+    lookup(id).tcp.end_input_stream();
+    service(_connections.find(id));
+}
+
+optional<TCPStack::ConnectionId> TCPStack::datagram_received(const InternetDatagram &dgram) {
+    if (dgram.header().proto != IPv4Header::PROTO_TCP) {
+        return {};
+    }
+
+    TCPSegment seg;
+    if (ParseResult::NoError != seg.parse(dgram.payload(), dgram.header().pseudo_cksum())) {
+        return {};
+    }
+
+    const FourTuple tuple{dgram.header().dst, dgram.header().src, seg.header().dport, seg.header().sport};
+    const bool syn = seg.header().syn and not seg.header().ack and not seg.header().rst;
+    const bool ack = seg.header().ack and not seg.header().syn and not seg.header().rst;
+
+    optional<ConnectionMap::iterator> it{};
+    const auto known = _demux.find(tuple);
+    if (known != _demux.end()) {
+        const auto conn = _connections.find(known->second);
+        if (conn != _connections.end()) {
+            conn->second.tcp.segment_received(seg);
+            it = conn;
+        } else {
+            // a half-open connection
+            const auto half_open = _half_open.find(known->second);
+            if (half_open == _half_open.end()) {
+                // neither: the entry outlived what it named
+                _demux.erase(known);
+                return {};
+            }
+            const HalfOpen &h = half_open->second;
+            if (seg.header().rst) {
+                remove_half_open(half_open);
+            } else if (syn and seg.header().seqno == h.peer_isn) {
+                send_syn_ack(tuple, h.isn, h.peer_isn, _listeners.at(tuple.local_port).config);
+            } else if (ack and seg.header().ackno == h.isn + 1 and seg.header().seqno == h.peer_isn + 1 and
+                       _listeners.at(tuple.local_port).pending < _listeners.at(tuple.local_port).backlog) {
+                const WrappingInt32 isn = h.isn;
+                remove_half_open(half_open);
+                it = complete_handshake(_listeners.at(tuple.local_port), tuple, isn, seg);
+            }
+            if (not it.has_value()) {
+                return {};
+            }
+        }
+    } else {
+        // a new connection, or the end of a handshake that used a SYN cookie?
+        const auto listener = _listeners.find(tuple.local_port);
+        if (listener == _listeners.end()) {
+            return {};
+        }
+        if (syn) {
+            syn_received(listener->second, tuple, seg);
+            return {};
+        }
+        if (not ack or not valid_cookie_ack(tuple, seg)) {
+            return {};
+        }
+        it = complete_handshake(listener->second, tuple, seg.header().ackno - 1, seg);
+        if (not it.has_value()) {
+            return {};
+        }
+    }
+
+    const ConnectionId id = it.value()->first;
+    service(it.value());
+    if (_connections.count(id) == 0) {
+        return {};
+    }
+    return id;
+}
+
+//! \param[in] listener is the listener that the SYN is for
+//! \param[in] tuple identifies the connection
+//! \param[in] seg is the SYN
+void TCPStack::syn_received(Listener &listener, const FourTuple &tuple, const TCPSegment &seg) {
+    // no room for the connection even if the handshake completes
+    if (listener.pending >= listener.backlog) {
+        return;
+    }
+
+    const WrappingInt32 peer_isn = seg.header().seqno;
+    if (listener.half_open >= listener.syn_backlog) {
+        const uint64_t period = _timers.now() / SYN_COOKIE_PERIOD_MS;
+        send_syn_ack(tuple, syn_cookie(tuple, peer_isn, period), peer_isn, listener.config);
+        _syn_cookies_sent++;
+        return;
+    }
+
+    const ConnectionId id = _next_id++;
+    const WrappingInt32 isn{uint32_t(_random())};
+    HalfOpen &h = _half_open
+                      .emplace(piecewise_construct,
+                               forward_as_tuple(id),
+                               forward_as_tuple(
+                                   tuple, isn, peer_isn, _timers, id, listener.config.rt_timeout))
+                      .first->second;
+    _demux.emplace(tuple, id);
+    listener.half_open++;
+    h.timer.start(h.timeout);
+    send_syn_ack(tuple, isn, peer_isn, listener.config);
+}
+
+//! \param[in] tuple identifies the connection
+//! \param[in] isn is our initial sequence number
+//! \param[in] peer_isn is the peer's initial sequence number
+//! \param[in] config is the configuration of the listener
+void TCPStack::send_syn_ack(const FourTuple &tuple,
+                            const WrappingInt32 isn,
+                            const WrappingInt32 peer_isn,
+                            const TCPConfig &config) {
+    TCPSegment seg;
+    seg.header().syn = true;
+    seg.header().ack = true;
+    seg.header().seqno = isn;
+    seg.header().ackno = peer_isn + 1;
+    seg.header().win = uint16_t(min(config.recv_capacity, size_t(numeric_limits<uint16_t>::max())));
+    send_segment(tuple, seg);
+}
+
+//! Finalizer of the splitmix64 generator: a fast, well-mixing bijection on 64-bit values
+static uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+//! \details The top five bits hold the period (modulo 32), so that old cookies can be told apart;
+//! the other 27 are a hash, keyed by a secret, of everything else.
+WrappingInt32 TCPStack::syn_cookie(const FourTuple &tuple, const WrappingInt32 peer_isn, const uint64_t period) const {
+    uint64_t h = mix(_cookie_secret ^ ((uint64_t(tuple.local_address) << 32) | tuple.remote_address));
+    h = mix(h ^ ((uint64_t(tuple.local_port) << 48) | (uint64_t(tuple.remote_port) << 32) | peer_isn.raw_value()));
+    h = mix(h ^ period);
+    return WrappingInt32{uint32_t((period % 32) << 27) | uint32_t(h & 0x07ffffff)};
+}
+
+//! \details A cookie from the current or the previous period is accepted.
+bool TCPStack::valid_cookie_ack(const FourTuple &tuple, const TCPSegment &seg) const {
+    const WrappingInt32 cookie = seg.header().ackno - 1;
+    const WrappingInt32 peer_isn = seg.header().seqno - 1;
+    const uint64_t period = _timers.now() / SYN_COOKIE_PERIOD_MS;
+    return syn_cookie(tuple, peer_isn, period) == cookie or
+           (period > 0 and syn_cookie(tuple, peer_isn, period - 1) == cookie);
+}
+
+//! \param[in] listener is the listener that the connection is for
+//! \param[in] tuple identifies the connection
+//! \param[in] isn is the initial sequence number of our SYN-ACK
+//! \param[in] seg is the segment that acknowledges the SYN-ACK
+//! \details The TCPConnection is brought to where it would be had it received the SYN itself: it is given
+//! a SYN from the peer's initial sequence number, and the SYN-ACK that it answers with is discarded.
+optional<TCPStack::ConnectionMap::iterator> TCPStack::complete_handshake(Listener &listener,
+                                                                         const FourTuple &tuple,
+                                                                         const WrappingInt32 isn,
+                                                                         const TCPSegment &seg) {
+    if (listener.pending >= listener.backlog) {
+        return {};
+    }
+
+    TCPConfig config = listener.config;
+    config.fixed_isn = isn;
+    const auto it = add_connection(tuple, config);
+    it->second.listener = tuple.local_port;
+    listener.pending++;
+
+    TCPSegment syn;
+    syn.header().syn = true;
+    syn.header().seqno = seg.header().seqno - 1;
+    TCPConnection &tcp = it->second.tcp;
+    tcp.segment_received(syn);
+    while (not tcp.segments_out().empty()) {
+        tcp.segments_out().pop();
+    }
+    tcp.segment_received(seg);
+    return it;
+}
+
+void TCPStack::half_open_timer_expired(unordered_map<ConnectionId, HalfOpen>::iterator it) {
+    HalfOpen &h = it->second;
+    if (h.retransmissions >= TCPConfig::MAX_RETX_ATTEMPTS) {
+        remove_half_open(it);
+        return;
+    }
+    h.retransmissions++;
+    h.timeout *= 2;
+    h.timer.start(h.timeout);
+    send_syn_ack(h.tuple, h.isn, h.peer_isn, _listeners.at(h.tuple.local_port).config);
+}
+
+void TCPStack::remove_half_open(unordered_map<ConnectionId, HalfOpen>::iterator it) {
+    _listeners.at(it->second.tuple.local_port).half_open--;
+    _demux.erase(it->second.tuple);
+    _half_open.erase(it);
+}
+
+//! \param[in] ms_since_last_tick number of milliseconds since the last call to this method
+//! \param[in] on_timer is called during the tick, so it must not add or remove connections
+void TCPStack::tick(const size_t ms_since_last_tick, const function<void(const ConnectionId)> &on_timer) {
+    _timers.advance(ms_since_last_tick, [&](const uint64_t id, const TCPTimers::Kind kind) {
+        // the connection may have been removed by an earlier timer of the same advance
+        const auto it = _connections.find(id);
+        if (it != _connections.end()) {
+            it->second.tcp.timer_expired(kind);
+            service(it);
+            if (on_timer and _connections.count(id) != 0) {
+                on_timer(id);
+            }
+            return;
+        }
+        const auto half_open = _half_open.find(id);
+        if (half_open != _half_open.end()) {
+            half_open_timer_expired(half_open);
+        }
+    });
+}
+
+optional<size_t> TCPStack::time_until_next_deadline() const {
+    const optional<uint64_t> next = _timers.time_until_next_expiry();
+    if (not next.has_value()) {
+        return {};
+    }
+    return next.value();
+}
@@ -0,0 +1,249 @@
+#ifndef SPONGE_LIBSPONGE_TCP_STACK_HH
+#define SPONGE_LIBSPONGE_TCP_STACK_HH
+
+#include "address.hh"
+#include "byte_stream.hh"
+#include "ipv4_datagram.hh"
+#include "ring_queue.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_timers.hh"
+#include "wrapping_integers.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+//! \brief Any number of TCP connections sharing one source and sink of IPv4 datagrams
+class TCPStack {
+  public:
+    //! Names a connection for as long as it is in the stack
+    using ConnectionId = uint64_t;
+
+    //! Default limit on connections a listener has answered the SYN of, and not yet heard back from
+    static constexpr size_t DEFAULT_SYN_BACKLOG = 256;
+
+    //! How long a SYN cookie stays valid (between one and two periods, in tick() time)
+    static constexpr uint64_t SYN_COOKIE_PERIOD_MS = 64000;
+
+  private:
+    //! Addresses and ports that identify a connection (numeric addresses, host byte order)
+    struct FourTuple {
+        uint32_t local_address;   //!< Our address
+        uint32_t remote_address;  //!< The peer's address
+        uint16_t local_port;      //!< Our port
+        uint16_t remote_port;     //!< The peer's port
+
+        bool operator==(const FourTuple &other) const {
+            return local_address == other.local_address and remote_address == other.remote_address and
+                   local_port == other.local_port and remote_port == other.remote_port;
+        }
+    };
+
+    //! Hash of a FourTuple, for the demultiplexing table
+    struct FourTupleHash {
+        size_t operator()(const FourTuple &t) const;
+    };
+
+    //! A connection and what the stack knows about it
+    struct Connection {
+        FourTuple tuple;                     //!< How segments of the connection are addressed
+        TCPConnection tcp;                   //!< The connection itself
+        std::optional<uint16_t> listener{};  //!< Port of the listener it arrived on, until it is accepted
+        bool ready{false};                   //!< Whether it is in its listener's accept queue
+        bool closed{false};                  //!< Whether the owner has called close()
+
+        //! Construct a connection whose timers are kept in `timers`
+        Connection(const FourTuple &t, const TCPConfig &cfg, TCPTimers &timers, const ConnectionId id)
+            : tuple(t), tcp(cfg, timers, id) {}
+    };
+
+    //! \brief A connection that a listener has sent a SYN-ACK for, and is waiting to hear back from
+    //! \details Keeps just enough to answer retransmitted SYNs and to build the TCPConnection when the
+    //! handshake completes; no buffers are allocated until then.
+    struct HalfOpen {
+        FourTuple tuple;              //!< How segments of the connection are addressed
+        WrappingInt32 isn;            //!< Our initial sequence number
+        WrappingInt32 peer_isn;       //!< The peer's initial sequence number
+        TCPTimers::Timer timer;       //!< Retransmission timer of the SYN-ACK
+        uint64_t timeout;             //!< Current retransmission timeout of the SYN-ACK
+        unsigned retransmissions{0};  //!< Times the SYN-ACK has been retransmitted
+
+        //! Construct a half-open connection whose timer is kept in `timers`
+        HalfOpen(const FourTuple &t,
+                 const WrappingInt32 i,
+                 const WrappingInt32 p,
+                 TCPTimers &timers,
+                 const ConnectionId id,
+                 const uint16_t rt_timeout)
+            : tuple(t)
+            , isn(i)
+            , peer_isn(p)
+            , timer(timers, id, TCPTimers::Kind::Retransmission)
+            , timeout(rt_timeout) {}
+    };
+
+    //! A port that accepts connections
+    struct Listener {
+        TCPConfig config;                         //!< Configuration of the connections it accepts
+        size_t backlog;                           //!< Most connections that may be pending at once
+        size_t syn_backlog;                       //!< Most half-open connections that may be kept at once
+        size_t pending{0};                        //!< Connections that are established and not yet accepted
+        size_t half_open{0};                      //!< Half-open connections kept for the listener
+        std::deque<ConnectionId> accept_queue{};  //!< Established connections, in the order they got there
+    };
+
+    using ConnectionMap = std::unordered_map<ConnectionId, Connection>;
+
+    TCPTimers _timers{};                                                  //!< The timers of every connection
+    ConnectionMap _connections{};                                         //!< Every connection, by id
+    std::unordered_map<ConnectionId, HalfOpen> _half_open{};              //!< Half-open connections, by id
+    std::unordered_map<FourTuple, ConnectionId, FourTupleHash> _demux{};  //!< Every connection, by FourTuple
+    std::unordered_map<uint16_t, Listener> _listeners{};                  //!< Listeners, by port
+    ConnectionId _next_id{1};                                             //!< Id of the next new connection
+    std::mt19937 _random;                                                 //!< Source of ISNs and of the secret
+    uint64_t _cookie_secret;                                              //!< Key of the SYN cookie hash
+    uint64_t _syn_cookies_sent{0};                                        //!< SYN cookies sent so far
+
+    //! Datagrams carrying the segments of every connection, oldest first
+    RingQueue<InternetDatagram> _datagrams_out;
+
+    //! Add a connection to both tables
+    ConnectionMap::iterator add_connection(const FourTuple &tuple, const TCPConfig &config);
+
+    //! Wrap a segment in an IPv4 datagram addressed by `tuple`, and queue it for transmission
+    void send_segment(const FourTuple &tuple, TCPSegment &seg);
+
+    //! Send the SYN-ACK answering a SYN with initial sequence number `peer_isn`
+    void send_syn_ack(const FourTuple &tuple,
+                      const WrappingInt32 isn,
+                      const WrappingInt32 peer_isn,
+                      const TCPConfig &config);
+
+    //! Answer a SYN to a listening port, keeping a HalfOpen if there is room and sending a SYN cookie if not
+    void syn_received(Listener &listener, const FourTuple &tuple, const TCPSegment &seg);
+
+    //! The SYN cookie for a SYN with initial sequence number `peer_isn`, in SYN cookie period `period`
+    WrappingInt32 syn_cookie(const FourTuple &tuple, const WrappingInt32 peer_isn, const uint64_t period) const;
+
+    //! `true` if `seg` acknowledges a SYN-ACK carrying a SYN cookie that is still valid
+    bool valid_cookie_ack(const FourTuple &tuple, const TCPSegment &seg) const;
+
+    //! \brief Build the connection whose handshake `seg` completes, and give it `seg`
+    //! \returns the new connection, or nothing if the listener's backlog is full
+    std::optional<ConnectionMap::iterator> complete_handshake(Listener &listener,
+                                                              const FourTuple &tuple,
+                                                              const WrappingInt32 isn,
+                                                              const TCPSegment &seg);
+
+    //! The SYN-ACK retransmission timer of a half-open connection expired
+    void half_open_timer_expired(std::unordered_map<ConnectionId, HalfOpen>::iterator it);
+
+    //! Forget a half-open connection
+    void remove_half_open(std::unordered_map<ConnectionId, HalfOpen>::iterator it);
+
+    //! Send what the connection has queued, move it to the accept queue once established, and remove it once done
+    void service(ConnectionMap::iterator it);
+
+    //! Look up a connection, throwing if there is none with that id
+    Connection &lookup(const ConnectionId id);
+
+  public:
+    //! \brief Construct an empty stack
+    //! \param[in] datagrams_out_capacity is the capacity of datagrams_out()
+    explicit TCPStack(const size_t datagrams_out_capacity = RingQueue<InternetDatagram>::DEFAULT_CAPACITY);
+
+    //! \name Opening and closing connections
+    //!@{
+
+    //! \brief Accept connections to `port` (on any local address)
+    //! \param[in] backlog is the most established connections that may wait for accept(); while it is
+    //!            reached, SYNs and handshake-completing ACKs are dropped, as if lost
+    //! \param[in] syn_backlog is the most half-open connections to keep; SYNs beyond it get SYN cookies
+    void listen(const uint16_t port,
+                const TCPConfig &config,
+                const size_t backlog,
+                const size_t syn_backlog = DEFAULT_SYN_BACKLOG);
+
+    //! \brief Take the oldest established connection to `port` from the accept queue
+    //! \returns an empty optional if none is waiting
+    std::optional<ConnectionId> accept(const uint16_t port);
+
+    //! Open a connection from `local` to `remote` by sending a SYN
+    ConnectionId connect(const TCPConfig &config, const Address &local, const Address &remote);
+
+    //! \brief End the outbound stream, and forget the connection once it is no longer active
+    //! \note The connection's id must not be used after this call.
+    void close(const ConnectionId id);
+    //!@}
+
+    //! \name Using a connection
+    //!@{
+
+    //! Write data to the outbound stream of a connection, and send it if possible
+    size_t write(const ConnectionId id, const std::string &data);
+
+    //! Shut down the outbound stream of a connection (still allows reading incoming data)
+    void end_input_stream(const ConnectionId id);
+
+    //! The inbound stream of a connection
+    ByteStream &inbound_stream(const ConnectionId id) { return lookup(id).tcp.inbound_stream(); }
+
+    //! The connection itself, for inspection
+    const TCPConnection &connection(const ConnectionId id) { return lookup(id).tcp; }
+    //!@}
+
+    //! \name Methods for the owner or operating system to call
+    //!@{
+
+    //! \brief Called when an IPv4 datagram has been received from the network
+    //! \details Segments that belong to no connection are dropped, as are SYNs to a port without a listener.
+    //! \returns the connection that the segment was given to, unless there was none or it is already gone
+    std::optional<ConnectionId> datagram_received(const InternetDatagram &dgram);
+
+    //! \brief Called periodically when time elapses
+    //! \param[in] on_timer, if set, is told of each connection still in the stack that a timer acted on
+    void tick(const size_t ms_since_last_tick, const std::function<void(const ConnectionId)> &on_timer = {});
+
+    //! Milliseconds of tick() time until tick() next has something to do, or nothing if no timer is running
+    std::optional<size_t> time_until_next_deadline() const;
+
+    //! Datagrams that the stack has enqueued for transmission (dropped, as if lost, when the queue is full)
+    RingQueue<InternetDatagram> &datagrams_out() { return _datagrams_out; }
+
+    //! Number of connections in the stack, including those not yet accepted or lingering after close()
+    size_t size() const { return _connections.size(); }
+
+    //! Number of half-open connections kept by listeners
+    size_t half_open() const { return _half_open.size(); }
+
+    //! Number of SYN-ACKs sent with a SYN cookie, because a listener's SYN backlog was full
+    uint64_t syn_cookies_sent() const { return _syn_cookies_sent; }
+
+    //! Number of datagrams dropped because datagrams_out() was full when they were sent
+    uint64_t datagrams_dropped() const { return _datagrams_out.dropped(); }
+    //!@}
+};
+
+//! \class TCPStack
+//! Where a TCPSpongeSocket runs one TCPConnection behind an adapter that filters out everything else,
+//! a TCPStack sorts incoming segments among any number of connections by their addresses and ports,
+//! and starts a new connection for each SYN to a port that it listens on. All the connections keep
+//! their timers in one TCPTimers, so tick() only visits those whose timers expire.
+//!
+//! A listener answers a SYN without allocating a TCPConnection: it keeps a small HalfOpen record, or
+//! if it already has `syn_backlog` of those, nothing at all, and encodes what it needs in the initial
+//! sequence number of its SYN-ACK instead (a SYN cookie: a keyed hash of the addresses, ports and the
+//! peer's ISN, plus a coarse timestamp). The TCPConnection, and its buffers, are created only when the
+//! ACK that completes the handshake arrives. Cookie handshakes don't retransmit their SYN-ACK.
+//!
+//! A connection that completes its handshake is counted against the listener's backlog until
+//! accept() takes it, and is removed by the stack if it dies first. Any other connection stays until
+//! close() is called and it is no longer active, so that its owner can read the rest of the inbound stream.
+
+#endif  // SPONGE_LIBSPONGE_TCP_STACK_HH
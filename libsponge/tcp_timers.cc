@@ -0,0 +1,56 @@
+#include "tcp_timers.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+//! \param[in] delay_ms is the time until the timer fires; a timer with a delay of 0 fires at the next
+//!                     advance(), even one that passes no time
+void TCPTimers::Timer::start(const uint64_t delay_ms) {
+    stop();
+    _expiry = _timers->_now + delay_ms;
+    _id = _timers->_wheel.schedule(_expiry, Entry{_owner, _kind});
+}
+
+void TCPTimers::Timer::stop() {
+    if (_id != TimerWheel<Entry>::NO_TIMER) {
+        _timers->_wheel.cancel(_id);
+        _id = TimerWheel<Entry>::NO_TIMER;
+    }
+}
+
+bool TCPTimers::Timer::running() const { return _timers->_wheel.pending(_id); }
+
+uint64_t TCPTimers::Timer::time_remaining() const {
+    if (not running()) {
+        return 0;
+    }
+    // a timer started with a delay of 0 fires at the next advance(), whatever it passes
+    return max(_expiry, _timers->_now) - _timers->_now;
+}
+
+TCPTimers::Timer::Timer(Timer &&other) noexcept
+    : _timers(other._timers), _owner(other._owner), _kind(other._kind), _expiry(other._expiry), _id(other._id) {
+    other._id = TimerWheel<Entry>::NO_TIMER;
+}
+
+TCPTimers::Timer &TCPTimers::Timer::operator=(Timer &&other) noexcept {
+    if (this != &other) {
+        stop();
+        _timers = other._timers;
+        _owner = other._owner;
+        _kind = other._kind;
+        _expiry = other._expiry;
+        _id = other._id;
+        other._id = TimerWheel<Entry>::NO_TIMER;
+    }
+    return *this;
+}
+
+optional<uint64_t> TCPTimers::time_until_next_expiry() const {
+    const optional<uint64_t> expiry = _wheel.next_expiry();
+    if (not expiry.has_value()) {
+        return {};
+    }
+    return max(expiry.value(), _now) - _now;
+}
@@ -0,0 +1,106 @@
+#ifndef SPONGE_LIBSPONGE_TCP_TIMERS_HH
+#define SPONGE_LIBSPONGE_TCP_TIMERS_HH
+
+#include "timer_wheel.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+//! \brief A clock and the timers of any number of TCP endpoints, kept in one TimerWheel
+class TCPTimers {
+  public:
+    //! The timers an endpoint may have running (at most one of each kind)
+    enum class Kind : uint8_t {
+        Retransmission,  //!< TCPSender's retransmission timeout
+        Linger,          //!< End of TIME_WAIT (or of a connection that has nothing left to wait for)
+        DelayedAck,      //!< Deadline for an acknowledgment that is being held back
+        Keepalive        //!< Next probe of an idle connection
+    };
+
+  private:
+    //! What a timer in the wheel belongs to
+    struct Entry {
+        uint64_t owner;  //!< Identifies the endpoint to the caller of advance()
+        Kind kind;       //!< Which of the endpoint's timers it is
+    };
+
+    TimerWheel<Entry> _wheel{};  //!< Every running timer
+    uint64_t _now{0};            //!< Sum of all advance() arguments
+
+  public:
+    //! \brief One timer of one endpoint
+    //! \details Moving a Timer moves its schedule with it; destroying it stops it.
+    class Timer {
+      private:
+        TCPTimers *_timers;   //!< Where the timer is kept
+        uint64_t _owner;      //!< Passed to the callback of TCPTimers::advance
+        Kind _kind;           //!< Passed to the callback of TCPTimers::advance
+        uint64_t _expiry{0};  //!< When the timer fires, in TCPTimers::now() time
+
+        //! Entry in the wheel, if started
+        TimerWheel<Entry>::TimerId _id{TimerWheel<Entry>::NO_TIMER};
+
+      public:
+        //! Construct a stopped timer
+        Timer(TCPTimers &timers, const uint64_t owner, const Kind kind)
+            : _timers(&timers), _owner(owner), _kind(kind) {}
+
+        //! (Re)start the timer to fire `delay_ms` from now
+        void start(const uint64_t delay_ms);
+
+        //! Stop the timer if it is running
+        void stop();
+
+        //! `true` if the timer has been started and has neither fired nor been stopped since
+        bool running() const;
+
+        //! Milliseconds that TCPTimers::advance must pass for the timer to fire (0 if it isn't running)
+        uint64_t time_remaining() const;
+
+        //! \name
+        //! A Timer can be moved, but not copied
+        //!@{
+        Timer(Timer &&other) noexcept;
+        Timer &operator=(Timer &&other) noexcept;
+        Timer(const Timer &other) = delete;
+        Timer &operator=(const Timer &other) = delete;
+        ~Timer() { stop(); }
+        //!@}
+    };
+
+    //! \brief Pass `ms` milliseconds, firing every timer that expires by then
+    //! \param[in] on_expire is called as `on_expire(owner, kind)` for each timer that fires, in order of expiry
+    //! \details Only the timers that fire are visited. A timer started by `on_expire` counts from the end of
+    //! the `ms` that are passing, so it won't fire again during the same call (not even with a delay of 0).
+    template <typename Callback>
+    void advance(const uint64_t ms, Callback &&on_expire) {
+        _now += ms;
+        const auto fire = [&](const Entry &entry) { on_expire(entry.owner, entry.kind); };
+        if (ms == 0) {
+            _wheel.fire_due(fire);  // timers started with a delay of 0
+        } else {
+            _wheel.advance(_now, fire);
+        }
+    }
+
+    //! Milliseconds passed so far
+    uint64_t now() const { return _now; }
+
+    //! Milliseconds that advance() must pass for the next timer to fire, or nothing if no timer is running
+    std::optional<uint64_t> time_until_next_expiry() const;
+
+    //! Number of running timers
+    size_t size() const { return _wheel.size(); }
+};
+
+//! \class TCPTimers
+//! A TCPConnection normally keeps its timers (and those of its TCPSender) in a TCPTimers of its own,
+//! which TCPConnection::tick advances. A program that runs many connections can instead give them all
+//! one TCPTimers and advance that, so that the passing of time costs O(timers that fire) rather than
+//! a tick() of every connection. Starting and stopping a timer are O(1).
+//!
+//! Timers don't point back at their owners: each names its endpoint by an id chosen by the caller,
+//! and advance() hands that id back, so endpoints can be moved while their timers are running.
+
+#endif  // SPONGE_LIBSPONGE_TCP_TIMERS_HH
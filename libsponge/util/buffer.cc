@@ -7,7 +7,17 @@ void Buffer::remove_prefix(const size_t n) {
         throw out_of_range("Buffer::remove_prefix");
     }
     _starting_offset += n;
-    if (_storage and _starting_offset == _storage->size()) {
+    if (_storage and _starting_offset + _trailing_bytes == _storage->size()) {
+        _storage.reset();
+    }
+}
+
+void Buffer::remove_suffix(const size_t n) {
+    if (n > str().size()) {
+        throw out_of_range("Buffer::remove_suffix");
+    }
+    _trailing_bytes += n;
+    if (_storage and _starting_offset + _trailing_bytes == _storage->size()) {
         _storage.reset();
     }
 }
@@ -86,6 +96,22 @@ void BufferViewList::remove_prefix(size_t n) {
     }
 }
 
+void BufferViewList::remove_suffix(size_t n) {
+    while (n > 0) {
+        if (_views.empty()) {
+            throw std::out_of_range("BufferListView::remove_suffix");
+        }
+
+        if (n < _views.back().size()) {
+            _views.back().remove_suffix(n);
+            n = 0;
+        } else {
+            n -= _views.back().size();
+            _views.pop_back();
+        }
+    }
+}
+
 size_t BufferViewList::size() const {
     size_t ret = 0;
     for (const auto &buf : _views) {
@@ -0,0 +1,159 @@
+#include "byte_ring.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+//! Make an [eventfd(2)](\ref man2::eventfd) readable
+static void notify(const FileDescriptor &event) {
+    const uint64_t one = 1;
+    SystemCall("write", static_cast<int>(::write(event.fd_num(), &one, sizeof(one))));
+}
+
+//! Block until `event` is readable
+static void wait_for(const FileDescriptor &event) {
+    pollfd pfd{event.fd_num(), POLLIN, 0};
+    SystemCall("poll", ::poll(&pfd, 1, -1));
+}
+
+//! \brief Take back one notify() of an [eventfd(2)](\ref man2::eventfd)
+//! \details The eventfd may be in blocking or non-blocking mode (see ring_pair()), and the notify() may
+//! be a moment away in another thread; either way, this waits for it.
+static void clear(const FileDescriptor &event) {
+    uint64_t count = 0;
+    while (SystemCall("read", static_cast<int>(::read(event.fd_num(), &count, sizeof(count))), EAGAIN) < 0) {
+        wait_for(event);
+    }
+}
+
+//! \param[in] capacity is rounded up to a power of two
+ByteRing::ByteRing(const size_t capacity)
+    : _mask([&] {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        return rounded - 1;
+    }())
+    , _storage(make_unique<char[]>(_mask + 1))
+    , _readable(SystemCall("eventfd", ::eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC)))
+    , _writable(SystemCall("eventfd", ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {}
+
+//! \details Publishes everything that fits at once, and signals readable_event() if the ring was empty
+//! before. If some of `data` doesn't fit, asks the consumer for a signal on writable_event(), then checks
+//! once more for room that the consumer may have made in the meantime.
+size_t ByteRing::push(const BufferViewList &data) {
+    if (closed()) {
+        throw unix_error("write", EPIPE);
+    }
+
+    const vector<iovec> iovecs = data.as_iovecs();
+    const size_t total = data.size();
+    size_t index = 0;   // iovec to copy from next
+    size_t offset = 0;  // bytes of it already copied
+    size_t pushed = 0;
+    uint64_t tail = _tail.load(memory_order_relaxed);
+    while (true) {
+        const uint64_t old_tail = tail;
+        size_t room = capacity() - (tail - _head.load());
+        while (room > 0 and index < iovecs.size()) {
+            const iovec &chunk = iovecs[index];
+            const size_t at = tail & _mask;
+            const size_t n = min({room, chunk.iov_len - offset, capacity() - at});
+            memcpy(&_storage[at], static_cast<const char *>(chunk.iov_base) + offset, n);
+            tail += n;
+            room -= n;
+            offset += n;
+            pushed += n;
+            if (offset == chunk.iov_len) {
+                index++;
+                offset = 0;
+            }
+        }
+
+        if (tail != old_tail) {
+            _tail.store(tail);
+            if (_head.load() == old_tail and not _data_signalled.exchange(true)) {
+                notify(_readable);
+            }
+        }
+        if (pushed == total) {
+            return pushed;
+        }
+
+        _want_room.store(true);
+        if (tail - _head.load() == capacity()) {
+            return pushed;
+        }
+    }
+}
+
+//! \details Signals writable_event() if the producer asked for room. Clears readable_event() if this
+//! empties the ring, unless data or a close() arrived meanwhile.
+void ByteRing::pop(string &str, const size_t limit) {
+    const uint64_t head = _head.load(memory_order_relaxed);
+    const size_t n = min<uint64_t>(limit, _tail.load() - head);
+    const size_t at = head & _mask;
+    const size_t first = min(n, capacity() - at);
+    str.resize(n);
+    memcpy(str.data(), &_storage[at], first);
+    memcpy(str.data() + first, &_storage[0], n - first);
+    _head.store(head + n);
+
+    if (n > 0 and _want_room.load() and _want_room.exchange(false)) {
+        notify(_writable);
+    }
+    if (_tail.load() == head + n and _data_signalled.exchange(false)) {
+        clear(_readable);
+        if ((_tail.load() != head + n or closed()) and not _data_signalled.exchange(true)) {
+            notify(_readable);
+        }
+    }
+}
+
+void ByteRing::wait_for_room() {
+    while (not closed() and size() == capacity()) {
+        _want_room.store(true);
+        if (size() == capacity()) {
+            wait_for(_writable);
+            clear(_writable);
+        }
+    }
+}
+
+void ByteRing::wait_for_data() {
+    while (size() == 0 and not closed()) {
+        wait_for(_readable);
+    }
+}
+
+void ByteRing::close() {
+    _closed.store(true);
+    if (not _data_signalled.exchange(true)) {
+        notify(_readable);
+    }
+    notify(_writable);
+}
+
+//! \param[in] capacity is the capacity of each of the two rings
+//! \returns two FileDescriptors, each reading what the other writes
+pair<FileDescriptor, FileDescriptor> ring_pair(const size_t capacity) {
+    const auto a_to_b = make_shared<ByteRing>(capacity);
+    const auto b_to_a = make_shared<ByteRing>(capacity);
+
+    // duplicated fd numbers, rather than FileDescriptor::duplicate(), so that the rings (which hold
+    // their own FileDescriptors) aren't kept alive by themselves
+    FileDescriptor a{SystemCall("dup", ::dup(b_to_a->readable_event().fd_num()))};
+    FileDescriptor b{SystemCall("dup", ::dup(a_to_b->readable_event().fd_num()))};
+    a.set_rings(make_shared<RingStream>(RingStream{b_to_a, a_to_b}));
+    b.set_rings(make_shared<RingStream>(RingStream{a_to_b, b_to_a}));
+    return {move(a), move(b)};
+}
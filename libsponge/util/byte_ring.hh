@@ -0,0 +1,96 @@
+#ifndef SPONGE_LIBSPONGE_BYTE_RING_HH
+#define SPONGE_LIBSPONGE_BYTE_RING_HH
+
+#include "buffer.hh"
+#include "file_descriptor.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+//! \brief A lock-free byte queue between one producer thread and one consumer thread
+//! \details The consumer can wait for data by polling readable_event(), which is signalled when the ring
+//! goes from empty to non-empty and when it is closed, and the producer can wait for room by polling
+//! writable_event(), which is signalled when the consumer makes room after a push() that didn't fit.
+class ByteRing {
+  public:
+    //! Default capacity, in bytes
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+
+  private:
+    size_t _mask;                                //!< Capacity minus one (the capacity is a power of two)
+    std::unique_ptr<char[]> _storage;            //!< The bytes of the ring
+    alignas(64) std::atomic<uint64_t> _head{0};  //!< Bytes popped so far (written by the consumer)
+    alignas(64) std::atomic<uint64_t> _tail{0};  //!< Bytes pushed so far (written by the producer)
+    std::atomic<bool> _closed{false};            //!< Whether either side has closed the ring
+    std::atomic<bool> _want_room{false};         //!< Whether the producer is waiting for room
+    std::atomic<bool> _data_signalled{false};    //!< Whether _readable is (or is about to be) readable
+    FileDescriptor _readable;                    //!< [eventfd(2)](\ref man2::eventfd): the ring has data or is closed
+    FileDescriptor _writable;                    //!< [eventfd(2)](\ref man2::eventfd): the ring has room or is closed
+
+  public:
+    //! Construct an empty ring of at least `capacity` bytes
+    explicit ByteRing(const size_t capacity = DEFAULT_CAPACITY);
+
+    //! \name Producer
+    //!@{
+
+    //! \brief Copy as much of `data` into the ring as fits
+    //! \returns the number of bytes copied; if that is less than `data.size()`, writable_event()
+    //! will be signalled once there is room
+    //! \note Pushing to a closed ring throws a unix_error (`EPIPE`), as writing to a shut-down socket would.
+    size_t push(const BufferViewList &data);
+
+    //! Block until the ring has room, or is closed
+    void wait_for_room();
+    //!@}
+
+    //! \name Consumer
+    //!@{
+
+    //! Move up to `limit` bytes out of the ring into `str`
+    void pop(std::string &str, const size_t limit);
+
+    //! Block until the ring has data, or is closed
+    void wait_for_data();
+
+    //! `true` if the ring is closed and nothing is left to pop
+    bool eof() const { return _closed.load() and _head.load() == _tail.load(); }
+    //!@}
+
+    //! Close the ring: no more data may be pushed, and what is in it can still be popped (either side)
+    void close();
+
+    //! `true` if close() has been called
+    bool closed() const { return _closed.load(); }
+
+    //! Bytes in the ring
+    size_t size() const { return _tail.load() - _head.load(); }
+
+    //! Capacity of the ring in bytes
+    size_t capacity() const { return _mask + 1; }
+
+    //! Readable while the ring has data or is closed; for the consumer to poll
+    const FileDescriptor &readable_event() const { return _readable; }
+
+    //! Readable after the consumer has made room for a producer that ran out; for the producer to poll
+    const FileDescriptor &writable_event() const { return _writable; }
+};
+
+//! \brief One end of an in-process stream made of two ByteRing%s
+//! \details Attached to a FileDescriptor by ring_pair(), so that reads, writes and shutdowns of the
+//! FileDescriptor go to the rings instead of the kernel.
+struct RingStream {
+    std::shared_ptr<ByteRing> in;   //!< Ring that this end reads from
+    std::shared_ptr<ByteRing> out;  //!< Ring that this end writes to
+};
+
+//! \brief An in-process stand-in for a pair of connected stream sockets
+//! \details Each FileDescriptor is (a duplicate of) the readable_event() of the ring it reads from, so it
+//! can be polled for Direction::In like a socket; see FileDescriptor::set_rings.
+std::pair<FileDescriptor, FileDescriptor> ring_pair(const size_t capacity = ByteRing::DEFAULT_CAPACITY);
+
+#endif  // SPONGE_LIBSPONGE_BYTE_RING_HH
@@ -1,8 +1,15 @@
 #include "eventloop.hh"
 
+#include "io_uring.hh"
 #include "util.hh"
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <limits>
 #include <stdexcept>
 #include <system_error>
 #include <utility>
@@ -10,32 +17,331 @@
 
 using namespace std;
 
+//! What the user data of an io_uring request refers to (stored in its top byte)
+enum class Request : uint64_t { Poll = 1, Receive = 2, Send = 3, Cancel = 4 };
+
+static constexpr unsigned RING_ENTRIES = 1024;  //!< Submission queue size of the IoUring backend
+
+//! \name Provided buffers of the IoUring backend
+//!@{
+static constexpr uint16_t DATAGRAM_BUFFER_COUNT = 128;         //!< Buffers shared by all datagram sockets
+static constexpr uint32_t DATAGRAM_BUFFER_SIZE = 65536 + 256;  //!< Room for a recvmsg header and any datagram
+static constexpr uint16_t STREAM_BUFFER_COUNT = 8;             //!< Buffers of each stream socket
+static constexpr uint32_t STREAM_BUFFER_SIZE = 16384;          //!< Size of a stream socket's buffers
+//!@}
+
+//! User data for an io_uring request: its kind, the buffer group it draws from (if any), and the rule or send id
+static uint64_t user_data(const Request kind, const uint64_t id, const uint16_t buffer_group = 0) {
+    return static_cast<uint64_t>(kind) << 56 | uint64_t{buffer_group} << 40 | id;
+}
+
 unsigned int EventLoop::Rule::service_count() const {
     return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+//! \param[in] backend selects [poll(2)](\ref man2::poll) or [epoll(7)](\ref man7::epoll)
+EventLoop::EventLoop(const Backend backend) : _backend(backend), _timer_wheel(timestamp_ms()) {
+    if (_backend == Backend::Epoll) {
+        _epoll.emplace(SystemCall("epoll_create1", ::epoll_create1(EPOLL_CLOEXEC)));
+        _ready.resize(1024);
+    } else if (_backend == Backend::IoUring) {
+        _ring = make_unique<IoUring>(RING_ENTRIES);
+        _recvmsg_header.msg_namelen = sizeof(sockaddr_storage);
+    }
+}
+
+EventLoop::~EventLoop() {
+    if (_backend != Backend::IoUring) {
+        return;
+    }
+    try {
+        for (Rule &rule : _rules) {
+            if (rule.ring.offload and rule.fd.offload() == rule.ring.offload) {
+                rule.fd.set_offload(nullptr);
+            }
+        }
+
+        // UDPSocket::sendto reported these datagrams as sent, so give the kernel a moment to send them
+        const uint64_t deadline = timestamp_ms() + 1000;
+        while (not _sends.empty() and timestamp_ms() < deadline) {
+            _ring->submit_and_wait(100);
+            _ring->reap([&](const io_uring_cqe &completion) {
+                if (completion.user_data >> 56 == static_cast<uint64_t>(Request::Send)) {
+                    _sends.erase(completion.user_data & ((uint64_t{1} << 40) - 1));
+                }
+            });
+        }
+    } catch (const exception &e) {
+        // don't throw an exception from the destructor
+        cerr << "Exception destructing EventLoop: " << e.what() << endl;
+    }
+}
+
 //! \param[in] fd is the FileDescriptor to be polled
 //! \param[in] direction indicates whether to poll for reading (Direction::In) or writing (Direction::Out)
 //! \param[in] callback is called when `fd` is ready.
 //! \param[in] interest is called by EventLoop::wait_next_event. If it returns `true`, `fd` will
 //!                     be polled, otherwise `fd` will be ignored only for this execution of `wait_next_event.
+//!                     If empty, `fd` is polled until EventLoop::set_interest says otherwise.
 //! \param[in] cancel is called when the rule is cancelled (e.g. on hangup, EOF, or closure).
-void EventLoop::add_rule(const FileDescriptor &fd,
-                         const Direction direction,
-                         const CallbackT &callback,
-                         const InterestT &interest,
-                         const CallbackT &cancel) {
+EventLoop::RuleHandle EventLoop::add_rule(const FileDescriptor &fd,
+                                          const Direction direction,
+                                          const CallbackT &callback,
+                                          const InterestT &interest,
+                                          const CallbackT &cancel) {
     _rules.push_back({fd.duplicate(), direction, callback, interest, cancel});
+    const RuleIterator rule = prev(_rules.end());
+    if (_backend != Backend::Poll) {
+        rule->id = _next_id++;
+    }
+
+    if (_backend == Backend::Epoll) {
+        // a further rule for an fd that is already registered only changes the events requested for it
+        Registration &registration = _registrations[rule->fd.fd_num()];
+        (direction == Direction::In ? registration.in : registration.out).push_back(rule);
+        if (interest) {
+            // polled from the next wait on, depending on what the callback says; register the fd for errors now
+            _rules_with_interest.push_back(rule);
+            sync_registration(rule->fd.fd_num());
+        } else {
+            set_polled(*rule, true);
+        }
+    } else if (_backend == Backend::IoUring) {
+        _rules_by_id.emplace(rule->id, rule);
+        if (direction == Direction::In) {
+            attach_offload(*rule);
+        }
+        if (interest) {
+            _rules_with_interest.push_back(rule);
+        } else {
+            set_polled(*rule, true);
+        }
+    }
+
+    return RuleHandle{rule};
 }
 
-//! \param[in] timeout_ms is the timeout value passed to [poll(2)](\ref man2::poll); `wait_next_event`
-//!                       returns Result::Timeout if no fd is ready after the timeout expires.
-//! \returns Eventloop::Result indicating success, timeout, or no more Rule objects to poll.
-//!
-//! For each Rule, this function first calls Rule::interest; if `true`, Rule::fd is added to the
-//! list of file descriptors to be polled for readability (if Rule::direction == Direction::In) or
-//! writability (if Rule::direction == Direction::Out) unless Rule::fd has reached EOF, in which case
-//! the Rule is canceled (i.e., deleted from EventLoop::_rules).
+void EventLoop::set_interest(const RuleHandle &rule, const bool interested) {
+    if (rule._rule->interest) {
+        throw runtime_error("EventLoop: set_interest called on a rule that has an interest callback");
+    }
+    rule._rule->interested = interested;
+    if (_backend != Backend::Poll) {
+        set_polled(*rule._rule, interested);
+    }
+}
+
+void EventLoop::set_polled(Rule &rule, const bool polled) {
+    if (rule.polled == polled) {
+        return;
+    }
+    rule.polled = polled;
+    if (polled) {
+        _polled_rules++;
+    } else {
+        _polled_rules--;
+    }
+    if (_backend == Backend::Epoll) {
+        sync_registration(rule.fd.fd_num());
+    } else {
+        arm(rule);
+    }
+}
+
+//! \details An fd with no rules left is removed from the epoll instance; an fd whose rules are all
+//! uninterested stays registered with no events, so that errors and hangups are still reported.
+void EventLoop::sync_registration(const int fd_num) {
+    const auto found = _registrations.find(fd_num);
+    if (found == _registrations.end()) {
+        return;
+    }
+    Registration &registration = found->second;
+
+    if (registration.in.empty() and registration.out.empty()) {
+        // the fd may already have been closed, which removes it from the epoll instance by itself
+        if (registration.registered and ::epoll_ctl(_epoll->fd_num(), EPOLL_CTL_DEL, fd_num, nullptr) < 0 and
+            errno != EBADF and errno != ENOENT) {
+            throw unix_error("epoll_ctl");
+        }
+        _registrations.erase(found);
+        return;
+    }
+
+    const auto polled = [](const RuleIterator rule) { return rule->polled; };
+    uint32_t events = 0;
+    if (any_of(registration.in.begin(), registration.in.end(), polled)) {
+        events |= EPOLLIN;
+    }
+    if (any_of(registration.out.begin(), registration.out.end(), polled)) {
+        events |= EPOLLOUT;
+    }
+    if (registration.registered and events == registration.events) {
+        return;
+    }
+
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd_num;
+    SystemCall("epoll_ctl",
+               ::epoll_ctl(_epoll->fd_num(), registration.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd_num, &event));
+    registration.registered = true;
+    registration.events = events;
+}
+
+void EventLoop::cancel_rule(const RuleIterator rule) {
+    rule->cancel();
+    if (_backend != Backend::Poll) {
+        if (rule->polled) {
+            _polled_rules--;
+        }
+        if (rule->interest) {
+            const auto it = find(_rules_with_interest.begin(), _rules_with_interest.end(), rule);
+            *it = _rules_with_interest.back();
+            _rules_with_interest.pop_back();
+        }
+    }
+    if (_backend == Backend::Epoll) {
+        const int fd_num = rule->fd.fd_num();
+        Registration &registration = _registrations.at(fd_num);
+        auto &rules = rule->direction == Direction::In ? registration.in : registration.out;
+        rules.erase(find(rules.begin(), rules.end(), rule));
+        sync_registration(fd_num);
+    } else if (_backend == Backend::IoUring) {
+        // forget the rule first, so that completions already posted for it are ignored
+        Rule::RingState &ring = rule->ring;
+        _rules_by_id.erase(rule->id);
+        cancel_request(*rule);
+        if (ring.offload) {
+            detach_offload(*rule);
+        }
+    }
+    _rules.erase(rule);
+}
+
+//! \returns `false` if the rule was canceled (because its fd reached EOF or was closed)
+bool EventLoop::run_callback(const RuleIterator rule) {
+    const auto count_before = rule->service_count();
+    rule->callback();
+
+    if ((rule->direction == Direction::In and rule->fd.eof()) or rule->fd.closed()) {
+        cancel_rule(rule);
+        return false;
+    }
+    if (count_before == rule->service_count() and rule->wants_events()) {
+        throw runtime_error("EventLoop: busy wait detected: callback did not read/write fd and is still interested");
+    }
+    return true;
+}
+
+//! \param[in] timeout_ms is the timeout value passed to [poll(2)](\ref man2::poll) or
+//!                       [epoll_wait(2)](\ref man2::epoll_wait) (shortened if a timer expires sooner);
+//!                       `wait_next_event` returns Result::Timeout if no fd is ready and no timer
+//!                       fires before the timeout expires.
+//! \returns Eventloop::Result indicating success, timeout, or no more Rule objects or timers to wait for.
+//! \details Timers that have already expired are fired first; if any did, the fds are only checked
+//! for readiness, without waiting.
+EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
+    bool fired = run_timers();
+    const int wait_ms = fired ? 0 : time_to_next_timer(timeout_ms);
+
+    Result result = wait_next_event_backend(wait_ms);
+    if (result == Result::Exit) {
+        if (_timers.empty()) {
+            return fired ? Result::Success : Result::Exit;
+        }
+        // nothing to poll, but a timer will fire: sleep until then (or until the caller's timeout)
+        if (wait_ms != 0) {
+            this_thread::sleep_for(chrono::milliseconds(time_to_next_timer(wait_ms)));
+        }
+        result = Result::Timeout;
+    }
+
+    fired |= run_timers();
+    return fired ? Result::Success : result;
+}
+
+//! \param[in] delay_ms is the time until the timer fires; a timer with a delay of 0 fires in the
+//!                     next millisecond
+//! \param[in] callback is called from wait_next_event() each time the timer fires
+//! \param[in] period_ms is the interval between firings of a periodic timer, or 0 for a one-shot timer
+EventLoop::TimerId EventLoop::add_timer(const uint64_t delay_ms, const CallbackT &callback, const uint64_t period_ms) {
+    const TimerId id = _next_timer_id++;
+    const uint64_t expiry = timestamp_ms() + delay_ms;
+    _timers.emplace(id, Timer{callback, expiry, period_ms, _timer_wheel.schedule(expiry, id)});
+    return id;
+}
+
+bool EventLoop::cancel_timer(const TimerId timer) {
+    const auto it = _timers.find(timer);
+    if (it == _timers.end()) {
+        return false;
+    }
+    _timer_wheel.cancel(it->second.entry);
+    _timers.erase(it);
+    return true;
+}
+
+//! \details A periodic timer that has fallen more than a period behind (e.g. because a callback took
+//! too long) skips the firings it missed rather than firing several times in a row.
+bool EventLoop::run_timers() {
+    const uint64_t now = timestamp_ms();
+    _due_timers.clear();
+    _timer_wheel.advance(now, [&](const uint64_t id) { _due_timers.push_back(id); });
+
+    // NOTE: callbacks may add and cancel timers (including the ones still waiting to be called)
+    bool fired = false;
+    for (const uint64_t id : _due_timers) {
+        const auto it = _timers.find(id);
+        if (it == _timers.end()) {
+            continue;
+        }
+        Timer &timer = it->second;
+        const CallbackT callback = timer.callback;
+        if (timer.period == 0) {
+            _timers.erase(it);
+        } else {
+            timer.expiry += timer.period;
+            if (timer.expiry <= now) {
+                timer.expiry = now + timer.period;
+            }
+            timer.entry = _timer_wheel.schedule(timer.expiry, id);
+        }
+        callback();
+        fired = true;
+    }
+    return fired;
+}
+
+int EventLoop::time_to_next_timer(const int timeout_ms) const {
+    const optional<uint64_t> next = _timer_wheel.next_expiry();
+    if (not next.has_value()) {
+        return timeout_ms;
+    }
+    // the wheel fires a timer no earlier than the millisecond after the one it was last advanced to
+    const uint64_t expiry = max(next.value(), _timer_wheel.now() + 1);
+    const uint64_t now = timestamp_ms();
+    const uint64_t remaining = expiry > now ? expiry - now : 0;
+    if (timeout_ms >= 0 and remaining >= uint64_t(timeout_ms)) {
+        return timeout_ms;
+    }
+    return static_cast<int>(min(remaining, uint64_t(numeric_limits<int>::max())));
+}
+
+EventLoop::Result EventLoop::wait_next_event_backend(const int timeout_ms) {
+    switch (_backend) {
+        case Backend::Epoll:
+            return wait_next_event_epoll(timeout_ms);
+        case Backend::IoUring:
+            return wait_next_event_io_uring(timeout_ms);
+        default:
+            return wait_next_event_poll(timeout_ms);
+    }
+}
+
+//! For each Rule, this function first calls Rule::interest (or, if there is none, checks Rule::interested);
+//! if `true`, Rule::fd is added to the list of file descriptors to be polled for readability
+//! (if Rule::direction == Direction::In) or writability (if Rule::direction == Direction::Out) unless
+//! Rule::fd has reached EOF, in which case the Rule is canceled (i.e., deleted from EventLoop::_rules).
 //!
 //! Next, this function calls [poll(2)](\ref man2::poll) with timeout value `timeout_ms`.
 //!
@@ -52,34 +358,33 @@ void EventLoop::add_rule(const FileDescriptor &fd,
 //!
 //! Otherwise, this function returns Result::Success.
 //!
-//! \b IMPORTANT: every call to Rule::callback must read from or write to Rule::fd, or the `interest`
-//! callback must stop returning true after the callback completes.
+//! \b IMPORTANT: every call to Rule::callback must read from or write to Rule::fd, or the rule must
+//! stop being interested (via its `interest` callback or EventLoop::set_interest) by the time the
+//! callback completes.
 //! If none of these conditions occur, EventLoop::wait_next_event will throw std::runtime_error. This is
 //! because [poll(2)](\ref man2::poll) is level triggered, so failing to act on a ready file descriptor
 //! will result in a busy loop (poll returns on a ready file descriptor; file descriptor is not read or
 //! written, so it is still ready; the next call to poll will immediately return).
-EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
+EventLoop::Result EventLoop::wait_next_event_poll(const int timeout_ms) {
     vector<pollfd> pollfds{};
     pollfds.reserve(_rules.size());
     bool something_to_poll = false;
 
     // set up the pollfd for each rule
-    for (auto it = _rules.cbegin(); it != _rules.cend();) {  // NOTE: it gets erased or incremented in loop body
+    for (auto it = _rules.begin(); it != _rules.end();) {  // NOTE: it gets erased or incremented in loop body
         const auto &this_rule = *it;
         if (this_rule.direction == Direction::In && this_rule.fd.eof()) {
             // no more reading on this rule, it's reached eof
-            this_rule.cancel();
-            it = _rules.erase(it);
+            cancel_rule(it++);
             continue;
         }
 
         if (this_rule.fd.closed()) {
-            this_rule.cancel();
-            it = _rules.erase(it);
+            cancel_rule(it++);
             continue;
         }
 
-        if (this_rule.interest()) {
+        if (this_rule.wants_events()) {
             pollfds.push_back({this_rule.fd.fd_num(), static_cast<short>(this_rule.direction), 0});
             something_to_poll = true;
         } else {
@@ -121,8 +426,7 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
             // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
             //   - if it was POLLIN and nothing is readable, no more will ever be readable
             //   - if it was POLLOUT, it will not be writable again
-            this_rule.cancel();
-            it = _rules.erase(it);
+            cancel_rule(it++);
             continue;
         }
 
@@ -132,7 +436,7 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
             this_rule.callback();
 
             // only check for busy wait if we're not canceling or exiting
-            if (count_before == this_rule.service_count() and this_rule.interest()) {
+            if (count_before == this_rule.service_count() and this_rule.wants_events()) {
                 throw runtime_error(
                     "EventLoop: busy wait detected: callback did not read/write fd and is still interested");
             }
@@ -143,3 +447,455 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
 
     return Result::Success;
 }
+
+//! \details Works like the Poll backend, except that the rules are not scanned: only rules with an
+//! interest callback are visited before waiting (to call that callback, or cancel them on EOF or
+//! closure), and only the fds reported by [epoll_wait(2)](\ref man2::epoll_wait) are visited after.
+//! A rule without an interest callback is canceled on EOF right after its callback runs. EPOLLERR cancels
+//! every rule of the fd, and EPOLLHUP its Direction::Out rules and the polled Direction::In rules with
+//! nothing left to read.
+EventLoop::Result EventLoop::wait_next_event_epoll(const int timeout_ms) {
+    // NOTE: walk backwards, because cancel_rule() moves the last entry into the canceled rule's place
+    for (size_t i = _rules_with_interest.size(); i-- > 0;) {
+        const RuleIterator rule = _rules_with_interest[i];
+        if ((rule->direction == Direction::In and rule->fd.eof()) or rule->fd.closed()) {
+            cancel_rule(rule);
+            continue;
+        }
+        set_polled(*rule, rule->interest());
+    }
+
+    // quit if there is nothing left to poll
+    if (_polled_rules == 0) {
+        return Result::Exit;
+    }
+
+    int ready_count = 0;
+    try {
+        ready_count =
+            SystemCall("epoll_wait", ::epoll_wait(_epoll->fd_num(), _ready.data(), _ready.size(), timeout_ms));
+    } catch (unix_error const &e) {
+        if (e.code().value() == EINTR) {
+            return Result::Exit;
+        }
+        throw;
+    }
+    if (ready_count == 0) {
+        return Result::Timeout;
+    }
+
+    for (int i = 0; i < ready_count; i++) {
+        const int fd_num = _ready[i].data.fd;
+        const uint32_t revents = _ready[i].events;
+
+        for (const Direction direction : {Direction::In, Direction::Out}) {
+            const auto found = _registrations.find(fd_num);
+            if (found == _registrations.end()) {
+                break;
+            }
+            _dispatching.clear();
+            for (const RuleIterator rule : direction == Direction::In ? found->second.in : found->second.out) {
+                _dispatching.push_back(rule->id);
+            }
+
+            for (const uint64_t id : _dispatching) {
+                // look the rule up again each time, since a callback may have changed the fd's rules
+                const auto registration = _registrations.find(fd_num);
+                if (registration == _registrations.end()) {
+                    break;
+                }
+                const auto &rules = direction == Direction::In ? registration->second.in : registration->second.out;
+                const auto it = find_if(rules.begin(), rules.end(), [&](const RuleIterator r) { return r->id == id; });
+                if (it == rules.end()) {
+                    continue;
+                }
+                const RuleIterator rule = *it;
+
+                // after an error, or a hangup of a writer, no callback can make progress; a reader that is
+                // still polled may have data left, and is canceled once its callback reaches EOF
+                const bool defunct = (revents & EPOLLERR) or ((revents & EPOLLHUP) and direction == Direction::Out);
+                const bool ready =
+                    not defunct and rule->polled and (revents & (direction == Direction::In ? EPOLLIN : EPOLLOUT));
+                if (defunct or ((revents & EPOLLHUP) and rule->polled and not ready)) {
+                    cancel_rule(rule);
+                    continue;
+                }
+                if (ready) {
+                    run_callback(rule);
+                }
+            }
+        }
+    }
+
+    return Result::Success;
+}
+
+//! \details Each pass evaluates the interest callbacks (as the Epoll backend does), makes one call to
+//! io_uring_enter that both submits every queued request and waits for completions, and then runs
+//! the callbacks of the rules the completions made runnable. A pass in which no callback runs (e.g. the
+//! only completion was for a rule that has since lost interest) is followed by another, until
+//! `timeout_ms` expires.
+EventLoop::Result EventLoop::wait_next_event_io_uring(const int timeout_ms) {
+    const uint64_t deadline = timestamp_ms() + max(timeout_ms, 0);
+    if (this_thread::get_id() != _submitter) {
+        // the kernel does the work of a request (e.g. copying received data) in the thread that
+        // submitted it, so move the requests to the thread that is now waiting for them
+        _submitter = this_thread::get_id();
+        for (Rule &rule : _rules) {
+            cancel_request(rule);
+            arm(rule);
+        }
+    }
+
+    while (true) {
+        // NOTE: walk backwards, because cancel_rule() moves the last entry into the canceled rule's place
+        for (size_t i = _rules_with_interest.size(); i-- > 0;) {
+            const RuleIterator rule = _rules_with_interest[i];
+            if ((rule->direction == Direction::In and rule->fd.eof()) or rule->fd.closed()) {
+                cancel_rule(rule);
+                continue;
+            }
+            set_polled(*rule, rule->interest());
+            arm(*rule);
+        }
+
+        // quit if there is nothing left to poll
+        if (_polled_rules == 0) {
+            return Result::Exit;
+        }
+
+        if (timeout_ms == 0 and _runnable.empty()) {
+            _ring->submit_and_get_events();  // like poll(2) with a zero timeout: check with the kernel
+        } else {
+            int wait_ms = timeout_ms;
+            if (not _runnable.empty()) {
+                wait_ms = 0;
+            } else if (timeout_ms > 0) {
+                wait_ms = static_cast<int>(deadline - min(deadline, timestamp_ms()));
+            }
+            if (not _ring->submit_and_wait(wait_ms)) {
+                return Result::Exit;
+            }
+        }
+        _ring->reap([&](const io_uring_cqe &completion) { complete(completion); });
+
+        if (run_runnable_rules()) {
+            return Result::Success;
+        }
+        if (timeout_ms >= 0 and timestamp_ms() >= deadline) {
+            return Result::Timeout;
+        }
+    }
+}
+
+//! \details Offloads receives for connected stream sockets and for datagram sockets, unless another rule
+//! or EventLoop already receives for the socket. Listening sockets and other fds are left to polls.
+void EventLoop::attach_offload(Rule &rule) {
+    const int fd_num = rule.fd.fd_num();
+    if (rule.fd.offload()) {
+        return;
+    }
+
+    int type = 0;
+    socklen_t length = sizeof(type);
+    if (::getsockopt(fd_num, SOL_SOCKET, SO_TYPE, &type, &length) < 0) {
+        return;  // not a socket
+    }
+    if (type == SOCK_STREAM) {
+        int listening = 0;
+        length = sizeof(listening);
+        sockaddr_storage peer{};
+        socklen_t peer_length = sizeof(peer);
+        if (::getsockopt(fd_num, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) < 0 or listening or
+            ::getpeername(fd_num, reinterpret_cast<sockaddr *>(&peer), &peer_length) < 0) {
+            return;
+        }
+        rule.ring.buffers = _ring->add_buffer_ring(STREAM_BUFFER_COUNT, STREAM_BUFFER_SIZE);
+    } else if (type == SOCK_DGRAM) {
+        if (not _datagram_buffers.has_value()) {
+            _datagram_buffers = _ring->add_buffer_ring(DATAGRAM_BUFFER_COUNT, DATAGRAM_BUFFER_SIZE);
+        }
+        rule.ring.buffers = _datagram_buffers.value();
+    } else {
+        return;
+    }
+
+    auto offload = make_shared<OffloadedIO>();
+    const uint16_t group = rule.ring.buffers;
+    offload->release = [this, group](const uint16_t id) { release_buffer(group, id); };
+    if (type == SOCK_DGRAM) {
+        offload->send = [this, fd_num](const sockaddr *destination,
+                                       const socklen_t destination_length,
+                                       const BufferViewList &payload) {
+            queue_send(fd_num, destination, destination_length, payload);
+        };
+    }
+    rule.fd.set_offload(offload);
+    rule.ring.offload = move(offload);
+}
+
+void EventLoop::detach_offload(Rule &rule) {
+    OffloadedIO &offload = *rule.ring.offload;
+    while (not offload.received.empty()) {
+        offload.pop();
+    }
+    if (rule.fd.offload() == rule.ring.offload) {
+        rule.fd.set_offload(nullptr);
+    }
+    if (rule.ring.buffers != _datagram_buffers) {
+        _ring->submit();  // cancel the receive before its buffers go away
+        _ring->remove_buffer_ring(rule.ring.buffers);
+    }
+    rule.ring.offload.reset();
+}
+
+//! \details Idempotent, so it can be called whenever a rule may have become interested.
+void EventLoop::arm(Rule &rule) {
+    if (not rule.polled) {
+        return;
+    }
+    Rule::RingState &ring = rule.ring;
+
+    if (ring.offload) {
+        const auto &received = ring.offload->received;
+        if (not received.empty()) {
+            make_runnable(rule);
+        }
+        const bool eof_received = not received.empty() and received.back().eof;
+        if (ring.request != 0 or ring.starved or eof_received) {
+            return;
+        }
+        const bool datagrams = static_cast<bool>(ring.offload->send);
+        ring.request = _next_id++;
+        _requests.emplace(ring.request, _rules_by_id.at(rule.id));
+        io_uring_sqe &entry = _ring->prepare(datagrams ? IORING_OP_RECVMSG : IORING_OP_RECV,
+                                             rule.fd.fd_num(),
+                                             user_data(Request::Receive, ring.request, ring.buffers));
+        entry.ioprio = IORING_RECV_MULTISHOT;
+        entry.flags = IOSQE_BUFFER_SELECT;
+        entry.buf_group = ring.buffers;
+        if (datagrams) {
+            entry.addr = reinterpret_cast<uint64_t>(&_recvmsg_header);
+            entry.len = 1;
+        }
+    } else if (rule.direction == Direction::Out and rule.fd.offload() and rule.fd.offload()->send) {
+        make_runnable(rule);  // sends are only queued, so the socket is always writable
+    } else if (ring.request == 0) {
+        ring.request = _next_id++;
+        _requests.emplace(ring.request, _rules_by_id.at(rule.id));
+        io_uring_sqe &entry =
+            _ring->prepare(IORING_OP_POLL_ADD, rule.fd.fd_num(), user_data(Request::Poll, ring.request));
+        entry.poll32_events = static_cast<uint32_t>(rule.direction);
+    }
+}
+
+//! \details Completions of the canceled request will be ignored.
+void EventLoop::cancel_request(Rule &rule) {
+    Rule::RingState &ring = rule.ring;
+    if (ring.request == 0) {
+        return;
+    }
+    io_uring_sqe &entry = _ring->prepare(IORING_OP_ASYNC_CANCEL, -1, user_data(Request::Cancel, ring.request));
+    entry.addr = user_data(ring.offload ? Request::Receive : Request::Poll, ring.request, ring.buffers);
+    _requests.erase(ring.request);
+    ring.request = 0;
+}
+
+void EventLoop::make_runnable(Rule &rule) {
+    if (not rule.ring.runnable) {
+        rule.ring.runnable = true;
+        _runnable.push_back(rule.id);
+    }
+}
+
+void EventLoop::release_buffer(const uint16_t group, const uint16_t id) {
+    _ring->release_buffer(group, id);
+
+    vector<uint64_t> starved{};
+    swap(starved, _starved);
+    for (const uint64_t rule_id : starved) {
+        const auto found = _rules_by_id.find(rule_id);
+        if (found != _rules_by_id.end()) {
+            found->second->ring.starved = false;
+            arm(*found->second);
+        }
+    }
+}
+
+//! \param[in] fd_num is the datagram socket to send from
+//! \param[in] destination is the address to send to, or `nullptr` for a connected socket
+//! \param[in] length is the size of `destination`
+//! \param[in] payload is the datagram, which is copied
+void EventLoop::queue_send(const int fd_num,
+                           const sockaddr *destination,
+                           const socklen_t length,
+                           const BufferViewList &payload) {
+    auto send = make_unique<PendingSend>();
+    for (const iovec &piece : payload.as_iovecs()) {
+        send->payload.append(static_cast<const char *>(piece.iov_base), piece.iov_len);
+    }
+    send->iov.iov_base = send->payload.data();
+    send->iov.iov_len = send->payload.size();
+    send->message.msg_iov = &send->iov;
+    send->message.msg_iovlen = 1;
+    if (destination) {
+        if (length > sizeof(send->destination)) {
+            throw runtime_error("invalid sockaddr size");
+        }
+        memcpy(&send->destination, destination, length);
+        send->message.msg_name = &send->destination;
+        send->message.msg_namelen = length;
+    }
+
+    const uint64_t id = _next_id++;
+    io_uring_sqe &entry = _ring->prepare(IORING_OP_SENDMSG, fd_num, user_data(Request::Send, id));
+    entry.addr = reinterpret_cast<uint64_t>(&send->message);
+    entry.len = 1;
+    _sends.emplace(id, move(send));
+}
+
+void EventLoop::complete(const io_uring_cqe &completion) {
+    const auto kind = static_cast<Request>(completion.user_data >> 56);
+    const auto group = static_cast<uint16_t>(completion.user_data >> 40);
+    const uint64_t id = completion.user_data & ((uint64_t{1} << 40) - 1);
+    const int result = completion.res;
+
+    if (kind == Request::Cancel) {
+        return;
+    }
+    if (kind == Request::Send) {
+        const auto found = _sends.find(id);
+        if (found == _sends.end()) {
+            // already accounted for (e.g. by the destructor, which waits for the sends still in flight)
+            return;
+        }
+        const size_t expected = found->second->payload.size();
+        _sends.erase(found);
+        if (result < 0) {
+            throw unix_error("sendmsg", -result);
+        }
+        if (size_t(result) != expected) {
+            throw runtime_error("datagram payload too big for sendmsg()");
+        }
+        return;
+    }
+
+    const bool has_buffer = completion.flags & IORING_CQE_F_BUFFER;
+    const auto buffer_id = static_cast<uint16_t>(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+    const auto found = _requests.find(id);
+    if (found == _requests.end()) {
+        // the request was canceled after this completion was posted
+        if (has_buffer and _ring->has_buffer_ring(group)) {
+            _ring->release_buffer(group, buffer_id);
+        }
+        return;
+    }
+    Rule &rule = *found->second;
+    const bool finished = kind == Request::Poll or not(completion.flags & IORING_CQE_F_MORE);
+    if (finished) {
+        _requests.erase(found);
+        rule.ring.request = 0;
+    }
+    if (result == -ECANCELED) {
+        arm(rule);  // the thread that submitted the request exited; submit it again from this one
+        return;
+    }
+
+    if (kind == Request::Poll) {
+        if (result < 0) {
+            throw unix_error("poll", -result);
+        }
+        rule.ring.revents = result;
+        make_runnable(rule);
+        return;
+    }
+
+    // a multishot receive: keeps going until the kernel says otherwise
+    OffloadedIO &offload = *rule.ring.offload;
+    if (result == -ENOBUFS) {
+        // every buffer is waiting to be read; restart once one is released
+        rule.ring.starved = true;
+        _starved.push_back(rule.id);
+        return;
+    }
+    if (result < 0) {
+        throw unix_error(offload.send ? "recvmsg" : "recv", -result);
+    }
+
+    OffloadedIO::Chunk chunk{};
+    if (not has_buffer) {
+        chunk.eof = true;
+    } else {
+        const char *const buffer = _ring->buffer(group, buffer_id);
+        chunk.buffer_id = buffer_id;
+        if (offload.send) {
+            // see "Multishot" in recvmsg's part of io_uring_enter(2) for the layout
+            const auto *const header = reinterpret_cast<const io_uring_recvmsg_out *>(buffer);
+            const char *const name = buffer + sizeof(io_uring_recvmsg_out);
+            const char *const payload = name + _recvmsg_header.msg_namelen + _recvmsg_header.msg_controllen;
+            if (header->flags & MSG_TRUNC) {
+                _ring->release_buffer(group, buffer_id);
+                throw runtime_error("recvmsg (oversized datagram)");
+            }
+            chunk.source = {name, min<size_t>(header->namelen, _recvmsg_header.msg_namelen)};
+            chunk.data = {payload, header->payloadlen};
+        } else {
+            chunk.data = {buffer, size_t(result)};
+        }
+    }
+    offload.received.push_back(chunk);
+    arm(rule);
+}
+
+//! \details An In rule with offloaded receives has its callback called until it has read everything
+//! received or loses interest; any other rule has its callback called once, if its poll reported it ready.
+bool EventLoop::run_runnable_rules() {
+    _running.clear();
+    swap(_running, _runnable);
+
+    bool ran = false;
+    for (const uint64_t id : _running) {
+        const auto found = _rules_by_id.find(id);
+        if (found == _rules_by_id.end()) {
+            continue;
+        }
+        const RuleIterator rule = found->second;
+        rule->ring.runnable = false;
+        if (not rule->polled) {
+            continue;  // arm() lists it again once it is interested
+        }
+
+        if (rule->ring.offload) {
+            while (not rule->ring.offload->received.empty() and rule->wants_events()) {
+                ran = true;
+                if (not run_callback(rule)) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        bool ready = true;
+        if (not(rule->direction == Direction::Out and rule->fd.offload() and rule->fd.offload()->send)) {
+            const uint32_t revents = exchange(rule->ring.revents, 0);
+            if (revents & (POLLERR | POLLNVAL)) {
+                throw runtime_error("EventLoop: error on polled file descriptor");
+            }
+            ready = revents & static_cast<uint32_t>(rule->direction);
+            if ((revents & POLLHUP) and not ready) {
+                // only a hangup: this rule can never fire again (see the Poll backend)
+                cancel_rule(rule);
+                ran = true;
+                continue;
+            }
+        }
+        if (ready) {
+            ran = true;
+            if (not run_callback(rule)) {
+                continue;
+            }
+        }
+        arm(*rule);
+    }
+    return ran;
+}
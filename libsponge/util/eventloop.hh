@@ -2,11 +2,26 @@
 #define SPONGE_LIBSPONGE_EVENTLOOP_HH
 
 #include "file_descriptor.hh"
+#include "offloaded_io.hh"
+#include "timer_wheel.hh"
 
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <list>
+#include <memory>
+#include <optional>
 #include <poll.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class IoUring;
+struct io_uring_cqe;
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop {
@@ -17,6 +32,20 @@ class EventLoop {
         Out = POLLOUT  //!< Callback will be triggered when Rule::fd is writable.
     };
 
+    //! Mechanism used by EventLoop::wait_next_event to wait for file descriptors.
+    enum class Backend {
+        Poll,    //!< Collect every Rule::fd and call [poll(2)](\ref man2::poll) on each wait.
+        Epoll,   //!< Register each Rule::fd once with [epoll(7)](\ref man7::epoll); each wait visits only ready fds.
+        IoUring  //!< Submit polls, socket receives and datagram sends to an IoUring; see the class documentation.
+    };
+
+    //! Returned by each call to EventLoop::wait_next_event.
+    enum class Result {
+        Success,  //!< At least one Rule or timer was triggered.
+        Timeout,  //!< No rules or timers were triggered before timeout.
+        Exit      //!< No timers are pending and all rules have been canceled or were uninterested.
+    };
+
   private:
     using CallbackT = std::function<void(void)>;  //!< Callback for ready Rule::fd
     using InterestT = std::function<bool(void)>;  //!< `true` return indicates Rule::fd should be polled.
@@ -25,52 +54,277 @@ class EventLoop {
     //! \details Created by calling EventLoop::add_rule() or EventLoop::add_cancelable_rule().
     class Rule {
       public:
-        FileDescriptor fd;    //!< FileDescriptor to monitor for activity.
-        Direction direction;  //!< Direction::In for reading from fd, Direction::Out for writing to fd.
-        CallbackT callback;   //!< A callback that reads or writes fd.
-        InterestT interest;   //!< A callback that returns `true` whenever fd should be polled.
-        CallbackT cancel;     //!< A callback that is called when the rule is cancelled (e.g. on hangup)
+        FileDescriptor fd;      //!< FileDescriptor to monitor for activity.
+        Direction direction;    //!< Direction::In for reading from fd, Direction::Out for writing to fd.
+        CallbackT callback;     //!< A callback that reads or writes fd.
+        InterestT interest;     //!< A callback that returns `true` whenever fd should be polled (may be empty).
+        CallbackT cancel;       //!< A callback that is called when the rule is cancelled (e.g. on hangup)
+        bool interested{true};  //!< Interest of a rule without an interest callback; see EventLoop::set_interest.
+        bool polled{false};     //!< Whether fd is registered for this rule's direction (Epoll backend only).
+        uint64_t id{0};         //!< Identifies the rule (Epoll and IoUring backends)
+
+        //! State of a rule in the IoUring backend
+        struct RingState {
+            uint64_t request{0};                     //!< Id of the outstanding poll or receive, or 0 if none
+            bool runnable{false};                    //!< Whether the rule is listed in EventLoop::_runnable
+            bool starved{false};                     //!< Whether the rule's receive stopped for lack of buffers
+            uint32_t revents{0};                     //!< Result of the last completed poll, until the callback runs
+            uint16_t buffers{0};                     //!< Buffer group that receives for the rule draw from
+            std::shared_ptr<OffloadedIO> offload{};  //!< For an In rule on a socket: what its receives produced
+        } ring{};                                    //!< (IoUring backend only)
 
         //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
         //! \details This function is used internally by EventLoop; you will not need to call it
         unsigned int service_count() const;
+
+        //! Returns the result of Rule::interest, or Rule::interested if there is no interest callback.
+        bool wants_events() const { return interest ? interest() : interested; }
+    };
+
+    using RuleIterator = std::list<Rule>::iterator;  //!< Position of a Rule in EventLoop::_rules
+
+    //! The rules watching one fd, for the Epoll backend
+    struct Registration {
+        std::vector<RuleIterator> in{};   //!< The Direction::In rules, in the order they were added
+        std::vector<RuleIterator> out{};  //!< The Direction::Out rules, in the order they were added
+        uint32_t events{0};               //!< The events currently requested from the kernel
+        bool registered{false};           //!< Whether the fd has been added to the epoll instance
     };
 
     std::list<Rule> _rules{};  //!< All rules that have been added and not canceled.
 
+    Backend _backend;  //!< How wait_next_event() waits for file descriptors
+
+    //! \name State of the Epoll backend
+    //!@{
+    std::optional<FileDescriptor> _epoll{};                  //!< The epoll instance
+    std::unordered_map<int, Registration> _registrations{};  //!< Rules by fd number
+    std::vector<RuleIterator> _rules_with_interest{};        //!< Rules whose Rule::interest must be called each wait
+    size_t _polled_rules{0};                                 //!< Number of rules with Rule::polled set
+    std::vector<epoll_event> _ready{};                       //!< Buffer for the results of epoll_wait
+    std::vector<uint64_t> _dispatching{};                    //!< Ids of the rules of the fd being dispatched
+    //!@}
+
+    //! A datagram handed to the IoUring backend by UDPSocket::sendto, kept until the kernel has sent it
+    struct PendingSend {
+        sockaddr_storage destination{};  //!< Copy of the destination address
+        std::string payload{};           //!< Copy of the datagram
+        iovec iov{};                     //!< Points at `payload`
+        msghdr message{};                //!< Points at `destination` (if given) and `iov`
+    };
+
+    //! \name State of the IoUring backend
+    //!@{
+    std::unique_ptr<IoUring> _ring{};                                     //!< The io_uring instance
+    std::unordered_map<uint64_t, RuleIterator> _rules_by_id{};            //!< Rules by Rule::id          
+    std::unordered_map<uint64_t, RuleIterator> _requests{};               //!< Rules by Rule::RingState::request
+    std::thread::id _submitter{std::this_thread::get_id()};               //!< Thread that owns the outstanding requests
+    uint64_t _next_id{1};                                                 //!< Id of the next rule or send
+    std::vector<uint64_t> _runnable{};                                    //!< Rules whose callback can run at once
+    std::vector<uint64_t> _running{};                                     //!< _runnable of the batch being dispatched
+    std::vector<uint64_t> _starved{};                                     //!< Rules waiting for a buffer to be released
+    std::optional<uint16_t> _datagram_buffers{};                          //!< Buffer group shared by datagram sockets
+    std::unordered_map<uint64_t, std::unique_ptr<PendingSend>> _sends{};  //!< Sends not yet completed
+    msghdr _recvmsg_header{};                                             //!< Layout of multishot recvmsg results
+    //!@}
+
+    //! A timer added by add_timer()
+    struct Timer {
+        CallbackT callback;                   //!< Called when the timer fires
+        uint64_t expiry;                      //!< When the timer fires next, in timestamp_ms() time
+        uint64_t period;                      //!< Interval between firings, or 0 for a one-shot timer
+        TimerWheel<uint64_t>::TimerId entry;  //!< The timer's entry in _timer_wheel
+    };
+
+    //! \name Timers (all backends)
+    //!@{
+    std::unordered_map<uint64_t, Timer> _timers{};  //!< Pending timers, by the id returned from add_timer()
+    TimerWheel<uint64_t> _timer_wheel;              //!< Expiry times of _timers, keyed by timer id
+    uint64_t _next_timer_id{1};                     //!< Id of the next timer to be added
+    std::vector<uint64_t> _due_timers{};            //!< Timers found expired by the current run_timers()
+    //!@}
+
+    //! Fire the timers that have expired; returns `true` if any did.
+    bool run_timers();
+
+    //! Milliseconds until the next timer fires, limited to `timeout_ms` (which may be -1, meaning no limit).
+    int time_to_next_timer(const int timeout_ms) const;
+
+    //! wait_next_event() for the chosen backend, without running timers
+    Result wait_next_event_backend(const int timeout_ms);
+
+    //! Call a rule's cancel callback and delete it.
+    void cancel_rule(const RuleIterator rule);
+
+    //! Run a rule's callback, cancel the rule on EOF or closure, and check for a busy wait.
+    bool run_callback(const RuleIterator rule);
+
+    //! Bring the epoll instance's entry for an fd up to date with its rules (Epoll backend only).
+    void sync_registration(const int fd_num);
+
+    //! Set Rule::polled, and update the registration of the rule's fd to match (Epoll backend only).
+    void set_polled(Rule &rule, const bool polled);
+
+    //! wait_next_event() for the Poll backend
+    Result wait_next_event_poll(const int timeout_ms);
+
+    //! wait_next_event() for the Epoll backend
+    Result wait_next_event_epoll(const int timeout_ms);
+
+    //! wait_next_event() for the IoUring backend
+    Result wait_next_event_io_uring(const int timeout_ms);
+
+    //! \name Helpers for the IoUring backend
+    //!@{
+
+    //! If the rule's fd is a socket that can be received from, start receiving into an OffloadedIO.
+    void attach_offload(Rule &rule);
+
+    //! Stop receiving for a rule and give back the buffers its OffloadedIO holds.
+    void detach_offload(Rule &rule);
+
+    //! Make sure a polled rule will be noticed: start a poll or receive for it, or list it in _runnable.
+    void arm(Rule &rule);
+
+    //! Cancel a rule's outstanding poll or receive, if any.
+    void cancel_request(Rule &rule);
+
+    //! List a rule in _runnable, if it isn't already.
+    void make_runnable(Rule &rule);
+
+    //! Give a buffer back to the kernel, and restart receives that ran out of buffers.
+    void release_buffer(const uint16_t group, const uint16_t id);
+
+    //! Queue a datagram to be sent by the next io_uring_enter.
+    void queue_send(const int fd_num,
+                    const sockaddr *destination,
+                    const socklen_t length,
+                    const BufferViewList &payload);
+
+    //! Act on one completion.
+    void complete(const io_uring_cqe &completion);
+
+    //! Run the callbacks of the rules in _runnable; returns `true` if any callback ran.
+    bool run_runnable_rules();
+    //!@}
+
   public:
-    //! Returned by each call to EventLoop::wait_next_event.
-    enum class Result {
-        Success,  //!< At least one Rule was triggered.
-        Timeout,  //!< No rules were triggered before timeout.
-        Exit  //!< All rules have been canceled or were uninterested; make no further calls to EventLoop::wait_next_event.
+    //! \brief A reference to a rule, returned by EventLoop::add_rule.
+    //! \note Becomes invalid when the rule is canceled.
+    class RuleHandle {
+        friend class EventLoop;
+        RuleIterator _rule;
+        explicit RuleHandle(const RuleIterator rule) : _rule(rule) {}
     };
 
-    //! Add a rule whose callback will be called when `fd` is ready in the specified Direction.
-    void add_rule(const FileDescriptor &fd,
-                  const Direction direction,
-                  const CallbackT &callback,
-                  const InterestT &interest = [] { return true; },
-                  const CallbackT &cancel = [] {});
+    //! Construct an EventLoop that waits using the given backend.
+    explicit EventLoop(const Backend backend = Backend::Poll);
 
-    //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+    //! Detach from sockets whose I/O was offloaded, and wait for queued datagrams to be sent (IoUring backend).
+    ~EventLoop();
+
+    //! \name
+    //! An EventLoop cannot be copied or moved
+    //!@{
+    EventLoop(const EventLoop &other) = delete;
+    EventLoop &operator=(const EventLoop &other) = delete;
+    EventLoop(EventLoop &&other) = delete;
+    EventLoop &operator=(EventLoop &&other) = delete;
+    //!@}
+
+    //! \brief Add a rule whose callback will be called when `fd` is ready in the specified Direction.
+    //! \returns a handle that can be passed to set_interest() if no `interest` callback is given
+    RuleHandle add_rule(const FileDescriptor &fd,
+                        const Direction direction,
+                        const CallbackT &callback,
+                        const InterestT &interest = {},
+                        const CallbackT &cancel = [] {});
+
+    //! \brief Start or stop polling the fd of a rule that was added without an interest callback.
+    //! \details Rules start out interested. With the Epoll backend this is the cheap way to change
+    //! interest, because rules with an interest callback have that callback called on every wait.
+    void set_interest(const RuleHandle &rule, const bool interested);
+
+    //! Waits for rules' fds to become ready (using the backend chosen at construction) or timers to
+    //! expire, and then executes the callback for each ready fd and expired timer.
     Result wait_next_event(const int timeout_ms);
+
+    //! \name Timers
+    //!@{
+
+    //! Identifies a timer added with add_timer()
+    using TimerId = uint64_t;
+
+    //! A TimerId that never refers to a pending timer
+    static constexpr TimerId NO_TIMER = 0;
+
+    //! \brief Call `callback` from wait_next_event() once `delay_ms` milliseconds have passed
+    //! \param[in] period_ms, if nonzero, makes the timer periodic: it fires again every `period_ms` ms until
+    //!            it is canceled
+    //! \returns a handle that can be passed to cancel_timer()
+    TimerId add_timer(const uint64_t delay_ms, const CallbackT &callback, const uint64_t period_ms = 0);
+
+    //! \brief Stop a timer from firing (again)
+    //! \returns `true` if the timer was pending, `false` if it had already fired (or `timer` is NO_TIMER)
+    bool cancel_timer(const TimerId timer);
+
+    //! Number of timers that have not fired or been canceled (periodic timers are always pending)
+    size_t pending_timers() const { return _timers.size(); }
+    //!@}
 };
 
 using Direction = EventLoop::Direction;
 
 //! \class EventLoop
 //!
-//! An EventLoop holds a std::list of Rule objects. Each time EventLoop::wait_next_event is
-//! executed, the EventLoop uses the Rule objects to construct a call to [poll(2)](\ref man2::poll).
+//! An EventLoop holds a std::list of Rule objects. With the default Backend::Poll, each time
+//! EventLoop::wait_next_event is executed, the EventLoop uses the Rule objects to construct a call
+//! to [poll(2)](\ref man2::poll).
 //!
 //! When a Rule is installed using EventLoop::add_rule, it will be polled for the specified Rule::direction
-//! whenver the Rule::interest callback returns `true`, until Rule::fd is no longer readable
+//! whenver the Rule::interest callback returns `true` (or, for a rule without one, while it is
+//! interested according to EventLoop::set_interest), until Rule::fd is no longer readable
 //! (for Rule::direction == Direction::In) or writable (for Rule::direction == Direction::Out).
 //! Once this occurs, the Rule is canceled, i.e., the EventLoop deletes it.
 //!
 //! A Rule installed using EventLoop::add_cancelable_rule will be polled and canceled under the
 //! same conditions, with the additional condition that if Rule::callback returns `true`, the
 //! Rule will be canceled.
+//!
+//! With Backend::Epoll, each fd is registered with the kernel once, when its first rule is added,
+//! and wait_next_event only visits the fds that are ready plus the rules that have an interest
+//! callback. This makes a wait cost O(ready fds) rather than O(all fds), which matters for loops
+//! with many mostly-idle fds (like `bouncer`). Further rules for a registered fd share its registration.
+//! The differences from Backend::Poll are:
+//!   - an error on the fd cancels its rules instead of throwing, and a hangup cancels its Direction::Out
+//!     rules whether or not they are polled (a Direction::In rule is kept while it may still have data);
+//!   - the fd must support epoll, so regular files (e.g. a redirected stdin) are refused;
+//!   - a rule without an interest callback is checked for EOF only after its callback runs, and
+//!     is not canceled if its fd is closed through another FileDescriptor (the kernel silently
+//!     drops closed fds from the epoll instance).
+//!
+//! Backend::IoUring goes further and moves the I/O itself into an IoUring, so that one call to
+//! io_uring_enter per wait replaces the readiness check and most of the reads and writes:
+//!   - a Direction::In rule on a connected stream socket or a datagram socket gets a multishot
+//!     receive that fills buffers from a provided buffer ring. The received data is attached to the
+//!     socket as an OffloadedIO, and the rule's callback is called while data is waiting; its reads
+//!     (FileDescriptor::read, UDPSocket::recv) copy from the buffers without a system call, and fail
+//!     with `EAGAIN` if they ask for more than has arrived. Each stream socket gets its own small
+//!     buffer ring, so its receives stop (and flow control takes over) while its rule is uninterested;
+//!     datagram sockets share one ring.
+//!   - while a datagram socket is attached, UDPSocket::sendto and UDPSocket::send copy the datagram
+//!     and queue it, and the next wait submits everything queued in the same io_uring_enter. Such a
+//!     socket is always considered writable, so Direction::Out rules on it are not polled at all.
+//!     Errors from these sends are thrown by a later wait_next_event.
+//!   - other rules (pipes, TUN/TAP devices, stream writes) use one-shot polls, re-armed after each
+//!     callback while the rule is interested.
+//!
+//! The Epoll caveats apply to Backend::IoUring as well, except for the handling of errors (only the first
+//! Direction::In rule on a socket has its receives offloaded).
+//!
+//! Timers added with EventLoop::add_timer are kept in a TimerWheel. Whatever the backend, the time to the
+//! earliest timer bounds the wait for file descriptors, so a loop with nothing to do sleeps until its next
+//! timer instead of waking up periodically to check. A loop with pending timers doesn't return
+//! Result::Exit, even if it has no rules left to poll.
 
 #endif  // SPONGE_LIBSPONGE_EVENTLOOP_HH
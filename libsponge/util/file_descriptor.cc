@@ -1,11 +1,15 @@
 #include "file_descriptor.hh"
 
+#include "byte_ring.hh"
+#include "offloaded_io.hh"
 #include "util.hh"
 
 #include <algorithm>
+#include <cerrno>
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
+#include <sys/stat.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
@@ -49,6 +53,14 @@ FileDescriptor FileDescriptor::duplicate() const { return FileDescriptor(_intern
 void FileDescriptor::read(std::string &str, const size_t limit) {
     constexpr size_t BUFFER_SIZE = 1024 * 1024;  // maximum size of a read
     const size_t size_to_read = min(BUFFER_SIZE, limit);
+    if (_internal_fd->_offload) {
+        read_offloaded(str, size_to_read);
+        return;
+    }
+    if (_internal_fd->_rings) {
+        read_ring(str, size_to_read);
+        return;
+    }
     str.resize(size_to_read);
 
     ssize_t bytes_read = SystemCall("read", ::read(fd_num(), str.data(), size_to_read));
@@ -63,6 +75,58 @@ void FileDescriptor::read(std::string &str, const size_t limit) {
     register_read();
 }
 
+//! \param[out] str is the string to be read
+//! \param[in] limit is the maximum number of bytes to read; fewer bytes may be returned
+//! \details Reads datagrams as if they were a stream. Throws a unix_error (`EAGAIN`) if nothing has been
+//! received, as a non-blocking fd would.
+void FileDescriptor::read_offloaded(string &str, const size_t limit) {
+    OffloadedIO &offload = *_internal_fd->_offload;
+    if (limit > 0 and offload.received.empty()) {
+        throw unix_error("read", EAGAIN);
+    }
+
+    str.clear();
+    while (str.size() < limit and not offload.received.empty()) {
+        OffloadedIO::Chunk &chunk = offload.received.front();
+        if (chunk.eof) {
+            if (str.empty()) {
+                _internal_fd->_eof = true;
+                offload.pop();
+            }
+            break;
+        }
+        const size_t amount = min(limit - str.size(), chunk.data.size());
+        str.append(chunk.data.substr(0, amount));
+        chunk.data.remove_prefix(amount);
+        if (chunk.data.empty()) {
+            offload.pop();
+        }
+    }
+
+    register_read();
+}
+
+//! \param[out] str is the string to be read
+//! \param[in] limit is the maximum number of bytes to read; fewer bytes may be returned
+//! \details Blocks while the ring is empty, unless the file descriptor is non-blocking, in which case it
+//! throws a unix_error (`EAGAIN`) as a socket would.
+void FileDescriptor::read_ring(string &str, const size_t limit) {
+    ByteRing &ring = *_internal_fd->_rings->in;
+    ring.pop(str, limit);
+    while (limit > 0 and str.empty() and not ring.eof()) {
+        if (not blocking()) {
+            throw unix_error("read", EAGAIN);
+        }
+        ring.wait_for_data();
+        ring.pop(str, limit);
+    }
+    if (limit > 0 and str.empty()) {
+        _internal_fd->_eof = true;
+    }
+
+    register_read();
+}
+
 //! \param[in] limit is the maximum number of bytes to read; fewer bytes may be returned
 //! \returns a vector of bytes read
 string FileDescriptor::read(const size_t limit) {
@@ -74,6 +138,10 @@ string FileDescriptor::read(const size_t limit) {
 }
 
 size_t FileDescriptor::write(BufferViewList buffer, const bool write_all) {
+    if (_internal_fd->_rings) {
+        return write_ring(move(buffer), write_all);
+    }
+
     size_t total_bytes_written = 0;
 
     do {
@@ -98,6 +166,58 @@ size_t FileDescriptor::write(BufferViewList buffer, const bool write_all) {
     return total_bytes_written;
 }
 
+//! \details Blocks while the ring is full, even if the file descriptor is non-blocking: the eventfd
+//! behind it is always ready for Direction::Out, so a poller would otherwise spin on a full ring.
+size_t FileDescriptor::write_ring(BufferViewList buffer, const bool write_all) {
+    ByteRing &ring = *_internal_fd->_rings->out;
+    size_t total_bytes_written = 0;
+    while (true) {
+        const size_t bytes_written = ring.push(buffer);
+        register_write();
+        buffer.remove_prefix(bytes_written);
+        total_bytes_written += bytes_written;
+
+        if (buffer.size() == 0 or (not write_all and total_bytes_written > 0)) {
+            return total_bytes_written;
+        }
+        ring.wait_for_room();
+    }
+}
+
+//! \param[in] destination is where the bytes go
+//! \param[in] limit is the most bytes to move
+//! \details Doesn't block on the pipe (the other descriptor blocks as it is set to). Sets this descriptor's
+//! EOF flag if it is at the end.
+size_t FileDescriptor::splice_to(FileDescriptor &destination, const size_t limit) {
+    const ssize_t moved = SystemCall(
+        "splice",
+        static_cast<int>(::splice(
+            fd_num(), nullptr, destination.fd_num(), nullptr, limit, SPLICE_F_MOVE | SPLICE_F_NONBLOCK)),
+        EAGAIN);
+    register_read();
+    destination.register_write();
+    if (moved == 0 and limit > 0) {
+        _internal_fd->_eof = true;
+    }
+    return moved > 0 ? moved : 0;
+}
+
+//! \details A ring_pair() end, or a descriptor whose I/O an EventLoop performs, isn't: its bytes don't go
+//! through the kernel. Nor is a terminal or other character device, or a descriptor opened with `O_APPEND`,
+//! which [splice(2)](\ref man2::splice) refuses to write to.
+bool FileDescriptor::spliceable() const {
+    if (offload() or rings() or (SystemCall("fcntl", fcntl(fd_num(), F_GETFL)) & O_APPEND)) {
+        return false;
+    }
+    struct stat status {};
+    SystemCall("fstat", fstat(fd_num(), &status));
+    return S_ISFIFO(status.st_mode) or S_ISSOCK(status.st_mode) or S_ISREG(status.st_mode);
+}
+
+bool FileDescriptor::blocking() const {
+    return (SystemCall("fcntl", fcntl(fd_num(), F_GETFL)) & O_NONBLOCK) == 0;
+}
+
 void FileDescriptor::set_blocking(const bool blocking_state) {
     int flags = SystemCall("fcntl", fcntl(fd_num(), F_GETFL));
     if (blocking_state) {
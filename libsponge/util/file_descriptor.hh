@@ -7,6 +7,11 @@
 #include <cstddef>
 #include <limits>
 #include <memory>
+#include <string>
+#include <utility>
+
+struct OffloadedIO;
+struct RingStream;
 
 //! A reference-counted handle to a file descriptor
 class FileDescriptor {
@@ -20,6 +25,12 @@ class FileDescriptor {
         unsigned _read_count = 0;   //!< The number of times FDWrapper::_fd has been read
         unsigned _write_count = 0;  //!< The numberof times FDWrapper::_fd has been written
 
+        //! I/O that an EventLoop performs on FDWrapper::_fd's behalf, if any
+        std::shared_ptr<OffloadedIO> _offload{};
+
+        //! In-process rings that reads and writes go to instead of FDWrapper::_fd, if any (see ring_pair())
+        std::shared_ptr<RingStream> _rings{};
+
         //! Construct from a file descriptor number returned by the kernel
         explicit FDWrapper(const int fd);
         //! Closes the file descriptor upon destruction
@@ -48,6 +59,18 @@ class FileDescriptor {
     void register_read() { ++_internal_fd->_read_count; }    //!< increment read count
     void register_write() { ++_internal_fd->_write_count; }  //!< increment write count
 
+    //! Read from data an EventLoop has already received (see OffloadedIO)
+    void read_offloaded(std::string &str, const size_t limit);
+
+    //! Read from the ring that this end of a ring_pair() reads from
+    void read_ring(std::string &str, const size_t limit);
+
+    //! Write to the ring that this end of a ring_pair() writes to
+    size_t write_ring(BufferViewList buffer, const bool write_all);
+
+    //! Whether the file descriptor is in blocking mode
+    bool blocking() const;
+
   public:
     //! Construct from a file descriptor number returned by the kernel
     explicit FileDescriptor(const int fd);
@@ -70,6 +93,14 @@ class FileDescriptor {
     //! Write a buffer (or list of buffers), possibly blocking until all is written
     size_t write(BufferViewList buffer, const bool write_all = true);
 
+    //! \brief Move up to `limit` bytes to `destination` inside the kernel, with [splice(2)](\ref man2::splice)
+    //! \details One of the two must be a pipe, and both must be spliceable().
+    //! \returns the number of bytes moved (0 at EOF, or if neither side is ready)
+    size_t splice_to(FileDescriptor &destination, const size_t limit);
+
+    //! Whether the descriptor is a kernel pipe, socket or regular file that splice_to() can use
+    bool spliceable() const;
+
     //! Close the underlying file descriptor
     void close() { _internal_fd->close(); }
 
@@ -96,8 +127,22 @@ class FileDescriptor {
 
     //! number of writes
     unsigned int write_count() const { return _internal_fd->_write_count; }
+
+    //! I/O offloaded to an EventLoop, or `nullptr`
+    const std::shared_ptr<OffloadedIO> &offload() const { return _internal_fd->_offload; }
+
+    //! Rings that stand in for the kernel, or `nullptr`
+    const std::shared_ptr<RingStream> &rings() const { return _internal_fd->_rings; }
     //!@}
 
+    //! \brief Have reads (and, for datagram sockets, sends) served by an EventLoop, or stop if `nullptr`
+    //! \note Called by EventLoop; applies to every duplicate of this FileDescriptor.
+    void set_offload(std::shared_ptr<OffloadedIO> offload) { _internal_fd->_offload = std::move(offload); }
+
+    //! \brief Have reads and writes (and Socket::shutdown) go to `rings` instead of the kernel
+    //! \note Called by ring_pair(); applies to every duplicate of this FileDescriptor.
+    void set_rings(std::shared_ptr<RingStream> rings) { _internal_fd->_rings = std::move(rings); }
+
     //! \name Copy/move constructor/assignment operators
     //! FileDescriptor can be moved, but cannot be copied (but see duplicate())
     //!@{
@@ -0,0 +1,218 @@
+#include "io_uring.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <limits>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+//! \param[in] fd is the io_uring instance, or -1 for anonymous memory
+//! \param[in] size is the length of the mapping in bytes
+//! \param[in] offset selects the region of the io_uring instance (e.g. `IORING_OFF_SQ_RING`)
+IoUring::Mapping::Mapping(const int fd, const size_t size, const uint64_t offset) : _address(nullptr), _size(size) {
+    void *const address = fd < 0 ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                                 : ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (address == MAP_FAILED) {
+        throw unix_error("mmap");
+    }
+    _address = address;
+}
+
+IoUring::Mapping::Mapping(Mapping &&other) noexcept : _address(other._address), _size(other._size) {
+    other._address = nullptr;
+}
+
+IoUring::Mapping::~Mapping() {
+    if (_address) {
+        ::munmap(_address, _size);
+    }
+}
+
+//! Call [io_uring_setup(2)](https://man7.org/linux/man-pages/man2/io_uring_setup.2.html), which libc doesn't wrap
+static int io_uring_setup(const unsigned entries, io_uring_params &params) {
+    return SystemCall("io_uring_setup", static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params)));
+}
+
+//! \param[in] entries is the size of the submission queue; the completion queue is twice as big
+IoUring::IoUring(const unsigned entries)
+    : _fd(io_uring_setup(entries, _params))
+    , _rings(_fd.fd_num(),
+             max(_params.sq_off.array + _params.sq_entries * sizeof(unsigned),
+                 _params.cq_off.cqes + _params.cq_entries * sizeof(io_uring_cqe)),
+             IORING_OFF_SQ_RING)
+    , _sqes(_fd.fd_num(), _params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES)
+    , _sq_head(_rings.at<unsigned>(_params.sq_off.head))
+    , _sq_tail(_rings.at<unsigned>(_params.sq_off.tail))
+    , _sq_flags(_rings.at<unsigned>(_params.sq_off.flags))
+    , _sq_entries(_sqes.at<io_uring_sqe>(0))
+    , _sq_mask(*_rings.at<unsigned>(_params.sq_off.ring_mask))
+    , _cq_head(_rings.at<unsigned>(_params.cq_off.head))
+    , _cq_tail(_rings.at<unsigned>(_params.cq_off.tail))
+    , _cq_entries(_rings.at<io_uring_cqe>(_params.cq_off.cqes))
+    , _cq_mask(*_rings.at<unsigned>(_params.cq_off.ring_mask)) {
+    constexpr unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((_params.features & required) != required) {
+        throw runtime_error("IoUring: the kernel's io_uring is too old");
+    }
+
+    // entry i of the submission queue is always sqe i
+    unsigned *const array = _rings.at<unsigned>(_params.sq_off.array);
+    for (unsigned i = 0; i < _params.sq_entries; i++) {
+        array[i] = i;
+    }
+    _sq_local_tail = *_sq_tail;
+}
+
+io_uring_sqe &IoUring::prepare(const uint8_t opcode, const int fd, const uint64_t user_data) {
+    if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _params.sq_entries) {
+        submit();
+    }
+
+    io_uring_sqe &entry = _sq_entries[_sq_local_tail & _sq_mask];
+    entry = {};
+    entry.opcode = opcode;
+    entry.fd = fd;
+    entry.user_data = user_data;
+    _sq_local_tail++;
+    return entry;
+}
+
+//! \param[in] min_complete is the number of completions to wait for (0 to only submit)
+//! \param[in] flags are IORING_ENTER_* flags; IORING_ENTER_EXT_ARG is added when waiting
+//! \param[in] timeout_ms bounds the wait, if non-negative
+int IoUring::enter(const unsigned min_complete, unsigned flags, const int timeout_ms) {
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+    const unsigned to_submit = _sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+    __kernel_timespec timeout{};
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_EXT_ARG;
+        if (timeout_ms >= 0) {
+            timeout.tv_sec = timeout_ms / 1000;
+            timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            arg.ts = reinterpret_cast<uint64_t>(&timeout);
+        }
+    }
+
+    _enter_count++;
+    return static_cast<int>(
+        ::syscall(__NR_io_uring_enter, _fd.fd_num(), to_submit, min_complete, flags, &arg, sizeof(arg)));
+}
+
+void IoUring::submit() {
+    while (_sq_local_tail != __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE)) {
+        // with a full completion queue the kernel may refuse new work until completions are flushed
+        const bool overflowed = __atomic_load_n(_sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW;
+        if (enter(0, overflowed ? IORING_ENTER_GETEVENTS : 0, -1) < 0 and errno != EINTR and errno != EBUSY and
+            errno != EAGAIN) {
+            throw unix_error("io_uring_enter");
+        }
+    }
+}
+
+//! \details Unlike submit_and_wait() with a zero timeout, this always makes a system call, which gives
+//! the kernel a chance to finish work that completes requests (such as copying received data).
+void IoUring::submit_and_get_events() {
+    if (enter(0, IORING_ENTER_GETEVENTS, -1) < 0 and errno != EINTR and errno != EBUSY and errno != EAGAIN) {
+        throw unix_error("io_uring_enter");
+    }
+}
+
+//! \param[in] timeout_ms is the longest time to wait, in milliseconds; negative means no limit
+bool IoUring::submit_and_wait(const int timeout_ms) {
+    const bool completions_waiting = *_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    const bool overflowed = __atomic_load_n(_sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW;
+    const bool wait = timeout_ms != 0 and not completions_waiting;
+    const bool nothing_to_submit = _sq_local_tail == __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if (not wait and not overflowed and nothing_to_submit) {
+        return true;
+    }
+
+    const int ret = enter(wait ? 1 : 0, wait or overflowed ? IORING_ENTER_GETEVENTS : 0, timeout_ms);
+    if (ret < 0) {
+        switch (errno) {
+            case EINTR:
+                return false;
+            case ETIME:    // the wait timed out
+            case EBUSY:    // completions must be consumed before more can be submitted
+            case EAGAIN:
+                break;
+            default:
+                throw unix_error("io_uring_enter");
+        }
+    }
+    return true;
+}
+
+//! \param[in] count is the number of buffers; must be a power of two no larger than 32768
+//! \param[in] size is the size of each buffer in bytes
+uint16_t IoUring::add_buffer_ring(const uint16_t count, const uint32_t size) {
+    if (count == 0 or (count & (count - 1)) != 0 or count > 32768) {
+        throw runtime_error("IoUring: the number of buffers in a ring must be a power of two");
+    }
+
+    uint16_t group = 0;
+    if (not _retired_groups.empty() and static_cast<int>(*_cq_head - _retired_groups.front().cq_tail) >= 0) {
+        group = _retired_groups.front().group;
+        _retired_groups.pop_front();
+    } else if (_next_group <= numeric_limits<uint16_t>::max()) {
+        group = static_cast<uint16_t>(_next_group++);
+    } else {
+        throw runtime_error("IoUring: out of buffer group ids");
+    }
+    BufferRing buffers{Mapping{-1, count * sizeof(io_uring_buf), 0},
+                       Mapping{-1, size_t{count} * size, 0},
+                       size,
+                       static_cast<uint16_t>(count - 1)};
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(buffers.ring.at<io_uring_buf>(0));
+    registration.ring_entries = count;
+    registration.bgid = group;
+    SystemCall("io_uring_register",
+               static_cast<int>(
+                   ::syscall(__NR_io_uring_register, _fd.fd_num(), IORING_REGISTER_PBUF_RING, &registration, 1)));
+
+    _buffer_rings.emplace(group, move(buffers));
+    for (uint16_t id = 0; id < count; id++) {
+        release_buffer(group, id);
+    }
+    return group;
+}
+
+void IoUring::remove_buffer_ring(const uint16_t group) {
+    io_uring_buf_reg registration{};
+    registration.bgid = group;
+    SystemCall("io_uring_register",
+               static_cast<int>(
+                   ::syscall(__NR_io_uring_register, _fd.fd_num(), IORING_UNREGISTER_PBUF_RING, &registration, 1)));
+    _buffer_rings.erase(group);
+    _retired_groups.push_back({group, __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)});
+}
+
+char *IoUring::buffer(const uint16_t group, const uint16_t id) const {
+    const BufferRing &buffers = _buffer_rings.at(group);
+    return buffers.memory.at<char>(size_t{id} * buffers.size);
+}
+
+void IoUring::release_buffer(const uint16_t group, const uint16_t id) {
+    BufferRing &buffers = _buffer_rings.at(group);
+    io_uring_buf *const entries = buffers.ring.at<io_uring_buf>(0);
+
+    // NOTE: the ring's tail lives in the `resv` field of entry 0, so only set the other fields
+    io_uring_buf &entry = entries[buffers.tail & buffers.mask];
+    entry.addr = reinterpret_cast<uint64_t>(buffer(group, id));
+    entry.len = buffers.size;
+    entry.bid = id;
+    buffers.tail++;
+    __atomic_store_n(&entries[0].resv, buffers.tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,175 @@
+#ifndef SPONGE_LIBSPONGE_IO_URING_HH
+#define SPONGE_LIBSPONGE_IO_URING_HH
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <linux/io_uring.h>
+#include <unordered_map>
+
+//! \brief A Linux [io_uring](https://man7.org/linux/man-pages/man7/io_uring.7.html) instance: a submission
+//! queue and a completion queue shared with the kernel, plus rings of buffers lent to the kernel for receives
+class IoUring {
+  private:
+    //! A memory mapping, unmapped on destruction
+    class Mapping {
+      private:
+        void *_address;  //!< Start of the mapping
+        size_t _size;    //!< Length of the mapping in bytes
+
+      public:
+        //! Map `size` bytes of the io_uring `fd` at `offset`, or zeroed anonymous memory if `fd` is negative
+        Mapping(const int fd, const size_t size, const uint64_t offset);
+        ~Mapping();
+
+        //! \returns a pointer `offset` bytes into the mapping
+        template <typename T>
+        T *at(const size_t offset) const {
+            return reinterpret_cast<T *>(static_cast<char *>(_address) + offset);
+        }
+
+        //! \name
+        //! A Mapping can be moved, but not copied
+        //!@{
+        Mapping(Mapping &&other) noexcept;
+        Mapping(const Mapping &other) = delete;
+        Mapping &operator=(const Mapping &other) = delete;
+        Mapping &operator=(Mapping &&other) = delete;
+        //!@}
+    };
+
+    //! Buffers that the kernel picks from when a receive asks for a buffer of this ring's group
+    struct BufferRing {
+        Mapping ring;      //!< The io_uring_buf entries shared with the kernel
+        Mapping memory;    //!< The buffers themselves
+        uint32_t size;     //!< Size of each buffer
+        uint16_t mask;     //!< Number of buffers minus one (the count is a power of two)
+        uint16_t tail{0};  //!< Entries handed to the kernel so far (wrapping)
+    };
+
+    //! A group id given up by remove_buffer_ring()
+    struct RetiredGroup {
+        uint16_t group;    //!< The id
+        unsigned cq_tail;  //!< Completion queue tail at removal; completions before it may still name the group
+    };
+
+    std::unordered_map<uint16_t, BufferRing> _buffer_rings{};  //!< Buffer rings by group id
+    uint32_t _next_group{0};                                   //!< Lowest group id never handed out
+    std::deque<RetiredGroup> _retired_groups{};                //!< Group ids to hand out again, oldest first
+
+    io_uring_params _params{};  //!< What the kernel reported about the instance
+    FileDescriptor _fd;         //!< The io_uring instance (closed before the buffers are unmapped)
+    Mapping _rings;             //!< Submission and completion queues (the kernel must support one mapping)
+    Mapping _sqes;              //!< Submission queue entries
+
+    //! \name Submission queue
+    //!@{
+    unsigned *_sq_head;          //!< Advanced by the kernel as it consumes entries
+    unsigned *_sq_tail;          //!< Advanced by us to publish entries
+    unsigned *_sq_flags;         //!< Flags set by the kernel, e.g. IORING_SQ_CQ_OVERFLOW
+    io_uring_sqe *_sq_entries;   //!< Entries (the indirection array is set up as the identity)
+    unsigned _sq_mask;           //!< Number of entries minus one
+    unsigned _sq_local_tail{0};  //!< Entries prepared so far; published by submit()
+    //!@}
+
+    //! \name Completion queue
+    //!@{
+    unsigned *_cq_head;         //!< Advanced by us as completions are consumed
+    unsigned *_cq_tail;         //!< Advanced by the kernel as it posts completions
+    io_uring_cqe *_cq_entries;  //!< Completions
+    unsigned _cq_mask;          //!< Number of completions minus one
+    //!@}
+
+    uint64_t _enter_count{0};  //!< Calls to io_uring_enter so far
+
+    //! Publish prepared entries and call io_uring_enter; returns -1 and leaves `errno` set on failure
+    int enter(const unsigned min_complete, unsigned flags, const int timeout_ms);
+
+  public:
+    //! Set up an instance with room for `entries` submissions (rounded up to a power of two)
+    explicit IoUring(const unsigned entries);
+
+    //! \brief Start a submission queue entry
+    //! \details Fills in the opcode, fd and user data and zeroes the rest; the caller fills in the
+    //! remaining fields. Entries are handed to the kernel by the next submit() or submit_and_wait(),
+    //! or right away if the submission queue is full.
+    io_uring_sqe &prepare(const uint8_t opcode, const int fd, const uint64_t user_data);
+
+    //! Hand prepared entries to the kernel without waiting for completions (makes no system call if there are none)
+    void submit();
+
+    //! Hand prepared entries to the kernel and have it post whatever completions are ready, without waiting
+    void submit_and_get_events();
+
+    //! \brief Hand prepared entries to the kernel and wait up to `timeout_ms` (forever if negative) for a completion
+    //! \details Returns at once if completions are already waiting. Makes no system call at all if
+    //! `timeout_ms` is 0 and nothing is prepared.
+    //! \returns `false` if the wait was interrupted by a signal
+    bool submit_and_wait(const int timeout_ms);
+
+    //! \brief Consume the completions posted so far, oldest first, passing each one to `handle`
+    //! \returns the number of completions consumed
+    template <typename CompletionHandler>
+    size_t reap(CompletionHandler &&handle) {
+        size_t count = 0;
+        for (unsigned head = *_cq_head; head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE); head++, count++) {
+            const io_uring_cqe completion = _cq_entries[head & _cq_mask];
+            // give the slot back before handling, in case the handler throws
+            __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+            handle(completion);
+        }
+        return count;
+    }
+
+    //! \name Provided buffers
+    //!@{
+
+    //! \brief Register a ring of `count` buffers of `size` bytes each
+    //! \param[in] count is the number of buffers; must be a power of two
+    //! \returns the buffer group id that receive requests use to draw from the ring
+    uint16_t add_buffer_ring(const uint16_t count, const uint32_t size);
+
+    //! \brief Unregister a buffer ring and free its buffers
+    //! \details The group id is handed out again once the completions posted before now have been reaped,
+    //! so that a late completion can't be mistaken for one from the new ring.
+    void remove_buffer_ring(const uint16_t group);
+
+    //! `true` if `group` is a registered buffer ring
+    bool has_buffer_ring(const uint16_t group) const { return _buffer_rings.count(group) != 0; }
+
+    //! The start of buffer `id` of buffer ring `group`
+    char *buffer(const uint16_t group, const uint16_t id) const;
+
+    //! The size of each buffer of buffer ring `group`
+    uint32_t buffer_size(const uint16_t group) const { return _buffer_rings.at(group).size; }
+
+    //! Hand buffer `id` of ring `group` back to the kernel, to be filled by a later receive
+    void release_buffer(const uint16_t group, const uint16_t id);
+    //!@}
+
+    //! Number of calls to io_uring_enter so far (one per batch of submissions and/or wait)
+    uint64_t enter_count() const { return _enter_count; }
+
+    //! \name
+    //! An IoUring cannot be copied or moved
+    //!@{
+    IoUring(const IoUring &other) = delete;
+    IoUring &operator=(const IoUring &other) = delete;
+    IoUring(IoUring &&other) = delete;
+    IoUring &operator=(IoUring &&other) = delete;
+    ~IoUring() = default;
+    //!@}
+};
+
+//! \class IoUring
+//! This talks to the kernel directly through the io_uring_setup, io_uring_enter and io_uring_register
+//! system calls rather than through liburing. It needs Linux 5.19 or later (for buffer rings); the
+//! constructor throws if the kernel lacks a needed feature or refuses io_uring altogether (as some
+//! container sandboxes do).
+//!
+//! Only one thread at a time may use an IoUring. Nothing is handed to the kernel until submit() or
+//! submit_and_wait(), so any number of requests cost a single system call.
+
+#endif  // SPONGE_LIBSPONGE_IO_URING_HH
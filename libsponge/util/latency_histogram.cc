@@ -0,0 +1,71 @@
+#include "latency_histogram.hh"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+//! Values counted exactly, one per bucket
+static constexpr uint64_t EXACT = uint64_t{1} << LatencyHistogram::SUB_BUCKET_BITS;
+
+//! Buckets for each power of two above EXACT
+static constexpr uint64_t HALF = EXACT / 2;
+
+//! \details A value of `m` significant bits (m > SUB_BUCKET_BITS) is counted by its top SUB_BUCKET_BITS bits,
+//! `value >> shift` with `shift = m - SUB_BUCKET_BITS`, which lie in [HALF, EXACT). Bucket `shift * HALF +
+//! (value >> shift)` follows on from the exact ones without a gap.
+size_t LatencyHistogram::bucket(const uint64_t value) {
+    if (value < EXACT) {
+        return value;
+    }
+    const unsigned significant_bits = 64 - __builtin_clzll(value);
+    const unsigned shift = significant_bits - LatencyHistogram::SUB_BUCKET_BITS;
+    return shift * HALF + (value >> shift);
+}
+
+uint64_t LatencyHistogram::highest_value(const size_t index) {
+    if (index < EXACT) {
+        return index;
+    }
+    const unsigned shift = index / HALF - 1;
+    const uint64_t top_bits = index % HALF + HALF;
+    return ((top_bits + 1) << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() : _counts(bucket(UINT64_MAX) + 1) {}
+
+void LatencyHistogram::record(const uint64_t value) {
+    _counts[bucket(value)]++;
+    _count++;
+    _min = std::min(_min, value);
+    _max = std::max(_max, value);
+    _sum += value;
+}
+
+uint64_t LatencyHistogram::percentile(const double percentile) const {
+    if (_count == 0) {
+        return 0;
+    }
+    // the rank of the value wanted, counting from 1
+    const double fraction = std::clamp(percentile, 0.0, 100.0) / 100;
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(ceil(fraction * double(_count))));
+
+    uint64_t seen = 0;
+    for (size_t index = 0; index < _counts.size(); index++) {
+        seen += _counts[index];
+        if (seen >= rank) {
+            return std::min(highest_value(index), _max);
+        }
+    }
+    return _max;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (size_t index = 0; index < _counts.size(); index++) {
+        _counts[index] += other._counts[index];
+    }
+    _count += other._count;
+    _min = std::min(_min, other._min);
+    _max = std::max(_max, other._max);
+    _sum += other._sum;
+}
@@ -0,0 +1,53 @@
+#ifndef SPONGE_LIBSPONGE_LATENCY_HISTOGRAM_HH
+#define SPONGE_LIBSPONGE_LATENCY_HISTOGRAM_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! \brief A histogram of nonnegative values (like latencies in nanoseconds) with a bounded relative error,
+//! in the style of [HdrHistogram](http://hdrhistogram.org/)
+//! \details Values below 2^SUB_BUCKET_BITS are counted exactly. Above that, each power of two is split into
+//! 2^(SUB_BUCKET_BITS - 1) equal buckets, so a value is known to within 1 part in 2^(SUB_BUCKET_BITS - 1)
+//! (0.8%). Recording is constant-time and never allocates; the whole range of `uint64_t` takes 7424 buckets.
+class LatencyHistogram {
+  public:
+    static constexpr unsigned SUB_BUCKET_BITS = 8;  //!< Values below 2^SUB_BUCKET_BITS are exact
+
+  private:
+    std::vector<uint64_t> _counts;  //!< Number of values recorded in each bucket
+    uint64_t _count{0};             //!< Number of values recorded
+    uint64_t _min{UINT64_MAX};      //!< Smallest value recorded
+    uint64_t _max{0};               //!< Largest value recorded
+    long double _sum{0};            //!< Sum of the values recorded
+
+    //! Index of the bucket that counts `value`
+    static size_t bucket(const uint64_t value);
+
+    //! Largest value counted by bucket `index`
+    static uint64_t highest_value(const size_t index);
+
+  public:
+    LatencyHistogram();
+
+    //! Count one value
+    void record(const uint64_t value);
+
+    //! \brief The value at or below which `percentile` percent of the recorded values fall
+    //! \details Exact for small values, otherwise the top of the bucket (but never above max()).
+    //! \returns 0 if nothing has been recorded
+    uint64_t percentile(const double percentile) const;
+
+    //! Add all the values recorded in `other`
+    void merge(const LatencyHistogram &other);
+
+    //! \name Summary statistics
+    //!@{
+    uint64_t count() const { return _count; }
+    uint64_t min() const { return _count ? _min : 0; }
+    uint64_t max() const { return _max; }
+    double mean() const { return _count ? double(_sum / _count) : 0; }
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_LATENCY_HISTOGRAM_HH
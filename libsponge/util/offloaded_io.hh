@@ -0,0 +1,44 @@
+#ifndef SPONGE_LIBSPONGE_OFFLOADED_IO_HH
+#define SPONGE_LIBSPONGE_OFFLOADED_IO_HH
+
+#include "buffer.hh"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <sys/socket.h>
+
+//! \brief Receives and sends that an EventLoop performs on behalf of a socket
+//! \details Attached to a socket by an EventLoop using EventLoop::Backend::IoUring, for as long as the
+//! loop has a Direction::In rule on it. While attached, FileDescriptor::read and UDPSocket::recv take
+//! data from OffloadedIO::received instead of calling into the kernel, and UDPSocket::sendto and
+//! UDPSocket::send hand their datagram to OffloadedIO::send.
+struct OffloadedIO {
+    //! Data received by the EventLoop, still sitting in a buffer that the loop lent to the kernel
+    struct Chunk {
+        std::string_view data{};    //!< Bytes not yet read
+        std::string_view source{};  //!< Raw `sockaddr` of the sender (datagram sockets only)
+        uint16_t buffer_id{0};      //!< Buffer holding `data`; passed to OffloadedIO::release once read
+        bool eof{false};            //!< `true` for the (empty, bufferless) chunk marking the end of a stream
+    };
+
+    //! Data received and not yet read, oldest first
+    std::deque<Chunk> received{};
+
+    //! Return a buffer to the EventLoop, to be filled again
+    std::function<void(uint16_t)> release{};
+
+    //! Queue a datagram for sending at the EventLoop's next wait (empty for stream sockets)
+    std::function<void(const sockaddr *, socklen_t, const BufferViewList &)> send{};
+
+    //! Discard the oldest chunk and release its buffer
+    void pop() {
+        if (not received.front().eof) {
+            release(received.front().buffer_id);
+        }
+        received.pop_front();
+    }
+};
+
+#endif  // SPONGE_LIBSPONGE_OFFLOADED_IO_HH
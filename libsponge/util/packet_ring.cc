@@ -0,0 +1,158 @@
+#include "packet_ring.hh"
+
+#include "util.hh"
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+//! Offset of a frame's data in a transmit slot
+static constexpr size_t TX_DATA_OFFSET = TPACKET_ALIGN(sizeof(tpacket3_hdr));
+
+void PacketRing::Unmap::operator()(char *address) const { ::munmap(address, size); }
+
+//! Set a `SOL_PACKET` option
+template <typename T>
+static void set_packet_option(const FileDescriptor &fd, const int option, const T &value) {
+    SystemCall("setsockopt", ::setsockopt(fd.fd_num(), SOL_PACKET, option, &value, sizeof(value)));
+}
+
+//! \param[in] interface is the name of the network interface to send and receive on, which must be up
+//! \param[in] rx_blocks is the number of BLOCK_SIZE blocks in the receive ring
+//! \param[in] tx_frames is the number of slots in the transmit ring (a multiple of BLOCK_SIZE / FRAME_SIZE)
+//! \details The socket doesn't receive the frames that the host sends out of the interface, only the ones
+//! that arrive on it.
+PacketRing::PacketRing(const string &interface, const size_t rx_blocks, const size_t tx_frames)
+    : FileDescriptor(SystemCall("socket", ::socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))))
+    , _rx_blocks(rx_blocks)
+    , _tx_frames(tx_frames)
+    , _rings(nullptr, Unmap{0}) {
+    constexpr size_t frames_per_block = BLOCK_SIZE / FRAME_SIZE;
+    if (rx_blocks == 0 or tx_frames == 0 or tx_frames % frames_per_block != 0) {
+        throw runtime_error("PacketRing: bad ring size");
+    }
+
+    const unsigned index = if_nametoindex(interface.c_str());
+    if (index == 0) {
+        throw unix_error("if_nametoindex(" + interface + ")");
+    }
+
+    set_packet_option(*this, PACKET_VERSION, int(TPACKET_V3));
+    set_packet_option(*this, PACKET_IGNORE_OUTGOING, int(true));
+
+    tpacket_req3 rx_request{};
+    rx_request.tp_block_size = BLOCK_SIZE;
+    rx_request.tp_block_nr = rx_blocks;
+    rx_request.tp_frame_size = FRAME_SIZE;
+    rx_request.tp_frame_nr = rx_blocks * frames_per_block;
+    rx_request.tp_retire_blk_tov = BLOCK_TIMEOUT_MS;
+    set_packet_option(*this, PACKET_RX_RING, rx_request);
+
+    tpacket_req3 tx_request{};
+    tx_request.tp_block_size = BLOCK_SIZE;
+    tx_request.tp_block_nr = tx_frames / frames_per_block;
+    tx_request.tp_frame_size = FRAME_SIZE;
+    tx_request.tp_frame_nr = tx_frames;
+    set_packet_option(*this, PACKET_TX_RING, tx_request);
+
+    const size_t size = rx_blocks * BLOCK_SIZE + tx_frames * FRAME_SIZE;
+    void *const address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_num(), 0);
+    if (address == MAP_FAILED) {
+        throw unix_error("mmap");
+    }
+    _rings = {static_cast<char *>(address), Unmap{size}};
+
+    sockaddr_ll link_address{};
+    link_address.sll_family = AF_PACKET;
+    link_address.sll_protocol = htons(ETH_P_ALL);
+    link_address.sll_ifindex = static_cast<int>(index);
+    SystemCall("bind", ::bind(fd_num(), reinterpret_cast<const sockaddr *>(&link_address), sizeof(link_address)));
+}
+
+//! \details Hands each block back to the kernel once every frame in it has been returned (on the call after
+//! the one that returns its last frame). A frame that was truncated to fit the ring is skipped.
+optional<PacketRing::Frame> PacketRing::receive() {
+    register_read();
+    while (true) {
+        auto *const block = reinterpret_cast<tpacket_block_desc *>(rx_block(_rx_block));
+        if (_rx_remaining == 0) {
+            if (_rx_held) {
+                __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+                _rx_held = false;
+                _rx_block = (_rx_block + 1) % _rx_blocks;
+                continue;
+            }
+            if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+                return {};
+            }
+            _rx_held = true;
+            _rx_remaining = block->hdr.bh1.num_pkts;
+            _rx_next = block->hdr.bh1.offset_to_first_pkt;
+            continue;
+        }
+
+        const auto *const header = reinterpret_cast<const tpacket3_hdr *>(rx_block(_rx_block) + _rx_next);
+        _rx_next += header->tp_next_offset;
+        _rx_remaining--;
+        if (header->tp_snaplen == header->tp_len) {
+            const string_view data{reinterpret_cast<const char *>(header) + header->tp_mac, header->tp_snaplen};
+            return Frame{data, (header->tp_status & (TP_STATUS_CSUMNOTREADY | TP_STATUS_CSUM_VALID)) == 0};
+        }
+    }
+}
+
+bool PacketRing::receive_pending() const {
+    if (_rx_remaining > 0) {
+        return true;
+    }
+    const size_t next = _rx_held ? (_rx_block + 1) % _rx_blocks : _rx_block;
+    const auto *const block = reinterpret_cast<tpacket_block_desc *>(rx_block(next));
+    return (__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) != 0;
+}
+
+//! \details If the slot is still in use (the ring is full), flushes and waits for the kernel to transmit
+//! everything queued, which frees the slot.
+void PacketRing::send(const BufferViewList &frame) {
+    if (frame.size() > max_frame_size()) {
+        throw runtime_error("PacketRing: frame too big for the transmit ring");
+    }
+
+    auto *const header = reinterpret_cast<tpacket3_hdr *>(tx_frame(_tx_next));
+    if (__atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+        flush();
+        SystemCall("send", ::send(fd_num(), nullptr, 0, 0));
+        if (__atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+            throw runtime_error("PacketRing: the kernel didn't transmit a frame");
+        }
+    }
+
+    char *data = tx_frame(_tx_next) + TX_DATA_OFFSET;
+    for (const iovec &piece : frame.as_iovecs()) {
+        memcpy(data, piece.iov_base, piece.iov_len);
+        data += piece.iov_len;
+    }
+    header->tp_len = frame.size();
+    header->tp_next_offset = 0;
+    __atomic_store_n(&header->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+    _tx_next = (_tx_next + 1) % _tx_frames;
+    _tx_queued++;
+}
+
+void PacketRing::flush() {
+    if (_tx_queued == 0) {
+        return;
+    }
+    SystemCall("send", ::send(fd_num(), nullptr, 0, MSG_DONTWAIT));
+    _tx_queued = 0;
+    register_write();
+}
+
+size_t PacketRing::max_frame_size() { return FRAME_SIZE - TX_DATA_OFFSET; }
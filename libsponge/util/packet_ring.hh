@@ -0,0 +1,85 @@
+#ifndef SPONGE_LIBSPONGE_PACKET_RING_HH
+#define SPONGE_LIBSPONGE_PACKET_RING_HH
+
+#include "buffer.hh"
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+//! \brief An [AF_PACKET](\ref man7::packet) socket bound to a network interface, which sends and receives
+//! Ethernet frames through rings of frames shared with the kernel
+//! ([PACKET_MMAP](https://www.kernel.org/doc/Documentation/networking/packet_mmap.txt), `TPACKET_V3`)
+//! \details The kernel fills the receive ring a block of frames at a time, and hands a block over when it is
+//! full or has waited BLOCK_TIMEOUT_MS for more frames; receive() then walks the block in place, without a
+//! system call. send() copies frames into the transmit ring, and flush() has the kernel transmit all of them
+//! with one [send(2)](\ref man2::send). The socket can be polled for Direction::In like any other.
+//!
+//! Opening one needs `CAP_NET_RAW`. The interface might be one end of a veth pair (`ip link add veth0 type
+//! veth peer name veth1`) standing in for a TAP device, with the kernel's side of the link on the other end.
+class PacketRing : public FileDescriptor {
+  public:
+    static constexpr size_t BLOCK_SIZE = 1 << 20;      //!< Size of each block of the receive ring
+    static constexpr unsigned BLOCK_TIMEOUT_MS = 1;    //!< How long the kernel waits to fill a block
+    static constexpr size_t FRAME_SIZE = 2048;         //!< Size of each slot of the transmit ring
+    static constexpr size_t DEFAULT_RX_BLOCKS = 8;     //!< Default number of blocks in the receive ring
+    static constexpr size_t DEFAULT_TX_FRAMES = 1024;  //!< Default number of slots in the transmit ring
+
+    //! A frame returned by receive()
+    struct Frame {
+        std::string_view data;       //!< The frame, in the ring
+        bool verify_checksum{true};  //!< False if the kernel has checked the frame's TCP or UDP checksum, or if
+                                     //!< the frame comes from the host itself and the checksum was never filled in
+    };
+
+  private:
+    //! Deleter for the mapping of the rings
+    struct Unmap {
+        size_t size;                           //!< Length of the mapping in bytes
+        void operator()(char *address) const;  //!< Unmap the rings
+    };
+
+    size_t _rx_blocks;                    //!< Number of blocks in the receive ring
+    size_t _tx_frames;                    //!< Number of slots in the transmit ring
+    std::unique_ptr<char, Unmap> _rings;  //!< The receive ring, followed by the transmit ring
+    size_t _rx_block{0};                  //!< Index of the block receive() is on
+    bool _rx_held{false};                 //!< Does receive() hold that block (the kernel has handed it over)?
+    uint32_t _rx_remaining{0};            //!< Frames of that block not yet returned by receive()
+    size_t _rx_next{0};                   //!< Offset of the next of those frames in the block
+    size_t _tx_next{0};                   //!< Index of the slot the next send() uses
+    size_t _tx_queued{0};                 //!< Frames sent since the last flush()
+
+    //! Start of a block of the receive ring
+    char *rx_block(const size_t index) const { return _rings.get() + index * BLOCK_SIZE; }
+
+    //! Start of a slot of the transmit ring
+    char *tx_frame(const size_t index) const { return _rings.get() + _rx_blocks * BLOCK_SIZE + index * FRAME_SIZE; }
+
+  public:
+    //! Open a socket on the network interface `interface`, with rings of `rx_blocks` blocks and `tx_frames` slots
+    explicit PacketRing(const std::string &interface,
+                        const size_t rx_blocks = DEFAULT_RX_BLOCKS,
+                        const size_t tx_frames = DEFAULT_TX_FRAMES);
+
+    //! \brief The next frame the kernel has received, if any, read in place
+    //! \returns a view into the ring that stays valid until the next call
+    std::optional<Frame> receive();
+
+    //! Whether receive() has a frame to return
+    bool receive_pending() const;
+
+    //! Copy a frame into the transmit ring, for the next flush() to transmit (flushing first if it is full)
+    void send(const BufferViewList &frame);
+
+    //! Have the kernel transmit the frames send() has queued
+    void flush();
+
+    //! Largest frame that send() takes
+    static size_t max_frame_size();
+};
+
+#endif  // SPONGE_LIBSPONGE_PACKET_RING_HH
@@ -0,0 +1,144 @@
+#ifndef SPONGE_LIBSPONGE_RING_QUEUE_HH
+#define SPONGE_LIBSPONGE_RING_QUEUE_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+//! \brief A bounded FIFO queue stored in a ring buffer
+//! \tparam T the element type; only needs to be movable
+template <typename T>
+class RingQueue {
+  private:
+    std::vector<std::optional<T>> _slots{};  //!< Ring storage; grows on demand up to _capacity
+    size_t _capacity;                        //!< Most elements the queue will ever hold
+    size_t _head{0};                         //!< Index in _slots of the front element
+    size_t _size{0};                         //!< Number of queued elements
+    uint64_t _dropped{0};                    //!< Elements refused because the queue was full
+    std::function<void()> _on_room{};        //!< Called by pop() when it makes room in a full queue
+
+    //! Index in _slots of the element `n` places behind the front
+    size_t index(const size_t n) const {
+        const size_t i = _head + n;
+        return i < _slots.size() ? i : i - _slots.size();
+    }
+
+    //! Make room for one more element, or return `false` (and count a drop) if the queue is at capacity
+    bool reserve_one() {
+        if (_size < _slots.size()) {
+            return true;
+        }
+        if (_size >= _capacity) {
+            _dropped++;
+            return false;
+        }
+        std::vector<std::optional<T>> bigger(std::min(_capacity, std::max<size_t>(8, 2 * _slots.size())));
+        for (size_t n = 0; n < _size; n++) {
+            bigger[n] = std::move(_slots[index(n)]);
+        }
+        _slots = std::move(bigger);
+        _head = 0;
+        return true;
+    }
+
+  public:
+    //! Queue size used when none is specified
+    static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+    //! \brief Construct an empty queue that will hold at most `capacity` elements
+    //! \note Storage is allocated as elements arrive, so an idle queue costs almost nothing.
+    explicit RingQueue(const size_t capacity = DEFAULT_CAPACITY) : _capacity(capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("RingQueue: capacity must be positive");
+        }
+    }
+
+    //! \name Producer interface
+    //!@{
+
+    //! \brief Append an element to the back of the queue
+    //! \returns `false` if the queue was full, in which case `value` is discarded and counted in dropped()
+    bool push(T value) { return emplace(std::move(value)); }
+
+    //! \brief Construct an element in place at the back of the queue
+    //! \returns `false` if the queue was full, in which case nothing is constructed
+    template <typename... Args>
+    bool emplace(Args &&... args) {
+        if (not reserve_one()) {
+            return false;
+        }
+        _slots[index(_size)].emplace(std::forward<Args>(args)...);
+        _size++;
+        return true;
+    }
+
+    //! `true` if the next push() would be refused; producers that can wait should hold off until it is `false`
+    bool full() const { return _size >= _capacity; }
+
+    //! Number of elements that have been refused because the queue was full
+    uint64_t dropped() const { return _dropped; }
+
+    //! \brief Have pop() call `on_room` each time it makes room in a full queue
+    //! \details A producer that holds elements back while the queue is full can push them from `on_room`.
+    void set_on_room(std::function<void()> on_room) { _on_room = std::move(on_room); }
+    //!@}
+
+    //! \name Consumer interface
+    //!@{
+
+    //! \brief The oldest element
+    //! \note The queue must not be empty.
+    T &front() { return _slots[_head].value(); }
+    const T &front() const { return _slots[_head].value(); }
+
+    //! \brief Remove the oldest element
+    //! \note The queue must not be empty.
+    void pop() {
+        const bool was_full = full();
+        _slots[_head].reset();
+        _head = index(1);
+        _size--;
+        if (was_full and _on_room) {
+            _on_room();
+        }
+    }
+
+    //! \brief Move up to `max_count` elements, oldest first, out of the queue and into `out`
+    //! \param[out] out where to put the elements: e.g. a pointer to the start of an array, or a std::back_inserter
+    //! \param[in] max_count most elements to move (the size of the array that `out` points to)
+    //! \returns the number of elements moved
+    template <typename OutputIt>
+    size_t drain(OutputIt out, const size_t max_count = std::numeric_limits<size_t>::max()) {
+        const size_t count = std::min(max_count, _size);
+        for (size_t n = 0; n < count; n++) {
+            *out = std::move(front());
+            ++out;
+            pop();
+        }
+        return count;
+    }
+    //!@}
+
+    //! Number of queued elements
+    size_t size() const { return _size; }
+
+    //! `true` if no elements are queued
+    bool empty() const { return _size == 0; }
+
+    //! Most elements the queue will hold
+    size_t capacity() const { return _capacity; }
+};
+
+//! \class RingQueue
+//! Offers the subset of std::queue used for the output queues in this library (push, front, pop, empty, size),
+//! plus a bound on its length. A full queue refuses new elements instead of growing without limit, and
+//! reports that through the return value of push() and through full() and dropped(). Consumers can take a
+//! burst of elements at once with drain(), which calls the set_on_room() callback like pop() does.
+
+#endif  // SPONGE_LIBSPONGE_RING_QUEUE_HH
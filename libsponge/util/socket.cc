@@ -1,8 +1,12 @@
 #include "socket.hh"
 
+#include "byte_ring.hh"
+#include "offloaded_io.hh"
 #include "util.hh"
 
 #include <cstddef>
+#include <cstring>
+#include <netinet/udp.h>
 #include <stdexcept>
 #include <unistd.h>
 
@@ -17,7 +21,12 @@ Socket::Socket(const int domain, const int type) : FileDescriptor(SystemCall("so
 //! \param[in] fd is the FileDescriptor from which to construct
 //! \param[in] domain is `fd`'s domain; throws std::runtime_error if wrong value is supplied
 //! \param[in] type is `fd`'s type; throws std::runtime_error if wrong value is supplied
+//! \note An end of a ring_pair() isn't checked: it stands in for a connected `AF_UNIX` stream socket.
 Socket::Socket(FileDescriptor &&fd, const int domain, const int type) : FileDescriptor(move(fd)) {
+    if (rings()) {
+        return;
+    }
+
     int actual_value;
     socklen_t len;
 
@@ -66,8 +75,18 @@ void Socket::connect(const Address &address) { SystemCall("connect", ::connect(f
 
 // shut down a socket in the specified way
 //! \param[in] how can be `SHUT_RD`, `SHUT_WR`, or `SHUT_RDWR`; see [shutdown(2)](\ref man2::shutdown)
+//! \note An end of a ring_pair() closes the ring it reads from (`SHUT_RD`) and/or writes to (`SHUT_WR`).
 void Socket::shutdown(const int how) {
-    SystemCall("shutdown", ::shutdown(fd_num(), how));
+    if (const auto &ring_stream = rings()) {
+        if (how == SHUT_RD or how == SHUT_RDWR) {
+            ring_stream->in->close();
+        }
+        if (how == SHUT_WR or how == SHUT_RDWR) {
+            ring_stream->out->close();
+        }
+    } else {
+        SystemCall("shutdown", ::shutdown(fd_num(), how));
+    }
     switch (how) {
         case SHUT_RD:
             register_read();
@@ -85,25 +104,61 @@ void Socket::shutdown(const int how) {
 }
 
 //! \note If `mtu` is too small to hold the received datagram, this method throws a std::runtime_error
+//! \note After set_gro(), the received datagram may be several coalesced ones; see received_datagram::segment_size.
+//! \note If an EventLoop receives for this socket (see OffloadedIO), this method takes the oldest datagram
+//! the loop has received, or throws a unix_error (`EAGAIN`) if there is none.
 void UDPSocket::recv(received_datagram &datagram, const size_t mtu) {
-    // receive source address and payload
+    if (const auto &offload = this->offload()) {
+        if (offload->received.empty()) {
+            throw unix_error("recvfrom", EAGAIN);
+        }
+        const OffloadedIO::Chunk &chunk = offload->received.front();
+        if (chunk.data.size() > mtu) {
+            // consume it, as the kernel path does, so that the next call gets the next datagram
+            offload->pop();
+            register_read();
+            throw runtime_error("recvfrom (oversized datagram)");
+        }
+        datagram.source_address = {reinterpret_cast<const sockaddr *>(chunk.source.data()), chunk.source.size()};
+        datagram.payload.assign(chunk.data);
+        datagram.segment_size = 0;
+        offload->pop();
+        register_read();
+        return;
+    }
+
+    // receive source address, payload and (with GRO) the size of the coalesced datagrams
     Address::Raw datagram_source_address;
     datagram.payload.resize(mtu);
 
-    socklen_t fromlen = sizeof(datagram_source_address);
+    iovec payload_iovec{datagram.payload.data(), datagram.payload.size()};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+
+    msghdr message{};
+    message.msg_name = static_cast<sockaddr *>(datagram_source_address);
+    message.msg_namelen = sizeof(datagram_source_address);
+    message.msg_iov = &payload_iovec;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
 
-    const ssize_t recv_len = SystemCall(
-        "recvfrom",
-        ::recvfrom(
-            fd_num(), datagram.payload.data(), datagram.payload.size(), MSG_TRUNC, datagram_source_address, &fromlen));
+    const ssize_t recv_len = SystemCall("recvmsg", ::recvmsg(fd_num(), &message, MSG_TRUNC));
 
     if (recv_len > ssize_t(mtu)) {
         throw runtime_error("recvfrom (oversized datagram)");
     }
 
     register_read();
-    datagram.source_address = {datagram_source_address, fromlen};
+    datagram.source_address = {datagram_source_address, message.msg_namelen};
     datagram.payload.resize(recv_len);
+    datagram.segment_size = 0;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO) {
+            int segment_size;
+            memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+            datagram.segment_size = segment_size;
+        }
+    }
 }
 
 UDPSocket::received_datagram UDPSocket::recv(const size_t mtu) {
@@ -112,10 +167,12 @@ UDPSocket::received_datagram UDPSocket::recv(const size_t mtu) {
     return ret;
 }
 
+//! \param[in] segment_size, if nonzero, asks the kernel to split the payload into datagrams of that size
 void sendmsg_helper(const int fd_num,
                     const sockaddr *destination_address,
                     const socklen_t destination_address_len,
-                    const BufferViewList &payload) {
+                    const BufferViewList &payload,
+                    const uint16_t segment_size = 0) {
     auto iovecs = payload.as_iovecs();
 
     msghdr message{};
@@ -124,6 +181,17 @@ void sendmsg_helper(const int fd_num,
     message.msg_iov = iovecs.data();
     message.msg_iovlen = iovecs.size();
 
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(segment_size))];
+    if (segment_size > 0) {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(segment_size));
+        memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+    }
+
     const ssize_t bytes_sent = SystemCall("sendmsg", ::sendmsg(fd_num, &message, 0));
 
     if (size_t(bytes_sent) != payload.size()) {
@@ -131,16 +199,52 @@ void sendmsg_helper(const int fd_num,
     }
 }
 
+//! \note If an EventLoop sends for this socket (see OffloadedIO), the datagram is queued there instead.
 void UDPSocket::sendto(const Address &destination, const BufferViewList &payload) {
-    sendmsg_helper(fd_num(), destination, destination.size(), payload);
+    if (offload() and offload()->send) {
+        offload()->send(destination, destination.size(), payload);
+    } else {
+        sendmsg_helper(fd_num(), destination, destination.size(), payload);
+    }
     register_write();
 }
 
+//! \note If an EventLoop sends for this socket (see OffloadedIO), the datagram is queued there instead.
 void UDPSocket::send(const BufferViewList &payload) {
-    sendmsg_helper(fd_num(), nullptr, 0, payload);
+    if (offload() and offload()->send) {
+        offload()->send(nullptr, 0, payload);
+    } else {
+        sendmsg_helper(fd_num(), nullptr, 0, payload);
+    }
     register_write();
 }
 
+//! \param[in] destination is the Address to send every datagram to
+//! \param[in] payload is the datagrams' payloads, back to back
+//! \param[in] segment_size is the size of each datagram's payload, except that the last may be shorter
+//! \note If an EventLoop sends for this socket (see OffloadedIO), the datagrams are queued there one by one.
+void UDPSocket::sendto_segmented(const Address &destination,
+                                 const BufferViewList &payload,
+                                 const uint16_t segment_size) {
+    if (segment_size == 0) {
+        throw runtime_error("UDPSocket::sendto_segmented: segment_size must be positive");
+    }
+    if (offload() and offload()->send) {
+        const size_t total = payload.size();
+        for (size_t offset = 0; offset < total; offset += segment_size) {
+            BufferViewList datagram = payload;
+            datagram.remove_prefix(offset);
+            datagram.remove_suffix(total - min<size_t>(total, offset + segment_size));
+            offload()->send(destination, destination.size(), datagram);
+        }
+    } else {
+        sendmsg_helper(fd_num(), destination, destination.size(), payload, segment_size);
+    }
+    register_write();
+}
+
+void UDPSocket::set_gro() { setsockopt(SOL_UDP, UDP_GRO, int(true)); }
+
 // mark the socket as listening for incoming connections
 //! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
 void TCPSocket::listen(const int backlog) { SystemCall("listen", ::listen(fd_num(), backlog)); }
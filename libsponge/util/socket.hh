@@ -60,8 +60,9 @@ class UDPSocket : public Socket {
 
     //! Returned by UDPSocket::recv; carries received data and information about the sender
     struct received_datagram {
-        Address source_address;  //!< Address from which this datagram was received
-        std::string payload;     //!< UDP datagram payload
+        Address source_address;   //!< Address from which this datagram was received
+        std::string payload;      //!< UDP datagram payload
+        size_t segment_size = 0;  //!< If nonzero, `payload` is several datagrams of this size coalesced by GRO
     };
 
     //! Receive a datagram and the Address of its sender
@@ -75,6 +76,14 @@ class UDPSocket : public Socket {
 
     //! Send datagram to the socket's connected address (must call connect() first)
     void send(const BufferViewList &payload);
+
+    //! \brief Send `payload` as datagrams of `segment_size` bytes each (the last may be shorter) with one
+    //! [sendmsg(2)](\ref man2::sendmsg), segmented by the kernel or the NIC ([UDP_SEGMENT](\ref man7::udp))
+    void sendto_segmented(const Address &destination, const BufferViewList &payload, const uint16_t segment_size);
+
+    //! \brief Let the kernel coalesce received datagrams of one flow into one recv() ([UDP_GRO](\ref man7::udp))
+    //! \details recv() then reports the size of the coalesced datagrams in received_datagram::segment_size.
+    void set_gro();
 };
 
 //! \class UDPSocket
@@ -0,0 +1,355 @@
+#ifndef SPONGE_LIBSPONGE_TIMER_WHEEL_HH
+#define SPONGE_LIBSPONGE_TIMER_WHEEL_HH
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+//! \brief A hierarchical timing wheel with millisecond resolution
+//! \tparam T the value handed back to the caller when a timer expires
+template <typename T>
+class TimerWheel {
+  public:
+    //! Handle used to cancel a scheduled timer
+    using TimerId = uint64_t;
+
+    //! A TimerId that never refers to a scheduled timer
+    static constexpr TimerId NO_TIMER = 0;
+
+  private:
+    static constexpr unsigned SLOT_BITS = 6;                     //!< log2 of the number of slots per level
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;           //!< Slots per level
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;             //!< Mask selecting a slot index
+    static constexpr unsigned LEVELS = 4;                        //!< Levels in the hierarchy
+    static constexpr uint64_t SPAN = 1ull << (SLOT_BITS * LEVELS);  //!< Range covered by the wheels, in ms
+
+    static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();  //!< End of a slot's list
+
+    //! \name Values of Node::level that don't name a wheel
+    //!@{
+    static constexpr uint8_t OVERFLOW_LIST = LEVELS;  //!< Expires beyond SPAN; waiting to enter the wheels
+    static constexpr uint8_t DETACHED = LEVELS + 1;   //!< Removed from its slot and about to fire
+    static constexpr uint8_t UNUSED = LEVELS + 2;     //!< On the free list
+    //!@}
+
+    //! A scheduled timer, linked into the list of the slot it is waiting in
+    struct Node {
+        uint64_t expiry{};
+        uint32_t prev{NIL};
+        uint32_t next{NIL};
+        uint32_t generation{1};
+        uint8_t level{UNUSED};
+        uint8_t slot{};
+        std::optional<T> value{};
+    };
+
+    std::vector<Node> _nodes{};          //!< Storage for timers, indexed by the low half of a TimerId
+    std::vector<uint32_t> _free_nodes{};  //!< Indices of unused entries in _nodes
+
+    //! Head of each slot's doubly-linked list of nodes
+    std::array<std::array<uint32_t, SLOTS>, LEVELS> _heads{};
+
+    //! One bit per slot, set when that slot's list is non-empty
+    std::array<uint64_t, LEVELS> _occupied{};
+
+    uint32_t _overflow_head{NIL};  //!< Timers that expire more than SPAN ms in the future
+
+    //! Lower bound on the expiry of anything in the overflow list
+    uint64_t _overflow_min{std::numeric_limits<uint64_t>::max()};
+
+    uint64_t _now;     //!< Time up to which all timers have been processed
+    size_t _size{0};  //!< Number of scheduled timers
+
+    //! Scratch list of (index, generation) of the timers firing in the current slot
+    std::vector<std::pair<uint32_t, uint32_t>> _firing{};
+
+    uint32_t &head(const uint8_t level, const uint8_t slot) {
+        return level == OVERFLOW_LIST ? _overflow_head : _heads[level][slot];
+    }
+
+    static TimerId make_id(const uint32_t index, const uint32_t generation) {
+        return (uint64_t(generation) << 32) | index;
+    }
+
+    void link(const uint32_t index, const uint8_t level, const uint8_t slot) {
+        Node &node = _nodes[index];
+        uint32_t &first = head(level, slot);
+        node.level = level;
+        node.slot = slot;
+        node.prev = NIL;
+        node.next = first;
+        if (first != NIL) {
+            _nodes[first].prev = index;
+        }
+        first = index;
+        if (level < LEVELS) {
+            _occupied[level] |= 1ull << slot;
+        }
+    }
+
+    void unlink(const uint32_t index) {
+        Node &node = _nodes[index];
+        if (node.prev != NIL) {
+            _nodes[node.prev].next = node.next;
+        } else {
+            head(node.level, node.slot) = node.next;
+        }
+        if (node.next != NIL) {
+            _nodes[node.next].prev = node.prev;
+        }
+        if (node.level < LEVELS and _heads[node.level][node.slot] == NIL) {
+            _occupied[node.level] &= ~(1ull << node.slot);
+        }
+    }
+
+    //! Put a node into the slot that will be processed at (or, via a cascade, just before) its expiry
+    //! \param[in] due_slot the level-0 slot for timers whose expiry has already been reached
+    void place(const uint32_t index, const uint8_t due_slot) {
+        const uint64_t expiry = _nodes[index].expiry;
+        if (expiry <= _now) {
+            link(index, 0, due_slot);
+            return;
+        }
+        const uint64_t delta = expiry - _now;
+        for (unsigned level = 0; level < LEVELS; level++) {
+            if (delta < (1ull << (SLOT_BITS * (level + 1)))) {
+                link(index, level, (expiry >> (SLOT_BITS * level)) & SLOT_MASK);
+                return;
+            }
+        }
+        link(index, OVERFLOW_LIST, 0);
+        _overflow_min = std::min(_overflow_min, expiry);
+    }
+
+    void release(const uint32_t index) {
+        Node &node = _nodes[index];
+        node.value.reset();
+        node.level = UNUSED;
+        node.generation++;
+        _free_nodes.push_back(index);
+        _size--;
+    }
+
+    //! The next time at which a slot has to be cascaded or fired (or the overflow list revisited)
+    uint64_t next_event() const {
+        uint64_t ret = std::numeric_limits<uint64_t>::max();
+        for (unsigned level = 0; level < LEVELS; level++) {
+            if (not _occupied[level]) {
+                continue;
+            }
+            // find the first occupied slot after the current one, wrapping around
+            const uint64_t current = _now >> (SLOT_BITS * level);
+            const unsigned start = (current + 1) & SLOT_MASK;
+            const uint64_t bits = _occupied[level];
+            const uint64_t rotated = start ? (bits >> start) | (bits << (SLOTS - start)) : bits;
+            const uint64_t steps = __builtin_ctzll(rotated) + 1;
+            ret = std::min(ret, (current + steps) << (SLOT_BITS * level));
+        }
+        if (_overflow_head != NIL) {
+            ret = std::min(ret, std::max(_now + 1, _overflow_min - SPAN + 1));
+        }
+        return ret;
+    }
+
+    //! Move every timer in a slot down to the level appropriate for the current time
+    void cascade(const uint8_t level, const uint8_t slot) {
+        uint32_t index = _heads[level][slot];
+        _heads[level][slot] = NIL;
+        _occupied[level] &= ~(1ull << slot);
+        while (index != NIL) {
+            const uint32_t next = _nodes[index].next;
+            place(index, _now & SLOT_MASK);
+            index = next;
+        }
+    }
+
+    void refill_from_overflow() {
+        uint32_t index = _overflow_head;
+        _overflow_head = NIL;
+        _overflow_min = std::numeric_limits<uint64_t>::max();
+        while (index != NIL) {
+            const uint32_t next = _nodes[index].next;
+            place(index, _now & SLOT_MASK);
+            index = next;
+        }
+    }
+
+    //! Call `on_expire` for each of the detached timers in _firing that hasn't been cancelled since
+    template <typename Callback>
+    void fire(Callback &&on_expire) {
+        for (size_t i = 0; i < _firing.size(); i++) {
+            const auto [index, generation] = _firing[i];
+            if (_nodes[index].generation != generation or _nodes[index].level != DETACHED) {
+                continue;  // cancelled by an earlier callback
+            }
+            T value = std::move(_nodes[index].value.value());
+            release(index);
+            on_expire(value);
+        }
+    }
+
+  public:
+    //! Construct an empty wheel whose clock starts at `now`
+    explicit TimerWheel(const uint64_t now = 0) : _now(now) {
+        for (auto &level : _heads) {
+            level.fill(NIL);
+        }
+    }
+
+    //! \brief Schedule a timer
+    //! \param[in] expiry the absolute time (in ms) at which the timer fires
+    //! \param[in] value is handed to the callback of advance() when the timer fires
+    //! \returns a handle that can be passed to cancel()
+    //! \note A timer whose expiry is not after now() fires on the next call to advance() that moves the clock.
+    TimerId schedule(const uint64_t expiry, T value) {
+        uint32_t index;
+        if (_free_nodes.empty()) {
+            index = _nodes.size();
+            _nodes.emplace_back();
+        } else {
+            index = _free_nodes.back();
+            _free_nodes.pop_back();
+        }
+        Node &node = _nodes[index];
+        node.expiry = expiry;
+        node.value.emplace(std::move(value));
+        _size++;
+        place(index, (_now + 1) & SLOT_MASK);
+        return make_id(index, node.generation);
+    }
+
+    //! \brief Cancel a pending timer
+    //! \returns `true` if the timer was pending, `false` if it had already fired or been cancelled
+    bool cancel(const TimerId id) {
+        if (not pending(id)) {
+            return false;
+        }
+        const uint32_t index = id & 0xffffffff;
+        if (_nodes[index].level != DETACHED) {
+            unlink(index);
+        }
+        release(index);
+        return true;
+    }
+
+    //! \returns `true` if `id` names a timer that has neither fired nor been cancelled
+    bool pending(const TimerId id) const {
+        const uint32_t index = id & 0xffffffff;
+        return index < _nodes.size() and _nodes[index].generation == (id >> 32) and
+               _nodes[index].level != UNUSED;
+    }
+
+    //! \brief Move the clock forward, firing every timer whose expiry is at or before `now`
+    //! \param[in] now the new time, in ms; must not be earlier than now()
+    //! \param[in] on_expire is called as `on_expire(T &)` for each expired timer, in order of expiry
+    //! \details Only slots that contain timers are visited, so the cost is proportional to the
+    //! number of timers that fire (or move down a level), not to the time elapsed.
+    //! `on_expire` may schedule and cancel timers, but must not call advance().
+    template <typename Callback>
+    void advance(const uint64_t now, Callback &&on_expire) {
+        while (true) {
+            const uint64_t t = next_event();
+            if (t > now) {
+                break;
+            }
+            _now = t;
+
+            // cascade from the top so that timers falling through several levels land in this slot
+            for (unsigned level = LEVELS - 1; level >= 1; level--) {
+                const unsigned shift = SLOT_BITS * level;
+                if ((t & ((1ull << shift) - 1)) == 0) {
+                    cascade(level, (t >> shift) & SLOT_MASK);
+                }
+            }
+            if (_overflow_head != NIL and _overflow_min < t + SPAN) {
+                refill_from_overflow();
+            }
+
+            // detach the current slot before running callbacks, which may schedule or cancel timers
+            const uint8_t slot = t & SLOT_MASK;
+            _firing.clear();
+            for (uint32_t index = _heads[0][slot]; index != NIL; index = _nodes[index].next) {
+                _nodes[index].level = DETACHED;
+                _firing.emplace_back(index, _nodes[index].generation);
+            }
+            _heads[0][slot] = NIL;
+            _occupied[0] &= ~(1ull << slot);
+
+            fire(on_expire);
+        }
+        if (now > _now) {
+            _now = now;
+        }
+    }
+
+    //! \brief Fire every timer whose expiry is at or before now(), without moving the clock
+    //! \details Such timers otherwise wait for the next advance() that moves the clock. Timers that
+    //! `on_expire` schedules for now() or earlier wait for a later call.
+    template <typename Callback>
+    void fire_due(Callback &&on_expire) {
+        // schedule() puts timers that are already due in the slot after the current one
+        const uint8_t slot = (_now + 1) & SLOT_MASK;
+        _firing.clear();
+        for (uint32_t index = _heads[0][slot]; index != NIL; index = _nodes[index].next) {
+            if (_nodes[index].expiry <= _now) {
+                _firing.emplace_back(index, _nodes[index].generation);
+            }
+        }
+        for (const auto &[index, generation] : _firing) {
+            unlink(index);
+            _nodes[index].level = DETACHED;
+        }
+        fire(on_expire);
+    }
+
+    //! \returns the earliest expiry among the scheduled timers, or an empty optional if there are none
+    std::optional<uint64_t> next_expiry() const {
+        std::optional<uint64_t> ret{};
+        const auto consider = [&](uint32_t index) {
+            for (; index != NIL; index = _nodes[index].next) {
+                if (not ret.has_value() or _nodes[index].expiry < ret.value()) {
+                    ret = _nodes[index].expiry;
+                }
+            }
+        };
+        // within a level, the first occupied slot after the current one holds that level's earliest timers
+        for (unsigned level = 0; level < LEVELS; level++) {
+            if (not _occupied[level]) {
+                continue;
+            }
+            const uint64_t current = _now >> (SLOT_BITS * level);
+            for (unsigned steps = 1; steps <= SLOTS; steps++) {
+                const uint8_t slot = (current + steps) & SLOT_MASK;
+                if (_occupied[level] & (1ull << slot)) {
+                    consider(_heads[level][slot]);
+                    break;
+                }
+            }
+        }
+        consider(_overflow_head);
+        return ret;
+    }
+
+    //! The time up to which timers have been processed, in ms
+    uint64_t now() const { return _now; }
+
+    //! Number of timers that are scheduled and have not fired or been cancelled
+    size_t size() const { return _size; }
+
+    //! `true` if no timers are scheduled
+    bool empty() const { return _size == 0; }
+};
+
+//! \class TimerWheel
+//! Timers are kept in four levels of 64 slots. Level 0 has one slot per millisecond, level 1 one slot per
+//! 64 ms, and so on, so the wheels cover about 4.6 hours; timers further out wait in an overflow list.
+//! When the clock crosses a slot boundary of an upper level, that slot's timers are "cascaded" into
+//! the finer levels below. Scheduling and cancelling are O(1), and advancing the clock jumps directly
+//! between occupied slots (found with one bit scan per level).
+
+#endif  // SPONGE_LIBSPONGE_TIMER_WHEEL_HH
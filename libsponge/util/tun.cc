@@ -14,6 +14,12 @@ using namespace std;
 
 //! \param[in] devname is the name of the TUN or TAP device, specified at its creation.
 //! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device (expects Ethernet frames)
+//! \param[in] multi_queue opens one queue of a device created with `multi_queue`; each open of the device adds
+//! a queue, and the kernel spreads the packets it sends to the device among the queues by flow
+//! \param[in] vnet_hdr has each packet begin with a VirtioNetHeader, in both directions, and turns on the
+//! device's checksum and TCP segmentation offloads: a packet written to it may carry a TCP segment of up to
+//! 64 KiB with its checksum left to the kernel, which segments it as needed, and the kernel may likewise
+//! read out unsegmented TCP segments (its own, or ones it has coalesced by GRO).
 //!
 //! To create a TUN device, you should already have run
 //!
@@ -21,11 +27,17 @@ using namespace std;
 //!
 //! as root before calling this function.
 
-TunTapFD::TunTapFD(const string &devname, const bool is_tun)
-    : FileDescriptor(SystemCall("open", open(CLONEDEV, O_RDWR))) {
+TunTapFD::TunTapFD(const string &devname, const bool is_tun, const bool multi_queue, const bool vnet_hdr)
+    : FileDescriptor(SystemCall("open", open(CLONEDEV, O_RDWR))), _vnet_hdr(vnet_hdr) {
     struct ifreq tun_req {};
 
     tun_req.ifr_flags = (is_tun ? IFF_TUN : IFF_TAP) | IFF_NO_PI;  // tun device with no packetinfo
+    if (multi_queue) {
+        tun_req.ifr_flags |= IFF_MULTI_QUEUE;
+    }
+    if (vnet_hdr) {
+        tun_req.ifr_flags |= IFF_VNET_HDR;
+    }
 
     // copy devname to ifr_name, making sure to null terminate
 
@@ -33,4 +45,51 @@ TunTapFD::TunTapFD(const string &devname, const bool is_tun)
     tun_req.ifr_name[IFNAMSIZ - 1] = '\0';
 
     SystemCall("ioctl", ioctl(fd_num(), TUNSETIFF, static_cast<void *>(&tun_req)));
+
+    if (vnet_hdr) {
+        const unsigned long offloads = TUN_F_CSUM | TUN_F_TSO4;
+        SystemCall("ioctl", ioctl(fd_num(), TUNSETOFFLOAD, offloads));
+    }
+}
+
+//! Set IFF_ATTACH_QUEUE or IFF_DETACH_QUEUE on a queue of a multi-queue device
+static void set_queue(const FileDescriptor &fd, const short flag) {
+    struct ifreq queue_req {};
+    queue_req.ifr_flags = flag;
+    SystemCall("ioctl", ioctl(fd.fd_num(), TUNSETQUEUE, static_cast<void *>(&queue_req)));
+}
+
+void TunTapFD::attach_queue() { set_queue(*this, IFF_ATTACH_QUEUE); }
+
+//! \details Packets can still be written to a detached queue. A device must keep at least one queue attached.
+void TunTapFD::detach_queue() { set_queue(*this, IFF_DETACH_QUEUE); }
+
+//! \param[in] devname is the name of the device, which must have been created with `multi_queue`
+//! \param[in] is_tun is `true` for a TUN device, or `false` for a TAP device
+//! \param[in] count is the number of queues to open (the kernel allows up to 256)
+TunTapQueues::TunTapQueues(const string &devname, const bool is_tun, const size_t count)
+    : _devname(devname), _is_tun(is_tun) {
+    for (size_t i = 0; i < count; i++) {
+        add();
+    }
+}
+
+size_t TunTapQueues::add() {
+    _queues.emplace_back(_devname, _is_tun, true);
+    _attached.push_back(true);
+    return _queues.size() - 1;
+}
+
+void TunTapQueues::attach(const size_t index) {
+    if (not _attached.at(index)) {
+        _queues.at(index).attach_queue();
+        _attached.at(index) = true;
+    }
+}
+
+void TunTapQueues::detach(const size_t index) {
+    if (_attached.at(index)) {
+        _queues.at(index).detach_queue();
+        _attached.at(index) = false;
+    }
 }
@@ -3,20 +3,61 @@
 
 #include "file_descriptor.hh"
 
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <string>
+#include <vector>
+
+//! \brief The header that begins each packet read from or written to a TUN or TAP device opened with `vnet_hdr`
+//! \details The layout of `struct virtio_net_hdr` from `<linux/virtio_net.h>` (which isn't valid C++), in
+//! host byte order.
+struct VirtioNetHeader {
+    static constexpr uint8_t F_NEEDS_CSUM = 1;  //!< Flag: the checksum at `csum_start + csum_offset` is partial
+    static constexpr uint8_t F_DATA_VALID = 2;  //!< Flag: the kernel has checked the checksum
+    static constexpr uint8_t GSO_NONE = 0;      //!< Not to be segmented
+    static constexpr uint8_t GSO_TCPV4 = 1;     //!< A TCP segment in IPv4, to be cut into `gso_size` pieces
+
+    uint8_t flags{0};         //!< F_NEEDS_CSUM and F_DATA_VALID
+    uint8_t gso_type{0};      //!< GSO_NONE or GSO_TCPV4
+    uint16_t hdr_len{0};      //!< Length of the headers to copy into each piece
+    uint16_t gso_size{0};     //!< Payload size of each piece
+    uint16_t csum_start{0};   //!< Where the checksum starts being computed
+    uint16_t csum_offset{0};  //!< Where the checksum goes, from `csum_start`
+};
 
 //! A FileDescriptor to a [Linux TUN/TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunTapFD : public FileDescriptor {
+  private:
+    bool _vnet_hdr;  //!< Whether each packet read or written begins with a VirtioNetHeader
+
   public:
     //! Open an existing persistent [TUN or TAP device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TunTapFD(const std::string &devname, const bool is_tun);
+    explicit TunTapFD(const std::string &devname,
+                      const bool is_tun,
+                      const bool multi_queue = false,
+                      const bool vnet_hdr = false);
+
+    //! Whether each packet read or written begins with a VirtioNetHeader (see the constructor)
+    bool vnet_hdr() const { return _vnet_hdr; }
+
+    //! \name Queues of a multi-queue device
+    //!@{
+
+    //! Have the kernel deliver packets to this queue again, after detach_queue()
+    void attach_queue();
+
+    //! Stop the kernel from delivering packets to this queue, without closing it
+    void detach_queue();
+    //!@}
 };
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunFD : public TunTapFD {
   public:
     //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-    explicit TunFD(const std::string &devname) : TunTapFD(devname, true) {}
+    explicit TunFD(const std::string &devname, const bool multi_queue = false, const bool vnet_hdr = false)
+        : TunTapFD(devname, true, multi_queue, vnet_hdr) {}
 };
 
 //! A FileDescriptor to a [Linux TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -26,4 +67,38 @@ class TapFD : public TunTapFD {
     explicit TapFD(const std::string &devname) : TunTapFD(devname, false) {}
 };
 
+//! \brief The queues of a multi-queue TUN or TAP device
+//! \details The kernel spreads the packets it sends to the device among the attached queues by flow, so
+//! each queue can be served by a different thread or EventLoop. Packets written to any queue enter the
+//! kernel's network stack. The device must have been created with
+//!
+//!     ip tuntap add mode tun multi_queue user `username` name `devname`
+class TunTapQueues {
+  private:
+    std::string _devname;             //!< Name of the device
+    bool _is_tun;                     //!< TUN (IP datagrams) or TAP (Ethernet frames)
+    std::deque<TunTapFD> _queues{};  //!< The queues, attached or not (a deque, so add() leaves queue()s valid)
+    std::vector<bool> _attached{};   //!< Whether each queue is attached
+
+  public:
+    //! Open `count` queues of an existing persistent multi-queue device, all attached
+    TunTapQueues(const std::string &devname, const bool is_tun, const size_t count);
+
+    //! Open one more queue, attached, and return its index
+    size_t add();
+
+    //! Number of queues opened
+    size_t size() const { return _queues.size(); }
+
+    //! A queue (which can be duplicate()d, for instance to hand to another thread), valid as long as this is
+    TunTapFD &queue(const size_t index) { return _queues.at(index); }
+
+    //! \name Attaching and detaching queues at runtime
+    //!@{
+    void attach(const size_t index);                                         //!< See TunTapFD::attach_queue
+    void detach(const size_t index);                                         //!< See TunTapFD::detach_queue
+    bool attached(const size_t index) const { return _attached.at(index); }  //!< Whether a queue is attached
+    //!@}
+};
+
 #endif  // SPONGE_LIBSPONGE_TUN_HH
@@ -0,0 +1,161 @@
+#include "byte_ring.hh"
+#include "socket.hh"
+#include "test_should_be.hh"
+#include "util.hh"
+
+#include <cerrno>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <poll.h>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+//! Whether `fd` would be reported readable by a poll right now
+static bool readable(const FileDescriptor &fd) {
+    pollfd pfd{fd.fd_num(), POLLIN, 0};
+    SystemCall("poll", ::poll(&pfd, 1, 0));
+    return (pfd.revents & POLLIN) != 0;
+}
+
+//! The i-th byte of a test stream
+static char byte_at(const uint64_t i) { return char((i * 2654435761U) >> 24); }
+
+int main() {
+    try {
+        // a ring on its own: wrapping, and the doorbells
+        {
+            ByteRing ring{10};
+            test_should_be(ring.capacity(), size_t(16));
+            test_should_be(readable(ring.readable_event()), false);
+
+            test_should_be(ring.push("0123456789"), size_t(10));
+            test_should_be(readable(ring.readable_event()), true);
+            string out;
+            ring.pop(out, 6);
+            test_should_be(out == "012345", true);
+            test_should_be(readable(ring.readable_event()), true);
+
+            // wraps around the end of the storage, and only fills what is left
+            test_should_be(ring.push("abcdefghijklmnop"), size_t(12));
+            test_should_be(ring.size(), size_t(16));
+            test_should_be(readable(ring.writable_event()), false);
+            ring.pop(out, 100);
+            test_should_be(out == "6789abcdefghijkl", true);
+            test_should_be(readable(ring.readable_event()), false);
+            test_should_be(readable(ring.writable_event()), true);
+
+            // closing: what is left can still be popped, then the ring is at its end
+            ring.push("xy");
+            ring.close();
+            test_should_be(ring.eof(), false);
+            ring.pop(out, 100);
+            test_should_be(out == "xy", true);
+            test_should_be(ring.eof(), true);
+            test_should_be(readable(ring.readable_event()), true);
+
+            bool threw = false;
+            try {
+                ring.push("z");
+            } catch (const unix_error &e) {
+                threw = e.code().value() == EPIPE;
+            }
+            test_should_be(threw, true);
+        }
+
+        // a producer and a consumer thread pass a long stream through a small ring in random-sized pieces
+        {
+            constexpr uint64_t TOTAL = 16 * 1024 * 1024;
+            ByteRing ring{4096};
+
+            thread producer([&] {
+                mt19937 rng{1};
+                string chunk;
+                uint64_t sent = 0;
+                while (sent < TOTAL) {
+                    chunk.resize(min<uint64_t>(TOTAL - sent, rng() % 10000));
+                    for (size_t i = 0; i < chunk.size(); i++) {
+                        chunk[i] = byte_at(sent + i);
+                    }
+                    BufferViewList rest{chunk};
+                    while (rest.size() > 0) {
+                        const size_t pushed = ring.push(rest);
+                        rest.remove_prefix(pushed);
+                        sent += pushed;
+                        if (rest.size() > 0) {
+                            ring.wait_for_room();
+                        }
+                    }
+                }
+                ring.close();
+            });
+
+            mt19937 rng{2};
+            string out;
+            uint64_t received = 0;
+            bool in_order = true;
+            while (not ring.eof()) {
+                ring.wait_for_data();
+                ring.pop(out, rng() % 10000);
+                for (size_t i = 0; i < out.size(); i++) {
+                    in_order &= out[i] == byte_at(received + i);
+                }
+                received += out.size();
+            }
+            producer.join();
+            test_should_be(received, TOTAL);
+            test_should_be(in_order, true);
+        }
+
+        // a ring_pair stands in for a pair of connected stream sockets
+        {
+            auto [first, second] = ring_pair(1024);
+            LocalStreamSocket a{move(first)}, b{move(second)};
+
+            a.write("hello");
+            test_should_be(readable(b), true);
+            test_should_be(readable(a), false);
+            test_should_be(b.read() == "hello", true);
+            test_should_be(readable(b), false);
+            test_should_be(a.write_count(), 1U);
+            test_should_be(b.read_count(), 1U);
+
+            // a blocking read waits for the writer; a non-blocking one doesn't
+            thread writer([&] { a.write(string(5000, 'x')); });
+            size_t total = 0;
+            while (total < 5000) {
+                total += b.read().size();
+            }
+            writer.join();
+            test_should_be(total, size_t(5000));
+
+            b.set_blocking(false);
+            bool threw = false;
+            try {
+                b.read();
+            } catch (const unix_error &e) {
+                threw = e.code().value() == EAGAIN;
+            }
+            test_should_be(threw, true);
+
+            // a write that needn't write all writes what fits
+            test_should_be(b.write(string(2000, 'y'), false), size_t(1024));
+            test_should_be(a.read().size(), size_t(1024));
+
+            // shutting down one direction gives the other end an EOF in that direction only
+            b.shutdown(SHUT_WR);
+            test_should_be(a.read().empty(), true);
+            test_should_be(a.eof(), true);
+            a.write("still open");
+            test_should_be(b.read() == "still open", true);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
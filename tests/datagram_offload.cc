@@ -0,0 +1,100 @@
+#include "buffer.hh"
+#include "fd_adapter.hh"
+#include "socket.hh"
+#include "tcp_segment.hh"
+#include "test_should_be.hh"
+#include "wrapping_integers.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+
+using namespace std;
+
+//! A UDP socket bound to an ephemeral port on the loopback interface
+static UDPSocket bound_socket() {
+    UDPSocket sock;
+    sock.bind(Address{"127.0.0.1", 0});
+    return sock;
+}
+
+int main() {
+    try {
+        // a Buffer can be sliced into pieces that share its storage
+        {
+            const Buffer whole{string("0123456789")};
+            Buffer piece = whole;
+            piece.remove_prefix(3);
+            piece.remove_suffix(2);
+            test_should_be(piece.copy() == "34567", true);
+            test_should_be(piece.str().data() == whole.str().data() + 3, true);
+            piece.remove_suffix(5);
+            test_should_be(piece.size(), size_t(0));
+            test_should_be(whole.copy() == "0123456789", true);
+        }
+
+        // one segmented send arrives as one coalesced datagram at a socket with GRO
+        {
+            UDPSocket receiver = bound_socket();
+            receiver.set_gro();
+            UDPSocket sender;
+            sender.sendto_segmented(receiver.local_address(), string(10 * 100 + 50, 'x'), 100);
+            test_should_be(sender.write_count(), 1U);
+
+            const auto datagram = receiver.recv();
+            test_should_be(datagram.payload.size(), size_t(1050));
+            test_should_be(datagram.segment_size, size_t(100));
+        }
+
+        // without GRO, the same send arrives as separate datagrams
+        {
+            UDPSocket receiver = bound_socket();
+            UDPSocket sender;
+            sender.sendto_segmented(receiver.local_address(), string(3 * 100, 'y'), 100);
+            for (int i = 0; i < 3; i++) {
+                const auto datagram = receiver.recv();
+                test_should_be(datagram.payload.size(), size_t(100));
+                test_should_be(datagram.segment_size, size_t(0));
+            }
+        }
+
+        // a pair of adapters with segmentation offload pass a flight of segments in one send and one receive
+        {
+            UDPSocket a_sock = bound_socket(), b_sock = bound_socket();
+            const Address a_address = a_sock.local_address(), b_address = b_sock.local_address();
+            TCPOverUDPSocketAdapter a{move(a_sock), true}, b{move(b_sock), true};
+            a.config_mut().source = a_address;
+            a.config_mut().destination = b_address;
+            b.config_mut().source = b_address;
+            b.config_mut().destination = a_address;
+
+            // ten full segments and a shorter last one make one batch; a longer one then starts another
+            for (uint32_t i = 0; i < 12; i++) {
+                TCPSegment seg;
+                seg.header().ack = true;
+                seg.header().seqno = WrappingInt32{i * 1000};
+                seg.payload() = string(i == 10 ? 500 : 1000, char('a' + i));
+                a.write(seg);
+            }
+            a.flush();
+            const UDPSocket &a_udp = a, &b_udp = b;
+            test_should_be(a_udp.write_count(), 2U);
+
+            for (uint32_t i = 0; i < 12; i++) {
+                const optional<TCPSegment> seg = b.read();
+                test_should_be(seg.has_value(), true);
+                test_should_be(seg->header().seqno.raw_value(), i * 1000);
+                test_should_be(seg->payload().copy() == string(i == 10 ? 500 : 1000, char('a' + i)), true);
+                test_should_be(b.read_pending(), i != 10 and i != 11);
+            }
+            test_should_be(b_udp.read_count(), 2U);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+#include "eventloop.hh"
+#include "socket.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+#define check(condition) check_condition(condition, #condition, __LINE__)
+
+static void check_condition(const bool condition, const char *condition_s, const int lineno) {
+    if (not condition) {
+        throw runtime_error("`" + string(condition_s) + "` failed (at line " + to_string(lineno) + ")");
+    }
+}
+
+pair<LocalStreamSocket, LocalStreamSocket> make_socket_pair() {
+    int fds[2];
+    SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_STREAM, 0, static_cast<int *>(fds)));
+    return {LocalStreamSocket{FileDescriptor{fds[0]}}, LocalStreamSocket{FileDescriptor{fds[1]}}};
+}
+
+void check_backend(const EventLoop::Backend backend) {
+    auto [a, b] = make_socket_pair();
+    EventLoop loop{backend};
+
+    string received;
+    bool b_canceled = false;
+    const auto b_in = loop.add_rule(
+        b, Direction::In, [&] { received += b.read(); }, {}, [&] { b_canceled = true; });
+
+    // nothing to read yet
+    check(loop.wait_next_event(0) == EventLoop::Result::Timeout);
+
+    a.write("hello");
+    check(loop.wait_next_event(0) == EventLoop::Result::Success);
+    check(received == string("hello"));
+
+    // an uninterested rule isn't polled, and a loop with no interested rules exits
+    loop.set_interest(b_in, false);
+    a.write("again");
+    check(loop.wait_next_event(0) == EventLoop::Result::Exit);
+    loop.set_interest(b_in, true);
+    check(loop.wait_next_event(0) == EventLoop::Result::Success);
+    check(received == string("helloagain"));
+
+    // a rule with an interest callback is polled only while the callback says so
+    string to_send = "xyz";
+    loop.add_rule(
+        a,
+        Direction::Out,
+        [&] {
+            a.write(to_send);
+            to_send.clear();
+        },
+        [&] { return not to_send.empty(); });
+    check(loop.wait_next_event(0) == EventLoop::Result::Success);
+    check(loop.wait_next_event(0) == EventLoop::Result::Success);
+    check(received == string("helloagainxyz"));
+    check(loop.wait_next_event(0) == EventLoop::Result::Timeout);
+
+    // EOF cancels the reading rule
+    a.shutdown(SHUT_WR);
+    check(loop.wait_next_event(0) == EventLoop::Result::Success);
+    check(loop.wait_next_event(0) == EventLoop::Result::Exit);
+    check(b_canceled);
+}
+
+//! The io_uring backend receives and sends datagrams itself
+void check_io_uring_datagrams() {
+    UDPSocket receiver;
+    receiver.bind(Address{"127.0.0.1", 0});
+    UDPSocket sender;
+    sender.bind(Address{"127.0.0.1", 0});
+
+    EventLoop loop{EventLoop::Backend::IoUring};
+    vector<string> received;
+    size_t mtu = 65536, oversized = 0;
+    loop.add_rule(receiver, Direction::In, [&] {
+        try {
+            const auto datagram = receiver.recv(mtu);
+            check(datagram.source_address == sender.local_address());
+            received.push_back(datagram.payload);
+        } catch (const unix_error &) {
+            throw;
+        } catch (const runtime_error &) {
+            oversized++;
+        }
+    });
+    loop.add_rule(sender, Direction::In, [&] { sender.recv(); });
+
+    // queued by the loop, and sent by its next wait
+    sender.sendto(receiver.local_address(), "one");
+    sender.sendto(receiver.local_address(), string(60000, 'x'));
+    sender.sendto(receiver.local_address(), "three");
+    while (received.size() < 3) {
+        check(loop.wait_next_event(1000) == EventLoop::Result::Success);
+    }
+    check(received.at(0) == "one");
+    check(received.at(1) == string(60000, 'x'));
+    check(received.at(2) == "three");
+
+    // reading more than has been received fails as it would on a non-blocking socket
+    bool threw = false;
+    try {
+        receiver.recv();
+    } catch (const unix_error &e) {
+        threw = e.code().value() == EAGAIN;
+    }
+    check(threw);
+
+    // a datagram too big for the caller is consumed, so that the ones behind it still arrive
+    mtu = 1000;
+    sender.sendto(receiver.local_address(), string(2000, 'x'));
+    sender.sendto(receiver.local_address(), "after");
+    while (received.size() < 4) {
+        check(loop.wait_next_event(1000) == EventLoop::Result::Success);
+    }
+    check(oversized == 1);
+    check(received.at(3) == "after");
+}
+
+//! Timers fire from wait_next_event, bound its wait, and keep it from returning Exit
+void check_timers(const EventLoop::Backend backend) {
+    EventLoop loop{backend};
+    vector<string> fired;
+
+    // a loop with nothing but timers sleeps until the next one
+    loop.add_timer(30, [&] { fired.push_back("once"); });
+    const EventLoop::TimerId periodic = loop.add_timer(10, [&] { fired.push_back("tick"); }, 10);
+    const EventLoop::TimerId canceled = loop.add_timer(5, [&] { fired.push_back("canceled"); });
+    check(loop.cancel_timer(canceled));
+    check(not loop.cancel_timer(canceled));
+    check(loop.pending_timers() == 2);
+
+    const uint64_t start = timestamp_ms();
+    check(loop.wait_next_event(0) == EventLoop::Result::Timeout);
+    check(loop.wait_next_event(-1) == EventLoop::Result::Success);
+    check(fired == vector<string>{"tick"});
+    check(timestamp_ms() - start >= 10);
+    while (fired.size() < 4) {
+        check(loop.wait_next_event(1000) == EventLoop::Result::Success);
+    }
+    check(count(fired.begin(), fired.end(), "once") == 1);
+    check(loop.pending_timers() == 1);
+
+    // a timer shortens the wait for an fd; a periodic timer can cancel itself
+    auto [a, b] = make_socket_pair();
+    loop.add_rule(a, Direction::In, [&] { a.read(); });
+    loop.cancel_timer(periodic);
+    bool done = false;
+    EventLoop::TimerId self = EventLoop::NO_TIMER;
+    self = loop.add_timer(
+        5,
+        [&] {
+            done = true;
+            loop.cancel_timer(self);
+        },
+        5);
+    check(loop.wait_next_event(5000) == EventLoop::Result::Success);
+    check(done);
+    check(loop.pending_timers() == 0);
+    check(timestamp_ms() - start < 5000);
+
+    b.write("x");
+    check(loop.wait_next_event(0) == EventLoop::Result::Success);
+    b.shutdown(SHUT_WR);
+    check(loop.wait_next_event(0) == EventLoop::Result::Success);
+    check(loop.wait_next_event(0) == EventLoop::Result::Exit);
+}
+
+//! \returns `false` if this kernel (or sandbox) doesn't allow io_uring
+static bool io_uring_available() {
+    try {
+        EventLoop loop{EventLoop::Backend::IoUring};
+        return true;
+    } catch (const unix_error &e) {
+        cerr << "Skipping io_uring backend: " << e.what() << "\n";
+        return false;
+    }
+}
+
+int main() {
+    try {
+        check_backend(EventLoop::Backend::Poll);
+        check_backend(EventLoop::Backend::Epoll);
+        check_timers(EventLoop::Backend::Poll);
+        check_timers(EventLoop::Backend::Epoll);
+        if (io_uring_available()) {
+            check_backend(EventLoop::Backend::IoUring);
+            check_io_uring_datagrams();
+            check_timers(EventLoop::Backend::IoUring);
+        }
+
+        // the epoll backend merges further rules for an fd into its registration
+        {
+            auto [a, b] = make_socket_pair();
+            EventLoop loop{EventLoop::Backend::Epoll};
+            string first, second;
+            loop.add_rule(a, Direction::In, [&] { first += a.read(1); });
+            loop.add_rule(a, Direction::In, [&] { second += a.read(1); });
+            b.write("xy");
+            check(loop.wait_next_event(0) == EventLoop::Result::Success);
+            check(first == "x" and second == "y");
+        }
+
+        // a hangup cancels the epoll backend's writers, even those that aren't polled
+        {
+            auto [a, b] = make_socket_pair();
+            EventLoop loop{EventLoop::Backend::Epoll};
+            bool in_canceled = false, out_canceled = false;
+            loop.add_rule(
+                a, Direction::In, [&] { a.read(); }, {}, [&] { in_canceled = true; });
+            loop.add_rule(
+                a, Direction::Out, [&] { a.write("x"); }, [] { return false; }, [&] { out_canceled = true; });
+            b.close();
+            check(loop.wait_next_event(0) == EventLoop::Result::Success);
+            check(in_canceled and out_canceled);
+            check(loop.wait_next_event(0) == EventLoop::Result::Exit);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
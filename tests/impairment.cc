@@ -0,0 +1,202 @@
+#include "impairment.hh"
+#include "test_should_be.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//! A segment of `size` bytes (with its header) numbered `n`
+static TCPSegment numbered(const uint32_t n, const size_t size = 20) {
+    TCPSegment segment;
+    segment.header().seqno = WrappingInt32{n};
+    segment.payload() = string(size - 20, 'x');
+    return segment;
+}
+
+//! \brief Push `count` segments through `impairment`, one each millisecond, then keep ticking until it's empty
+//! \returns the number and release time of each segment that made it through, in order
+static vector<pair<uint32_t, uint64_t>> run(Impairment &impairment, const uint32_t count, const size_t size = 20) {
+    vector<pair<uint32_t, uint64_t>> ret;
+    const auto take = [&](const uint64_t now) {
+        while (auto segment = impairment.pop()) {
+            ret.emplace_back(segment->header().seqno.raw_value(), now);
+        }
+    };
+    uint64_t now = 0;
+    for (uint32_t n = 0; n < count; n++, now++) {
+        impairment.push(numbered(n, size));
+        take(now);
+        impairment.tick(1);
+    }
+    for (; impairment.time_until_next_deadline(); now++) {
+        take(now);
+        impairment.tick(1);
+    }
+    return ret;
+}
+
+int main() {
+    try {
+        // with no impairment, segments go straight through
+        {
+            Impairment impairment{{}, 1};
+            for (uint32_t n = 0; n < 3; n++) {
+                impairment.push(numbered(n));
+            }
+            test_should_be(impairment.ready(), true);
+            for (uint32_t n = 0; n < 3; n++) {
+                test_should_be(impairment.pop().value().header().seqno.raw_value(), n);
+            }
+            test_should_be(impairment.pop().has_value(), false);
+            test_should_be(impairment.time_until_next_deadline().has_value(), false);
+        }
+
+        // a delay holds segments back until enough time has passed
+        {
+            ImpairmentConfig config;
+            config.delay_ms = 40;
+            Impairment impairment{config, 1};
+            impairment.push(numbered(0));
+            test_should_be(impairment.pop().has_value(), false);
+            test_should_be(impairment.time_until_next_deadline().value(), size_t(40));
+            impairment.tick(39);
+            test_should_be(impairment.ready(), false);
+            test_should_be(impairment.time_until_next_deadline().value(), size_t(1));
+            impairment.tick(1);
+            test_should_be(impairment.ready(), true);
+            test_should_be(impairment.pop().has_value(), true);
+        }
+
+        // jitter reorders segments, but all of them get through
+        {
+            ImpairmentConfig config;
+            config.delay_ms = 50;
+            config.jitter_ms = 40;
+            Impairment impairment{config, 1};
+            const auto released = run(impairment, 200);
+            test_should_be(released.size(), size_t(200));
+            const bool in_order = is_sorted(released.begin(), released.end());
+            test_should_be(in_order, false);
+            for (const auto &[n, when] : released) {
+                test_should_be(when >= n + 10 and when <= n + 90, true);
+            }
+        }
+
+        // duplication sends segments twice
+        {
+            ImpairmentConfig config;
+            config.duplicate = 1;
+            Impairment impairment{config, 1};
+            test_should_be(run(impairment, 5).size(), size_t(10));
+            test_should_be(impairment.stats().duplicated, uint64_t(5));
+        }
+
+        // the token bucket paces segments at the rate, and drops those that don't fit in its queue
+        {
+            ImpairmentConfig config;
+            config.rate = 100000;
+            config.rate_burst = 1000;
+            Impairment paced{config, 1};
+            for (uint32_t n = 0; n < 100; n++) {
+                paced.push(numbered(n, 1000));
+            }
+            uint64_t now = 0, last = 0;
+            size_t released = 0;
+            for (; paced.time_until_next_deadline(); now++) {
+                while (paced.pop()) {
+                    released++;
+                    last = now;
+                }
+                paced.tick(1);
+            }
+            test_should_be(released, size_t(100));
+            test_should_be(last >= 950 and last <= 1010, true);
+
+            config.rate_limit = 3000;
+            Impairment limited{config, 1};
+            for (uint32_t n = 0; n < 5; n++) {
+                limited.push(numbered(n, 1000));
+            }
+            test_should_be(limited.pop().has_value(), true);
+            test_should_be(limited.stats().rate_drops, uint64_t(2));
+        }
+
+        // Gilbert-Elliott loss comes in bursts, at the stationary rate start / (start + end)
+        {
+            ImpairmentConfig config;
+            config.burst_start = 0.01;
+            config.burst_end = 0.1;
+            Impairment impairment{config, 1};
+            constexpr uint32_t count = 100000;
+            size_t lost = 0, bursts = 0;
+            bool losing = false;
+            for (uint32_t n = 0; n < count; n++) {
+                impairment.push(numbered(n));
+                const bool lost_this = not impairment.pop().has_value();
+                lost += lost_this;
+                bursts += lost_this and not losing;
+                losing = lost_this;
+            }
+            test_should_be(impairment.stats().lost, uint64_t(lost));
+            const double loss = double(lost) / count, mean_burst = double(lost) / double(bursts);
+            test_should_be(loss > 0.08 and loss < 0.10, true);
+            test_should_be(mean_burst > 8 and mean_burst < 12, true);
+        }
+
+        // the same seed impairs the same segments the same way
+        {
+            ImpairmentConfig config;
+            config.loss = 0.1;
+            config.duplicate = 0.05;
+            config.delay_ms = 20;
+            config.jitter_ms = 10;
+            config.reorder = 0.1;
+            Impairment first{config, 7}, second{config, 7}, other{config, 8};
+            const auto released = run(first, 1000);
+            test_should_be(run(second, 1000) == released, true);
+            test_should_be(run(other, 1000) == released, false);
+        }
+
+        // descriptions are parsed into their configs
+        {
+            const ImpairmentConfig config = parse_impairment("delay 40 10 loss 0.01 rate 1250000 3000 reorder 0.5");
+            test_should_be(config.delay_ms, uint32_t(40));
+            test_should_be(config.jitter_ms, uint32_t(10));
+            test_should_be(config.loss, 0.01);
+            test_should_be(config.rate, uint64_t(1250000));
+            test_should_be(config.rate_burst, size_t(3000));
+            test_should_be(config.rate_limit, size_t(0));
+            test_should_be(config.reorder, 0.5);
+
+            const ImpairmentConfig burst = parse_impairment("burst 0.01 0.2 duplicate 0.1 delay 5");
+            test_should_be(burst.burst_start, 0.01);
+            test_should_be(burst.burst_end, 0.2);
+            test_should_be(burst.burst_loss, 1.0);
+            test_should_be(burst.duplicate, 0.1);
+            test_should_be(burst.delay_ms, uint32_t(5));
+            test_should_be(burst.jitter_ms, uint32_t(0));
+
+            for (const char *bad : {"loss", "loss 2", "delay x", "burst 0.1", "wobble 1", "rate -5"}) {
+                bool threw = false;
+                try {
+                    parse_impairment(bad);
+                } catch (const runtime_error &) {
+                    threw = true;
+                }
+                test_should_be(threw, true);
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#include "latency_histogram.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+int main() {
+    try {
+        // an empty histogram
+        {
+            LatencyHistogram h;
+            test_should_be(h.count(), uint64_t(0));
+            test_should_be(h.min(), uint64_t(0));
+            test_should_be(h.max(), uint64_t(0));
+            test_should_be(h.percentile(50), uint64_t(0));
+        }
+
+        // small values are exact
+        {
+            LatencyHistogram h;
+            for (uint64_t value = 1; value <= 100; value++) {
+                h.record(value);
+            }
+            test_should_be(h.count(), uint64_t(100));
+            test_should_be(h.min(), uint64_t(1));
+            test_should_be(h.max(), uint64_t(100));
+            test_should_be(h.mean(), 50.5);
+            test_should_be(h.percentile(0), uint64_t(1));
+            test_should_be(h.percentile(50), uint64_t(50));
+            test_should_be(h.percentile(99), uint64_t(99));
+            test_should_be(h.percentile(99.9), uint64_t(100));
+            test_should_be(h.percentile(100), uint64_t(100));
+        }
+
+        // large values are within 1/128 of the truth, and never above the maximum
+        {
+            LatencyHistogram h;
+            for (uint64_t value = 1; value <= 1000000; value++) {
+                h.record(value * 1000);
+            }
+            for (const double p : {1.0, 50.0, 90.0, 99.0, 99.9, 99.99}) {
+                const double expected = p * 1e7;
+                const double reported = double(h.percentile(p));
+                test_should_be(reported >= expected and reported <= expected * (1 + 1.0 / 128), true);
+            }
+            test_should_be(h.percentile(100), uint64_t(1000000000));
+        }
+
+        // the extremes of the range
+        {
+            LatencyHistogram h;
+            h.record(0);
+            h.record(UINT64_MAX);
+            test_should_be(h.percentile(50), uint64_t(0));
+            test_should_be(h.percentile(100), UINT64_MAX);
+        }
+
+        // merging is the same as recording everything in one histogram
+        {
+            mt19937_64 random{1};
+            LatencyHistogram all, first, second;
+            for (unsigned i = 0; i < 10000; i++) {
+                const uint64_t value = random() >> (random() % 64);
+                all.record(value);
+                (i % 3 ? first : second).record(value);
+            }
+            first.merge(second);
+            test_should_be(first.count(), all.count());
+            test_should_be(first.min(), all.min());
+            test_should_be(first.max(), all.max());
+            for (const double p : {10.0, 50.0, 99.0, 99.9}) {
+                test_should_be(first.percentile(p), all.percentile(p));
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -5,6 +5,8 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -313,6 +315,148 @@ int main() {
                            make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.5").serialize())});
             test.execute(ExpectNoFrame{});
         }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress remote_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{
+                "pending datagrams are bounded per next hop", local_eth, Address("10.0.0.1", 0)};
+
+            // more datagrams than one next hop may hold while its address is being resolved
+            vector<InternetDatagram> datagrams;
+            for (unsigned i = 0; i < 70; i++) {
+                datagrams.push_back(make_datagram("10.0.0.1", "1.2.3." + to_string(i)));
+                test.execute(SendDatagram{datagrams.back(), Address("10.0.0.7", 0)});
+            }
+
+            // only one request goes out
+            test.execute(ExpectFrame{
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.7").serialize())});
+            test.execute(ExpectNoFrame{});
+
+            test.execute(ReceiveFrame{
+                make_frame(
+                    remote_eth,
+                    local_eth,
+                    EthernetHeader::TYPE_ARP,
+                    make_arp(ARPMessage::OPCODE_REPLY, remote_eth, "10.0.0.7", local_eth, "10.0.0.1").serialize()),
+                {}});
+
+            // the oldest datagrams were dropped; the newest 64 are sent in order
+            for (unsigned i = 6; i < 70; i++) {
+                test.execute(ExpectFrame{
+                    make_frame(local_eth, remote_eth, EthernetHeader::TYPE_IPv4, datagrams.at(i).serialize())});
+            }
+            test.execute(ExpectNoFrame{});
+        }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress router_eth = random_private_ethernet_address();
+            const EthernetAddress peer_eth = random_private_ethernet_address();
+            const EthernetAddress new_peer_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{"static neighbors and gratuitous ARP", local_eth, Address("10.0.0.1", 0)};
+
+            // a static neighbor is used immediately, and never expires
+            test.execute(AddStaticNeighbor{Address("10.0.0.254", 0), router_eth});
+            const auto datagram = make_datagram("10.0.0.1", "8.8.8.8");
+            test.execute(SendDatagram{datagram, Address("10.0.0.254", 0)});
+            test.execute(
+                ExpectFrame{make_frame(local_eth, router_eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+            test.execute(Tick{1000000});
+            test.execute(SendDatagram{datagram, Address("10.0.0.254", 0)});
+            test.execute(
+                ExpectFrame{make_frame(local_eth, router_eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+            test.execute(ExpectNoFrame{});
+
+            // our own announcement
+            test.execute(Announce{});
+            test.execute(ExpectFrame{
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.1").serialize())});
+            test.execute(ExpectNoFrame{});
+
+            // a peer's announcement is learned without a reply, and a later one (after failover) replaces it
+            test.execute(ReceiveFrame{
+                make_frame(peer_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, peer_eth, "10.0.0.9", {}, "10.0.0.9").serialize()),
+                {}});
+            test.execute(ExpectNoFrame{});
+            test.execute(SendDatagram{datagram, Address("10.0.0.9", 0)});
+            test.execute(
+                ExpectFrame{make_frame(local_eth, peer_eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+            test.execute(ReceiveFrame{
+                make_frame(
+                    new_peer_eth,
+                    ETHERNET_BROADCAST,
+                    EthernetHeader::TYPE_ARP,
+                    make_arp(ARPMessage::OPCODE_REQUEST, new_peer_eth, "10.0.0.9", {}, "10.0.0.9").serialize()),
+                {}});
+            test.execute(SendDatagram{datagram, Address("10.0.0.9", 0)});
+            test.execute(
+                ExpectFrame{make_frame(local_eth, new_peer_eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+
+            // ARP traffic doesn't override a static neighbor
+            test.execute(ReceiveFrame{
+                make_frame(peer_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, peer_eth, "10.0.0.254", {}, "10.0.0.254").serialize()),
+                {}});
+            test.execute(SendDatagram{datagram, Address("10.0.0.254", 0)});
+            test.execute(
+                ExpectFrame{make_frame(local_eth, router_eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+            test.execute(ExpectNoFrame{});
+        }
+
+        {
+            const EthernetAddress local_eth = random_private_ethernet_address();
+            const EthernetAddress remote_eth = random_private_ethernet_address();
+            NetworkInterfaceTestHarness test{"timeouts end once exceeded", local_eth, Address("10.0.0.1", 0)};
+            const auto datagram = make_datagram("10.0.0.1", "8.8.8.8");
+            const EthernetFrame request =
+                make_frame(local_eth,
+                           ETHERNET_BROADCAST,
+                           EthernetHeader::TYPE_ARP,
+                           make_arp(ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.7").serialize());
+
+            // a request still suppresses another after exactly 5 s
+            test.execute(SendDatagram{datagram, Address("10.0.0.7", 0)});
+            test.execute(ExpectFrame{request});
+            test.execute(Tick{5000});
+            test.execute(SendDatagram{datagram, Address("10.0.0.7", 0)});
+            test.execute(ExpectNoFrame{});
+            test.execute(Tick{1});
+            test.execute(SendDatagram{datagram, Address("10.0.0.7", 0)});
+            test.execute(ExpectFrame{request});
+
+            // a mapping is still used after exactly 30 s
+            test.execute(ReceiveFrame{
+                make_frame(
+                    remote_eth,
+                    local_eth,
+                    EthernetHeader::TYPE_ARP,
+                    make_arp(ARPMessage::OPCODE_REPLY, remote_eth, "10.0.0.7", local_eth, "10.0.0.1").serialize()),
+                {}});
+            test.execute(
+                ExpectFrame{make_frame(local_eth, remote_eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+            test.execute(ExpectNoFrame{});
+            test.execute(Tick{30000});
+            test.execute(SendDatagram{datagram, Address("10.0.0.7", 0)});
+            test.execute(
+                ExpectFrame{make_frame(local_eth, remote_eth, EthernetHeader::TYPE_IPv4, datagram.serialize())});
+            test.execute(Tick{1});
+            test.execute(SendDatagram{datagram, Address("10.0.0.7", 0)});
+            test.execute(ExpectFrame{request});
+            test.execute(ExpectNoFrame{});
+        }
     } catch (const exception &e) {
         cerr << e.what() << endl;
         return EXIT_FAILURE;
@@ -170,3 +170,15 @@ void ExpectNoFrame::execute(NetworkInterface &interface) const {
 string Tick::description() const { return to_string(_ms) + " ms pass"; }
 
 void Tick::execute(NetworkInterface &interface) const { interface.tick(_ms); }
+
+string AddStaticNeighbor::description() const {
+    return "static neighbor " + ip_address.ip() + " is at " + to_string(ethernet_address);
+}
+
+void AddStaticNeighbor::execute(NetworkInterface &interface) const {
+    interface.add_static_neighbor(ip_address, ethernet_address);
+}
+
+string Announce::description() const { return "gratuitous ARP announcement requested"; }
+
+void Announce::execute(NetworkInterface &interface) const { interface.announce(); }
@@ -78,6 +78,21 @@ struct Tick : public NetworkInterfaceAction {
     Tick(const size_t ms) : _ms(ms) {}
 };
 
+struct AddStaticNeighbor : public NetworkInterfaceAction {
+    Address ip_address;
+    EthernetAddress ethernet_address;
+
+    std::string description() const override;
+    void execute(NetworkInterface &interface) const override;
+
+    AddStaticNeighbor(Address i, EthernetAddress e) : ip_address(i), ethernet_address(e) {}
+};
+
+struct Announce : public NetworkInterfaceAction {
+    std::string description() const override;
+    void execute(NetworkInterface &interface) const override;
+};
+
 class NetworkInterfaceTestHarness {
     std::string _test_name;
     NetworkInterface _interface;
@@ -0,0 +1,88 @@
+#include "packet_ring.hh"
+#include "test_should_be.hh"
+#include "util.hh"
+
+#include <cerrno>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <poll.h>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+//! An Ethernet type for local experiments (IEEE 802), so that nothing else on the interface claims the frames
+static const string EXPERIMENTAL_TYPE = "\x88\xb5";
+
+//! The i-th test frame: broadcast, from a private address, with the index in the payload
+static string test_frame(const size_t i) {
+    string frame = string(6, '\xff') + string("\x02\x00\x00\x00\x00\x01", 6) + EXPERIMENTAL_TYPE;
+    frame += "frame " + to_string(i);
+    frame.resize(64 + i % 1000, '.');
+    return frame;
+}
+
+int main() {
+    try {
+        // frames sent through one ring on the loopback interface are received through another
+        optional<PacketRing> sender, receiver;
+        try {
+            sender.emplace("lo", 1, 512);
+            receiver.emplace("lo");
+        } catch (const unix_error &e) {
+            if (e.code().value() == EPERM) {
+                cerr << "skipped: opening an AF_PACKET socket needs CAP_NET_RAW\n";
+                return EXIT_SUCCESS;
+            }
+            throw;
+        }
+
+        // bursts of more frames than the transmit ring has slots, so that it has to wait for the kernel to
+        // free them, each drained from the receive ring before the next (a block is handed over after at most
+        // BLOCK_TIMEOUT_MS, so frames sent much faster than they are received would fill the ring)
+        constexpr size_t burst_size = 700, burst_count = 5;
+        size_t received = 0;
+        bool in_order = true;
+        for (size_t burst = 0; burst < burst_count; burst++) {
+            const unsigned writes_before = sender->write_count();
+            for (size_t i = 0; i < burst_size; i++) {
+                sender->send(test_frame(burst * burst_size + i));
+            }
+            sender->flush();
+            sender->flush();  // nothing left to flush
+            test_should_be(sender->write_count() - writes_before, 2U);
+
+            while (received < (burst + 1) * burst_size) {
+                pollfd pfd{receiver->fd_num(), POLLIN, 0};
+                if (SystemCall("poll", ::poll(&pfd, 1, 1000)) == 0) {
+                    break;
+                }
+                while (const optional<PacketRing::Frame> frame = receiver->receive()) {
+                    if (frame->data.substr(12, 2) == EXPERIMENTAL_TYPE) {
+                        in_order &= frame->data == test_frame(received);
+                        received++;
+                    }
+                }
+                test_should_be(receiver->receive_pending(), false);
+            }
+        }
+        test_should_be(received, burst_size * burst_count);
+        test_should_be(in_order, true);
+
+        // a frame that doesn't fit a slot of the transmit ring is refused
+        bool threw = false;
+        try {
+            sender->send(string(PacketRing::max_frame_size() + 1, 'x'));
+        } catch (const runtime_error &) {
+            threw = true;
+        }
+        test_should_be(threw, true);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
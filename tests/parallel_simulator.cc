@@ -0,0 +1,132 @@
+#include "parallel_simulator.hh"
+#include "simulated_nodes.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//! \brief Transfer `size` bytes over each of 8 connections, each between two of 4 partitions, on `threads`
+//! threads
+//! \returns when each receiver read the end of the stream, the number of events run, and what the links did
+static vector<uint64_t> transfers(const size_t threads, const size_t size) {
+    constexpr size_t partitions = 4, connections = 8;
+    LinkConfig link;
+    link.bits_per_second = 10000000;
+    link.delay_ns = 5000000;
+    link.queue_limit = 20000;
+    link.loss = 0.02;
+    link.reorder = 0.05;
+    link.reorder_delay_ns = 2000000;
+    TCPConfig config;
+    config.rt_timeout = 100;
+    ParallelSimulator simulator{partitions, link.delay_ns, 11, threads};
+
+    struct Transfer {
+        string received{};
+        optional<uint64_t> finished_ns{};
+    };
+    vector<Transfer> results(connections);
+    vector<pair<Link<TCPSegment> &, Link<TCPSegment> &>> links;
+    for (size_t i = 0; i < connections; i++) {
+        const size_t client_partition = i % partitions, server_partition = (i + 1) % partitions;
+        auto &client = simulator.partition(client_partition).add<ConnectionNode>(config);
+        auto &server = simulator.partition(server_partition).add<ConnectionNode>(config);
+        links.push_back(connect(simulator, client_partition, client, 0, server_partition, server, 0, link));
+
+        Simulator &server_simulator = simulator.partition(server_partition);
+        Transfer &result = results[i];
+        server.set_application([&result, &server_simulator](TCPConnection &connection) {
+            result.received += connection.inbound_stream().read(connection.inbound_stream().buffer_size());
+            if (connection.inbound_stream().eof() and not result.finished_ns) {
+                result.finished_ns = server_simulator.now_ns();
+            }
+        });
+        client.act([&](TCPConnection &connection) {
+            connection.connect();
+            connection.write(string(size, char('a' + i)));
+            connection.end_input_stream();
+        });
+    }
+
+    const bool finished = simulator.run([&] {
+        for (const auto &result : results) {
+            if (not result.finished_ns) {
+                return false;
+            }
+        }
+        return true;
+    });
+    test_should_be(finished, true);
+
+    vector<uint64_t> ret;
+    for (size_t i = 0; i < connections; i++) {
+        test_should_be(results[i].received == string(size, char('a' + i)), true);
+        ret.push_back(*results[i].finished_ns);
+    }
+    ret.push_back(simulator.events_run());
+    for (const auto &[there, back] : links) {
+        for (const LinkStats &stats : {there.stats(), back.stats()}) {
+            ret.insert(ret.end(), {stats.sent, stats.delivered, stats.queue_drops, stats.lost});
+        }
+    }
+    return ret;
+}
+
+int main() {
+    try {
+        // a link between partitions delivers at the same times as one within a partition
+        {
+            LinkConfig config;
+            config.bits_per_second = 1000000;
+            config.delay_ns = 10000000;
+            ParallelSimulator simulator{2, config.delay_ns, 1, 2};
+            vector<uint64_t> arrivals;
+            auto &link = simulator.add_link<TCPSegment>(
+                0, 1, config, [&](TCPSegment &&) { arrivals.push_back(simulator.partition(1).now_ms()); });
+            simulator.partition(0).schedule(0, [&] {
+                for (int i = 0; i < 3; i++) {
+                    TCPSegment segment;
+                    segment.payload() = string(980, 'x');
+                    link.send(move(segment));
+                }
+            });
+            test_should_be(simulator.run([] { return false; }), false);
+            test_should_be(arrivals == vector<uint64_t>({18, 26, 34}), true);
+            test_should_be(simulator.now_ns() >= uint64_t(34000000), true);
+        }
+
+        // a link between partitions can't be faster than the lookahead
+        {
+            ParallelSimulator simulator{2, 10000000, 1, 1};
+            LinkConfig config;
+            config.delay_ns = 5000000;
+            simulator.add_link<TCPSegment>(0, 0, config, [](TCPSegment &&) {});
+            bool threw = false;
+            try {
+                simulator.add_link<TCPSegment>(0, 1, config, [](TCPSegment &&) {});
+            } catch (const invalid_argument &) {
+                threw = true;
+            }
+            test_should_be(threw, true);
+        }
+
+        // the same seed gives the same run on any number of threads
+        {
+            const auto sequential = transfers(1, 30000);
+            test_should_be(transfers(2, 30000) == sequential, true);
+            test_should_be(transfers(4, 30000) == sequential, true);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
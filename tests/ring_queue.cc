@@ -0,0 +1,93 @@
+#include "ring_queue.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+int main() {
+    try {
+        // FIFO order across wrap-around and growth
+        {
+            RingQueue<int> q{105};
+            int next_in = 0, next_out = 0;
+            for (unsigned round = 0; round < 50; round++) {
+                for (unsigned i = 0; i < 7; i++) {
+                    test_should_be(q.push(next_in++), true);
+                }
+                for (unsigned i = 0; i < 5; i++) {
+                    test_should_be(q.front(), next_out++);
+                    q.pop();
+                }
+            }
+            test_should_be(q.size(), size_t(100));
+            test_should_be(q.full(), false);
+            test_should_be(q.dropped(), uint64_t(0));
+        }
+
+        // a full queue refuses (and counts) new elements
+        {
+            RingQueue<int> q{3};
+            test_should_be(q.push(1), true);
+            test_should_be(q.push(2), true);
+            test_should_be(q.push(3), true);
+            test_should_be(q.push(4), false);
+            test_should_be(q.emplace(5), false);
+            test_should_be(q.dropped(), uint64_t(2));
+            test_should_be(q.size(), size_t(3));
+            q.pop();
+            test_should_be(q.full(), false);
+            test_should_be(q.push(6), true);
+            test_should_be(q.front(), 2);
+        }
+
+        // drain moves a bounded burst, oldest first, and works with move-only elements
+        {
+            RingQueue<unique_ptr<int>> q{16};
+            for (int i = 0; i < 10; i++) {
+                q.emplace(make_unique<int>(i));
+            }
+            unique_ptr<int> burst[4];
+            test_should_be(q.drain(burst, 4), size_t(4));
+            test_should_be(*burst[0], 0);
+            test_should_be(*burst[3], 3);
+            vector<unique_ptr<int>> rest;
+            test_should_be(q.drain(back_inserter(rest)), size_t(6));
+            test_should_be(*rest.back(), 9);
+            test_should_be(q.empty(), true);
+            test_should_be(q.drain(burst, 4), size_t(0));
+        }
+
+        // pop() calls the on_room callback when it makes room in a full queue, and only then
+        {
+            RingQueue<int> q{2};
+            int next = 0;
+            q.set_on_room([&] { q.push(next++); });
+            q.push(next++);
+            q.pop();
+            test_should_be(next, 1);
+            q.push(next++);
+            q.push(next++);
+            test_should_be(q.full(), true);
+            q.pop();
+            test_should_be(next, 4);
+            test_should_be(q.full(), true);
+            int burst[2];
+            test_should_be(q.drain(burst, 2), size_t(2));
+            test_should_be(burst[0], 2);
+            test_should_be(burst[1], 3);
+            test_should_be(q.front(), 4);
+            test_should_be(q.dropped(), uint64_t(0));
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
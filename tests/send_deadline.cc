@@ -0,0 +1,73 @@
+#include "sender_harness.hh"
+#include "wrapping_integers.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        {
+            TCPConfig cfg;
+            WrappingInt32 isn(rd());
+            uint16_t retx_timeout = uniform_int_distribution<uint16_t>{10, 10000}(rd);
+            cfg.fixed_isn = isn;
+            cfg.rt_timeout = retx_timeout;
+
+            TCPSenderTestHarness test{"Deadline follows the SYN's retransmissions, then stops on ack", cfg};
+            test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+            test.execute(ExpectDeadline{retx_timeout});
+            test.execute(Tick{retx_timeout - 1u});
+            test.execute(ExpectNoSegment{});
+            test.execute(ExpectDeadline{1});
+            test.execute(Tick{1});
+            test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+            // twice as long b/c exponential back-off
+            test.execute(ExpectDeadline{2 * retx_timeout});
+            test.execute(Tick{2 * retx_timeout - 1u});
+            test.execute(ExpectNoSegment{});
+            test.execute(ExpectDeadline{1});
+            test.execute(AckReceived{WrappingInt32{isn + 1}});
+            test.execute(ExpectState{TCPSenderStateSummary::SYN_ACKED});
+            test.execute(ExpectDeadline{nullopt});
+        }
+
+        {
+            TCPConfig cfg;
+            WrappingInt32 isn(rd());
+            uint16_t retx_timeout = uniform_int_distribution<uint16_t>{10, 10000}(rd);
+            cfg.fixed_isn = isn;
+            cfg.rt_timeout = retx_timeout;
+
+            TCPSenderTestHarness test{"Deadline restarts when new data is acked", cfg};
+            test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+            test.execute(AckReceived{WrappingInt32{isn + 1}});
+            test.execute(ExpectDeadline{nullopt});
+            test.execute(WriteBytes{"abcd"});
+            test.execute(ExpectSegment{}.with_payload_size(4));
+            test.execute(ExpectDeadline{retx_timeout});
+            test.execute(Tick{retx_timeout - 5u});
+            test.execute(WriteBytes{"efgh"});
+            test.execute(ExpectSegment{}.with_payload_size(4));
+            // the timer keeps running for the oldest outstanding segment
+            test.execute(ExpectDeadline{5});
+            test.execute(AckReceived{WrappingInt32{isn + 5}});
+            test.execute(ExpectDeadline{retx_timeout});
+            test.execute(AckReceived{WrappingInt32{isn + 9}});
+            test.execute(ExpectDeadline{nullopt});
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
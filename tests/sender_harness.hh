@@ -99,6 +99,27 @@ struct ExpectBytesInFlight : public SenderExpectation {
     }
 };
 
+struct ExpectDeadline : public SenderExpectation {
+    std::optional<size_t> _ms;
+
+    ExpectDeadline(std::optional<size_t> ms) : _ms(ms) {}
+    std::string description() const {
+        return _ms ? "retransmission timer to expire in " + std::to_string(_ms.value()) + " ms"
+                   : "retransmission timer to be stopped";
+    }
+
+    void execute(TCPSender &sender, std::queue<TCPSegment> &) const {
+        const std::optional<size_t> reported = sender.time_until_next_deadline();
+        if (reported != _ms) {
+            std::ostringstream ss;
+            ss << "The TCPSender reported that its next deadline is "
+               << (reported ? "in " + std::to_string(reported.value()) + " ms" : "never")
+               << ", but it was expected to be " << (_ms ? "in " + std::to_string(_ms.value()) + " ms" : "never");
+            throw SenderExpectationViolation(ss.str());
+        }
+    }
+};
+
 struct ExpectNoSegment : public SenderExpectation {
     ExpectNoSegment() {}
     std::string description() const { return "no (more) segments"; }
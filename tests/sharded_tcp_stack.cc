@@ -0,0 +1,292 @@
+#include "address.hh"
+#include "flow_hash.hh"
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+#include "sharded_tcp_stack.hh"
+#include "tcp_stack.hh"
+#include "tcp_state.hh"
+#include "test_should_be.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+using ConnectionId = TCPStack::ConnectionId;
+
+//! Numeric address of a dotted-quad string
+static uint32_t ip(const string &str) { return Address{str}.ipv4_numeric(); }
+
+//! Addresses and ports in network byte order, as the RSS hash reads them
+static string hash_input(const uint32_t src, const uint32_t dst) {
+    string ret;
+    for (const uint32_t addr : {src, dst}) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            ret.push_back(char(addr >> shift));
+        }
+    }
+    return ret;
+}
+
+int main() {
+    try {
+        // the verification suite of the Receive Side Scaling specification
+        {
+            struct Vector {
+                string destination, source;
+                uint16_t destination_port, source_port;
+                uint32_t tcp, ip_only;
+            };
+            const vector<Vector> vectors = {
+                {"161.142.100.80", "66.9.149.187", 1766, 2794, 0x51ccc178, 0x323e8fc2},
+                {"65.69.140.83", "199.92.111.2", 4739, 14230, 0xc626b0ea, 0xd718262a},
+                {"12.22.207.184", "24.19.198.95", 38024, 12898, 0x5c2b394a, 0xd2d0a5de},
+                {"209.142.163.6", "38.27.205.30", 2217, 48228, 0xafc7327f, 0x82989176},
+                {"202.188.127.2", "153.39.163.191", 1303, 44251, 0x10e828a2, 0x5d1809c5},
+            };
+            for (const auto &v : vectors) {
+                test_should_be(flow_hash(ip(v.source), ip(v.destination), v.source_port, v.destination_port),
+                               v.tcp);
+                test_should_be(toeplitz_hash(hash_input(ip(v.source), ip(v.destination))), v.ip_only);
+
+                // the same, read from a datagram
+                TCPSegment seg;
+                seg.header().sport = v.source_port;
+                seg.header().dport = v.destination_port;
+                InternetDatagram dgram;
+                dgram.header().src = ip(v.source);
+                dgram.header().dst = ip(v.destination);
+                dgram.header().len = dgram.header().hlen * 4 + seg.header().doff * 4;
+                dgram.payload() = seg.serialize(dgram.header().pseudo_cksum());
+                test_should_be(flow_hash(dgram.serialize().concatenate()) == v.tcp, true);
+
+                dgram.header().proto = 17;
+                test_should_be(flow_hash(dgram.serialize().concatenate()).has_value(), false);
+            }
+        }
+
+        // the indirection table starts out round-robin, and can be reprogrammed until the threads start
+        {
+            constexpr size_t SHARDS = 3;
+            vector<FileDescriptor> queues, peers;
+            for (size_t i = 0; i < SHARDS; i++) {
+                int fds[2];
+                SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds));
+                queues.emplace_back(fds[0]);
+                peers.emplace_back(fds[1]);
+            }
+            ShardedTCPStack stack{move(queues), [](const size_t, TCPStack &, const ConnectionId) { return false; }};
+
+            vector<size_t> entries(SHARDS);
+            for (size_t i = 0; i < ShardedTCPStack::INDIRECTION_TABLE_SIZE; i++) {
+                test_should_be(stack.indirection_table()[i], uint16_t(i % SHARDS));
+                entries[stack.indirection_table()[i]]++;
+            }
+            test_should_be(entries == vector<size_t>({43, 43, 42}), true);
+
+            ShardedTCPStack::IndirectionTable table{};
+            table[5] = 2;
+            stack.set_indirection_table(table);
+            test_should_be(stack.shard_for(5), size_t(2));
+            test_should_be(stack.shard_for(5 + ShardedTCPStack::INDIRECTION_TABLE_SIZE), size_t(2));
+            test_should_be(stack.shard_for(6), size_t(0));
+
+            bool threw = false;
+            try {
+                table[7] = SHARDS;
+                stack.set_indirection_table(table);
+            } catch (const runtime_error &) {
+                threw = true;
+            }
+            test_should_be(threw, true);
+            test_should_be(stack.shard_for(7), size_t(0));
+
+            stack.start();
+            threw = false;
+            try {
+                stack.set_indirection_table({});
+            } catch (const runtime_error &) {
+                threw = true;
+            }
+            test_should_be(threw, true);
+        }
+
+        // many connections to a sharded stack, whose segments arrive on the wrong queues as often as not
+        {
+            constexpr size_t SHARDS = 4;
+            constexpr size_t CONNECTIONS = 200;
+            const string server_ip = "10.0.0.1";
+            const string client_ip = "10.0.0.2";
+
+            vector<FileDescriptor> server_queues, client_queues;
+            for (size_t i = 0; i < SHARDS; i++) {
+                int fds[2];
+                SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds));
+                server_queues.emplace_back(fds[0]);
+                client_queues.emplace_back(fds[1]);
+                client_queues.back().set_blocking(false);
+            }
+
+            // the echo server notes which shard served each client port
+            mutex handled_mutex;
+            vector<pair<size_t, uint16_t>> handled;
+            const auto echo = [&](const size_t shard, TCPStack &stack, const ConnectionId id) {
+                ByteStream &inbound = stack.inbound_stream(id);
+                const string request = inbound.read(inbound.buffer_size());
+                if (not request.empty()) {
+                    stack.write(id, request);
+                    lock_guard<mutex> lock(handled_mutex);
+                    handled.emplace_back(shard, uint16_t(stoul(request)));
+                }
+                return not inbound.eof() and not inbound.error();
+            };
+            ShardedTCPStack server{move(server_queues), echo};
+            server.listen(80, TCPConfig{}, CONNECTIONS);
+            server.start();
+
+            TCPConfig client_config;
+            client_config.rt_timeout = 10;  // so that TIME_WAIT is short
+            TCPStack client{4 * CONNECTIONS};
+            vector<ConnectionId> clients;
+            for (size_t i = 0; i < CONNECTIONS; i++) {
+                const uint16_t port = 20000 + i;
+                clients.push_back(client.connect(client_config, Address{client_ip, port}, Address{server_ip, 80}));
+                client.write(clients.back(), to_string(port));
+                client.end_input_stream(clients.back());
+            }
+
+            vector<string> echoes(CONNECTIONS);
+            size_t finished = 0;
+            size_t next_queue = 0;
+            string buffer;
+            uint64_t last_tick_ms = timestamp_ms();
+            const uint64_t give_up_ms = last_tick_ms + 20000;
+            while ((finished < CONNECTIONS or client.size() > 0) and timestamp_ms() < give_up_ms) {
+                // spread the client's datagrams over the queues regardless of their flow
+                for (; not client.datagrams_out().empty(); client.datagrams_out().pop()) {
+                    client_queues[next_queue++ % SHARDS].write(client.datagrams_out().front().serialize());
+                }
+
+                vector<pollfd> pfds;
+                for (const auto &queue : client_queues) {
+                    pfds.push_back({queue.fd_num(), POLLIN, 0});
+                }
+                SystemCall("poll", ::poll(pfds.data(), pfds.size(), 10));
+                for (size_t i = 0; i < SHARDS; i++) {
+                    if (pfds[i].revents & POLLIN) {
+                        client_queues[i].read(buffer, ShardedTCPStack::MAX_DATAGRAM_SIZE);
+                        InternetDatagram dgram;
+                        if (dgram.parse(Buffer{move(buffer)}) == ParseResult::NoError) {
+                            client.datagram_received(dgram);
+                        }
+                    }
+                }
+
+                const uint64_t now = timestamp_ms();
+                client.tick(now - last_tick_ms);
+                last_tick_ms = now;
+
+                for (size_t i = 0; i < CONNECTIONS; i++) {
+                    if (clients[i] == 0) {
+                        continue;
+                    }
+                    ByteStream &inbound = client.inbound_stream(clients[i]);
+                    echoes[i].append(inbound.read(inbound.buffer_size()));
+                    if (inbound.eof()) {
+                        client.close(clients[i]);
+                        clients[i] = 0;
+                        finished++;
+                    }
+                }
+            }
+            server.stop();
+
+            test_should_be(finished, CONNECTIONS);
+            for (size_t i = 0; i < CONNECTIONS; i++) {
+                test_should_be(echoes[i] == to_string(20000 + i), true);
+            }
+
+            // each connection was served by the shard its flow hashes to, though most of its segments
+            // arrived on other shards' queues
+            test_should_be(handled.size(), CONNECTIONS);
+            vector<size_t> per_shard(SHARDS);
+            for (const auto &[shard, port] : handled) {
+                test_should_be(server.shard_for(flow_hash(ip(client_ip), ip(server_ip), port, 80)), shard);
+                per_shard[shard]++;
+            }
+            uint64_t steered = 0;
+            for (size_t i = 0; i < SHARDS; i++) {
+                test_should_be(per_shard[i] > 0, true);
+                steered += server.stats(i).steered;
+            }
+            test_should_be(steered > 0, true);
+        }
+
+        // a connection whose peer vanishes is given up on by its timers, and the shard forgets it
+        {
+            int fds[2];
+            SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds));
+            vector<FileDescriptor> server_queues;
+            server_queues.emplace_back(fds[0]);
+            FileDescriptor client_queue{fds[1]};
+            client_queue.set_blocking(false);
+
+            // the server greets each connection, and never says it is done with one
+            atomic<size_t> calls{0}, inactive_calls{0};
+            const auto greet = [&](const size_t, TCPStack &stack, const ConnectionId id) {
+                if (calls++ == 0) {
+                    stack.write(id, "hello");
+                }
+                inactive_calls += not stack.connection(id).active();
+                return true;
+            };
+            TCPConfig server_config;
+            server_config.rt_timeout = 1;  // so that retransmissions run out quickly
+            ShardedTCPStack server{move(server_queues), greet};
+            server.listen(80, server_config, 1);
+            server.start();
+
+            // the client completes the handshake, then stops answering
+            TCPStack client;
+            const ConnectionId id = client.connect(TCPConfig{}, Address{"10.0.0.2", 20000}, Address{"10.0.0.1", 80});
+            string buffer;
+            const uint64_t give_up_ms = timestamp_ms() + 10000;
+            while ((calls == 0 or server.stats(0).serving > 0) and timestamp_ms() < give_up_ms) {
+                for (; not client.datagrams_out().empty(); client.datagrams_out().pop()) {
+                    client_queue.write(client.datagrams_out().front().serialize());
+                }
+                pollfd pfd{client_queue.fd_num(), POLLIN, 0};
+                SystemCall("poll", ::poll(&pfd, 1, 10));
+                if (pfd.revents & POLLIN) {
+                    client_queue.read(buffer, ShardedTCPStack::MAX_DATAGRAM_SIZE);
+                    InternetDatagram dgram;
+                    if (client.connection(id).state() == TCPState::State::SYN_SENT and
+                        dgram.parse(Buffer{move(buffer)}) == ParseResult::NoError) {
+                        client.datagram_received(dgram);
+                    }
+                }
+            }
+            server.stop();
+
+            test_should_be(server.stats(0).serving, uint64_t(0));
+            test_should_be(calls > 1, true);
+            test_should_be(inactive_calls.load(), size_t(1));
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
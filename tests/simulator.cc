@@ -0,0 +1,153 @@
+#include "simulated_nodes.hh"
+#include "simulator.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+//! A segment that takes `size` bytes on a link
+static TCPSegment segment_of_size(const size_t size) {
+    TCPSegment segment;
+    segment.payload() = string(size - segment.header().doff * 4, 'x');
+    return segment;
+}
+
+//! \brief Send `data` from one ConnectionNode to another over a pair of links
+//! \returns what the receiver read, when it read the end of the stream, and how many events that took
+static tuple<string, uint64_t, uint64_t> transfer(const uint64_t seed, const LinkConfig &link, const string &data) {
+    TCPConfig config;
+    config.rt_timeout = 100;
+    Simulator simulator{seed};
+    auto &client = simulator.add<ConnectionNode>(config);
+    auto &server = simulator.add<ConnectionNode>(config);
+    connect(simulator, client, 0, server, 0, link);
+
+    client.act([&](TCPConnection &connection) {
+        connection.connect();
+        connection.write(data);
+        connection.end_input_stream();
+    });
+    string received;
+    const bool finished = simulator.run([&] {
+        server.act([&](TCPConnection &connection) {
+            received += connection.inbound_stream().read(connection.inbound_stream().buffer_size());
+        });
+        return server.connection().inbound_stream().eof();
+    });
+    test_should_be(finished, true);
+    return {received, simulator.now_ns(), simulator.events_run()};
+}
+
+int main() {
+    try {
+        // events run in order of time, and in the order they were scheduled for the same time
+        {
+            Simulator simulator;
+            vector<int> order;
+            simulator.schedule(20, [&] { order.push_back(3); });
+            simulator.schedule(10, [&] {
+                order.push_back(1);
+                simulator.schedule(0, [&] { order.push_back(2); });
+            });
+            simulator.schedule(20, [&] { order.push_back(4); });
+            simulator.run_until(15);
+            test_should_be(order == vector<int>({1, 2}), true);
+            test_should_be(simulator.now_ns(), uint64_t(15));
+            test_should_be(simulator.run([] { return false; }), false);
+            test_should_be(order == vector<int>({1, 2, 3, 4}), true);
+            test_should_be(simulator.now_ns(), uint64_t(20));
+            test_should_be(simulator.events_run(), uint64_t(4));
+        }
+
+        // packets wait for the transmitter, then for the propagation delay
+        {
+            Simulator simulator;
+            LinkConfig config;
+            config.bits_per_second = 1000000;
+            config.delay_ns = 10000000;
+            vector<uint64_t> arrivals;
+            auto &link = simulator.add<Link<TCPSegment>>(
+                config, [&](TCPSegment &&) { arrivals.push_back(simulator.now_ms()); });
+            for (int i = 0; i < 3; i++) {
+                link.send(segment_of_size(1000));
+            }
+            simulator.run([] { return false; });
+            test_should_be(arrivals == vector<uint64_t>({18, 26, 34}), true);
+            test_should_be(link.stats().bytes_delivered, uint64_t(3000));
+        }
+
+        // a drop-tail queue drops what doesn't fit, until the queue drains
+        {
+            Simulator simulator;
+            LinkConfig config;
+            config.bits_per_second = 1000000;
+            config.queue_limit = 2500;
+            auto &link = simulator.add<Link<TCPSegment>>(config, [](TCPSegment &&) {});
+            for (int i = 0; i < 5; i++) {
+                link.send(segment_of_size(1000));
+            }
+            test_should_be(link.stats().queue_drops, uint64_t(3));
+            simulator.run_until(8000000);
+            link.send(segment_of_size(1000));
+            simulator.run([] { return false; });
+            test_should_be(link.stats().delivered, uint64_t(3));
+            test_should_be(link.stats().queue_drops, uint64_t(3));
+        }
+
+        // a transfer over a lossy, reordering link completes, and the same seed gives the same run
+        {
+            LinkConfig config;
+            config.bits_per_second = 10000000;
+            config.delay_ns = 5000000;
+            config.loss = 0.05;
+            config.reorder = 0.05;
+            config.reorder_delay_ns = 3000000;
+            string data;
+            for (size_t i = 0; i < 50000; i++) {
+                data.push_back(char('a' + i % 26));
+            }
+
+            const auto first = transfer(7, config, data);
+            test_should_be(get<0>(first) == data, true);
+            test_should_be(transfer(7, config, data) == first, true);
+        }
+
+        // hosts on either side of a router
+        {
+            Simulator simulator;
+            const TCPConfig config;
+            const LinkConfig link{};
+            auto &client = simulator.add<TCPHostNode>(
+                config, EthernetAddress{2, 0, 0, 0, 0, 1}, Address{"10.0.0.2"}, Address{"10.0.0.1"});
+            auto &server = simulator.add<TCPHostNode>(
+                config, EthernetAddress{2, 0, 0, 0, 0, 2}, Address{"10.0.1.2"}, Address{"10.0.1.1"});
+            auto &router = simulator.add<RouterNode>();
+            const size_t client_side = router.add_interface(EthernetAddress{2, 0, 0, 0, 1, 1}, Address{"10.0.0.1"});
+            const size_t server_side = router.add_interface(EthernetAddress{2, 0, 0, 0, 1, 2}, Address{"10.0.1.1"});
+            router.add_route(Address{"10.0.0.0"}.ipv4_numeric(), 24, {}, client_side);
+            router.add_route(Address{"10.0.1.0"}.ipv4_numeric(), 24, {}, server_side);
+            connect(simulator, client, 0, router, client_side, link);
+            connect(simulator, server, 0, router, server_side, link);
+
+            server.listen(80);
+            client.connect(1234, Address{"10.0.1.2", 80});
+            client.act([](TCPConnection &connection) { connection.write("hello, server"); });
+            test_should_be(simulator.run([&] { return server.connection().inbound_stream().buffer_size() == 13; }),
+                           true);
+            server.act([](TCPConnection &connection) {
+                test_should_be(connection.inbound_stream().read(13) == "hello, server", true);
+            });
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+#include "ring_queue.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//! Deliver every segment `from` has queued to `to`
+static void deliver(TCPConnection &from, TCPConnection &to) {
+    for (auto &segments = from.segments_out(); not segments.empty(); segments.pop()) {
+        to.segment_received(segments.front());
+    }
+}
+
+//! Connect `client` to `server`
+static void handshake(TCPConnection &client, TCPConnection &server) {
+    client.connect();
+    deliver(client, server);
+    deliver(server, client);
+}
+
+int main() {
+    try {
+        TCPConfig config;
+        config.max_payload_size = 1;
+        const size_t size = 3 * RingQueue<TCPSegment>::DEFAULT_CAPACITY;
+
+        // a TCPConnection whose queue is full holds its segments back (in order) instead of dropping them,
+        // and moves them in as the owner pops
+        {
+            TCPConnection client{config}, server{config};
+            handshake(client, server);
+
+            test_should_be(client.write(string(size, 'x')), size);
+            test_should_be(client.segments_out().full(), true);
+            size_t delivered = 0;
+            for (auto &segments = client.segments_out(); not segments.empty(); segments.pop(), delivered++) {
+                server.segment_received(segments.front());
+            }
+            test_should_be(client.segments_out().dropped(), uint64_t(0));
+            test_should_be(server.inbound_stream().buffer_size(), size);
+            test_should_be(delivered >= size, true);
+
+            client.end_input_stream();
+            server.end_input_stream();
+            while (not client.segments_out().empty() or not server.segments_out().empty()) {
+                deliver(client, server);
+                deliver(server, client);
+            }
+            client.tick(10 * TCPConfig::TIMEOUT_DFLT);
+            server.tick(10 * TCPConfig::TIMEOUT_DFLT);
+            test_should_be(client.active() or server.active(), false);
+        }
+
+        // the segments held back by a connection that has been moved go out from the new one
+        {
+            vector<TCPConnection> clients;
+            clients.emplace_back(config);
+            TCPConnection server{config};
+            handshake(clients.back(), server);
+
+            test_should_be(clients.back().write(string(size, 'x')), size);
+            clients.reserve(clients.capacity() + 1);
+            deliver(clients.back(), server);
+            test_should_be(server.inbound_stream().buffer_size(), size);
+            test_should_be(clients.back().segments_out().dropped(), uint64_t(0));
+
+            clients.back().end_input_stream();
+            server.end_input_stream();
+            while (not clients.back().segments_out().empty() or not server.segments_out().empty()) {
+                deliver(clients.back(), server);
+                deliver(server, clients.back());
+            }
+            clients.back().tick(10 * TCPConfig::TIMEOUT_DFLT);
+            server.tick(10 * TCPConfig::TIMEOUT_DFLT);
+            test_should_be(clients.back().active() or server.active(), false);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
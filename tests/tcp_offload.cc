@@ -0,0 +1,215 @@
+#include "ipv4_header.hh"
+#include "socket.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_segment.hh"
+#include "tcp_sponge_socket.hh"
+#include "test_should_be.hh"
+#include "tun.hh"
+#include "tuntap_adapter.hh"
+#include "util.hh"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <linux/if.h>
+#include <netinet/in.h>
+#include <optional>
+#include <string>
+#include <sys/ioctl.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//! Deliver every segment that `from` has queued to `to`, returning the payload sizes of the segments
+static vector<size_t> deliver(TCPConnection &from, TCPConnection &to) {
+    vector<size_t> sizes;
+    for (; not from.segments_out().empty(); from.segments_out().pop()) {
+        sizes.push_back(from.segments_out().front().payload().size());
+        to.segment_received(from.segments_out().front());
+    }
+    return sizes;
+}
+
+//! Open a connection between two TCPConnections
+static void connect(TCPConnection &client, TCPConnection &server) {
+    client.connect();
+    deliver(client, server);
+    deliver(server, client);
+    deliver(client, server);
+}
+
+//! Close both directions of a connection, and wait out the linger
+static void finish(TCPConnection &a, TCPConnection &b) {
+    a.end_input_stream();
+    b.end_input_stream();
+    while (not a.segments_out().empty() or not b.segments_out().empty()) {
+        deliver(a, b);
+        deliver(b, a);
+    }
+    a.tick(10 * TCPConfig::TIMEOUT_DFLT);
+    b.tick(10 * TCPConfig::TIMEOUT_DFLT);
+    test_should_be(a.active() or b.active(), false);
+}
+
+//! Give a TUN device an address (with a /24 route), and bring it up
+static void configure(const string &devname, const string &address) {
+    UDPSocket sock;
+    struct ifreq req {};
+    strncpy(static_cast<char *>(req.ifr_name), devname.data(), IFNAMSIZ - 1);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    SystemCall("inet_pton", inet_pton(AF_INET, address.c_str(), &addr.sin_addr) == 1 ? 0 : -1);
+    memcpy(&req.ifr_addr, &addr, sizeof(addr));
+    SystemCall("ioctl", ioctl(sock.fd_num(), SIOCSIFADDR, &req));
+
+    SystemCall("inet_pton", inet_pton(AF_INET, "255.255.255.0", &addr.sin_addr) == 1 ? 0 : -1);
+    memcpy(&req.ifr_netmask, &addr, sizeof(addr));
+    SystemCall("ioctl", ioctl(sock.fd_num(), SIOCSIFNETMASK, &req));
+
+    SystemCall("ioctl", ioctl(sock.fd_num(), SIOCGIFFLAGS, &req));
+    req.ifr_flags |= IFF_UP;
+    SystemCall("ioctl", ioctl(sock.fd_num(), SIOCSIFFLAGS, &req));
+}
+
+int main() {
+    try {
+        // a partial checksum, completed as a device would, gives the full checksum
+        {
+            IPv4Header ip;
+            ip.src = 0x0a000001;
+            ip.dst = 0x0a000002;
+            TCPSegment seg;
+            seg.header().sport = 1234;
+            seg.header().dport = 80;
+            seg.header().ack = true;
+            seg.payload() = string(3001, 'x');
+            ip.len = ip.hlen * 4 + seg.header().doff * 4 + seg.payload().size();
+
+            const string full = seg.serialize(ip.pseudo_cksum()).concatenate();
+            string partial = seg.serialize_partial_checksum(ip.pseudo_cksum()).concatenate();
+            test_should_be(full == partial, false);
+
+            InternetChecksum device;
+            device.add(partial);
+            const uint16_t cksum = device.value();
+            partial[16] = char(cksum >> 8);
+            partial[17] = char(cksum & 0xff);
+            test_should_be(full == partial, true);
+
+            // a segment whose checksum is left to the device parses only without checking it
+            TCPSegment parsed;
+            const string unfinished = seg.serialize_partial_checksum(ip.pseudo_cksum()).concatenate();
+            test_should_be(parsed.parse(string(unfinished), ip.pseudo_cksum()) == ParseResult::BadChecksum, true);
+            test_should_be(parsed.parse(string(unfinished), ip.pseudo_cksum(), false) == ParseResult::NoError, true);
+            test_should_be(parsed.payload().size(), size_t(3001));
+        }
+
+        // with a larger max_payload_size, a window's worth of data goes in one segment
+        {
+            TCPConfig big;
+            big.max_payload_size = 65535 - 40;
+            TCPConfig normal;
+            normal.recv_capacity = 60000;
+
+            TCPConnection sender{big}, receiver{normal};
+            connect(sender, receiver);
+            test_should_be(sender.write(string(60000, 'y')), size_t(60000));
+            test_should_be(deliver(sender, receiver) == vector<size_t>{60000}, true);
+            test_should_be(receiver.inbound_stream().read(60000).size(), size_t(60000));
+            finish(sender, receiver);
+
+            // the default cuts the same data into MAX_PAYLOAD_SIZE pieces
+            TCPConnection small_sender{TCPConfig{}}, small_receiver{normal};
+            connect(small_sender, small_receiver);
+            small_sender.write(string(60000, 'y'));
+            test_should_be(deliver(small_sender, small_receiver).size(), size_t(60));
+            finish(small_sender, small_receiver);
+        }
+
+        // a max_payload_size beyond what fits in a datagram is limited by the window instead
+        {
+            TCPConfig huge;
+            huge.max_payload_size = 100000;
+            TCPConfig normal;
+            normal.recv_capacity = 60000;
+
+            TCPConnection sender{huge}, receiver{normal};
+            connect(sender, receiver);
+            test_should_be(sender.write(string(60000, 'z')), size_t(60000));
+            test_should_be(deliver(sender, receiver) == vector<size_t>{60000}, true);
+            finish(sender, receiver);
+        }
+
+        // through a TUN device with `vnet_hdr`, a transfer to and from the host's own TCP stack goes both ways
+        // in segments larger than the MTU, with checksums left to the kernel
+        {
+            const string devname = "sponge-vnet";
+            optional<TunFD> tun;
+            try {
+                tun.emplace(devname, false, true);
+            } catch (const unix_error &e) {
+                if (e.code().value() != EPERM and e.code().value() != ENOENT) {
+                    throw;
+                }
+                cerr << "skipped: creating a TUN device needs /dev/net/tun and CAP_NET_ADMIN\n";
+            }
+
+            if (tun.has_value()) {
+                test_should_be(tun->vnet_hdr(), true);
+                configure(devname, "172.31.244.1");
+
+                TCPSocket listener;
+                listener.bind(Address{"172.31.244.1", 0});
+                listener.listen();
+
+                string upload(1 << 20, 0), download(1 << 20, 0);
+                for (size_t i = 0; i < upload.size(); i++) {
+                    upload[i] = char(i % 251);
+                    download[i] = char(i % 241);
+                }
+
+                // the host echoes nothing back until it has the whole upload
+                string uploaded;
+                thread host([&] {
+                    TCPSocket peer = listener.accept();
+                    while (not peer.eof()) {
+                        uploaded.append(peer.read());
+                    }
+                    peer.write(download);
+                    peer.shutdown(SHUT_WR);
+                });
+
+                TCPConfig config;
+                config.rt_timeout = 100;  // so that closing doesn't linger long
+                config.max_payload_size = TCPOverIPv4OverTunFdAdapter::MAX_OFFLOAD_PAYLOAD_SIZE;
+                FdAdapterConfig adapter_config;
+                adapter_config.source = Address{"172.31.244.2", 4321};
+                adapter_config.destination = listener.local_address();
+                TCPOverIPv4SpongeSocket sock{TCPOverIPv4OverTunFdAdapter{move(tun.value())}};
+                sock.connect(config, adapter_config);
+                sock.write(upload);
+                sock.shutdown(SHUT_WR);
+                string downloaded;
+                while (not sock.eof()) {
+                    downloaded.append(sock.read());
+                }
+                sock.wait_until_closed();
+                host.join();
+
+                test_should_be(uploaded == upload, true);
+                test_should_be(downloaded == download, true);
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
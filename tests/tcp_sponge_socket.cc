@@ -0,0 +1,100 @@
+#include "socket.hh"
+#include "tcp_config.hh"
+#include "tcp_sponge_socket.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+using Transport = TCPOverUDPSpongeSocket::Transport;
+
+//! Whether `f` throws a runtime_error
+template <typename F>
+static bool throws(const F &f) {
+    try {
+        f();
+    } catch (const runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+int main() {
+    try {
+        TCPConfig config;
+        config.rt_timeout = 100;  // so that closing doesn't linger long
+
+        // two connections run inline, on their owners' threads, over UDP on the loopback interface
+        {
+            UDPSocket server_udp;
+            server_udp.bind(Address{"127.0.0.1", 0});
+            FdAdapterConfig server_config;
+            server_config.source = server_udp.local_address();
+            TCPOverUDPSpongeSocket server{
+                TCPOverUDPSocketAdapter{move(server_udp)}, EventLoop::Backend::Poll, Transport::Inline};
+
+            // more than fits in the window, so that write_inline() has to run the connection to finish
+            string upload(config.send_capacity * 4, 0);
+            for (size_t i = 0; i < upload.size(); i++) {
+                upload[i] = char(i % 251);
+            }
+
+            string received;
+            thread server_thread([&] {
+                server.listen_and_accept(config, server_config);
+                ByteStream &inbound = server.inbound_stream();
+                server.run_until([&] {
+                    received.append(inbound.read(inbound.buffer_size()));
+                    return inbound.eof();
+                });
+                server.write_inline("got " + to_string(received.size()));
+                server.wait_until_closed();
+            });
+
+            FdAdapterConfig client_config;
+            client_config.destination = server_config.source;
+            TCPOverUDPSpongeSocket client{
+                TCPOverUDPSocketAdapter{UDPSocket{}}, EventLoop::Backend::Poll, Transport::Inline};
+            client.connect(config, client_config);
+
+            // the socket itself carries nothing with Transport::Inline
+            test_should_be(throws([&] { client.read(); }), true);
+            test_should_be(throws([&] { client.eof(); }), true);
+
+            test_should_be(client.write_inline(upload), upload.size());
+            client.end_input_stream();
+
+            ByteStream &inbound = client.inbound_stream();
+            while (not inbound.eof() and client.poll_once(-1)) {
+            }
+            test_should_be(inbound.read(inbound.buffer_size()) == "got " + to_string(upload.size()), true);
+
+            client.wait_until_closed();
+            server_thread.join();
+            test_should_be(received == upload, true);
+        }
+
+        // the inline methods need Transport::Inline, and a connection
+        {
+            TCPOverUDPSpongeSocket unconnected{
+                TCPOverUDPSocketAdapter{UDPSocket{}}, EventLoop::Backend::Poll, Transport::Inline};
+            test_should_be(throws([&] { unconnected.poll_once(); }), true);
+
+            TCPOverUDPSpongeSocket threaded{TCPOverUDPSocketAdapter{UDPSocket{}}};
+            test_should_be(throws([&] { threaded.write_inline("x"); }), true);
+            test_should_be(throws([&] { threaded.inbound_stream(); }), true);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
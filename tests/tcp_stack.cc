@@ -0,0 +1,267 @@
+#include "tcp_stack.hh"
+#include "test_should_be.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using ConnectionId = TCPStack::ConnectionId;
+
+//! An IPv4 datagram carrying `seg` from `src` to `dst`, as parsed off the wire
+static InternetDatagram wire(const uint32_t src, const uint32_t dst, const TCPSegment &seg) {
+    InternetDatagram dgram;
+    dgram.header().src = src;
+    dgram.header().dst = dst;
+    dgram.header().len = dgram.header().hlen * 4 + seg.header().doff * 4 + seg.payload().size();
+    dgram.payload() = seg.serialize(dgram.header().pseudo_cksum());
+
+    InternetDatagram parsed;
+    test_should_be(parsed.parse(Buffer{dgram.serialize().concatenate()}) == ParseResult::NoError, true);
+    return parsed;
+}
+
+//! Serialize and parse each datagram that `from` has queued, as the wire would, and give it to `to`
+static void deliver(TCPStack &from, TCPStack &to) {
+    for (; not from.datagrams_out().empty(); from.datagrams_out().pop()) {
+        InternetDatagram dgram;
+        test_should_be(dgram.parse(Buffer{from.datagrams_out().front().serialize().concatenate()}) ==
+                           ParseResult::NoError,
+                       true);
+        to.datagram_received(dgram);
+    }
+}
+
+//! Carry datagrams between two stacks until neither has anything more to send
+static void exchange(TCPStack &a, TCPStack &b) {
+    while (not a.datagrams_out().empty() or not b.datagrams_out().empty()) {
+        deliver(a, b);
+        deliver(b, a);
+    }
+}
+
+//! Pass time in both stacks until neither has a timer running
+static void run_timers(TCPStack &a, TCPStack &b) {
+    while (a.time_until_next_deadline().has_value() or b.time_until_next_deadline().has_value()) {
+        const size_t ms = min(a.time_until_next_deadline().value_or(SIZE_MAX),
+                              b.time_until_next_deadline().value_or(SIZE_MAX));
+        a.tick(ms);
+        b.tick(ms);
+        exchange(a, b);
+    }
+}
+
+int main() {
+    try {
+        TCPConfig cfg;
+        cfg.send_capacity = cfg.recv_capacity = 1024;
+        const string server_ip = "10.0.0.1";
+        const string client_ip = "10.0.0.2";
+        const Address server_address{server_ip, 80};
+
+        // many simultaneous connections between two stacks
+        {
+            constexpr size_t N = 10000;
+            TCPStack server{4 * N}, client{4 * N};
+            server.listen(80, cfg, N);
+
+            vector<ConnectionId> clients;
+            for (size_t i = 0; i < N; i++) {
+                clients.push_back(client.connect(cfg, Address{client_ip, uint16_t(10000 + i)}, server_address));
+            }
+            test_should_be(client.datagrams_out().size(), N);
+            exchange(client, server);
+            test_should_be(server.size(), N);
+
+            vector<ConnectionId> accepted;
+            while (const auto id = server.accept(80)) {
+                accepted.push_back(id.value());
+            }
+            test_should_be(accepted.size(), N);
+
+            for (size_t i = 0; i < N; i++) {
+                test_should_be(client.write(clients.at(i), "request " + to_string(i)), 8 + to_string(i).size());
+            }
+            exchange(client, server);
+
+            // the server echoes each request and closes
+            for (const ConnectionId id : accepted) {
+                ByteStream &in = server.inbound_stream(id);
+                server.write(id, in.read(in.buffer_size()));
+                server.close(id);
+            }
+            exchange(client, server);
+
+            for (size_t i = 0; i < N; i++) {
+                ByteStream &in = client.inbound_stream(clients.at(i));
+                test_should_be(in.read(in.buffer_size()) == "request " + to_string(i), true);
+                test_should_be(in.eof(), true);
+                client.close(clients.at(i));
+            }
+            exchange(client, server);
+
+            // the clients are done at once; the server lingers in TIME_WAIT
+            test_should_be(server.size(), N);
+            run_timers(client, server);
+            test_should_be(client.size(), size_t(0));
+            test_should_be(server.size(), size_t(0));
+        }
+
+        // the backlog limits connections that haven't been accepted; the ACKs that would complete
+        // any more are dropped, and the SYN-ACK is retransmitted until there is room
+        {
+            TCPStack server, client;
+            server.listen(80, cfg, 2);
+            for (uint16_t port = 1; port <= 3; port++) {
+                client.connect(cfg, Address{client_ip, port}, server_address);
+            }
+            exchange(client, server);
+            test_should_be(server.size(), size_t(2));
+            test_should_be(server.half_open(), size_t(1));
+
+            const auto first = server.accept(80);
+            test_should_be(first.has_value(), true);
+            server.tick(cfg.rt_timeout);
+            exchange(client, server);
+            test_should_be(server.size(), size_t(3));
+            test_should_be(server.half_open(), size_t(0));
+            test_should_be(server.accept(80).has_value(), true);
+            test_should_be(server.accept(80).has_value(), true);
+            test_should_be(server.accept(80).has_value(), false);
+        }
+
+        // a half-open connection whose SYN-ACK is never acknowledged is given up on
+        {
+            TCPStack server, client;
+            server.listen(80, cfg, 1);
+            client.connect(cfg, Address{client_ip, 1}, server_address);
+            deliver(client, server);
+            test_should_be(server.half_open(), size_t(1));
+            size_t syn_acks = 0;
+            while (server.time_until_next_deadline().has_value()) {
+                syn_acks += server.datagrams_out().size();
+                while (not server.datagrams_out().empty()) {
+                    server.datagrams_out().pop();
+                }
+                server.tick(server.time_until_next_deadline().value());
+            }
+            test_should_be(syn_acks, size_t(1 + TCPConfig::MAX_RETX_ATTEMPTS));
+            test_should_be(server.half_open(), size_t(0));
+        }
+
+        // with no room for half-open connections, handshakes use SYN cookies
+        {
+            TCPStack server, client;
+            server.listen(80, cfg, 10, 0);
+            const ConnectionId c = client.connect(cfg, Address{client_ip, 1}, server_address);
+            exchange(client, server);
+            test_should_be(server.syn_cookies_sent(), uint64_t(1));
+            test_should_be(server.half_open(), size_t(0));
+            const ConnectionId s = server.accept(80).value();
+            client.write(c, "cookie");
+            exchange(client, server);
+            test_should_be(server.inbound_stream(s).read(6) == "cookie", true);
+
+            // an ACK that doesn't carry a valid cookie starts nothing
+            client.connect(cfg, Address{client_ip, 2}, server_address);
+            deliver(client, server);
+            for (; not server.datagrams_out().empty(); server.datagrams_out().pop()) {
+                TCPSegment seg;
+                const InternetDatagram &syn_ack = server.datagrams_out().front();
+                test_should_be(seg.parse(syn_ack.payload().concatenate(), syn_ack.header().pseudo_cksum()) ==
+                                   ParseResult::NoError,
+                               true);
+                TCPSegment ack;
+                ack.header().sport = seg.header().dport;
+                ack.header().dport = seg.header().sport;
+                ack.header().ack = true;
+                ack.header().seqno = seg.header().ackno;
+                ack.header().ackno = seg.header().seqno + 2;
+                const InternetDatagram forged = wire(syn_ack.header().dst, syn_ack.header().src, ack);
+                test_should_be(server.datagram_received(forged).has_value(), false);
+            }
+            test_should_be(server.size(), size_t(1));
+
+            // nor does a valid cookie once it has expired
+            client.tick(cfg.rt_timeout);
+            deliver(client, server);
+            deliver(server, client);
+            server.tick(2 * TCPStack::SYN_COOKIE_PERIOD_MS);
+            deliver(client, server);
+            test_should_be(server.size(), size_t(1));
+            test_should_be(server.accept(80).has_value(), false);
+        }
+
+        // datagrams that don't fit in datagrams_out() are dropped, and counted
+        {
+            TCPStack server{2};
+            server.listen(80, cfg, 10);
+            for (uint16_t port = 1; port <= 5; port++) {
+                TCPSegment syn;
+                syn.header().sport = port;
+                syn.header().dport = 80;
+                syn.header().syn = true;
+                server.datagram_received(
+                    wire(Address{client_ip}.ipv4_numeric(), Address{server_ip}.ipv4_numeric(), syn));
+            }
+            test_should_be(server.datagrams_out().size(), size_t(2));
+            test_should_be(server.datagrams_dropped(), uint64_t(3));
+        }
+
+        // a burst of SYNs keeps at most syn_backlog half-open connections, and nothing at all with SYN cookies
+        // (bench_tcp_stack reports the bytes this takes, next to a TCPConnection's)
+        {
+            constexpr size_t N = 1000;
+            for (const size_t syn_backlog : {size_t(100), size_t(0)}) {
+                TCPStack server;
+                server.listen(80, cfg, N, syn_backlog);
+                for (uint16_t port = 1; port <= N; port++) {
+                    TCPSegment syn;
+                    syn.header().sport = port;
+                    syn.header().dport = 80;
+                    syn.header().syn = true;
+                    server.datagram_received(
+                        wire(Address{client_ip}.ipv4_numeric(), Address{server_ip}.ipv4_numeric(), syn));
+                }
+                test_should_be(server.half_open(), syn_backlog);
+                test_should_be(server.size(), size_t(0));
+                test_should_be(server.syn_cookies_sent(), uint64_t(N - syn_backlog));
+                test_should_be(server.datagrams_out().size(), N);
+            }
+        }
+
+        // segments that belong to no connection or listener are dropped
+        {
+            TCPStack server, client;
+            client.connect(cfg, Address{client_ip, 5}, server_address);
+            exchange(client, server);
+            test_should_be(server.size(), size_t(0));
+
+            server.listen(80, cfg, 1);
+            client.tick(cfg.rt_timeout);
+            exchange(client, server);
+            test_should_be(server.size(), size_t(1));
+            const ConnectionId id = server.accept(80).value();
+            test_should_be(server.connection(id).state() == TCPState::State::ESTABLISHED, true);
+
+            // connect() refuses a four-tuple that is in use
+            bool threw = false;
+            try {
+                client.connect(cfg, Address{client_ip, 5}, server_address);
+            } catch (const runtime_error &) {
+                threw = true;
+            }
+            test_should_be(threw, true);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,308 @@
+#include "tcp_connection.hh"
+#include "tcp_timers.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+using Kind = TCPTimers::Kind;
+
+//! Deliver every segment that `from` has queued to `to`, returning how many there were
+static size_t deliver(TCPConnection &from, TCPConnection &to) {
+    size_t count = 0;
+    for (; not from.segments_out().empty(); from.segments_out().pop(), count++) {
+        to.segment_received(from.segments_out().front());
+    }
+    return count;
+}
+
+//! Discard every segment that `conn` has queued, returning the last one
+static TCPSegment drain(TCPConnection &conn) {
+    TCPSegment last;
+    for (; not conn.segments_out().empty(); conn.segments_out().pop()) {
+        last = conn.segments_out().front();
+    }
+    return last;
+}
+
+static void handshake(TCPConnection &client, TCPConnection &server) {
+    client.connect();
+    deliver(client, server);
+    deliver(server, client);
+    deliver(client, server);
+    test_should_be(client.state() == TCPState::State::ESTABLISHED, true);
+    test_should_be(server.state() == TCPState::State::ESTABLISHED, true);
+}
+
+int main() {
+    try {
+        // advance() fires only the timers that expire, with their owner and kind
+        {
+            TCPTimers timers;
+            TCPTimers::Timer a{timers, 1, Kind::Retransmission};
+            TCPTimers::Timer b{timers, 2, Kind::Linger};
+            TCPTimers::Timer c{timers, 3, Kind::Keepalive};
+            a.start(100);
+            b.start(50);
+            c.start(1000);
+            test_should_be(timers.size(), size_t(3));
+            test_should_be(timers.time_until_next_expiry().value(), uint64_t(50));
+            test_should_be(a.time_remaining(), uint64_t(100));
+
+            vector<pair<uint64_t, Kind>> fired;
+            const auto record = [&](uint64_t owner, Kind kind) { fired.emplace_back(owner, kind); };
+            timers.advance(49, record);
+            test_should_be(fired.size(), size_t(0));
+            timers.advance(51, record);
+            test_should_be(fired.size(), size_t(2));
+            test_should_be(fired.at(0).first, uint64_t(2));
+            test_should_be(fired.at(1).first, uint64_t(1));
+            test_should_be(fired.at(1).second == Kind::Retransmission, true);
+            test_should_be(a.running(), false);
+            test_should_be(c.running(), true);
+            test_should_be(c.time_remaining(), uint64_t(900));
+
+            // stopping and restarting
+            c.stop();
+            test_should_be(timers.time_until_next_expiry().has_value(), false);
+            c.start(10);
+            c.start(20);
+            timers.advance(10, record);
+            test_should_be(fired.size(), size_t(2));
+            timers.advance(10, record);
+            test_should_be(fired.size(), size_t(3));
+            test_should_be(timers.size(), size_t(0));
+            test_should_be(timers.now(), uint64_t(120));
+        }
+
+        // a timer restarted by its callback counts from the end of the advance, and a Timer's
+        // schedule moves with it and ends with it
+        {
+            TCPTimers timers;
+            TCPTimers::Timer t{timers, 7, Kind::DelayedAck};
+            t.start(10);
+            size_t fired = 0;
+            timers.advance(1000, [&](uint64_t, Kind) {
+                fired++;
+                t.start(10);
+            });
+            test_should_be(fired, size_t(1));
+            test_should_be(t.time_remaining(), uint64_t(10));
+
+            TCPTimers::Timer moved{std::move(t)};
+            test_should_be(moved.running(), true);
+            {
+                const TCPTimers::Timer gone{std::move(moved)};
+                test_should_be(timers.size(), size_t(1));
+            }
+            test_should_be(timers.size(), size_t(0));
+        }
+
+        // a timer started with a delay of 0 fires at the next advance, even one that passes no time; one that
+        // its callback starts that way waits for the advance after
+        {
+            TCPTimers timers;
+            TCPTimers::Timer t{timers, 1, Kind::Linger};
+            t.start(0);
+            test_should_be(t.time_remaining(), uint64_t(0));
+            test_should_be(timers.time_until_next_expiry().value(), uint64_t(0));
+            size_t fired = 0;
+            const auto restart = [&](uint64_t, Kind) {
+                fired++;
+                t.start(0);
+            };
+            timers.advance(0, restart);
+            test_should_be(fired, size_t(1));
+            test_should_be(t.running(), true);
+            timers.advance(0, restart);
+            test_should_be(fired, size_t(2));
+            t.stop();
+            timers.advance(0, restart);
+            test_should_be(fired, size_t(2));
+        }
+
+        // the side that closes passively stops lingering at the next tick, even tick(0)
+        {
+            TCPConfig cfg;
+            TCPConnection client{cfg}, server{cfg};
+            handshake(client, server);
+            client.end_input_stream();
+            deliver(client, server);
+            deliver(server, client);
+            server.end_input_stream();
+            deliver(server, client);
+            deliver(client, server);
+            test_should_be(server.active(), true);
+            server.tick(0);
+            test_should_be(server.active(), false);
+            test_should_be(client.active(), true);
+        }
+
+        // a connection assigned over another takes its timers with it, and the old one's timers end
+        {
+            TCPConfig cfg;
+            TCPTimers timers;
+            TCPConnection a{cfg, timers, 0}, b{cfg, timers, 1};
+            a.connect();
+            b.connect();
+            drain(a);
+            drain(b);
+            test_should_be(timers.size(), size_t(2));
+            b = std::move(a);
+            test_should_be(timers.size(), size_t(1));
+            size_t visited = 0;
+            timers.advance(cfg.rt_timeout, [&](uint64_t owner, Kind kind) {
+                visited++;
+                test_should_be(owner, uint64_t(0));
+                b.timer_expired(kind);
+            });
+            test_should_be(visited, size_t(1));
+            test_should_be(drain(b).header().syn, true);
+
+            TCPConnection c{cfg}, d{cfg};
+            c.connect();
+            drain(c);
+            d = std::move(c);
+            d.tick(cfg.rt_timeout);
+            test_should_be(drain(d).header().syn, true);
+        }
+
+        // many connections share one TCPTimers; only those whose timers expire are visited
+        {
+            TCPConfig cfg;
+            TCPTimers timers;
+            vector<TCPConnection> conns;
+            constexpr size_t N = 1000;
+            conns.reserve(N);
+            for (size_t i = 0; i < N; i++) {
+                conns.emplace_back(cfg, timers, i);
+                conns.back().connect();
+                drain(conns.back());
+            }
+            test_should_be(timers.size(), N);
+            test_should_be(conns.at(0).time_until_next_deadline().value(), size_t(cfg.rt_timeout));
+
+            // tick() of a connection on shared timers does nothing
+            conns.at(0).tick(10 * cfg.rt_timeout);
+            test_should_be(conns.at(0).segments_out().size(), size_t(0));
+
+            size_t visited = 0;
+            const auto expire = [&](uint64_t owner, Kind kind) {
+                visited++;
+                conns.at(owner).timer_expired(kind);
+            };
+            timers.advance(cfg.rt_timeout - 1, expire);
+            test_should_be(visited, size_t(0));
+            timers.advance(1, expire);
+            test_should_be(visited, N);
+            for (auto &conn : conns) {
+                test_should_be(drain(conn).header().syn, true);
+            }
+            test_should_be(conns.at(N - 1).time_until_next_deadline().value(), size_t(2 * cfg.rt_timeout));
+
+            conns.pop_back();
+            test_should_be(timers.size(), N - 1);
+            visited = 0;
+            timers.advance(2 * cfg.rt_timeout, expire);
+            test_should_be(visited, N - 1);
+
+            // the connections give up once they have retransmitted too often
+            while (timers.time_until_next_expiry().has_value()) {
+                timers.advance(timers.time_until_next_expiry().value(), expire);
+            }
+            for (auto &conn : conns) {
+                test_should_be(conn.active(), false);
+                test_should_be(drain(conn).header().rst, true);
+            }
+        }
+
+        // delayed acknowledgments: the first segment of in-order data waits, the second is acked at once
+        {
+            TCPConfig cfg;
+            cfg.delayed_ack_ms = 40;
+            TCPConnection client{TCPConfig{}}, server{cfg};
+            handshake(client, server);
+
+            client.write("hello");
+            test_should_be(deliver(client, server), size_t(1));
+            test_should_be(server.segments_out().size(), size_t(0));
+            test_should_be(server.time_until_next_deadline().value(), size_t(40));
+            server.tick(39);
+            test_should_be(server.segments_out().size(), size_t(0));
+            server.tick(1);
+            test_should_be(server.segments_out().size(), size_t(1));
+            test_should_be(deliver(server, client), size_t(1));
+            test_should_be(client.bytes_in_flight(), size_t(0));
+
+            client.write("a");
+            client.write("b");
+            test_should_be(deliver(client, server), size_t(2));
+            test_should_be(server.segments_out().size(), size_t(1));
+            deliver(server, client);
+            test_should_be(client.bytes_in_flight(), size_t(0));
+            test_should_be(server.time_until_next_deadline().has_value(), false);
+
+            // data sent by the server carries the pending ACK
+            client.write("c");
+            deliver(client, server);
+            test_should_be(server.segments_out().size(), size_t(0));
+            server.write("reply");
+            test_should_be(server.segments_out().size(), size_t(1));
+            test_should_be(server.time_until_next_deadline().value(), size_t(cfg.rt_timeout));
+            deliver(server, client);
+            test_should_be(client.bytes_in_flight(), size_t(0));
+            test_should_be(client.inbound_stream().read(5) == "reply", true);
+        }
+
+        // keepalives: an idle connection is probed, and given up on if the probes go unanswered
+        {
+            TCPConfig cfg;
+            cfg.keepalive_ms = 5000;
+            TCPConnection client{cfg}, server{TCPConfig{}};
+            handshake(client, server);
+            deliver(server, client);
+
+            client.tick(4999);
+            test_should_be(client.segments_out().size(), size_t(0));
+            client.tick(1);
+            test_should_be(client.segments_out().size(), size_t(1));
+            const TCPSegment probe = client.segments_out().front();
+            test_should_be(probe.payload().size(), size_t(0));
+
+            // the peer acknowledges the probe, which resets the idle time
+            test_should_be(deliver(client, server), size_t(1));
+            test_should_be(deliver(server, client), size_t(1));
+            test_should_be(client.time_until_next_deadline().value(), size_t(cfg.keepalive_ms));
+
+            // the probe repeated the last byte the peer had acknowledged
+            client.write("x");
+            test_should_be(client.segments_out().front().header().seqno, probe.header().seqno + 1);
+            deliver(client, server);
+            deliver(server, client);
+            test_should_be(client.bytes_in_flight(), size_t(0));
+
+            // now the peer goes silent
+            client.tick(cfg.keepalive_ms);
+            for (unsigned i = 1; i < TCPConfig::MAX_KEEPALIVE_PROBES; i++) {
+                test_should_be(drain(client).header().rst, false);
+                client.tick(cfg.rt_timeout);
+            }
+            test_should_be(client.active(), true);
+            drain(client);
+            client.tick(cfg.rt_timeout);
+            test_should_be(drain(client).header().rst, true);
+            test_should_be(client.active(), false);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+#include "test_should_be.hh"
+#include "timer_wheel.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // timers fire at their expiry, not before
+        {
+            TimerWheel<int> wheel;
+            wheel.schedule(5, 1);
+            wheel.schedule(64, 2);
+            wheel.schedule(5000, 3);
+            test_should_be(wheel.next_expiry().value(), uint64_t(5));
+
+            vector<int> fired;
+            const auto record = [&](int v) { fired.push_back(v); };
+            wheel.advance(4, record);
+            test_should_be(fired.size(), size_t(0));
+            wheel.advance(5, record);
+            test_should_be(fired.size(), size_t(1));
+            wheel.advance(4999, record);
+            test_should_be(fired.size(), size_t(2));
+            test_should_be(fired.at(1), 2);
+            test_should_be(wheel.next_expiry().value(), uint64_t(5000));
+            wheel.advance(100000, record);
+            test_should_be(fired.size(), size_t(3));
+            test_should_be(wheel.empty(), true);
+            test_should_be(wheel.now(), uint64_t(100000));
+        }
+
+        // cancelled timers don't fire, and stale handles are rejected
+        {
+            TimerWheel<int> wheel;
+            const auto a = wheel.schedule(100, 1);
+            const auto b = wheel.schedule(100, 2);
+            test_should_be(wheel.cancel(a), true);
+            test_should_be(wheel.cancel(a), false);
+            test_should_be(wheel.pending(b), true);
+            int fired = 0;
+            wheel.advance(100, [&](int v) { fired = v; });
+            test_should_be(fired, 2);
+            test_should_be(wheel.pending(b), false);
+            test_should_be(wheel.cancel(b), false);
+            test_should_be(wheel.cancel(TimerWheel<int>::NO_TIMER), false);
+        }
+
+        // callbacks may schedule more timers, including ones that are already due
+        {
+            TimerWheel<int> wheel;
+            wheel.schedule(10, 0);
+            vector<uint64_t> fire_times;
+            wheel.advance(1000, [&](int v) {
+                fire_times.push_back(wheel.now());
+                if (v < 3) {
+                    wheel.schedule(wheel.now() + 100 * v, v + 1);
+                }
+            });
+            test_should_be(fire_times.size(), size_t(4));
+            test_should_be(fire_times.at(1), uint64_t(11));
+            test_should_be(fire_times.at(3), uint64_t(311));
+        }
+
+        // timers beyond the range of the wheels
+        {
+            TimerWheel<int> wheel{12345};
+            const uint64_t far = 12345 + 20000000000ull;
+            wheel.schedule(far, 7);
+            wheel.schedule(far + 1, 8);
+            int fired = 0;
+            wheel.advance(far - 1, [&](int) { fired++; });
+            test_should_be(fired, 0);
+            wheel.advance(far, [&](int) { fired++; });
+            test_should_be(fired, 1);
+            wheel.advance(far + 1, [&](int) { fired++; });
+            test_should_be(fired, 2);
+        }
+
+        // compare against a simple model under random scheduling, cancelling and advancing
+        for (unsigned round = 0; round < 20; round++) {
+            TimerWheel<uint64_t> wheel;
+            multimap<uint64_t, uint64_t> model;  // expiry -> serial
+            map<uint64_t, TimerWheel<uint64_t>::TimerId> ids;
+            uint64_t now = 0, serial = 0;
+
+            for (unsigned step = 0; step < 2000; step++) {
+                switch (rd() % 4) {
+                    case 0:
+                    case 1: {
+                        const unsigned magnitude = rd() % 5;
+                        uint64_t delay = 1 + rd() % 64;
+                        for (unsigned i = 0; i < magnitude; i++) {
+                            delay = delay * 64 + rd() % 64;
+                        }
+                        ids[serial] = wheel.schedule(now + delay, serial);
+                        model.emplace(now + delay, serial);
+                        serial++;
+                    } break;
+                    case 2:
+                        if (not model.empty()) {
+                            auto it = model.begin();
+                            advance(it, rd() % model.size());
+                            test_should_be(wheel.cancel(ids.at(it->second)), true);
+                            ids.erase(it->second);
+                            model.erase(it);
+                        }
+                        break;
+                    case 3: {
+                        now += rd() % (rd() % 2 ? 100 : 100000);
+                        wheel.advance(now, [&](uint64_t s) {
+                            auto it = model.begin();
+                            test_should_be(it == model.end(), false);
+                            test_should_be(it->first, wheel.now());
+                            if (it->second != s) {
+                                // several timers may share an expiry
+                                auto range = model.equal_range(it->first);
+                                for (it = range.first; it != range.second and it->second != s; ++it) {
+                                }
+                                test_should_be(it == range.second, false);
+                            }
+                            ids.erase(s);
+                            model.erase(it);
+                        });
+                        test_should_be(model.empty() or model.begin()->first > now, true);
+                    } break;
+                }
+                test_should_be(wheel.size(), model.size());
+                if (not model.empty()) {
+                    test_should_be(wheel.next_expiry().value(), model.begin()->first);
+                }
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
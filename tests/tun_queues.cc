@@ -0,0 +1,53 @@
+#include "test_should_be.hh"
+#include "tun.hh"
+#include "util.hh"
+
+#include <cerrno>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+
+using namespace std;
+
+//! A device that no one has made persistent, so that it goes away when the test's queues are closed
+static const string DEVNAME = "sponge-test";
+
+int main() {
+    try {
+        // without a persistent device of this name, opening one creates it, which needs CAP_NET_ADMIN
+        optional<TunTapQueues> queues;
+        try {
+            queues.emplace(DEVNAME, true, 2);
+        } catch (const unix_error &e) {
+            if (e.code().value() == EPERM or e.code().value() == ENOENT) {
+                cerr << "skipped: creating a TUN device needs /dev/net/tun and CAP_NET_ADMIN\n";
+                return EXIT_SUCCESS;
+            }
+            throw;
+        }
+
+        // queues handed out stay valid as more are opened
+        TunTapFD &first = queues->queue(0);
+        const int first_fd = first.fd_num();
+        for (size_t i = 2; i < 10; i++) {
+            test_should_be(queues->add(), i);
+        }
+        test_should_be(queues->size(), size_t(10));
+        test_should_be(&first == &queues->queue(0), true);
+        test_should_be(first.fd_num(), first_fd);
+
+        // queues can be detached and reattached, as long as one stays attached
+        queues->detach(1);
+        test_should_be(queues->attached(1), false);
+        test_should_be(queues->attached(0), true);
+        queues->detach(1);  // already detached
+        queues->attach(1);
+        test_should_be(queues->attached(1), true);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}